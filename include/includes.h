@@ -143,6 +143,7 @@
 #endif
 
 #include <radcli/radcli.h>
+#include <pthread.h>
 
 #define GETSTR_LENGTH		128	//!< must be bigger than AUTH_PASS_LEN.
 
@@ -167,20 +168,51 @@ AUTH_HDR;
 typedef struct rc_sockets_override {
 	void *ptr;
 	const char *static_secret;
-	int (*get_fd)(void *ptr, struct sockaddr* our_sockaddr);
-	/* get_active_fd: return the fd of an already-established connection
-	 * without allocating a new socket. Only set by transports that
-	 * maintain a persistent connection (TLS/DTLS). */
-	int (*get_active_fd)(void *ptr);
-	void (*close_fd)(int fd);
+	/* get_fd: @peer is the server the socket will be used with;
+	 * transports keeping connections per server (TCP) key on it. */
+	int (*get_fd)(void *ptr, struct sockaddr* our_sockaddr,
+		      const struct sockaddr *peer);
+	/* close_fd: release a descriptor returned by get_fd; transports
+	 * keeping persistent connections (TCP, TLS/DTLS) keep it open. */
+	void (*close_fd)(void *ptr, int fd);
+	/* get_id: optional; the Identifier the request on @fd must use,
+	 * for transports multiplexing requests on one connection. */
+	int (*get_id)(void *ptr, int fd);
+	/* wait: optional; replaces poll() while waiting for the reply on
+	 * @fd. Returns 1 when recvfrom has a result, 0 after @timeout ms,
+	 * or -1 on error. */
+	int (*wait)(void *ptr, int fd, int timeout);
 	ssize_t (*sendto)(void *ptr, int sockfd, const void *buf, size_t len, int flags,
 	                  const struct sockaddr *dest_addr, socklen_t addrlen);
 	ssize_t (*recvfrom)(void *ptr, int sockfd, void *buf, size_t len, int flags,
 	                    struct sockaddr *src_addr, socklen_t *addrlen);
-	int (*lock)(void *ptr);
-	int (*unlock)(void *ptr);
 } rc_sockets_override;
 
+/* Load balancing policies of a server list, see rc_server_next() */
+enum {
+	RC_BALANCE_FAILOVER = 0,	/* the first server that is up */
+	RC_BALANCE_ROUND_ROBIN,
+	RC_BALANCE_WEIGHTED,		/* smooth weighted round-robin */
+	RC_BALANCE_LEAST_OUTSTANDING
+};
+
+/* Load balancing state of the authserver or acctserver list */
+struct rc_balance {
+	int		policy;
+	unsigned	next;		/* where round-robin continues */
+	int		weight[RC_SERVER_MAX];
+	int		credit[RC_SERVER_MAX]; /* of the weighted policy */
+	unsigned	outstanding[RC_SERVER_MAX]; /* requests awaiting a reply */
+};
+
+/* The servers a request was sent to, see rc_server_next() */
+struct rc_server_iter {
+	unsigned	tried;		/* bit mask of server indexes */
+	int		start;		/* the server the policy chose, or -1 */
+	int		current;	/* the server counted as outstanding, or -1 */
+};
+#define RC_SERVER_ITER_INIT { 0, -1, -1 }
+
 struct rc_conf
 {
 	struct _option		*config_options;
@@ -197,9 +229,22 @@ struct rc_conf
 	struct dict_attr	*dictionary_attributes;
 	struct dict_value	*dictionary_values;
 	struct dict_vendor	*dictionary_vendors;
+	struct rc_dict_index	*dict_index; /* hash tables over the three lists, see dict.c */
+	unsigned		dict_rfc; /* the built-in dictionary is attached */
+	struct rc_dict		*dict; /* shared or cached dictionary, see dictcache.c */
+	struct rc_dict_lazy	*dict_lazy; /* vendor blocks not read yet, see dict.c */
 
 	rc_sockets_override	so;
 	unsigned		so_type; /* rc_socket_type */
+
+	struct rc_sockpool	*sockpool; /* UDP sockets and TCP connections reused across requests */
+	struct rc_async		*async; /* rc_aaa_submit() state, created on first use */
+	struct rc_resolver	*resolver; /* addresses of server names, see resolve.c */
+	struct rc_servers	*servers; /* the servers file, indexed by address */
+	struct rc_rtt		*rtt; /* round-trip times of servers, see rtt.c */
+	struct rc_srcaddr	*srcaddr; /* local address per server, see srcaddr.c */
+	struct rc_balance	balance[2]; /* of the authserver and acctserver lists */
+	pthread_mutex_t		lock; /* protects SERVER deadtime_ends[] and balance */
 };
 
 /* older compilers don't like seeing this typedef along with the one in radcli.h */
@@ -210,6 +255,36 @@ struct rc_aaa_ctx_st
 };
 
 int rc_send_server_ctx (rc_handle *rh, RC_AAA_CTX **ctx, SEND_DATA *data,
-                        char *msg, rc_type type, int no_wait);
+                        char *msg, rc_type type, int no_wait,
+                        int timeout_ms, double deadline);
+int rc_build_request(rc_handle *rh, SEND_DATA *data, char *secret,
+		     const struct sockaddr_storage *our_sockaddr,
+		     unsigned char vector[AUTH_VECTOR_LEN], uint8_t *buf);
+int rc_check_reply(AUTH_HDR *auth, int bufferlen, char const *secret,
+		   unsigned char const *vector, uint8_t seq_nbr);
+int rc_validate_reply_attrs(uint8_t *recv_buffer, int length,
+			    const char *server_name, int port);
+int rc_validate_reply_msg_auth(rc_handle *rh, const uint8_t *recv_buffer,
+			       VALUE_PAIR *receive_pairs, const char *secret,
+			       const unsigned char *vector,
+			       const char *server_name, int port);
+int rc_reply_result(uint8_t code);
+
+int rc_select_aaa_server(rc_handle *rh, SERVER **aaaserver,
+			 rc_type *type, rc_standard_codes request_type);
+int rc_find_server(rc_handle const *rh, char const *server_name,
+		   struct addrinfo **info, char *secret, rc_type type);
+int rc_balance_init(rc_handle *rh);
+int rc_server_next(rc_handle *rh, SERVER *aaaserver,
+		   struct rc_server_iter *it, int *probe);
+void rc_server_end(rc_handle *rh, SERVER *aaaserver,
+		   struct rc_server_iter *it);
+void rc_server_result(rc_handle *rh, SERVER *aaaserver, unsigned servernum,
+		      int result);
+void rc_dict_rfc_attach(rc_handle *rh);
+int rc_fill_acct_pairs(rc_handle const *rh, SEND_DATA *data,
+		       uint32_t nas_port, int add_nas_port,
+		       rc_standard_codes request_type,
+		       VALUE_PAIR **adt_vp, double *start_time);
 
 #endif
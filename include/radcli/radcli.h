@@ -37,6 +37,9 @@
 #include <sys/socket.h>
 #include <netdb.h>
 
+/* for struct pollfd */
+#include <poll.h>
+
 /* *INDENT-OFF* */
 #ifdef __cplusplus
 extern "C" {
@@ -88,6 +91,9 @@ typedef enum rc_type {
 struct rc_conf;
 typedef struct rc_conf rc_handle;
 
+struct rc_dict;
+typedef struct rc_dict rc_dict;
+
 /** \struct server
  * Avoid using this structure directly, it is included for backwards compatibility only.
  * Several of its fields have been deprecated.
@@ -97,7 +103,7 @@ typedef struct server {
 	char *name[RC_SERVER_MAX];
 	uint16_t port[RC_SERVER_MAX];
 	char *secret[RC_SERVER_MAX];
-	double deadtime_ends[RC_SERVER_MAX]; //!< unused
+	double deadtime_ends[RC_SERVER_MAX]; //!< when a dead server is tried again (radius_deadtime); zero it
 } SERVER;
 
 /** \enum rc_socket_type Indicate the type of the socket
@@ -695,6 +701,30 @@ int rc_aaa_ctx_server(rc_handle *rh, RC_AAA_CTX **ctx, SERVER *aaaserver,
                       VALUE_PAIR *send, VALUE_PAIR **received,
                       char *msg, int add_nas_port, rc_standard_codes request_type);
 
+/* async.c */
+
+/** Completion callback of rc_aaa_submit()
+ *
+ * @param rh the handle the request was submitted on.
+ * @param result OK_RC, CHALLENGE_RC or REJECT_RC when a reply was received,
+ *  TIMEOUT_RC when no server replied, or a negative rc_send_status on error.
+ * @param received the reply attributes, or NULL; the callback owns them and
+ *  must free them with rc_avpair_free().
+ * @param arg the value given to rc_aaa_submit().
+ */
+typedef void (*rc_aaa_cb)(rc_handle *rh, int result, VALUE_PAIR *received, void *arg);
+
+int rc_aaa_submit(rc_handle *rh, uint32_t client_port, VALUE_PAIR *send,
+		  int add_nas_port, rc_standard_codes request_type,
+		  rc_aaa_cb cb, void *arg);
+int rc_aaa_dispatch(rc_handle *rh, int timeout_ms);
+unsigned rc_aaa_pending(rc_handle *rh);
+unsigned rc_aaa_fds(rc_handle *rh, struct pollfd *fds, unsigned max_fds);
+int rc_aaa_timeout(rc_handle *rh);
+int rc_process_events(rc_handle *rh);
+int rc_acct_batch(rc_handle *rh, uint32_t client_port, VALUE_PAIR **sends,
+		  unsigned count, int *results);
+
 /* config.c */
 
 int rc_add_config(rc_handle *rh, char const *option_name, char const *option_val, char const *source, int line);
@@ -717,7 +747,12 @@ rc_socket_type rc_get_socket_type(rc_handle * rh);
 /* dict.c */
 
 int rc_read_dictionary (rc_handle *rh, char const *filename);
+int rc_read_dictionary_lazy (rc_handle *rh, char const *filename);
 int rc_read_dictionary_from_buffer (rc_handle *rh, char const *buf, size_t size);
+int rc_compile_dictionary(char const *filename, char const *cachefile);
+rc_dict *rc_dict_load(char const *filename);
+void rc_dict_attach(rc_handle *rh, rc_dict *dict);
+void rc_dict_unref(rc_dict *dict);
 
 DICT_ATTR *rc_dict_addattr(rc_handle *rh, char const * namestr, uint32_t value, int type, uint32_t vendorspec);
 DICT_VALUE *rc_dict_addval(rc_handle *rh, char const * attrstr, char const * namestr, uint32_t value);
@@ -736,6 +771,10 @@ void rc_dict_free(rc_handle *rh);
 int rc_tls_fd(rc_handle * rh);
 int rc_check_tls(rc_handle * rh);
 
+/*	resolve.c		*/
+
+int rc_resolve_refresh(rc_handle *rh);
+
 /* ip_util.c */
 
 unsigned short rc_getport(int type);
@@ -0,0 +1,1873 @@
+/*
+ * Copyright (c) 2026, Nikos Mavrogiannopoulos.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <includes.h>
+#include <radcli/radcli.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include "util.h"
+#include "async.h"
+#include "resolve.h"
+#include "rtt.h"
+#include "srcaddr.h"
+
+/**
+ * @defgroup radcli-async Asynchronous API
+ * @brief Non-blocking submission of authentication and accounting requests
+ *
+ * rc_aaa_submit() queues a request and returns immediately; the reply is
+ * delivered to a completion callback from rc_aaa_dispatch(), or from
+ * rc_process_events() when the application drives the engine from its own
+ * event loop. Requests share
+ * a small set of non-blocking UDP sockets, each carrying up to 256
+ * outstanding requests told apart by their RADIUS Identifier, so a single
+ * thread can keep many exchanges in flight. Retransmission and failover to
+ * the next configured server follow radius_timeout and radius_retries as in
+ * rc_aaa().
+ *
+ * With RADIUS/TCP (RFC 6613) the same applies to a persistent connection
+ * per server: requests are pipelined on it and replies are taken off the
+ * stream by the Length field of their header. Requests are not
+ * retransmitted on a connection; when it fails, the requests it carried
+ * are resent on a new one, each resend counting as a retry.
+ *
+ * With hedge-delay-ms or hedge-percentile, an Access-Request its server
+ * has not answered in time is also sent to the next server, as a
+ * request of its own with a fresh Identifier and Request Authenticator.
+ * The first valid reply to either completes the request, and the other
+ * one is dropped.
+ *
+ * The engine state belongs to the handle and is not locked: only one
+ * thread at a time may submit or dispatch on a given handle.
+ *
+ * @{
+ */
+
+/* Number of RADIUS Identifiers, and therefore of requests that can be
+ * outstanding on a single socket. */
+#define ASYNC_IDS 256
+
+/* Datagrams read per recvmmsg() and sent per sendmmsg() call. */
+#define ASYNC_RECV_BATCH 16
+#define ASYNC_SEND_BATCH 64
+
+/* Requests rc_acct_batch() keeps in flight at once; bounds the number of
+ * sockets a large batch opens. */
+#define ASYNC_BATCH_WINDOW (4 * ASYNC_IDS)
+
+/// @cond INTERNAL
+struct async_req;
+
+struct async_sock {
+	int fd;				/* -1 for a failed connection */
+	struct sockaddr_storage addr;	/* bound address, port zeroed */
+	unsigned inflight;
+	unsigned next_id;
+	struct async_req *ids[ASYNC_IDS];
+
+	/* RADIUS/TCP only */
+	int stream;
+	int error;			/* errno of a failure not yet handled */
+	struct sockaddr_storage peer;
+	uint8_t *rbuf;			/* received bytes not forming a packet yet */
+	unsigned rlen;
+	uint8_t *wbuf;			/* queued bytes the socket did not take */
+	unsigned wlen;
+	unsigned walloc;
+};
+
+struct async_req {
+	SEND_DATA data;
+	rc_type type;
+	SERVER *aaaserver;
+	unsigned servernum;
+	struct rc_server_iter iter;	/* servers tried, see rc_server_next() */
+	int retries;			/* radius_retries */
+	char secret[MAX_SECRET_LENGTH + 1];
+	unsigned char vector[AUTH_VECTOR_LEN];
+	struct addrinfo *dest;
+	int sock;			/* index in rc_async.socks, or -1 */
+	uint8_t *packet;
+	unsigned packet_len;
+	int tries;
+	double timeout;			/* radius_timeout_ms, in seconds */
+	double rto;			/* wait for a reply to this transmission */
+	double sent;			/* time of the first transmission */
+	double expires;			/* end of radius_deadline_ms, or 0 */
+	double retry_at;		/* when the transmission times out */
+	double hedge_at;		/* when to hedge the request, or 0 */
+	double deadline;		/* the earlier of the two */
+	unsigned heap_pos;
+	VALUE_PAIR *adt_vp;
+	double start_time;
+	int hedged;			/* has been hedged, or is a hedge */
+	struct async_req *hedge;	/* the other copy while both wait */
+	rc_aaa_cb cb;
+	void *arg;
+};
+
+struct rc_async {
+	struct async_sock **socks;	/* never shrinks while the handle lives */
+	struct pollfd *pfds;
+	unsigned nsocks;
+	struct async_req **heap;	/* pending requests, earliest deadline first */
+	unsigned heap_size;
+	unsigned heap_alloc;
+	unsigned hedges;		/* hedged requests, in the heap twice */
+	struct async_req **outq;	/* built by rc_acct_batch(), not yet sent */
+	unsigned outq_size;
+	unsigned outq_alloc;
+#ifdef HAVE_RECVMMSG
+	uint8_t *rbuf;			/* ASYNC_RECV_BATCH receive buffers */
+#endif
+};
+/// @endcond
+
+/// @cond INTERNAL
+static void heap_set(struct rc_async *as, unsigned pos, struct async_req *req)
+{
+	as->heap[pos] = req;
+	req->heap_pos = pos;
+}
+
+static void heap_up(struct rc_async *as, unsigned pos)
+{
+	struct async_req *req = as->heap[pos];
+	unsigned parent;
+
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+		if (as->heap[parent]->deadline <= req->deadline)
+			break;
+		heap_set(as, pos, as->heap[parent]);
+		pos = parent;
+	}
+	heap_set(as, pos, req);
+}
+
+static void heap_down(struct rc_async *as, unsigned pos)
+{
+	struct async_req *req = as->heap[pos];
+	unsigned child;
+
+	for (;;) {
+		child = 2 * pos + 1;
+		if (child >= as->heap_size)
+			break;
+		if (child + 1 < as->heap_size &&
+		    as->heap[child + 1]->deadline < as->heap[child]->deadline)
+			child++;
+		if (req->deadline <= as->heap[child]->deadline)
+			break;
+		heap_set(as, pos, as->heap[child]);
+		pos = child;
+	}
+	heap_set(as, pos, req);
+}
+
+static int heap_reserve(struct rc_async *as)
+{
+	struct async_req **heap;
+	unsigned alloc;
+
+	if (as->heap_size < as->heap_alloc)
+		return 0;
+
+	alloc = as->heap_alloc ? as->heap_alloc * 2 : 64;
+	heap = realloc(as->heap, alloc * sizeof(*heap));
+	if (heap == NULL) {
+		rc_log(LOG_CRIT, "rc_aaa_submit: out of memory");
+		return -1;
+	}
+	as->heap = heap;
+	as->heap_alloc = alloc;
+	return 0;
+}
+
+static void heap_push(struct rc_async *as, struct async_req *req)
+{
+	heap_set(as, as->heap_size++, req);
+	heap_up(as, req->heap_pos);
+}
+
+static void heap_remove(struct rc_async *as, struct async_req *req)
+{
+	struct async_req *last;
+
+	as->heap_size--;
+	if (req->heap_pos == as->heap_size)
+		return;
+
+	last = as->heap[as->heap_size];
+	heap_set(as, req->heap_pos, last);
+	heap_up(as, last->heap_pos);
+	heap_down(as, last->heap_pos);
+}
+
+static void heap_update(struct rc_async *as, struct async_req *req)
+{
+	heap_up(as, req->heap_pos);
+	heap_down(as, req->heap_pos);
+}
+/// @endcond
+
+/* Allocates the engine state of a handle on first use
+ *
+ * @param rh a handle to parsed configuration.
+ * @return 0 on success, -1 on failure.
+ */
+/// @cond INTERNAL
+static int async_init(rc_handle *rh)
+{
+	if (rh->async != NULL)
+		return 0;
+
+	rh->async = calloc(1, sizeof(struct rc_async));
+	if (rh->async == NULL) {
+		rc_log(LOG_CRIT, "rc_aaa_submit: out of memory");
+		return -1;
+	}
+
+#ifdef HAVE_RECVMMSG
+	rh->async->rbuf = malloc(ASYNC_RECV_BATCH * RC_BUFFER_LEN);
+	if (rh->async->rbuf == NULL) {
+		rc_log(LOG_CRIT, "rc_aaa_submit: out of memory");
+		free(rh->async);
+		rh->async = NULL;
+		return -1;
+	}
+#endif
+	return 0;
+}
+/// @endcond
+
+/// @cond INTERNAL
+static int same_peer(const struct sockaddr *a, const struct sockaddr_storage *b)
+{
+	if (a->sa_family != b->ss_family)
+		return 0;
+
+	if (a->sa_family == AF_INET)
+		return ((const struct sockaddr_in *)a)->sin_port ==
+		       ((const struct sockaddr_in *)b)->sin_port &&
+		       memcmp(&((const struct sockaddr_in *)a)->sin_addr,
+			      &((const struct sockaddr_in *)b)->sin_addr,
+			      sizeof(struct in_addr)) == 0;
+
+	return ((const struct sockaddr_in6 *)a)->sin6_port ==
+	       ((const struct sockaddr_in6 *)b)->sin6_port &&
+	       memcmp(&((const struct sockaddr_in6 *)a)->sin6_addr,
+		      &((const struct sockaddr_in6 *)b)->sin6_addr,
+		      sizeof(struct in6_addr)) == 0;
+}
+/// @endcond
+
+/* Checks whether a socket can take another request for @p dest
+ *
+ * An idle RADIUS/TCP connection with anything to read was closed by
+ * the server, or carries a reply nobody waits for; it is marked failed
+ * rather than reused, and async_service() closes it.
+ *
+ * @param sock the socket.
+ * @param our_sockaddr the local address, port zeroed.
+ * @param dest the server, or NULL for UDP.
+ * @return non-zero if the socket is usable.
+ */
+/// @cond INTERNAL
+static int async_sock_usable(struct async_sock *sock,
+			     const struct sockaddr_storage *our_sockaddr,
+			     const struct sockaddr *dest)
+{
+	struct pollfd pfd;
+
+	if (sock->fd < 0 || sock->inflight >= ASYNC_IDS ||
+	    memcmp(&sock->addr, our_sockaddr, SS_LEN(our_sockaddr)) != 0)
+		return 0;
+
+	if (dest == NULL)
+		return !sock->stream;
+
+	if (!sock->stream || sock->error != 0 || !same_peer(dest, &sock->peer))
+		return 0;
+
+	if (sock->inflight == 0 && sock->wlen == 0) {
+		pfd.fd = sock->fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 0) != 0) {
+			sock->error = ECONNRESET;
+			return 0;
+		}
+	}
+
+	return 1;
+}
+/// @endcond
+
+/* Returns a socket bound to @p our_sockaddr with a free Identifier
+ *
+ * A new non-blocking socket is opened when every existing one bound
+ * to that address already has 256 requests outstanding. For RADIUS/TCP
+ * the socket is a connection to @p dest, started without waiting for
+ * it to complete; packets queued meanwhile are sent once it does.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param our_sockaddr the local address; its port is zeroed.
+ * @param dest the server for RADIUS/TCP, NULL for UDP.
+ * @return the socket index, or -1 on failure.
+ */
+/// @cond INTERNAL
+static int async_get_sock(rc_handle *rh, struct sockaddr_storage *our_sockaddr,
+			  const struct sockaddr *dest)
+{
+	struct rc_async *as = rh->async;
+	struct async_sock *sock, **socks;
+	struct pollfd *pfds;
+	unsigned i;
+	int flags, one = 1;
+	int sidx = -1;
+
+	if (our_sockaddr->ss_family == AF_INET)
+		((struct sockaddr_in *)our_sockaddr)->sin_port = 0;
+	else
+		((struct sockaddr_in6 *)our_sockaddr)->sin6_port = 0;
+
+	for (i = 0; i < as->nsocks; i++) {
+		if (async_sock_usable(as->socks[i], our_sockaddr, dest))
+			return i;
+		/* slots of failed connections are recycled once empty */
+		if (sidx < 0 && as->socks[i]->fd < 0 &&
+		    as->socks[i]->inflight == 0)
+			sidx = i;
+	}
+
+	if (sidx >= 0) {
+		sock = as->socks[sidx];
+	} else {
+		socks = realloc(as->socks, (as->nsocks + 1) * sizeof(*socks));
+		if (socks == NULL)
+			return -1;
+		as->socks = socks;
+
+		pfds = realloc(as->pfds, (as->nsocks + 1) * sizeof(*pfds));
+		if (pfds == NULL)
+			return -1;
+		as->pfds = pfds;
+
+		sock = calloc(1, sizeof(*sock));
+		if (sock == NULL)
+			return -1;
+		sock->fd = -1;
+	}
+
+	if (dest != NULL && sock->rbuf == NULL) {
+		sock->rbuf = malloc(RC_BUFFER_LEN);
+		if (sock->rbuf == NULL)
+			goto fail;
+	}
+
+	sock->fd = rc_socket(rh, our_sockaddr->ss_family,
+			     dest != NULL ? SOCK_STREAM : SOCK_DGRAM, 0);
+	if (sock->fd < 0)
+		goto fail;
+
+	flags = fcntl(sock->fd, F_GETFL);
+	if (flags == -1 || fcntl(sock->fd, F_SETFL, flags | O_NONBLOCK) == -1)
+		goto fail;
+
+	if (bind(sock->fd, SA(our_sockaddr), SS_LEN(our_sockaddr)) < 0)
+		goto fail;
+
+	if (our_sockaddr->ss_family == AF_INET6 &&
+	    rc_prefer_public_addr(rh, sock->fd) != OK_RC)
+		goto fail;
+
+	if (dest != NULL) {
+		/* pipelined requests are small and should not wait on
+		 * the acknowledgement of the previous one */
+		setsockopt(sock->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (connect(sock->fd, dest, SA_LEN(dest)) != 0 &&
+		    errno != EINPROGRESS)
+			goto fail;
+		memcpy(&sock->peer, dest, SA_LEN(dest));
+	}
+
+	memcpy(&sock->addr, our_sockaddr, SS_LEN(our_sockaddr));
+	sock->stream = dest != NULL;
+	sock->error = 0;
+	sock->rlen = 0;
+	sock->wlen = 0;
+	sock->next_id = random() % ASYNC_IDS;
+	if (sidx >= 0)
+		return sidx;
+
+	as->socks[as->nsocks] = sock;
+	return as->nsocks++;
+
+ fail:
+	if (sock->fd >= 0) {
+		flags = errno;
+		close(sock->fd);
+		sock->fd = -1;
+		errno = flags;
+	}
+	if (sidx < 0) {
+		free(sock->rbuf);
+		free(sock);
+	}
+	return -1;
+}
+/// @endcond
+
+/* Gives up the Identifier, packet and destination of the current attempt
+ *
+ * @param as the engine state.
+ * @param req the request.
+ */
+/// @cond INTERNAL
+static void async_release(struct rc_async *as, struct async_req *req)
+{
+	if (req->sock >= 0) {
+		as->socks[req->sock]->ids[req->data.seq_nbr] = NULL;
+		as->socks[req->sock]->inflight--;
+		req->sock = -1;
+	}
+
+	free(req->packet);
+	req->packet = NULL;
+
+	if (req->dest != NULL) {
+		rc_addrinfo_free(req->dest);
+		req->dest = NULL;
+	}
+}
+
+static void async_req_free(struct async_req *req)
+{
+	rc_avpair_free(req->data.send_pairs);
+	memset(req->secret, '\0', sizeof(req->secret));
+	free(req);
+}
+/// @endcond
+
+/* Maps a send error to the result of the attempt
+ *
+ * A send that fails for lack of buffer space is treated like a lost
+ * datagram and left to the retransmission timer.
+ *
+ * @param e the errno value of the failed send.
+ * @return OK_RC, NETUNREACH_RC or ERROR_RC.
+ */
+/// @cond INTERNAL
+static int async_send_error(int e)
+{
+	if (e == EAGAIN || e == EWOULDBLOCK || e == ENOBUFS)
+		return OK_RC;
+
+	rc_log(LOG_ERR, "rc_aaa_submit: socket: %s", strerror(e));
+	return e == ENETUNREACH ? NETUNREACH_RC : ERROR_RC;
+}
+/// @endcond
+
+/* Writes as much of the output queued on a RADIUS/TCP connection as
+ * the socket takes without blocking. A failure is recorded in
+ * sock->error and handled by async_service().
+ *
+ * @param sock the socket.
+ */
+/// @cond INTERNAL
+static void async_stream_flush(struct async_sock *sock)
+{
+	ssize_t ret;
+
+	while (sock->wlen > 0 && sock->error == 0) {
+		ret = send(sock->fd, sock->wbuf, sock->wlen, MSG_NOSIGNAL);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;	/* still connecting, or the buffer is full */
+		if (ret <= 0) {
+			sock->error = ret == 0 ? ECONNRESET : errno;
+			return;
+		}
+		sock->wlen -= ret;
+		memmove(sock->wbuf, sock->wbuf + ret, sock->wlen);
+	}
+}
+/// @endcond
+
+/* Appends a packet to the output of a RADIUS/TCP connection
+ *
+ * Once queued, a packet is sent in full even if its request completes
+ * in the meantime, as the stream has no other framing.
+ *
+ * @param sock the socket.
+ * @param packet the packet.
+ * @param len the packet length.
+ * @return OK_RC or ERROR_RC.
+ */
+/// @cond INTERNAL
+static int async_stream_queue(struct async_sock *sock, const uint8_t *packet,
+			      unsigned len)
+{
+	uint8_t *wbuf;
+	unsigned walloc;
+
+	if (sock->wlen + len > sock->walloc) {
+		walloc = sock->walloc ? sock->walloc : RC_BUFFER_LEN;
+		while (walloc < sock->wlen + len)
+			walloc *= 2;
+		wbuf = realloc(sock->wbuf, walloc);
+		if (wbuf == NULL) {
+			rc_log(LOG_CRIT, "rc_aaa_submit: out of memory");
+			return ERROR_RC;
+		}
+		sock->wbuf = wbuf;
+		sock->walloc = walloc;
+	}
+
+	memcpy(sock->wbuf + sock->wlen, packet, len);
+	sock->wlen += len;
+	return OK_RC;
+}
+/// @endcond
+
+/* Arms the timer of a request to go off @wait seconds from now, or
+ * when its radius_deadline_ms ends if that is earlier; the timer goes
+ * off before that if the request is due to be hedged */
+/// @cond INTERNAL
+static void async_arm(struct async_req *req, double wait)
+{
+	req->retry_at = rc_getmtime() + wait;
+	if (req->expires > 0 && req->retry_at > req->expires)
+		req->retry_at = req->expires;
+
+	req->deadline = req->retry_at;
+	if (req->hedge_at > 0 && req->deadline > req->hedge_at)
+		req->deadline = req->hedge_at;
+}
+
+static int async_expired(const struct async_req *req)
+{
+	return req->expires > 0 && rc_getmtime() >= req->expires;
+}
+/// @endcond
+
+/* Sends (or resends) the packet of the current attempt and arms its timer
+ *
+ * @param rh a handle to parsed configuration.
+ * @param req the request.
+ * @return OK_RC, NETUNREACH_RC or ERROR_RC.
+ */
+/// @cond INTERNAL
+static int async_transmit(rc_handle *rh, struct async_req *req)
+{
+	const rc_sockets_override *sfuncs = &rh->so;
+	struct async_sock *sock = rh->async->socks[req->sock];
+	ssize_t ret;
+
+	async_arm(req, req->rto);
+
+	if (sock->stream) {
+		if (async_stream_queue(sock, req->packet, req->packet_len) != OK_RC)
+			return ERROR_RC;
+		async_stream_flush(sock);
+		return OK_RC;
+	}
+
+	do {
+		ret = sfuncs->sendto(sfuncs->ptr, rh->async->socks[req->sock]->fd,
+				     req->packet, req->packet_len, 0,
+				     req->dest->ai_addr, req->dest->ai_addrlen);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret == -1)
+		return async_send_error(errno);
+
+	return OK_RC;
+}
+/// @endcond
+
+/* Builds the request for its current server and sends it
+ *
+ * Resolves the server and its secret as rc_send_server_ctx() does,
+ * takes a fresh Identifier on a matching socket and transmits.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param req the request; any previous attempt is released first.
+ * @param defer if non-zero, only arm the timer; the caller sends the
+ *  packet later with async_flush().
+ * @return OK_RC, NETUNREACH_RC or ERROR_RC.
+ */
+/// @cond INTERNAL
+static int async_send_to_server(rc_handle *rh, struct async_req *req,
+				int defer)
+{
+	struct rc_async *as = rh->async;
+	SEND_DATA *data = &req->data;
+	struct sockaddr_storage our_sockaddr;
+	struct async_sock *sock;
+	uint8_t buf[RC_BUFFER_LEN];
+	VALUE_PAIR *vp;
+	int length, result, sidx;
+	unsigned i, id;
+	time_t dtime;
+	double hedge;
+
+	async_release(as, req);
+
+	data->server = req->aaaserver->name[req->servernum];
+	data->svc_port = req->aaaserver->port[req->servernum];
+	data->secret = req->aaaserver->secret[req->servernum];
+
+	memset(req->secret, '\0', sizeof(req->secret));
+	if ((vp = rc_avpair_get(data->send_pairs, PW_SERVICE_TYPE, 0)) &&
+	    (vp->lvalue == PW_ADMINISTRATIVE)) {
+		strlcpy(req->secret, MGMT_POLL_SECRET, sizeof(req->secret));
+		req->dest = rc_resolve(rh, data->server,
+				       req->type == AUTH ? PW_AI_AUTH : PW_AI_ACCT);
+		if (req->dest == NULL) {
+			result = ERROR_RC;
+			goto cleanup;
+		}
+	} else {
+		if (data->secret != NULL)
+			strlcpy(req->secret, data->secret, sizeof(req->secret));
+		if (rc_find_server(rh, data->server, &req->dest,
+				   req->secret, req->type) != 0) {
+			/* rc_find_server() frees the list on failure */
+			req->dest = NULL;
+			rc_log(LOG_ERR, "rc_aaa_submit: unable to find server: %s",
+			       data->server);
+			result = ERROR_RC;
+			goto cleanup;
+		}
+	}
+
+	if (data->svc_port) {
+		if (req->dest->ai_family == AF_INET)
+			((struct sockaddr_in *)req->dest->ai_addr)->sin_port =
+			    htons((unsigned short)data->svc_port);
+		else
+			((struct sockaddr_in6 *)req->dest->ai_addr)->sin6_port =
+			    htons((unsigned short)data->svc_port);
+	}
+
+	rc_own_bind_addr(rh, &our_sockaddr);
+	if (our_sockaddr.ss_family == AF_INET &&
+	    ((struct sockaddr_in *)&our_sockaddr)->sin_addr.s_addr == INADDR_ANY) {
+		result = rc_srcaddr_get(rh, SA(&our_sockaddr), req->dest->ai_addr);
+		if (result != OK_RC) {
+			rc_log(LOG_ERR,
+			       "rc_aaa_submit: cannot figure our own address");
+			goto cleanup;
+		}
+	}
+
+	sidx = async_get_sock(rh, &our_sockaddr,
+			      rh->so_type == RC_SOCKET_TCP ?
+			      req->dest->ai_addr : NULL);
+	if (sidx < 0) {
+		rc_log(LOG_ERR, "rc_aaa_submit: socket: %s", strerror(errno));
+		/* a server refusing connections is failed over like an
+		 * unreachable one */
+		result = rh->so_type == RC_SOCKET_TCP ? NETUNREACH_RC : ERROR_RC;
+		goto cleanup;
+	}
+
+	/* Identifiers are handed out in sequence from a random start, so
+	 * that a slot freed by a reply is not immediately reused while a
+	 * late duplicate of that reply may still be on its way. */
+	sock = as->socks[sidx];
+	for (i = 0; i < ASYNC_IDS; i++) {
+		id = (sock->next_id + i) % ASYNC_IDS;
+		if (sock->ids[id] == NULL)
+			break;
+	}
+	sock->ids[id] = req;
+	sock->inflight++;
+	sock->next_id = (id + 1) % ASYNC_IDS;
+	req->sock = sidx;
+	data->seq_nbr = id;
+
+	if (data->code == PW_ACCOUNTING_REQUEST) {
+		dtime = rc_getmtime() - req->start_time;
+		rc_avpair_assign(req->adt_vp, &dtime, 0);
+	}
+
+	length = rc_build_request(rh, data, req->secret, &our_sockaddr,
+				  req->vector, buf);
+	if (length < 0) {
+		result = ERROR_RC;
+		goto cleanup;
+	}
+
+	req->packet = malloc(length);
+	if (req->packet == NULL) {
+		rc_log(LOG_CRIT, "rc_aaa_submit: out of memory");
+		result = ERROR_RC;
+		goto cleanup;
+	}
+	memcpy(req->packet, buf, length);
+	req->packet_len = length;
+	req->tries = 0;
+	req->rto = rc_rtt_first(rh, req->dest->ai_addr, req->timeout);
+	req->sent = rc_getmtime();
+
+	req->hedge_at = 0;
+	if (!req->hedged && data->code == PW_ACCESS_REQUEST) {
+		hedge = rc_rtt_hedge(rh, req->dest->ai_addr);
+		if (hedge > 0)
+			req->hedge_at = req->sent + hedge;
+	}
+
+	if (defer) {
+		async_arm(req, req->rto);
+		result = OK_RC;
+	} else {
+		result = async_transmit(rh, req);
+	}
+
+ cleanup:
+	return result;
+}
+/// @endcond
+
+/* Sends the request to the next server rc_server_next() picks, failing
+ * over for as long as the network is unreachable.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param req the request.
+ * @param defer passed to async_send_to_server().
+ * @param last the result to return when no server is left.
+ * @return OK_RC, NETUNREACH_RC, ERROR_RC or @p last.
+ */
+/// @cond INTERNAL
+static int async_start(rc_handle *rh, struct async_req *req, int defer,
+		       int last)
+{
+	int result = last;
+	int servernum, probe;
+
+	while ((servernum = rc_server_next(rh, req->aaaserver, &req->iter,
+					   &probe)) >= 0) {
+		req->servernum = servernum;
+		req->data.retries = probe ? 0 : req->retries;
+		result = async_send_to_server(rh, req, defer);
+		if (result != NETUNREACH_RC)
+			return result;
+		rc_server_result(rh, req->aaaserver, servernum, result);
+	}
+
+	return result;
+}
+/// @endcond
+
+/* Removes a request from the engine without running its callback
+ *
+ * @param rh a handle to parsed configuration.
+ * @param req the request; freed by this function.
+ */
+/// @cond INTERNAL
+static void async_drop(rc_handle *rh, struct async_req *req)
+{
+	rc_server_end(rh, req->aaaserver, &req->iter);
+	async_release(rh->async, req);
+	heap_remove(rh->async, req);
+	async_req_free(req);
+}
+/// @endcond
+
+/* Removes a request from the engine and runs its callback
+ *
+ * The request is unlinked before the callback runs, so the callback
+ * may submit new requests. Of a hedged request, the copy that got a
+ * valid reply drops the other one; a copy that failed is dropped
+ * alone, and the other one completes the request.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param req the request; freed by this function.
+ * @param result the rc_send_status to report.
+ * @param received the reply attributes, handed to the callback.
+ */
+/// @cond INTERNAL
+static void async_complete(rc_handle *rh, struct async_req *req, int result,
+			   VALUE_PAIR *received)
+{
+	struct async_req *other = req->hedge;
+	rc_aaa_cb cb = req->cb;
+	void *arg = req->arg;
+
+	if (other != NULL) {
+		other->hedge = NULL;
+		rh->async->hedges--;
+
+		if (result < OK_RC || result == TIMEOUT_RC) {
+			rc_avpair_free(received);
+			async_drop(rh, req);
+			return;
+		}
+
+		/* the reply the other copy waits for takes at least that
+		 * long; leaving it out would bias hedge-percentile low */
+		if (other->tries == 0 && other->dest != NULL)
+			rc_rtt_sample(rh, other->dest->ai_addr,
+				      rc_getmtime() - other->sent);
+		async_drop(rh, other);
+	}
+
+	async_drop(rh, req);
+
+	cb(rh, result, received, arg);
+}
+/// @endcond
+
+/* Sends a copy of an Access-Request to the server after the one that is
+ * slow to answer it
+ *
+ * The copy is a request of its own, with its own Identifier, Request
+ * Authenticator, retries and failover. Nothing is sent if no other
+ * server is left, and the original request keeps waiting either way.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param req the request.
+ */
+/// @cond INTERNAL
+static void async_hedge(rc_handle *rh, struct async_req *req)
+{
+	struct rc_async *as = rh->async;
+	struct async_req *copy;
+
+	req->hedged = 1;
+	if (heap_reserve(as) != 0)
+		return;
+
+	copy = calloc(1, sizeof(*copy));
+	if (copy == NULL) {
+		rc_log(LOG_CRIT, "%s: out of memory", __func__);
+		return;
+	}
+	copy->data.code = req->data.code;
+	copy->data.timeout = req->data.timeout;
+	if (req->data.send_pairs != NULL) {
+		copy->data.send_pairs = rc_avpair_copy(req->data.send_pairs);
+		if (copy->data.send_pairs == NULL) {
+			free(copy);
+			return;
+		}
+	}
+	copy->type = req->type;
+	copy->aaaserver = req->aaaserver;
+	copy->iter.tried = req->iter.tried;
+	copy->iter.start = req->iter.start;
+	copy->iter.current = -1;
+	copy->retries = req->retries;
+	copy->timeout = req->timeout;
+	copy->expires = req->expires;
+	copy->hedged = 1;
+	copy->sock = -1;
+	copy->cb = req->cb;
+	copy->arg = req->arg;
+
+	if (async_start(rh, copy, 0, ERROR_RC) != OK_RC) {
+		DEBUG(LOG_INFO, "rc_aaa_dispatch: no server to hedge request to");
+		rc_server_end(rh, copy->aaaserver, &copy->iter);
+		async_release(as, copy);
+		async_req_free(copy);
+		return;
+	}
+
+	/* the original fails over past the server the copy went to */
+	req->iter.tried |= copy->iter.tried;
+	req->hedge = copy;
+	copy->hedge = req;
+	as->hedges++;
+	heap_push(as, copy);
+}
+/// @endcond
+
+/* Acts on the outcome of a (re)transmission: fails over to the next
+ * server after a timeout or an unreachable network, completes the
+ * request if that is not possible, and otherwise re-arms its timer.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param req the request.
+ * @param result the outcome of the attempt.
+ */
+/// @cond INTERNAL
+static void async_next(rc_handle *rh, struct async_req *req, int result)
+{
+	if (result == TIMEOUT_RC || result == NETUNREACH_RC) {
+		rc_server_result(rh, req->aaaserver, req->servernum, result);
+		if (async_expired(req))
+			result = TIMEOUT_RC;
+		else
+			result = async_start(rh, req, 0, result);
+	}
+
+	if (result != OK_RC) {
+		async_complete(rh, req, result, NULL);
+		return;
+	}
+
+	heap_update(rh->async, req);
+}
+/// @endcond
+
+/* Handles an expired request timer: retransmits, fails over to the
+ * next server once the retries are exhausted, or completes the request
+ * with TIMEOUT_RC when no server is left.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param req the request.
+ */
+/// @cond INTERNAL
+static void async_expire(rc_handle *rh, struct async_req *req)
+{
+	char server_ip[128];
+	int result;
+
+	if (async_expired(req)) {
+		/* the budget ran out, not necessarily the server */
+		rc_log(LOG_ERR, "rc_aaa_dispatch: no reply within radius_deadline_ms");
+		async_complete(rh, req, TIMEOUT_RC, NULL);
+		return;
+	}
+
+	if (req->hedge_at > 0 && rc_getmtime() >= req->hedge_at) {
+		req->hedge_at = 0;
+		async_hedge(rh, req);
+		if (req->retry_at > rc_getmtime()) {
+			req->deadline = req->retry_at;
+			heap_update(rh->async, req);
+			return;
+		}
+	}
+
+	if (req->tries < req->data.retries) {
+		req->tries++;
+		if (rh->async->socks[req->sock]->stream) {
+			/* RFC 6613 rules out retransmitting on the same
+			 * connection; keep waiting instead */
+			async_arm(req, req->timeout);
+			result = OK_RC;
+		} else {
+			req->rto = rc_rtt_next(rh, req->rto);
+			result = async_transmit(rh, req);
+		}
+	} else {
+		getnameinfo(req->dest->ai_addr, req->dest->ai_addrlen,
+			    server_ip, sizeof(server_ip), NULL, 0,
+			    NI_NUMERICHOST);
+		rc_log(LOG_ERR,
+		       "rc_aaa_dispatch: no reply from RADIUS %s server %s:%u",
+		       req->type == ACCT ? "acct" : "auth", server_ip,
+		       req->data.svc_port);
+		result = TIMEOUT_RC;
+	}
+
+	async_next(rh, req, result);
+}
+/// @endcond
+
+/* Matches a received datagram to its request and completes it
+ *
+ * Replies are matched on the Identifier and source address, then
+ * verified with rc_check_reply(). A reply that fails verification is
+ * dropped and the request keeps waiting: with Identifiers recycled on
+ * a shared socket, it may simply be a late answer to an earlier
+ * request that held the same Identifier.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param sidx the socket index the datagram was read from.
+ * @param recv_buffer the datagram, in a buffer of RC_BUFFER_LEN bytes.
+ * @param length the datagram length.
+ * @param from the datagram source address.
+ */
+/// @cond INTERNAL
+static void async_reply(rc_handle *rh, unsigned sidx, uint8_t *recv_buffer,
+			ssize_t length, const struct sockaddr_storage *from)
+{
+	AUTH_HDR *recv_auth = (AUTH_HDR *)recv_buffer;
+	struct async_req *req;
+	VALUE_PAIR *received;
+
+	if (length < AUTH_HDR_LEN || length < ntohs(recv_auth->length)) {
+		rc_log(LOG_ERR, "rc_aaa_dispatch: recvfrom: reply is too short");
+		return;
+	}
+
+	req = rh->async->socks[sidx]->ids[recv_auth->id];
+	if (req == NULL || !same_peer(req->dest->ai_addr, from)) {
+		DEBUG(LOG_INFO,
+		      "rc_aaa_dispatch: ignoring reply with unknown id %u",
+		      recv_auth->id);
+		return;
+	}
+
+	if (rc_check_reply(recv_auth, RC_BUFFER_LEN, req->secret,
+			   req->vector, req->data.seq_nbr) != OK_RC)
+		return;
+
+	rc_server_result(rh, req->aaaserver, req->servernum, OK_RC);
+	if (req->tries == 0)
+		rc_rtt_sample(rh, req->dest->ai_addr, rc_getmtime() - req->sent);
+
+	if (length > ntohs(recv_auth->length))
+		length = ntohs(recv_auth->length);
+
+	if (rc_validate_reply_attrs(recv_buffer, length, req->data.server,
+				    req->data.svc_port) != OK_RC) {
+		async_complete(rh, req, ERROR_RC, NULL);
+		return;
+	}
+
+	received = NULL;
+	length = ntohs(recv_auth->length) - AUTH_HDR_LEN;
+	if (length > 0)
+		received = rc_avpair_gen(rh, NULL, recv_auth->data, length, 0);
+
+	if (req->type == AUTH &&
+	    rc_validate_reply_msg_auth(rh, recv_buffer, received, req->secret,
+				       req->vector, req->data.server,
+				       req->data.svc_port) != OK_RC) {
+		rc_avpair_free(received);
+		async_complete(rh, req, ERROR_RC, NULL);
+		return;
+	}
+
+	async_complete(rh, req, rc_reply_result(recv_auth->code), received);
+}
+/// @endcond
+
+/* Reads the replies queued on a socket and completes the requests
+ * they answer
+ *
+ * Where recvmmsg() is available, up to ASYNC_RECV_BATCH datagrams are
+ * read per system call.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param sidx the socket index.
+ */
+/// @cond INTERNAL
+#ifdef HAVE_RECVMMSG
+static void async_read(rc_handle *rh, unsigned sidx)
+{
+	struct rc_async *as = rh->async;
+	struct mmsghdr msgs[ASYNC_RECV_BATCH];
+	struct iovec iov[ASYNC_RECV_BATCH];
+	struct sockaddr_storage from[ASYNC_RECV_BATCH];
+	unsigned n, i;
+	int got;
+
+	/* bounded, so that a flood on one socket cannot starve the timers */
+	for (n = 0; n < ASYNC_IDS; n += got) {
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < ASYNC_RECV_BATCH; i++) {
+			iov[i].iov_base = as->rbuf + i * RC_BUFFER_LEN;
+			iov[i].iov_len = RC_BUFFER_LEN;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &from[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+		}
+
+		do {
+			got = recvmmsg(as->socks[sidx]->fd, msgs, ASYNC_RECV_BATCH,
+				       MSG_DONTWAIT, NULL);
+		} while (got == -1 && errno == EINTR);
+
+		if (got <= 0) {
+			if (got == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+				rc_log(LOG_ERR, "rc_aaa_dispatch: recvmmsg: %s",
+				       strerror(errno));
+			return;
+		}
+
+		for (i = 0; i < (unsigned)got; i++)
+			async_reply(rh, sidx, iov[i].iov_base, msgs[i].msg_len,
+				    &from[i]);
+
+		if (got < ASYNC_RECV_BATCH)
+			return;
+	}
+}
+#else
+static void async_read(rc_handle *rh, unsigned sidx)
+{
+	const rc_sockets_override *sfuncs = &rh->so;
+	uint8_t recv_buffer[RC_BUFFER_LEN];
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	ssize_t length;
+	unsigned n;
+
+	/* bounded, so that a flood on one socket cannot starve the timers */
+	for (n = 0; n < ASYNC_IDS; n++) {
+		fromlen = sizeof(from);
+		do {
+			length = sfuncs->recvfrom(sfuncs->ptr,
+						  rh->async->socks[sidx]->fd,
+						  recv_buffer, sizeof(recv_buffer),
+						  0, SA(&from), &fromlen);
+		} while (length == -1 && errno == EINTR);
+
+		if (length < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				rc_log(LOG_ERR, "rc_aaa_dispatch: recvfrom: %s",
+				       strerror(errno));
+			return;
+		}
+
+		async_reply(rh, sidx, recv_buffer, length, &from);
+	}
+}
+#endif
+/// @endcond
+
+/* Reads a RADIUS/TCP connection and completes the requests answered
+ *
+ * Packets are cut from the stream by the Length field of their header;
+ * a partial packet stays buffered until the rest arrives. A Length
+ * outside the RADIUS limits means the stream cannot be followed any
+ * further, and is recorded as a connection failure.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param sidx the socket index.
+ */
+/// @cond INTERNAL
+static void async_read_stream(rc_handle *rh, unsigned sidx)
+{
+	struct async_sock *sock = rh->async->socks[sidx];
+	uint8_t packet[RC_BUFFER_LEN];
+	unsigned plen, n;
+	ssize_t ret;
+
+	/* bounded, so that a flood on one connection cannot starve the timers */
+	for (n = 0; n < ASYNC_IDS && sock->error == 0; n++) {
+		do {
+			ret = recv(sock->fd, sock->rbuf + sock->rlen,
+				   RC_BUFFER_LEN - sock->rlen, 0);
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret == 0) {
+			sock->error = ECONNRESET;
+			return;
+		}
+		if (ret < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				sock->error = errno;
+			return;
+		}
+		sock->rlen += ret;
+
+		while (sock->rlen >= 4) {
+			plen = ((unsigned)sock->rbuf[2] << 8) | sock->rbuf[3];
+			if (plen < AUTH_HDR_LEN || plen > RC_MAX_PACKET_LEN) {
+				rc_log(LOG_ERR,
+				       "rc_aaa_dispatch: invalid packet length %u on stream",
+				       plen);
+				sock->error = EBADMSG;
+				return;
+			}
+			if (sock->rlen < plen)
+				break;
+
+			memcpy(packet, sock->rbuf, plen);
+			sock->rlen -= plen;
+			memmove(sock->rbuf, sock->rbuf + plen, sock->rlen);
+			async_reply(rh, sidx, packet, plen, &sock->peer);
+		}
+	}
+}
+/// @endcond
+
+/* Resends a request whose RADIUS/TCP connection failed
+ *
+ * The request is rebuilt and sent on a new connection to the same
+ * server, which counts as one of its retries; with none left it is
+ * failed over.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param req the request.
+ */
+/// @cond INTERNAL
+static void async_conn_lost(rc_handle *rh, struct async_req *req)
+{
+	int tries = req->tries;
+	int result;
+
+	if (tries < req->data.retries) {
+		result = async_send_to_server(rh, req, 0);
+		req->tries = tries + 1;
+	} else {
+		result = TIMEOUT_RC;
+	}
+
+	async_next(rh, req, result);
+}
+/// @endcond
+
+/* Closes a failed RADIUS/TCP connection and resends what it carried
+ *
+ * @param rh a handle to parsed configuration.
+ * @param sidx the socket index.
+ */
+/// @cond INTERNAL
+static void async_sock_fail(rc_handle *rh, unsigned sidx)
+{
+	struct async_sock *sock = rh->async->socks[sidx];
+	struct async_req *reqs[ASYNC_IDS];
+	char server_ip[128];
+	unsigned i, n = 0;
+
+	getnameinfo(SA(&sock->peer), SS_LEN(&sock->peer), server_ip,
+		    sizeof(server_ip), NULL, 0, NI_NUMERICHOST);
+	rc_log(sock->inflight ? LOG_ERR : LOG_INFO,
+	       "rc_aaa_dispatch: connection to RADIUS server %s lost: %s",
+	       server_ip, strerror(sock->error));
+
+	/* the slot is recycled only once every request has left it */
+	for (i = 0; i < ASYNC_IDS; i++) {
+		if (sock->ids[i] != NULL)
+			reqs[n++] = sock->ids[i];
+	}
+
+	close(sock->fd);
+	sock->fd = -1;
+	sock->rlen = 0;
+	sock->wlen = 0;
+
+	for (i = 0; i < n; i++)
+		async_conn_lost(rh, reqs[i]);
+}
+/// @endcond
+
+/* Handles whatever is ready on a socket: queued replies and, for
+ * RADIUS/TCP, pending output and connection failures.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param sidx the socket index.
+ */
+/// @cond INTERNAL
+static void async_service(rc_handle *rh, unsigned sidx)
+{
+	struct async_sock *sock = rh->async->socks[sidx];
+
+	if (sock->fd < 0)
+		return;
+
+	if (!sock->stream) {
+		async_read(rh, sidx);
+		return;
+	}
+
+	async_stream_flush(sock);
+	async_read_stream(rh, sidx);
+	if (sock->error != 0)
+		async_sock_fail(rh, sidx);
+}
+/// @endcond
+
+/* Creates a request and starts its first attempt
+ *
+ * @param rh a handle to parsed configuration.
+ * @param nas_port see rc_aaa_submit().
+ * @param send see rc_aaa_submit().
+ * @param add_nas_port see rc_aaa_submit().
+ * @param request_type see rc_aaa_submit().
+ * @param cb see rc_aaa_submit().
+ * @param arg see rc_aaa_submit().
+ * @param defer if non-zero, the packet is built and queued for
+ *  async_flush() instead of being sent.
+ * @return OK_RC or a negative rc_send_status; @p cb is only ever called
+ *  on OK_RC.
+ */
+/// @cond INTERNAL
+static int async_submit(rc_handle *rh, uint32_t nas_port, VALUE_PAIR *send,
+			int add_nas_port, rc_standard_codes request_type,
+			rc_aaa_cb cb, void *arg, int defer)
+{
+	struct rc_async *as;
+	struct async_req **outq;
+	struct async_req *req;
+	int result, budget;
+
+	if (cb == NULL)
+		return ERROR_RC;
+
+	if (rh->so_type != RC_SOCKET_UDP && rh->so_type != RC_SOCKET_TCP) {
+		rc_log(LOG_ERR, "%s: only UDP and TCP transports are supported",
+		       __func__);
+		return ERROR_RC;
+	}
+
+	if (async_init(rh) != 0 || heap_reserve(rh->async) != 0)
+		return ERROR_RC;
+	as = rh->async;
+
+	if (defer && as->outq_size == as->outq_alloc) {
+		outq = realloc(as->outq, (as->outq_alloc + ASYNC_SEND_BATCH) *
+			       sizeof(*outq));
+		if (outq == NULL) {
+			rc_log(LOG_CRIT, "%s: out of memory", __func__);
+			return ERROR_RC;
+		}
+		as->outq = outq;
+		as->outq_alloc += ASYNC_SEND_BATCH;
+	}
+
+	req = calloc(1, sizeof(*req));
+	if (req == NULL) {
+		rc_log(LOG_CRIT, "%s: out of memory", __func__);
+		return ERROR_RC;
+	}
+	req->sock = -1;
+	req->iter.start = -1;
+	req->iter.current = -1;
+	req->cb = cb;
+	req->arg = arg;
+
+	if (rc_select_aaa_server(rh, &req->aaaserver, &req->type,
+				 request_type) != OK_RC ||
+	    req->aaaserver->max == 0) {
+		result = ERROR_RC;
+		goto fail;
+	}
+
+	if (send != NULL) {
+		req->data.send_pairs = rc_avpair_copy(send);
+		if (req->data.send_pairs == NULL) {
+			result = ERROR_RC;
+			goto fail;
+		}
+	}
+
+	if (rc_fill_acct_pairs(rh, &req->data, nas_port, add_nas_port,
+			       request_type, &req->adt_vp,
+			       &req->start_time) != OK_RC) {
+		result = ERROR_RC;
+		goto fail;
+	}
+
+	req->data.code = request_type;
+	req->data.timeout = rc_conf_int(rh, "radius_timeout");
+	req->timeout = rc_conf_timeout_ms(rh) / 1000.0;
+	req->retries = rc_conf_int(rh, "radius_retries");
+	budget = rc_conf_int_default(rh, "radius_deadline_ms", 0);
+	if (budget > 0)
+		req->expires = rc_getmtime() + budget / 1000.0;
+
+	result = async_start(rh, req, defer, ERROR_RC);
+	if (result != OK_RC)
+		goto fail;
+
+	heap_push(as, req);
+	if (defer)
+		as->outq[as->outq_size++] = req;
+	return OK_RC;
+
+ fail:
+	rc_server_end(rh, req->aaaserver, &req->iter);
+	async_release(as, req);
+	async_req_free(req);
+	return result;
+}
+/// @endcond
+
+/* Sends the packets queued by async_submit()
+ *
+ * Packets that share a socket go out together, up to ASYNC_SEND_BATCH
+ * per sendmmsg() call where that is available. On a RADIUS/TCP
+ * connection they are written with a single send().
+ *
+ * @param rh a handle to parsed configuration.
+ */
+/// @cond INTERNAL
+static void async_flush(rc_handle *rh)
+{
+	struct rc_async *as = rh->async;
+	struct async_req *reqs[ASYNC_SEND_BATCH];
+	unsigned i, n;
+	int sidx;
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[ASYNC_SEND_BATCH];
+	struct iovec iov[ASYNC_SEND_BATCH];
+	unsigned sent;
+	int ret;
+#endif
+
+	while (as->outq_size > 0) {
+		/* take the queued requests that share the first one's socket */
+		sidx = as->outq[0]->sock;
+		n = 0;
+		for (i = 0; i < as->outq_size && n < ASYNC_SEND_BATCH;) {
+			if (as->outq[i]->sock == sidx) {
+				reqs[n++] = as->outq[i];
+				as->outq[i] = as->outq[--as->outq_size];
+			} else {
+				i++;
+			}
+		}
+
+		if (as->socks[sidx]->stream) {
+			for (i = 0; i < n; i++)
+				async_next(rh, reqs[i],
+					   async_stream_queue(as->socks[sidx],
+							      reqs[i]->packet,
+							      reqs[i]->packet_len));
+			async_stream_flush(as->socks[sidx]);
+			continue;
+		}
+
+#ifdef HAVE_SENDMMSG
+		memset(msgs, 0, n * sizeof(msgs[0]));
+		for (i = 0; i < n; i++) {
+			iov[i].iov_base = reqs[i]->packet;
+			iov[i].iov_len = reqs[i]->packet_len;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = reqs[i]->dest->ai_addr;
+			msgs[i].msg_hdr.msg_namelen = reqs[i]->dest->ai_addrlen;
+		}
+
+		for (sent = 0; sent < n;) {
+			ret = sendmmsg(as->socks[sidx]->fd, msgs + sent, n - sent, 0);
+			if (ret == -1 && errno == EINTR)
+				continue;
+			if (ret > 0) {
+				sent += ret;
+				continue;
+			}
+			/* the first unsent packet failed; the rest are retried */
+			async_next(rh, reqs[sent], async_send_error(errno));
+			sent++;
+		}
+#else
+		for (i = 0; i < n; i++)
+			async_next(rh, reqs[i], async_transmit(rh, reqs[i]));
+#endif
+	}
+}
+/// @endcond
+
+/** Submits an authentication or accounting request without waiting for the reply
+ *
+ * Builds the request like rc_aaa() and sends it to the first configured
+ * server. The outcome is reported through @p cb, called from
+ * rc_aaa_dispatch() once a reply arrives or every server has timed out.
+ * UDP and TCP transports are supported; with TCP, connecting to the
+ * server does not block, and the request is sent once the connection
+ * is established.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param nas_port the physical NAS port number to include (may be zero).
+ * @param send VALUE_PAIR list of attributes to send; it is copied, and
+ *  remains owned by the caller.
+ * @param add_nas_port if non-zero, PW_NAS_PORT is added to the sent pairs.
+ * @param request_type one of the standard RADIUS codes (e.g., PW_ACCESS_REQUEST).
+ * @param cb the completion callback.
+ * @param arg passed unchanged to @p cb.
+ * @return OK_RC (0) if the request was sent, in which case @p cb will be
+ *  called exactly once; a negative rc_send_status if it could not be, in
+ *  which case @p cb is never called.
+ */
+int rc_aaa_submit(rc_handle *rh, uint32_t nas_port, VALUE_PAIR *send,
+		  int add_nas_port, rc_standard_codes request_type,
+		  rc_aaa_cb cb, void *arg)
+{
+	return async_submit(rh, nas_port, send, add_nas_port, request_type,
+			    cb, arg, 0);
+}
+
+/// @cond INTERNAL
+struct batch_ent {
+	int result;
+	unsigned *remaining;
+};
+
+static void batch_done(rc_handle *rh, int result, VALUE_PAIR *received,
+		       void *arg)
+{
+	struct batch_ent *ent = arg;
+
+	rc_avpair_free(received);
+	ent->result = result;
+	(*ent->remaining)--;
+}
+
+/* Completes the batch requests still pending with ERROR_RC
+ *
+ * @param rh a handle to parsed configuration.
+ */
+static void batch_fail(rc_handle *rh)
+{
+	struct rc_async *as = rh->async;
+	unsigned i = 0;
+
+	/* completing a request reorders the heap, so rescan from the top */
+	while (i < as->heap_size) {
+		if (as->heap[i]->cb != batch_done) {
+			i++;
+			continue;
+		}
+		async_complete(rh, as->heap[i], ERROR_RC, NULL);
+		i = 0;
+	}
+}
+
+/* Processes events until at most @p limit batch requests are pending
+ *
+ * @param rh a handle to parsed configuration.
+ * @param remaining the number of batch requests still pending.
+ * @param limit the number of batch requests that may stay pending.
+ * @return 0 on success, or -1 if waiting failed, in which case every
+ *  pending batch request has been completed with ERROR_RC.
+ */
+static int batch_wait(rc_handle *rh, unsigned *remaining, unsigned limit)
+{
+	async_flush(rh);
+
+	while (*remaining > limit && rc_aaa_pending(rh) > 0) {
+		if (rc_aaa_dispatch(rh, -1) < 0) {
+			batch_fail(rh);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+/// @endcond
+
+/** Sends a batch of accounting requests and waits for all of them to complete
+ *
+ * Each request is built as with rc_acct() and sent through the
+ * asynchronous engine, so that up to 256 requests share each socket.
+ * Packets are pushed with sendmmsg() and replies collected with
+ * recvmmsg() where the system provides them. Retransmission and server
+ * failover apply to each request individually. UDP and TCP transports
+ * are supported.
+ *
+ * Requests already submitted with rc_aaa_submit() on the same handle
+ * keep being processed, and their callbacks may run from within this
+ * call. It must not be called from such a callback.
+ *
+ * If waiting for replies fails, the requests still pending are
+ * completed with ERROR_RC and the rest of the batch is not sent.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param nas_port the physical NAS port number to include (may be zero).
+ * @param sends an array of @p count VALUE_PAIR lists; NAS-Port and
+ *  Acct-Delay-Time are filled in as with rc_acct(). The lists are copied
+ *  and remain owned by the caller.
+ * @param count the number of requests.
+ * @param results if non-NULL, an array of @p count entries that receives
+ *  the rc_send_status of each request.
+ * @return the number of requests acknowledged by a server, or ERROR_RC
+ *  if none could be sent.
+ */
+int rc_acct_batch(rc_handle *rh, uint32_t nas_port, VALUE_PAIR **sends,
+		  unsigned count, int *results)
+{
+	struct batch_ent *ents;
+	unsigned i, remaining = 0, submitted = 0;
+	int ok = 0, ret;
+
+	if (count == 0)
+		return 0;
+
+	ents = calloc(count, sizeof(*ents));
+	if (ents == NULL) {
+		rc_log(LOG_CRIT, "%s: out of memory", __func__);
+		return ERROR_RC;
+	}
+
+	/* requests never sent, or lost track of, count as failed */
+	for (i = 0; i < count; i++)
+		ents[i].result = ERROR_RC;
+
+	for (i = 0; i < count; i++) {
+		ents[i].remaining = &remaining;
+		ret = async_submit(rh, nas_port, sends[i], 1,
+				   PW_ACCOUNTING_REQUEST, batch_done,
+				   &ents[i], 1);
+		if (ret != OK_RC) {
+			ents[i].result = ret;
+			continue;
+		}
+		remaining++;
+		submitted++;
+
+		if (remaining >= ASYNC_BATCH_WINDOW &&
+		    batch_wait(rh, &remaining, ASYNC_BATCH_WINDOW - 1) < 0)
+			break;
+	}
+
+	if (i == count && submitted > 0)
+		batch_wait(rh, &remaining, 0);
+
+	for (i = 0; i < count; i++) {
+		if (results != NULL)
+			results[i] = ents[i].result;
+		if (ents[i].result == OK_RC)
+			ok++;
+	}
+	free(ents);
+
+	return submitted > 0 ? ok : ERROR_RC;
+}
+
+/* Runs the timers of every request whose deadline has passed
+ *
+ * @param rh a handle to parsed configuration.
+ */
+/// @cond INTERNAL
+static void async_run_timers(rc_handle *rh)
+{
+	struct rc_async *as = rh->async;
+	double now = rc_getmtime();
+
+	while (as->heap_size > 0 && as->heap[0]->deadline <= now)
+		async_expire(rh, as->heap[0]);
+}
+/// @endcond
+
+/** Returns the sockets the asynchronous engine needs watched, and for what
+ *
+ * For applications that run their own event loop instead of calling
+ * rc_aaa_dispatch(): each returned descriptor should be watched for the
+ * events given, POLLIN always and POLLOUT while a TCP connection is
+ * being established or has output its socket did not take yet, and
+ * rc_process_events() called when any of them occurs. The array can be
+ * passed to poll() as it is. A call to rc_aaa_submit() may add a socket
+ * or queue output, and rc_process_events() may send the output queued or
+ * replace a connection the server closed, so the set should be queried
+ * again after either. The descriptors remain owned by radcli and are
+ * closed by rc_destroy().
+ *
+ * @param rh a handle to parsed configuration.
+ * @param fds an array that receives up to @p max_fds entries, with
+ *  revents cleared.
+ * @param max_fds the size of @p fds.
+ * @return the total number of engine sockets, which may exceed @p max_fds.
+ */
+unsigned rc_aaa_fds(rc_handle *rh, struct pollfd *fds, unsigned max_fds)
+{
+	struct rc_async *as = rh->async;
+	struct async_sock *sock;
+	unsigned i, n = 0;
+
+	if (as == NULL)
+		return 0;
+
+	for (i = 0; i < as->nsocks; i++) {
+		sock = as->socks[i];
+		if (sock->fd < 0)
+			continue;
+		if (n < max_fds) {
+			fds[n].fd = sock->fd;
+			fds[n].events = sock->wlen ? POLLIN | POLLOUT : POLLIN;
+			fds[n].revents = 0;
+		}
+		n++;
+	}
+
+	return n;
+}
+
+/** Returns the time until the asynchronous engine next needs to run
+ *
+ * rc_process_events() should be called when this time has elapsed, even
+ * if none of the events rc_aaa_fds() asked for occurred, so that
+ * requests are retransmitted or failed over.
+ *
+ * @param rh a handle to parsed configuration.
+ * @return the delay in milliseconds, 0 if a timer has already expired,
+ *  or -1 if no request is pending.
+ */
+int rc_aaa_timeout(rc_handle *rh)
+{
+	struct rc_async *as = rh->async;
+	double delta;
+
+	if (as == NULL || as->heap_size == 0)
+		return -1;
+
+	delta = as->heap[0]->deadline - rc_getmtime();
+	if (delta <= 0)
+		return 0;
+	if (delta > INT_MAX / 1000)
+		return INT_MAX;
+
+	/* rounded up, so that a wake-up is never early */
+	return (int)(delta * 1000) + 1;
+}
+
+/** Processes the pending replies and expired timers without blocking
+ *
+ * Reads every reply queued on the sockets reported by rc_aaa_fds(),
+ * completes the requests they answer, writes the output pending on TCP
+ * connections that their sockets take, and retransmits, fails over or
+ * times out the requests whose deadline has passed. Callbacks run from
+ * within this call; they may submit new requests, but must not call
+ * rc_process_events(), rc_aaa_dispatch() or rc_destroy().
+ *
+ * @param rh a handle to parsed configuration.
+ * @return the number of requests still pending.
+ */
+int rc_process_events(rc_handle *rh)
+{
+	struct rc_async *as = rh->async;
+	unsigned i, nsocks;
+
+	if (as == NULL)
+		return 0;
+
+	/* idle sockets are drained too, since a level-triggered loop
+	 * would otherwise keep reporting a stale reply queued on them */
+	nsocks = as->nsocks;
+	for (i = 0; i < nsocks; i++)
+		async_service(rh, i);
+
+	async_run_timers(rh);
+
+	return rc_aaa_pending(rh);
+}
+
+/** Waits for and processes replies and timeouts of submitted requests
+ *
+ * Waits until a reply arrives, the next retransmission is due, or
+ * @p timeout_ms elapses, then runs the callbacks of every request that
+ * completed. Callbacks may submit new requests, but must not call
+ * rc_aaa_dispatch() or rc_destroy(). Applications with their own event
+ * loop can use rc_aaa_fds(), rc_aaa_timeout() and rc_process_events()
+ * instead.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param timeout_ms the maximum time to wait in milliseconds, or -1 to
+ *  wait until the next request event.
+ * @return the number of requests still pending, or -1 on error.
+ */
+int rc_aaa_dispatch(rc_handle *rh, int timeout_ms)
+{
+	struct rc_async *as = rh->async;
+	struct async_sock *sock;
+	unsigned i, nsocks;
+	int wait, ret;
+
+	if (as == NULL || as->heap_size == 0)
+		return 0;
+
+	wait = rc_aaa_timeout(rh);
+	if (timeout_ms >= 0 && timeout_ms < wait)
+		wait = timeout_ms;
+
+	nsocks = as->nsocks;
+	for (i = 0; i < nsocks; i++) {
+		sock = as->socks[i];
+		as->pfds[i].fd = sock->inflight || sock->wlen || sock->error ?
+				 sock->fd : -1;
+		as->pfds[i].events = sock->wlen ? POLLIN | POLLOUT : POLLIN;
+		as->pfds[i].revents = 0;
+	}
+
+	ret = poll(as->pfds, nsocks, wait);
+	if (ret == -1 && errno != EINTR) {
+		rc_log(LOG_ERR, "%s: poll: %s", __func__, strerror(errno));
+		return -1;
+	}
+
+	/* callbacks may add sockets, which moves pfds but keeps its
+	 * contents; connections marked failed are closed whether ready or not */
+	for (i = 0; i < nsocks; i++) {
+		if ((as->pfds[i].revents & (POLLIN | POLLOUT | POLLERR | POLLHUP)) ||
+		    as->socks[i]->error != 0)
+			async_service(rh, i);
+	}
+
+	async_run_timers(rh);
+
+	return rc_aaa_pending(rh);
+}
+
+/** Returns the number of submitted requests that have not completed yet
+ *
+ * @param rh a handle to parsed configuration.
+ * @return the number of pending requests.
+ */
+unsigned rc_aaa_pending(rc_handle *rh)
+{
+	if (rh->async == NULL)
+		return 0;
+
+	return rh->async->heap_size - rh->async->hedges;
+}
+
+/* Releases the engine state of a handle
+ *
+ * Requests still pending are dropped without running their callbacks.
+ *
+ * @param rh a handle to parsed configuration.
+ */
+/// @cond INTERNAL
+void rc_async_free(rc_handle *rh)
+{
+	struct rc_async *as = rh->async;
+	unsigned i;
+
+	if (as == NULL)
+		return;
+
+	for (i = 0; i < as->heap_size; i++) {
+		free(as->heap[i]->packet);
+		if (as->heap[i]->dest != NULL)
+			rc_addrinfo_free(as->heap[i]->dest);
+		async_req_free(as->heap[i]);
+	}
+
+	for (i = 0; i < as->nsocks; i++) {
+		if (as->socks[i]->fd >= 0)
+			close(as->socks[i]->fd);
+		free(as->socks[i]->rbuf);
+		free(as->socks[i]->wbuf);
+		free(as->socks[i]);
+	}
+
+	free(as->heap);
+	free(as->outq);
+	free(as->socks);
+	free(as->pfds);
+#ifdef HAVE_RECVMMSG
+	free(as->rbuf);
+#endif
+	free(as);
+	rh->async = NULL;
+}
+/// @endcond
+
+/** @} */
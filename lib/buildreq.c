@@ -58,7 +58,8 @@ void rc_buildreq(rc_handle const *rh, SEND_DATA * data, int code, char *server,
 
 /** @brief Selects the server list and rc_type for a request based on transport and request type
  *
- * @note Internal helper shared by rc_aaa_ctx() and rc_acct_async().
+ * @note Internal helper shared by rc_aaa_ctx(), rc_acct_async() and
+ * rc_aaa_submit().
  *
  * @param rh a handle to parsed configuration.
  * @param aaaserver receives the selected SERVER list from configuration.
@@ -66,8 +67,9 @@ void rc_buildreq(rc_handle const *rh, SEND_DATA * data, int code, char *server,
  * @param request_type one of the standard RADIUS codes (e.g., PW_ACCESS_REQUEST).
  * @return OK_RC (0) on success, ERROR_RC if no matching servers are configured.
  */
-static int rc_select_aaa_server(rc_handle *rh, SERVER **aaaserver,
-				rc_type *type, rc_standard_codes request_type)
+/// @cond INTERNAL
+int rc_select_aaa_server(rc_handle *rh, SERVER **aaaserver,
+			 rc_type *type, rc_standard_codes request_type)
 {
 	if (rh->so_type == RC_SOCKET_TLS || rh->so_type == RC_SOCKET_DTLS ||
 	    request_type != PW_ACCOUNTING_REQUEST) {
@@ -83,11 +85,12 @@ static int rc_select_aaa_server(rc_handle *rh, SERVER **aaaserver,
 
 	return OK_RC;
 }
+/// @endcond
 
 /** @brief Fills in NAS-Port and Acct-Delay-Time on a request being built
  *
- * @note Internal helper shared by rc_aaa_ctx_server() and
- * rc_aaa_ctx_server_async().
+ * @note Internal helper shared by rc_aaa_ctx_server(),
+ * rc_aaa_ctx_server_async() and rc_aaa_submit().
  *
  * @param rh a handle to parsed configuration.
  * @param data the request being built; @c send_pairs is extended in place.
@@ -99,10 +102,11 @@ static int rc_select_aaa_server(rc_handle *rh, SERVER **aaaserver,
  * @param start_time receives the time the delay is measured from.
  * @return OK_RC (0) on success, ERROR_RC on failure.
  */
-static int rc_fill_acct_pairs(rc_handle const *rh, SEND_DATA *data,
-			      uint32_t nas_port, int add_nas_port,
-			      rc_standard_codes request_type,
-			      VALUE_PAIR **adt_vp, double *start_time)
+/// @cond INTERNAL
+int rc_fill_acct_pairs(rc_handle const *rh, SEND_DATA *data,
+		       uint32_t nas_port, int add_nas_port,
+		       rc_standard_codes request_type,
+		       VALUE_PAIR **adt_vp, double *start_time)
 {
 	time_t dtime;
 	double now;
@@ -138,6 +142,317 @@ static int rc_fill_acct_pairs(rc_handle const *rh, SEND_DATA *data,
 
 	return OK_RC;
 }
+/// @endcond
+
+/* Reads the balancing options of server list @name into @b */
+/// @cond INTERNAL
+static int balance_init(rc_handle *rh, char const *name, struct rc_balance *b)
+{
+	static char const *const policies[] = {
+		[RC_BALANCE_FAILOVER] = "failover",
+		[RC_BALANCE_ROUND_ROBIN] = "round-robin",
+		[RC_BALANCE_WEIGHTED] = "weighted",
+		[RC_BALANCE_LEAST_OUTSTANDING] = "least-outstanding",
+	};
+	SERVER *srv = rc_conf_srv(rh, name);
+	char option[32];
+	char const *txt, *p;
+	char *end;
+	long w;
+	int i;
+
+	memset(b, 0, sizeof(*b));
+	for (i = 0; i < RC_SERVER_MAX; i++)
+		b->weight[i] = 1;
+
+	snprintf(option, sizeof(option), "%s-balance", name);
+	txt = rc_conf_str(rh, option);
+	if (txt != NULL) {
+		for (i = 0; i < (int)(sizeof(policies) / sizeof(policies[0])); i++) {
+			if (strcasecmp(txt, policies[i]) == 0)
+				break;
+		}
+		if (i == (int)(sizeof(policies) / sizeof(policies[0]))) {
+			rc_log(LOG_ERR, "%s: unknown %s: %s", __func__, option, txt);
+			return -1;
+		}
+		b->policy = i;
+	}
+
+	snprintf(option, sizeof(option), "%s-weights", name);
+	txt = rc_conf_str(rh, option);
+	if (txt == NULL)
+		return 0;
+
+	p = txt;
+	for (i = 0; ; i++) {
+		errno = 0;
+		w = strtol(p, &end, 10);
+		if (end == p || errno != 0 || w < 1 || w > 1000 ||
+		    i >= RC_SERVER_MAX || (srv != NULL && i >= srv->max)) {
+			rc_log(LOG_ERR, "%s: invalid %s: %s", __func__, option, txt);
+			return -1;
+		}
+		b->weight[i] = w;
+
+		p = end + strspn(end, " \t");
+		if (*p == '\0')
+			break;
+		if (*p != ',') {
+			rc_log(LOG_ERR, "%s: invalid %s: %s", __func__, option, txt);
+			return -1;
+		}
+		p++;
+	}
+
+	return 0;
+}
+/// @endcond
+
+/** Reads the load balancing options of the configured server lists
+ *
+ * authserver-balance and acctserver-balance select the policy of each
+ * list; authserver-weights and acctserver-weights the weights of its
+ * servers for the weighted policy, as comma separated integers in the
+ * order of the list. Servers without a weight have weight 1.
+ *
+ * @param rh a handle to parsed configuration.
+ * @return 0 on success, -1 on an invalid option.
+ */
+/// @cond INTERNAL
+int rc_balance_init(rc_handle *rh)
+{
+	if (balance_init(rh, "authserver", &rh->balance[0]) < 0 ||
+	    balance_init(rh, "acctserver", &rh->balance[1]) < 0)
+		return -1;
+
+	return 0;
+}
+/// @endcond
+
+/* The balancing state of a configured server list, or NULL for a list
+ * an application passed to rc_aaa_ctx_server(), which is used in order.
+ */
+/// @cond INTERNAL
+static struct rc_balance *server_balance(rc_handle *rh, SERVER *aaaserver)
+{
+	if (aaaserver == rc_conf_srv(rh, "authserver"))
+		return &rh->balance[0];
+	if (aaaserver == rc_conf_srv(rh, "acctserver"))
+		return &rh->balance[1];
+	return NULL;
+}
+
+/* The first server from @from on, wrapping around, that @usable allows */
+static int server_from(int const *usable, int n, int from)
+{
+	int i, k;
+
+	for (k = 0; k < n; k++) {
+		i = (from + k) % n;
+		if (usable[i])
+			return i;
+	}
+	return -1;
+}
+
+/* Stops counting the request at it->current as outstanding */
+static void server_release(struct rc_balance *b, struct rc_server_iter *it)
+{
+	if (it->current < 0)
+		return;
+
+	if (b != NULL && b->outstanding[it->current] > 0)
+		b->outstanding[it->current]--;
+	it->current = -1;
+}
+/// @endcond
+
+/* With radius_deadtime set, a server that timed out or was unreachable
+ * is skipped by the failover loops for that many seconds, recorded in
+ * SERVER.deadtime_ends[]. Afterwards the next request probes it with a
+ * single transmission, which other requests do not wait for. A value
+ * outside (0, now + radius_deadtime + radius_timeout], as in a SERVER
+ * an application did not zero, counts as a server that is up.
+ */
+
+/** Picks the next server of a list to send a request to
+ *
+ * The first server is chosen by the balancing policy of the list among
+ * those that are up; the request then fails over to the servers that
+ * follow it, wrapping around, skipping dead ones. When every server is
+ * dead, the one whose dead time ends first is probed rather than none.
+ * The request is counted as outstanding at the server until the next
+ * call or rc_server_end().
+ *
+ * @param rh a handle to parsed configuration.
+ * @param aaaserver the server list.
+ * @param it the servers this request tried, updated; initialized with
+ *	RC_SERVER_ITER_INIT.
+ * @param probe set to 1 if the server is to be sent a single transmission.
+ * @return the index of the server, or -1 when none is left to try.
+ */
+/// @cond INTERNAL
+int rc_server_next(rc_handle *rh, SERVER *aaaserver,
+		   struct rc_server_iter *it, int *probe)
+{
+	int deadtime = rc_conf_int_default(rh, "radius_deadtime", 0);
+	double timeout = rc_conf_timeout_ms(rh) / 1000.0;
+	struct rc_balance *b = server_balance(rh, aaaserver);
+	int policy = b != NULL ? b->policy : RC_BALANCE_FAILOVER;
+	int usable[RC_SERVER_MAX]; /* 1 if up, 2 if to be probed */
+	int i, n, total, pick = -1, first = -1;
+	double now = 0, ends;
+
+	*probe = 0;
+	n = aaaserver->max;
+	if (n > RC_SERVER_MAX)
+		n = RC_SERVER_MAX;
+	if (n <= 0)
+		return -1;
+
+	if (deadtime <= 0 && policy == RC_BALANCE_FAILOVER) {
+		for (i = 0; i < n; i++) {
+			if (!(it->tried & (1u << i))) {
+				it->tried |= 1u << i;
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	if (deadtime > 0)
+		now = rc_getmtime();
+
+	pthread_mutex_lock(&rh->lock);
+	server_release(b, it);
+
+	for (i = 0; i < n; i++) {
+		usable[i] = 0;
+		if (it->tried & (1u << i))
+			continue;
+
+		ends = deadtime > 0 ? aaaserver->deadtime_ends[i] : 0;
+		if (!(ends > 0 && ends <= now + deadtime + timeout))
+			usable[i] = 1;
+		else if (ends <= now)
+			usable[i] = 2;
+		else if (first < 0 || ends < aaaserver->deadtime_ends[first])
+			first = i;
+	}
+
+	switch (policy) {
+	case RC_BALANCE_ROUND_ROBIN:
+		if (it->start < 0) {
+			it->start = server_from(usable, n, b->next % n);
+			if (it->start >= 0)
+				b->next = it->start + 1;
+		}
+		pick = server_from(usable, n, it->start < 0 ? 0 : it->start);
+		break;
+	case RC_BALANCE_WEIGHTED:
+		if (it->start < 0) {
+			/* smooth weighted round-robin among the servers up */
+			total = 0;
+			for (i = 0; i < n; i++) {
+				if (!usable[i])
+					continue;
+				b->credit[i] += b->weight[i];
+				total += b->weight[i];
+				if (it->start < 0 || b->credit[i] > b->credit[it->start])
+					it->start = i;
+			}
+			if (it->start >= 0)
+				b->credit[it->start] -= total;
+		}
+		pick = server_from(usable, n, it->start < 0 ? 0 : it->start);
+		break;
+	case RC_BALANCE_LEAST_OUTSTANDING:
+		/* ties go round-robin */
+		for (i = 0; i < n; i++) {
+			int j = (b->next + i) % n;
+			if (usable[j] && (pick < 0 ||
+			    b->outstanding[j] < b->outstanding[pick]))
+				pick = j;
+		}
+		if (pick >= 0)
+			b->next = pick + 1;
+		break;
+	default:
+		pick = server_from(usable, n, 0);
+		break;
+	}
+
+	if (pick >= 0 && usable[pick] == 2) {
+		/* dead time is over; others skip it during the probe */
+		aaaserver->deadtime_ends[pick] = now + timeout;
+		*probe = 1;
+	} else if (pick < 0 && it->tried == 0 && first >= 0) {
+		pick = first;
+		*probe = 1;
+	}
+
+	if (pick >= 0) {
+		it->tried |= 1u << pick;
+		if (b != NULL) {
+			b->outstanding[pick]++;
+			it->current = pick;
+		}
+	}
+	pthread_mutex_unlock(&rh->lock);
+
+	return pick;
+}
+/// @endcond
+
+/** Ends a request rc_server_next() picked servers for
+ *
+ * @param rh a handle to parsed configuration.
+ * @param aaaserver the server list.
+ * @param it the servers the request tried.
+ */
+/// @cond INTERNAL
+void rc_server_end(rc_handle *rh, SERVER *aaaserver, struct rc_server_iter *it)
+{
+	if (it->current < 0)
+		return;
+
+	pthread_mutex_lock(&rh->lock);
+	server_release(server_balance(rh, aaaserver), it);
+	pthread_mutex_unlock(&rh->lock);
+}
+/// @endcond
+
+/** Records the outcome of a request to a server
+ *
+ * A server is marked dead for radius_deadtime seconds when it timed out
+ * or was unreachable, and up when it answered.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param aaaserver the server list.
+ * @param servernum the index of the server in @p aaaserver.
+ * @param result the rc_send_status of the request.
+ */
+/// @cond INTERNAL
+void rc_server_result(rc_handle *rh, SERVER *aaaserver, unsigned servernum,
+		      int result)
+{
+	int deadtime = rc_conf_int_default(rh, "radius_deadtime", 0);
+
+	if (deadtime <= 0 || result == ERROR_RC)
+		return;
+
+	pthread_mutex_lock(&rh->lock);
+	if (result == TIMEOUT_RC || result == NETUNREACH_RC) {
+		rc_log(LOG_WARNING, "%s: server %s is marked dead for %d seconds",
+		       __func__, aaaserver->name[servernum], deadtime);
+		aaaserver->deadtime_ends[servernum] = rc_getmtime() + deadtime;
+	} else {
+		aaaserver->deadtime_ends[servernum] = 0;
+	}
+	pthread_mutex_unlock(&rh->lock);
+}
+/// @endcond
 
 /** @brief Builds an authentication/accounting request and submits it to a server, optionally returning context
  *
@@ -213,10 +528,14 @@ int rc_aaa_ctx_server(rc_handle * rh, RC_AAA_CTX ** ctx, SERVER * aaaserver,
 	VALUE_PAIR *adt_vp = NULL;
 	int result;
 	int timeout = rc_conf_int(rh, "radius_timeout");
+	int timeout_ms = rc_conf_timeout_ms(rh);
 	int retries = rc_conf_int(rh, "radius_retries");
+	int budget = rc_conf_int_default(rh, "radius_deadline_ms", 0);
+	double deadline = budget > 0 ? rc_getmtime() + budget / 1000.0 : 0;
 	double start_time = 0;
 	time_t dtime;
-	int servernum;
+	struct rc_server_iter it = RC_SERVER_ITER_INIT;
+	int servernum, probe;
 
 	data.send_pairs = send;
 	data.receive_pairs = NULL;
@@ -230,18 +549,35 @@ int rc_aaa_ctx_server(rc_handle * rh, RC_AAA_CTX ** ctx, SERVER * aaaserver,
 		data.receive_pairs = NULL;
 	}
 
-	servernum = 0;
-	do {
+	result = ERROR_RC;
+	for (;;) {
+		if (deadline > 0 && rc_getmtime() >= deadline) {
+			rc_log(LOG_ERR, "%s: no reply within radius_deadline_ms",
+			       __func__);
+			result = TIMEOUT_RC;
+			break;
+		}
+
+		servernum = rc_server_next(rh, aaaserver, &it, &probe);
+		if (servernum < 0)
+			break;
+
 		rc_buildreq(rh, &data, request_type, aaaserver->name[servernum],
 			    aaaserver->port[servernum],
-			    aaaserver->secret[servernum], timeout, retries);
+			    aaaserver->secret[servernum], timeout,
+			    probe ? 0 : retries);
 
 		if (request_type == PW_ACCOUNTING_REQUEST) {
 			dtime = rc_getmtime() - start_time;
 			rc_avpair_assign(adt_vp, &dtime, 0);
 		}
 
-		result = rc_send_server_ctx(rh, ctx, &data, msg, type, 0);
+		result = rc_send_server_ctx(rh, ctx, &data, msg, type, 0,
+					    timeout_ms, deadline);
+		/* a server cut short by the deadline is not known to be dead */
+		if (result != TIMEOUT_RC || deadline == 0 ||
+		    rc_getmtime() < deadline)
+			rc_server_result(rh, aaaserver, servernum, result);
 
 		if ((result == OK_RC) || (result == CHALLENGE_RC) || (result == REJECT_RC)) {
 			if (request_type != PW_ACCOUNTING_REQUEST) {
@@ -252,16 +588,19 @@ int rc_aaa_ctx_server(rc_handle * rh, RC_AAA_CTX ** ctx, SERVER * aaaserver,
 
 			DEBUG(LOG_INFO,
 			      "rc_send_server_ctx returned success for server %u", servernum);
+			rc_server_end(rh, aaaserver, &it);
 			return result;
 		}
 
 		rc_avpair_free(data.receive_pairs);
 		data.receive_pairs = NULL;
 
-		DEBUG(LOG_INFO, "rc_send_server_ctx returned error (%d) for server %u: (remaining: %d)",
-              result, servernum, aaaserver->max-servernum);
-		servernum++;
-	} while (servernum < aaaserver->max && ((result == TIMEOUT_RC) || (result == NETUNREACH_RC)));
+		DEBUG(LOG_INFO, "rc_send_server_ctx returned error (%d) for server %d",
+              result, servernum);
+		if ((result != TIMEOUT_RC) && (result != NETUNREACH_RC))
+			break;
+	}
+	rc_server_end(rh, aaaserver, &it);
 
 	return result;
 }
@@ -403,7 +742,7 @@ static int rc_aaa_ctx_server_async(rc_handle * rh, SERVER * aaaserver,
 			    aaaserver->port[servernum],
 			    aaaserver->secret[servernum], timeout, retries);
 
-		result = rc_send_server_ctx(rh, NULL, &data, NULL, type, 1);
+		result = rc_send_server_ctx(rh, NULL, &data, NULL, type, 1, 0, 0);
 
 		if (data.receive_pairs != NULL) {
 			rc_avpair_free(data.receive_pairs);
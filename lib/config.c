@@ -23,9 +23,15 @@
 #include <includes.h>
 #include <radcli/radcli.h>
 #include <options.h>
+#include <poll.h>
 #include "util.h"
 #include "tls.h"
-#include "dict_rfc_gen.h"
+#include "sockpool.h"
+#include "resolve.h"
+#include "servers.h"
+#include "rtt.h"
+#include "srcaddr.h"
+#include "async.h"
 
 #ifndef TRUE
 #define TRUE  1
@@ -452,93 +458,246 @@ static ssize_t plain_sendto(void *ptr, int sockfd,
 }
 /// @endcond
 
+/* With udp-connect the socket is connected to the server already, and
+ * some systems refuse a destination address on a connected socket. */
 /// @cond INTERNAL
-static ssize_t plain_tcp_sendto(void *ptr, int sockfd,
-			    const void *buf, size_t len, int flags,
-			    const struct sockaddr *dest_addr, socklen_t addrlen)
+static ssize_t plain_connected_sendto(void *ptr, int sockfd,
+				      const void *buf, size_t len, int flags,
+				      const struct sockaddr *dest_addr,
+				      socklen_t addrlen)
 {
-	if((connect(sockfd, dest_addr, addrlen)) != 0){
-		rc_log(LOG_ERR, "%s: Connect Call Failed : %s", __FUNCTION__, strerror(errno));
-		return -1;
-	}
-	return sendto(sockfd, buf, len, flags, dest_addr, addrlen);
+	return send(sockfd, buf, len, flags);
 }
 /// @endcond
 
 /// @cond INTERNAL
-static ssize_t plain_recvfrom(void *ptr, int sockfd,
-			      void *buf, size_t len, int flags,
-			      struct sockaddr *src_addr, socklen_t * addrlen)
+static ssize_t tcp_send_all(int sockfd, const void *buf, size_t len)
 {
-	return recvfrom(sockfd, buf, len, flags, src_addr, addrlen);
+	const uint8_t *p = buf;
+	size_t off = 0;
+	ssize_t ret;
+
+	while (off < len) {
+		ret = send(sockfd, p + off, len - off, MSG_NOSIGNAL);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		off += ret;
+	}
+	return len;
 }
 /// @endcond
 
+/* Replaces the connection behind @sockfd with a new one to the same
+ * server, keeping the descriptor number the caller holds. */
 /// @cond INTERNAL
-static void plain_close_fd(int fd)
+static int tcp_reconnect(rc_handle const *rh, int sockfd,
+			 const struct sockaddr *dest_addr, socklen_t addrlen)
 {
+	struct sockaddr_storage ss;
+	socklen_t sslen = sizeof(ss);
+	int fd;
+
+	if (getsockname(sockfd, SA(&ss), &sslen) < 0)
+		return -1;
+
+	if (ss.ss_family == AF_INET)
+		((struct sockaddr_in *)&ss)->sin_port = 0;
+	else
+		((struct sockaddr_in6 *)&ss)->sin6_port = 0;
+
+	fd = rc_socket(rh, ss.ss_family, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	if (bind(fd, SA(&ss), sslen) < 0 ||
+	    connect(fd, dest_addr, addrlen) != 0 ||
+	    dup2(fd, sockfd) < 0) {
+		close(fd);
+		return -1;
+	}
+
 	close(fd);
+	return 0;
 }
 /// @endcond
 
+/* RADIUS/TCP (RFC 6613) keeps the connection to a server open across
+ * requests. A fresh socket from rc_sockpool_get_stream() is connected on
+ * its first send; a reused one the server has meanwhile closed is
+ * reconnected, either when that shows before sending or when the send
+ * fails. Any other failure discards the connection. */
 /// @cond INTERNAL
-static int plain_get_fd(void *ptr, struct sockaddr *our_sockaddr)
+static ssize_t plain_tcp_sendto(void *ptr, int sockfd,
+			    const void *buf, size_t len, int flags,
+			    const struct sockaddr *dest_addr, socklen_t addrlen)
 {
-	int sockfd;
-
-	sockfd = socket(our_sockaddr->sa_family, SOCK_DGRAM, 0);
-	if (sockfd < 0) {
+	struct sockaddr_storage peer;
+	socklen_t peerlen = sizeof(peer);
+	struct pollfd pfd;
+	ssize_t ret;
+	int reused;
+
+	reused = getpeername(sockfd, SA(&peer), &peerlen) == 0;
+	if (reused) {
+		/* nothing is expected to be readable before the request
+		 * goes out, except the end of the stream */
+		pfd.fd = sockfd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 0) != 0 &&
+		    tcp_reconnect(ptr, sockfd, dest_addr, addrlen) < 0) {
+			rc_log(LOG_ERR, "%s: Connect Call Failed : %s", __FUNCTION__, strerror(errno));
+			rc_sockpool_discard(ptr, sockfd);
+			return -1;
+		}
+	} else if ((connect(sockfd, dest_addr, addrlen)) != 0){
+		rc_log(LOG_ERR, "%s: Connect Call Failed : %s", __FUNCTION__, strerror(errno));
+		rc_sockpool_discard(ptr, sockfd);
 		return -1;
 	}
 
-	if (our_sockaddr->sa_family == AF_INET)
-		((struct sockaddr_in *)our_sockaddr)->sin_port = 0;
-	else
-		((struct sockaddr_in6 *)our_sockaddr)->sin6_port = 0;
+	ret = tcp_send_all(sockfd, buf, len);
+	if (ret < 0 && reused && (errno == EPIPE || errno == ECONNRESET)) {
+		DEBUG(LOG_INFO, "%s: connection closed by server, reconnecting",
+		      __func__);
+		if (tcp_reconnect(ptr, sockfd, dest_addr, addrlen) == 0)
+			ret = tcp_send_all(sockfd, buf, len);
+	}
 
-	if (bind(sockfd, SA(our_sockaddr), SA_LEN(our_sockaddr)) < 0) {
-		close(sockfd);
-		return -1;
+	if (ret < 0)
+		rc_sockpool_discard(ptr, sockfd);
+	return ret;
+}
+/// @endcond
+
+/// @cond INTERNAL
+static int tcp_recv_all(int sockfd, uint8_t *buf, size_t len)
+{
+	size_t off = 0;
+	ssize_t ret;
+
+	while (off < len) {
+		ret = recv(sockfd, buf + off, len - off, 0);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret == 0)
+			errno = ECONNRESET;
+		if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			errno = ETIMEDOUT;
+		if (ret <= 0)
+			return -1;
+		off += ret;
 	}
-	return sockfd;
+	return 0;
 }
 /// @endcond
 
+/* Reads exactly one packet off a RADIUS/TCP stream, delimited by the
+ * Length field of its header; the stream carries no other framing
+ * (RFC 6613). A closed connection is reported as ECONNRESET and left to
+ * plain_tcp_sendto() to reconnect. A short read or an invalid length
+ * leaves the stream at an unknown position, so the connection is
+ * discarded. */
 /// @cond INTERNAL
-static int plain_tcp_get_fd(void *ptr, struct sockaddr *our_sockaddr)
+static ssize_t plain_tcp_recvfrom(void *ptr, int sockfd,
+				  void *buf, size_t len, int flags,
+				  struct sockaddr *src_addr, socklen_t *addrlen)
 {
-	int sockfd;
+	uint8_t *p = buf;
+	size_t plen;
 
-	sockfd = socket(our_sockaddr->sa_family, SOCK_STREAM, 0);
-	if (sockfd < 0) {
+	if (len < AUTH_HDR_LEN) {
+		errno = EINVAL;
 		return -1;
 	}
 
-	if (our_sockaddr->sa_family == AF_INET)
-		((struct sockaddr_in *)our_sockaddr)->sin_port = 0;
-	else
-		((struct sockaddr_in6 *)our_sockaddr)->sin6_port = 0;
+	if (tcp_recv_all(sockfd, p, 4) < 0)
+		goto fail;
 
-	if (bind(sockfd, SA(our_sockaddr), SA_LEN(our_sockaddr)) < 0) {
-		close(sockfd);
-		return -1;
+	plen = ((size_t)p[2] << 8) | p[3];
+	if (plen < AUTH_HDR_LEN || plen > RC_MAX_PACKET_LEN || plen > len) {
+		rc_log(LOG_ERR, "%s: invalid packet length %u on stream",
+		       __func__, (unsigned)plen);
+		errno = EBADMSG;
+		goto fail;
 	}
-	return sockfd;
+
+	if (tcp_recv_all(sockfd, p + 4, plen - 4) < 0)
+		goto fail;
+
+	if (src_addr != NULL && addrlen != NULL)
+		getpeername(sockfd, src_addr, addrlen);
+
+	return plen;
+
+ fail:
+	if (errno != ECONNRESET)
+		rc_sockpool_discard(ptr, sockfd);
+	return -1;
+}
+/// @endcond
+
+/// @cond INTERNAL
+static ssize_t plain_recvfrom(void *ptr, int sockfd,
+			      void *buf, size_t len, int flags,
+			      struct sockaddr *src_addr, socklen_t * addrlen)
+{
+	return recvfrom(sockfd, buf, len, flags, src_addr, addrlen);
+}
+/// @endcond
+
+/// @cond INTERNAL
+static void plain_pool_close_fd(void *ptr, int fd)
+{
+	rc_sockpool_put(ptr, fd);
+}
+/// @endcond
+
+/// @cond INTERNAL
+static int plain_get_fd(void *ptr, struct sockaddr *our_sockaddr,
+			const struct sockaddr *peer)
+{
+	return rc_sockpool_get(ptr, our_sockaddr);
+}
+/// @endcond
+
+/// @cond INTERNAL
+static int plain_connected_get_fd(void *ptr, struct sockaddr *our_sockaddr,
+				  const struct sockaddr *peer)
+{
+	return rc_sockpool_get_connected(ptr, our_sockaddr, peer);
+}
+/// @endcond
+
+/// @cond INTERNAL
+static int plain_tcp_get_fd(void *ptr, struct sockaddr *our_sockaddr,
+			    const struct sockaddr *peer)
+{
+	return rc_sockpool_get_stream(ptr, our_sockaddr, peer);
 }
 /// @endcond
 
 static const rc_sockets_override default_socket_funcs = {
 	.get_fd = plain_get_fd,
-	.close_fd = plain_close_fd,
+	.close_fd = plain_pool_close_fd,
 	.sendto = plain_sendto,
 	.recvfrom = plain_recvfrom
 };
 
+static const rc_sockets_override default_connected_socket_funcs = {
+	.get_fd = plain_connected_get_fd,
+	.close_fd = plain_pool_close_fd,
+	.sendto = plain_connected_sendto,
+	.recvfrom = plain_recvfrom
+};
+
 static const rc_sockets_override default_tcp_socket_funcs = {
 	.get_fd = plain_tcp_get_fd,
-	.close_fd = plain_close_fd,
+	.close_fd = plain_pool_close_fd,
 	.sendto = plain_tcp_sendto,
-	.recvfrom = plain_recvfrom
+	.recvfrom = plain_tcp_recvfrom
 };
 
 /// @cond INTERNAL
@@ -574,8 +733,8 @@ static int set_addr(struct sockaddr_storage *ss, const char *ip)
  */
 int rc_apply_config(rc_handle *rh)
 {
-	const char *txt;
-	int ret;
+	const char *txt, *udp_connect;
+	int ret, connected;
 
 	memset(&rh->own_bind_addr, 0, sizeof(rh->own_bind_addr));
 	rh->own_bind_addr_set = 0;
@@ -589,6 +748,17 @@ int rc_apply_config(rc_handle *rh)
 		rh->nas_addr_set = 1;
 	}
 
+	if (rc_conf_int_default(rh, "radius_timeout_ms", 0) < 0 ||
+	    rc_conf_int_default(rh, "radius_deadline_ms", 0) < 0) {
+		rc_log(LOG_ERR, "%s: radius_timeout_ms and radius_deadline_ms must not be negative",
+		       __func__);
+		return -1;
+	}
+
+	if (rc_resolver_init(rh) < 0 || rc_servers_init(rh) < 0 ||
+	    rc_balance_init(rh) < 0 || rc_srcaddr_init(rh) < 0)
+		return -1;
+
 	txt = rc_conf_str(rh, "serv-type");
 	if (txt == NULL)
 		txt = rc_conf_str(rh, "serv-auth-type");
@@ -597,15 +767,32 @@ int rc_apply_config(rc_handle *rh)
 		txt = "udp";
 
 	if (strcasecmp(txt, "udp") == 0) {
+		udp_connect = rc_conf_str(rh, "udp-connect");
+		connected = udp_connect != NULL &&
+			    (strcasecmp(udp_connect, "yes") == 0 ||
+			     strcasecmp(udp_connect, "true") == 0);
+		if (udp_connect != NULL && !connected &&
+		    strcasecmp(udp_connect, "no") != 0 &&
+		    strcasecmp(udp_connect, "false") != 0) {
+			rc_log(LOG_ERR, "%s: unknown udp-connect: %s", __func__,
+			       udp_connect);
+			return -1;
+		}
 		memset(&rh->so, 0, sizeof(rh->so));
 		rh->so_type = RC_SOCKET_UDP;
-		memcpy(&rh->so, &default_socket_funcs, sizeof(rh->so));
-		ret = 0;
+		if (connected)
+			memcpy(&rh->so, &default_connected_socket_funcs,
+			       sizeof(rh->so));
+		else
+			memcpy(&rh->so, &default_socket_funcs, sizeof(rh->so));
+		rh->so.ptr = rh;
+		ret = rc_sockpool_init(rh);
 	} else if (strcasecmp(txt, "tcp") == 0) {
 		memset(&rh->so, 0, sizeof(rh->so));
 		rh->so_type = RC_SOCKET_TCP;
 		memcpy(&rh->so, &default_tcp_socket_funcs, sizeof(rh->so));
-		ret = 0;
+		rh->so.ptr = rh;
+		ret = rc_sockpool_init(rh);
 #ifdef HAVE_GNUTLS
 	} else if (strcasecmp(txt, "dtls") == 0) {
 		ret = rc_init_tls(rh, SEC_FLAG_DTLS);
@@ -622,6 +809,9 @@ int rc_apply_config(rc_handle *rh)
 		return -1;
 	}
 
+	if (rc_rtt_init(rh) < 0)
+		return -1;
+
 	return 0;
 
 }
@@ -642,10 +832,25 @@ int rc_apply_config(rc_handle *rh)
  *  - @b authserver: authentication server; format is
  *    @c host[:port[:secret]] (may be repeated for failover, comma-separated).
  *  - @b acctserver: accounting server; same format as @b authserver.
+ *  - @b resolve-ttl: seconds a resolved server name is reused before it is
+ *    looked up again (integer, default 300; 0 resolves on every request).
+ *    Numeric addresses are parsed once.  If a lookup fails, the previous
+ *    addresses are kept.
  *
  * **Transport:**
  *  - @b serv-type: one of @c udp (default), @c tcp, @c tls, @c dtls.
  *  - @b namespace: Linux network namespace name to use for socket operations.
+ *    Sockets are created in it and kept for later requests, so switching
+ *    to it is only needed when a new socket is opened or a name looked up.
+ *  - @b srcaddr-ttl: without a bindaddr, seconds the local address that
+ *    routes to a server is reused (integer, default 60; 0 finds it for
+ *    every request).  On Linux it is also forgotten as soon as an
+ *    address or route changes.
+ *  - @b udp-connect: with @c yes, RADIUS/UDP requests go out on sockets
+ *    connected to their server, so that an ICMP error such as port
+ *    unreachable fails the request over at once instead of after
+ *    radius_timeout and every retry (default @c no).  Replies must then
+ *    come from the address the request was sent to.
  *
  * **TLS/DTLS credentials** (required when @b serv-type is @c tls or @c dtls):
  *  - @b tls-ca-file: PEM file of the CA certificate used to verify the server.
@@ -653,6 +858,16 @@ int rc_apply_config(rc_handle *rh)
  *  - @b tls-key-file: PEM file of the client private key.
  *  - @b tls-verify-hostname: set to @c false to skip server hostname
  *    verification (not recommended).
+ *  - @b tls-sessions: maximum number of concurrent sessions to each
+ *    authserver (integer, default 1).  Requests from threads sharing the
+ *    handle are pipelined on the least loaded session, up to 256 on each;
+ *    another session is only opened when all open ones have requests in
+ *    flight.
+ *  - @b tls-warm-sessions: number of sessions to each authserver connected
+ *    when the configuration is applied rather than on first use (integer,
+ *    default 0, at most @b tls-sessions).  Requests move to another warm
+ *    session while a broken one is reconnected, and rc_check_tls()
+ *    reconnects warm sessions that are down.
  *
  * **Security:**
  *  - @b require-message-authenticator: set to @c no to accept responses that
@@ -664,10 +879,39 @@ int rc_apply_config(rc_handle *rh)
  *
  * **Tuning:**
  *  - @b radius_timeout: request timeout in seconds (integer, default 3).
+ *  - @b radius_timeout_ms: request timeout in milliseconds; overrides
+ *    @b radius_timeout when set.
  *  - @b radius_retries: number of retries per server (integer, default 3).
+ *  - @b radius_deadline_ms: overall time in milliseconds a request may
+ *    take across retries and failover (integer, default 0: unbounded).
+ *    When it is spent, the request ends with TIMEOUT_RC.
+ *  - @b radius_deadtime: seconds a server that did not answer is skipped
+ *    by failover (integer, default 0: never skipped).  Afterwards a
+ *    single transmission of the next request probes it.
+ *  - @b retransmit: @c fixed (default) waits radius_timeout for every
+ *    transmission; with @c adaptive, RADIUS/UDP waits for an RTO derived
+ *    from the round-trip times measured to the server, doubled on every
+ *    retransmission, with random jitter (RFC 5080).
+ *  - @b rto-min-ms, @b rto-max-ms: bounds of the adaptive RTO in
+ *    milliseconds (default 100 and radius_timeout).
+ *  - @b hedge-delay-ms: milliseconds after which an Access-Request
+ *    submitted with rc_aaa_submit() and not answered yet is also sent to
+ *    the next server; the first valid reply wins (integer, default 0:
+ *    not hedged).
+ *  - @b hedge-percentile: hedge after this percentile of the round-trip
+ *    times measured to the server instead, once some were measured
+ *    (integer, 0 to 99, default 0: use hedge-delay-ms).
+ *  - @b authserver-balance, @b acctserver-balance: how requests are spread
+ *    over the servers of the list: @c failover (default; the first server
+ *    up), @c round-robin, @c weighted or @c least-outstanding.
+ *  - @b authserver-weights, @b acctserver-weights: comma separated server
+ *    weights for @c weighted, in list order (default 1).
  *  - @b nas-ip: source IP address to bind to when sending requests.
  *  - @b nas-identifier: NAS-Identifier string sent in requests.
  *  - @b dictionary: path to an additional attribute dictionary file.
+ *  - @b dictionary-lazy: with @c yes, the BEGIN-VENDOR blocks of the
+ *    dictionary are read on first use, see rc_read_dictionary_lazy()
+ *    (default @c no).
  *  - @b clientdebug: debug verbosity level (integer; 0 = off).
  *
  * @param filename path to the configuration file.
@@ -680,7 +924,7 @@ rc_handle *rc_read_config(char const *filename)
 	size_t bufsize = 0;
 	ssize_t nread;
 	OPTION *option;
-	int line;
+	int line, lazy;
 	size_t pos;
 	rc_handle *rh;
 
@@ -781,18 +1025,24 @@ rc_handle *rc_read_config(char const *filename)
                 }
         }
 
-	/* Always load the built-in RFC 2865/2866/2869 dictionary first so that
+	/* Always attach the built-in RFC 2865/2866/2869 dictionary first so that
 	 * applications need not ship a dictionary file for standard attributes. */
-	if (rc_read_dictionary_from_buffer(rh, rc_rfc_dictionary,
-	                                   sizeof(rc_rfc_dictionary) - 1) != 0) {
-		rc_log(LOG_CRIT, "rc_read_config: failed to load built-in RFC dictionary");
+	rc_dict_rfc_attach(rh);
+
+	p = rc_conf_str(rh, "dictionary-lazy");
+	lazy = p != NULL &&
+	       (strcasecmp(p, "yes") == 0 || strcasecmp(p, "true") == 0);
+	if (p != NULL && !lazy && strcasecmp(p, "no") != 0 &&
+	    strcasecmp(p, "false") != 0) {
+		rc_log(LOG_ERR, "%s: unknown dictionary-lazy: %s", __func__, p);
 		rc_destroy(rh);
 		return NULL;
 	}
 
 	p = rc_conf_str(rh, "dictionary");
 	if (p != NULL) {
-		if (rc_read_dictionary(rh, p) != 0) {
+		if ((lazy ? rc_read_dictionary_lazy(rh, p) :
+			    rc_read_dictionary(rh, p)) != 0) {
 			rc_log(LOG_CRIT, "could not load dictionary");
 			rc_destroy(rh);
 			return NULL;
@@ -866,6 +1116,35 @@ int rc_conf_int(rc_handle const *rh, char const *optname)
         return rc_conf_int_2(rh, optname, TRUE);
 }
 
+/* Returns @def, without complaining, for an optional integer option that
+ * was not set. */
+/// @cond INTERNAL
+int rc_conf_int_default(rc_handle const *rh, char const *optname, int def)
+{
+	OPTION *option;
+
+	option = find_option(rh, optname, OT_INT);
+	if (option == NULL || option->val == NULL)
+		return def;
+
+	return *((int *)option->val);
+}
+/// @endcond
+
+/* Returns how long to wait for the reply to a transmission, in
+ * milliseconds: radius_timeout_ms, or radius_timeout when it is unset. */
+/// @cond INTERNAL
+int rc_conf_timeout_ms(rc_handle const *rh)
+{
+	int ms = rc_conf_int_default(rh, "radius_timeout_ms", 0);
+
+	if (ms > 0)
+		return ms;
+
+	return rc_conf_int_default(rh, "radius_timeout", 0) * 1000;
+}
+/// @endcond
+
 /** @brief Get the value of a config option
  *
  * @param rh a handle to parsed configuration.
@@ -936,125 +1215,18 @@ int rc_test_config(rc_handle *rh, char const *filename)
 	return 0;
 }
 
-/* See if info matches hostname
- *
- * @param addr a struct addrinfo
- * @param hostname the name of the host.
- * @return 0 on success, -1 when failure.
- */
-/// @cond INTERNAL
-static int find_match (const struct addrinfo* addr, const struct addrinfo *hostname)
-{
-	const struct addrinfo *ptr, *ptr2;
-	unsigned len1, len2;
-
-	ptr = addr;
-	while(ptr) {
-		ptr2 = hostname;
-		while(ptr2) {
-			len1 = SA_GET_INLEN(ptr->ai_addr);
-			len2 = SA_GET_INLEN(ptr2->ai_addr);
-
-			if (len1 > 0 &&
-			    len1 == len2 &&
-			    memcmp(SA_GET_INADDR(ptr->ai_addr), SA_GET_INADDR(ptr2->ai_addr), len1) == 0) {
-				return 0;
-			}
-			ptr2 = ptr2->ai_next;
- 		}
-		ptr = ptr->ai_next;
- 	}
- 	return -1;
-}
-/// @endcond
-
-/* Checks if provided address is local address
- *
- * @param addr an %AF_INET or %AF_INET6 address
- * @return 0 if local, 1 if not local, -1 on failure.
- */
-/// @cond INTERNAL
-static int rc_ipaddr_local(const struct sockaddr *addr)
-{
-	int temp_sock, res, serrno;
-	struct sockaddr_storage tmpaddr;
-
-	memcpy(&tmpaddr, addr, SA_LEN(addr));
-
-	temp_sock = socket(addr->sa_family, SOCK_DGRAM, 0);
-	if (temp_sock == -1)
-		return -1;
-
-	if (addr->sa_family == AF_INET) {
-		((struct sockaddr_in*)&tmpaddr)->sin_port = 0;
-	} else {
-		((struct sockaddr_in6*)&tmpaddr)->sin6_port = 0;
-	}
-	res = bind(temp_sock, SA(&tmpaddr), SS_LEN(&tmpaddr));
-	serrno = errno;
-	close(temp_sock);
-	if (res == 0)
-		return 0;
-	if (serrno == EADDRNOTAVAIL)
-		return 1;
-	return -1;
-}
-/// @endcond
-
-/* Checks if provided name refers to ourselves
- *
- * @param info an addrinfo of the host to check
- * @return 0 if yes, 1 if no and -1 on failure.
- */
-/// @cond INTERNAL
-static int rc_is_myname(const struct addrinfo *info)
-{
-	const struct addrinfo *p;
-	int	res;
-
-	p = info;
-	while(p != NULL) {
-		res = rc_ipaddr_local(p->ai_addr);
-		if (res == 0 || res == -1) {
- 			return res;
-		}
-		p = p->ai_next;
- 	}
- 	return 1;
-}
-/// @endcond
-
-/** @brief Locate a server in the rh config or if not found, check for a servers file
+/* Looks up the secret of a server whose addresses are info, in the rh
+ * config or if not found, in the servers file.
  *
- * @param rh a handle to parsed configuration.
- * @param server_name the name of the server.
- * @param info: will hold a pointer to addrinfo
- * @param secret will hold the server's secret (of %MAX_SECRET_LENGTH).
- * @param type %AUTH or %ACCT
-
  * @return 0 on success, -1 on failure.
  */
-int rc_find_server_addr (rc_handle const *rh, char const *server_name,
-                         struct addrinfo** info, char *secret, rc_type type)
+/// @cond INTERNAL
+static int find_server_secret (rc_handle const *rh, char const *server_name,
+                               const struct addrinfo *info, char *secret, rc_type type)
 {
-	int             result = 0;
-	FILE           *clientfd;
-	char           *h;
-	char           *s;
-	char           *buffer = NULL;
-	size_t          bufsize = 0;
-	char            hostnm[AUTH_ID_LEN + 1];
-	char	       *buffer_save;
-	char	       *hostnm_save;
 	SERVER	       *servers;
-	struct addrinfo *tmpinfo = NULL;
-	const char      *fservers;
 	char const      *optname;
 
-	/* Lookup the IP address of the radius server */
-	if ((*info = rc_getaddrinfo (server_name, type==AUTH?PW_AI_AUTH:PW_AI_ACCT)) == NULL)
-		return -1;
-
 	switch (type)
 	{
 	case AUTH: optname = "authserver"; break;
@@ -1080,99 +1252,68 @@ int rc_find_server_addr (rc_handle const *rh, char const *server_name,
 	}
 
 	/* We didn't find it in the rh_config or the servername is too long so look for a
-	 * servers file to define the secret(s)
+	 * servers file to define the secret(s); it is indexed by address once, see servers.c
 	 */
+	if (rc_conf_str(rh, "servers") == NULL)
+		goto fail;
 
-	fservers = rc_conf_str(rh, "servers");
-	if (fservers != NULL) {
-		if ((clientfd = fopen (fservers, "r")) == NULL)
-		{
-			rc_log(LOG_ERR, "rc_find_server: couldn't open file: %s: %s", strerror(errno), rc_conf_str(rh, "servers"));
-			goto fail;
-		}
-
-		while (getline (&buffer, &bufsize, clientfd) != -1)
-		{
-			if (*buffer == '#')
-				continue;
+	if (rc_servers_find(rh, info, secret) == 0)
+		return 0;
 
-			if ((h = strtok_r(buffer, " \t\n", &buffer_save)) == NULL) /* first hostname */
-				continue;
+	rc_log(LOG_ERR, "rc_find_server: couldn't find RADIUS server %s in %s",
+		 server_name, rc_conf_str(rh, "servers"));
 
-			strlcpy (hostnm, h, AUTH_ID_LEN);
+ fail:
+	memset (secret, '\0', MAX_SECRET_LENGTH);
+	return -1;
+}
+/// @endcond
 
-			if ((s = strtok_r (NULL, " \t\n", &buffer_save)) == NULL) /* and secret field */
-				continue;
+/** @brief Locate a server in the rh config or if not found, check for a servers file
+ *
+ * @param rh a handle to parsed configuration.
+ * @param server_name the name of the server.
+ * @param info: will hold a pointer to addrinfo
+ * @param secret will hold the server's secret (of %MAX_SECRET_LENGTH).
+ * @param type %AUTH or %ACCT
 
-			strlcpy (secret, s, MAX_SECRET_LENGTH);
+ * @return 0 on success, -1 on failure.
+ */
+int rc_find_server_addr (rc_handle const *rh, char const *server_name,
+                         struct addrinfo** info, char *secret, rc_type type)
+{
+	/* Lookup the IP address of the radius server */
+	if ((*info = rc_getaddrinfo (server_name, type==AUTH?PW_AI_AUTH:PW_AI_ACCT)) == NULL)
+		return -1;
 
-			if (!strchr (hostnm, '/')) /* If single name form */
-			{
-				tmpinfo = rc_getaddrinfo(hostnm, 0);
-				if (tmpinfo)
-				{
-					result = find_match (*info, tmpinfo);
-					if (result == 0)
-					{
-						result++;
-						break;
-					}
-
-					freeaddrinfo(tmpinfo);
-					tmpinfo = NULL;
-				}
-			}
-			else /* <name1>/<name2> "paired" form */
-			{
-				strtok_r(hostnm, "/", &hostnm_save);
-				tmpinfo = rc_getaddrinfo(hostnm, 0);
-				if (tmpinfo)
- 				{
-					if (rc_is_myname(tmpinfo) == 0)
-					{	     /* If we're the 1st name, target is 2nd */
-						if (find_match (*info, tmpinfo) == 0)
-						{
-							result++;
-							break;
-						}
-					}
-					else	/* If we were 2nd name, target is 1st name */
- 					{
-						if (find_match (*info, tmpinfo) == 0)
-						{
-							result++;
-							break;
-						}
- 					}
-					freeaddrinfo(tmpinfo);
-					tmpinfo = NULL;
- 				}
-			}
-		}
-		fclose (clientfd);
-	}
-	if (result == 0)
-	{
-		memset (secret, '\0', MAX_SECRET_LENGTH);
-		rc_log(LOG_ERR, "rc_find_server: couldn't find RADIUS server %s in %s",
-			 server_name, rc_conf_str(rh, "servers"));
-		goto fail;
+	if (find_server_secret (rh, server_name, *info, secret, type) != 0) {
+		freeaddrinfo(*info);
+		return -1;
 	}
 
-	result = 0;
-	goto cleanup;
+	return 0;
+}
 
- fail:
- 	freeaddrinfo(*info);
- 	result = -1;
+/* Like rc_find_server_addr(), but the address comes from the resolver
+ * cache of the handle (see resolve.c), so a request does not wait for
+ * DNS. The list must be released with rc_addrinfo_free().
+ */
+/// @cond INTERNAL
+int rc_find_server (rc_handle const *rh, char const *server_name,
+                    struct addrinfo** info, char *secret, rc_type type)
+{
+	if ((*info = rc_resolve (rh, server_name, type==AUTH?PW_AI_AUTH:PW_AI_ACCT)) == NULL)
+		return -1;
 
- cleanup:
- 	if (tmpinfo)
- 		freeaddrinfo(tmpinfo);
-	free(buffer);
+	if (find_server_secret (rh, server_name, *info, secret, type) != 0) {
+		rc_addrinfo_free(*info);
+		*info = NULL;
+		return -1;
+	}
 
-	return result;
+	return 0;
 }
+/// @endcond
 
 /**
  * @brief Frees allocated config values
@@ -1189,6 +1330,10 @@ void rc_config_free(rc_handle *rh)
 	int i;
 	SERVER *serv;
 
+	/* also set by rc_read_dictionary() on handles without a configuration */
+	free(rh->first_dict_read);
+	rh->first_dict_read = NULL;
+
 	if (rh->config_options == NULL)
 		return;
 
@@ -1204,9 +1349,7 @@ void rc_config_free(rc_handle *rh)
 		}
 	}
 	free(rh->config_options);
-	free(rh->first_dict_read);
 	rh->config_options = NULL;
-	rh->first_dict_read = NULL;
 }
 
 static int _initialized = 0;
@@ -1239,6 +1382,12 @@ rc_handle *rc_new(void)
                 rc_log(LOG_CRIT, "rc_new: out of memory");
                 return NULL;
         }
+
+	if (pthread_mutex_init(&rh->lock, NULL) != 0) {
+		rc_log(LOG_CRIT, "rc_new: cannot initialize mutex");
+		free(rh);
+		return NULL;
+	}
 	return rh;
 }
 
@@ -1252,7 +1401,14 @@ void rc_destroy(rc_handle *rh)
 #ifdef HAVE_GNUTLS
 	rc_deinit_tls(rh);
 #endif
+	rc_async_free(rh);
+	rc_sockpool_free(rh);
+	rc_servers_free(rh);
+	rc_resolver_free(rh);
+	rc_rtt_free(rh);
+	rc_srcaddr_free(rh);
 	rc_config_free(rh);
+	pthread_mutex_destroy(&rh->lock);
 	free(rh);
 
 #if defined(HAVE_GNUTLS) && GNUTLS_VERSION_NUMBER < 0x030300
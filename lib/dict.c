@@ -23,6 +23,279 @@
 #include <includes.h>
 #include <radcli/radcli.h>
 #include "util.h"
+#include "dict.h"
+#include "dict_rfc_gen.h"
+
+/* Besides their lists, attributes, values and vendors are indexed by
+ * open addressing hash tables: attributes by ID and by name, values by
+ * name and by attribute name and value, vendors by PEN and by name.
+ * Names are compared without regard to case. An entry whose key is
+ * already present replaces the older one in its slot, so that lookups
+ * return the most recently added entry, as walking the lists did.
+ * Tables are grown before an entry is linked, so it is either in its
+ * list and both of its tables or in none. */
+
+/// @cond INTERNAL
+/* Smallest table size; a table is doubled when it gets half full */
+#define DICT_TABLE_MIN 64
+
+struct dict_table {
+	void		**slot;
+	size_t		size;	/* a power of two, or 0 */
+	size_t		used;
+};
+
+struct rc_dict_index {
+	struct dict_table	t[DICT_TABLES];
+};
+
+void dict_entry_key(int table, void const *entry, struct dict_key *key)
+{
+	key->name = NULL;
+	key->num = 0;
+
+	switch (table) {
+	case DICT_ATTR_ID:
+		key->num = ((DICT_ATTR const *)entry)->value;
+		break;
+	case DICT_ATTR_NAME:
+		key->name = ((DICT_ATTR const *)entry)->name;
+		break;
+	case DICT_VAL_NAME:
+		key->name = ((DICT_VALUE const *)entry)->name;
+		break;
+	case DICT_VAL_ATTR:
+		key->name = ((DICT_VALUE const *)entry)->attrname;
+		key->num = ((DICT_VALUE const *)entry)->value;
+		break;
+	case DICT_VEND_ID:
+		key->num = ((DICT_VENDOR const *)entry)->vendorpec;
+		break;
+	case DICT_VEND_NAME:
+		key->name = ((DICT_VENDOR const *)entry)->vendorname;
+		break;
+	}
+}
+
+/* FNV-1a of the name folded to lower case, mixed with the number */
+static size_t dict_hash(struct dict_key const *key)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	char const *p;
+
+	if (key->name != NULL) {
+		for (p = key->name; *p != '\0'; p++) {
+			h ^= (unsigned char)tolower((unsigned char)*p);
+			h *= 0x100000001b3ULL;
+		}
+	}
+
+	h ^= key->num;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (size_t)h;
+}
+
+int dict_key_eq(struct dict_key const *a, struct dict_key const *b)
+{
+	if (a->num != b->num)
+		return 0;
+	return a->name == NULL || strcasecmp(a->name, b->name) == 0;
+}
+
+static void *dict_find(struct rc_dict_index const *ix, int table,
+		       struct dict_key const *key)
+{
+	struct dict_table const *t;
+	struct dict_key k;
+	size_t i;
+
+	if (ix == NULL || ix->t[table].size == 0)
+		return NULL;
+
+	t = &ix->t[table];
+	for (i = dict_hash(key) & (t->size - 1); t->slot[i] != NULL;
+	     i = (i + 1) & (t->size - 1)) {
+		dict_entry_key(table, t->slot[i], &k);
+		if (dict_key_eq(&k, key))
+			return t->slot[i];
+	}
+	return NULL;
+}
+
+static void dict_put(struct dict_table *t, int table, void *entry)
+{
+	struct dict_key key, k;
+	size_t i;
+
+	dict_entry_key(table, entry, &key);
+	for (i = dict_hash(&key) & (t->size - 1); t->slot[i] != NULL;
+	     i = (i + 1) & (t->size - 1)) {
+		dict_entry_key(table, t->slot[i], &k);
+		if (dict_key_eq(&k, &key)) {
+			t->slot[i] = entry;
+			return;
+		}
+	}
+	t->slot[i] = entry;
+	t->used++;
+}
+
+/* Makes room for one more entry */
+static int dict_reserve(struct dict_table *t, int table)
+{
+	struct dict_table n;
+	size_t i;
+
+	if ((t->used + 1) * 2 <= t->size)
+		return 0;
+
+	n.size = t->size ? t->size * 2 : DICT_TABLE_MIN;
+	n.used = 0;
+	n.slot = calloc(n.size, sizeof(*n.slot));
+	if (n.slot == NULL)
+		return -1;
+
+	for (i = 0; i < t->size; i++) {
+		if (t->slot[i] != NULL)
+			dict_put(&n, table, t->slot[i]);
+	}
+	free(t->slot);
+	*t = n;
+	return 0;
+}
+
+/* Adds an entry to its two tables */
+static int dict_index_add(rc_handle *rh, int first, int second, void *entry)
+{
+	struct rc_dict_index *ix = rh->dict_index;
+
+	if (ix == NULL) {
+		ix = calloc(1, sizeof(*ix));
+		if (ix == NULL)
+			return -1;
+		rh->dict_index = ix;
+	}
+
+	if (dict_reserve(&ix->t[first], first) < 0 ||
+	    dict_reserve(&ix->t[second], second) < 0)
+		return -1;
+
+	dict_put(&ix->t[first], first, entry);
+	dict_put(&ix->t[second], second, entry);
+	return 0;
+}
+/// @endcond
+
+/* The built-in dictionary is compiled from etc/dictionary by
+ * gen-dict.awk into the static tables of dict_rfc_gen.h, laid out with
+ * dict_static_hash(). A handle refers to them instead of holding copies;
+ * as they are attached before anything else is added, the entries of
+ * the handle take precedence over them. Their entries are not linked
+ * to each other. */
+
+/// @cond INTERNAL
+static const struct dict_static dict_rfc = {
+	rc_rfc_attrs, rc_rfc_values, rc_rfc_vendors,
+	{
+		[DICT_ATTR_ID] = rc_rfc_attr_id,
+		[DICT_ATTR_NAME] = rc_rfc_attr_name,
+		[DICT_VAL_NAME] = rc_rfc_val_name,
+		[DICT_VAL_ATTR] = rc_rfc_val_attr,
+		[DICT_VEND_ID] = rc_rfc_vend_id,
+		[DICT_VEND_NAME] = rc_rfc_vend_name,
+	},
+	{
+		[DICT_ATTR_ID] = sizeof(rc_rfc_attr_id) / sizeof(uint32_t),
+		[DICT_ATTR_NAME] = sizeof(rc_rfc_attr_name) / sizeof(uint32_t),
+		[DICT_VAL_NAME] = sizeof(rc_rfc_val_name) / sizeof(uint32_t),
+		[DICT_VAL_ATTR] = sizeof(rc_rfc_val_attr) / sizeof(uint32_t),
+		[DICT_VEND_ID] = sizeof(rc_rfc_vend_id) / sizeof(uint32_t),
+		[DICT_VEND_NAME] = sizeof(rc_rfc_vend_name) / sizeof(uint32_t),
+	},
+};
+
+/* djb2 of the name with ASCII letters folded to lower case, followed by
+ * the two halves of the number. gen-dict.awk computes the same. */
+uint32_t dict_static_hash(struct dict_key const *key)
+{
+	uint32_t h = 5381;
+	unsigned char c;
+	char const *p;
+
+	if (key->name != NULL) {
+		for (p = key->name; *p != '\0'; p++) {
+			c = *p;
+			if (c >= 'A' && c <= 'Z')
+				c += 'a' - 'A';
+			h = h * 33 + c;
+		}
+	}
+
+	h = h * 33 + (uint32_t)(key->num >> 32);
+	h = h * 33 + (uint32_t)key->num;
+	return h;
+}
+
+static void const *dict_static_entry(struct dict_static const *d, int table,
+				     uint32_t i)
+{
+	switch (table) {
+	case DICT_ATTR_ID:
+	case DICT_ATTR_NAME:
+		return &d->attrs[i];
+	case DICT_VAL_NAME:
+	case DICT_VAL_ATTR:
+		return &d->values[i];
+	default:
+		return &d->vendors[i];
+	}
+}
+
+static void *dict_static_find(struct dict_static const *d, int table,
+			      struct dict_key const *key)
+{
+	uint32_t const *slot = d->slot[table];
+	size_t mask = d->size[table] - 1;
+	void const *entry;
+	struct dict_key k;
+	size_t i;
+
+	/* the tables are at most half full */
+	for (i = dict_static_hash(key) & mask; slot[i] != 0; i = (i + 1) & mask) {
+		entry = dict_static_entry(d, table, slot[i] - 1);
+		dict_entry_key(table, entry, &k);
+		if (dict_key_eq(&k, key))
+			return (void *)entry;
+	}
+	return NULL;
+}
+
+/* Looks a key up in the entries of the handle, then in its shared or
+ * cached dictionary, then in the built-in dictionary if it is attached; that is the
+ * reverse of the order they are added in. Vendor blocks not read yet
+ * are not considered, see dict_lookup(). */
+static void *dict_lookup_loaded(rc_handle const *rh, int table,
+				struct dict_key const *key)
+{
+	void *entry;
+
+	entry = dict_find(rh->dict_index, table, key);
+	if (entry == NULL && rh->dict != NULL)
+		entry = dict_static_find(&rh->dict->s, table, key);
+	if (entry == NULL && rh->dict_rfc)
+		entry = dict_static_find(&dict_rfc, table, key);
+	return entry;
+}
+
+/* Attaches the built-in dictionary to a handle. Nothing is parsed or
+ * allocated; rc_dict_free() detaches it again. */
+void rc_dict_rfc_attach(rc_handle *rh)
+{
+	rh->dict_rfc = 1;
+}
+/// @endcond
 
 /** @brief Add attribute to dictionary
  *
@@ -62,6 +335,13 @@ DICT_ATTR *rc_dict_addattr(rc_handle *rh, char const * namestr, uint32_t value,
 	attr->value = RADCLI_VENDOR_ATTR_SET(value, vendorspec);
 	attr->type = type;
 
+	if (dict_index_add(rh, DICT_ATTR_ID, DICT_ATTR_NAME, attr) < 0)
+	{
+		rc_log(LOG_CRIT, "rc_dict_addattr: out of memory");
+		free(attr);
+		return NULL;
+	}
+
 	/* Insert it into the list */
 	attr->next = rh->dictionary_attributes;
 	rh->dictionary_attributes = attr;
@@ -104,6 +384,13 @@ DICT_VALUE *rc_dict_addval(rc_handle *rh, char const * attrstr, char const * nam
 	strlcpy(dval->name, namestr, sizeof(dval->name));
 	dval->value = value;
 
+	if (dict_index_add(rh, DICT_VAL_NAME, DICT_VAL_ATTR, dval) < 0)
+	{
+		rc_log(LOG_CRIT, "rc_dict_addval: out of memory");
+		free(dval);
+		return NULL;
+	}
+
 	/* Insert it into the list */
 	dval->next = rh->dictionary_values;
 	rh->dictionary_values = dval;
@@ -139,12 +426,283 @@ DICT_VENDOR *rc_dict_addvend(rc_handle *rh, char const * namestr, uint32_t vendo
 	strlcpy(dvend->vendorname, namestr, sizeof(dvend->vendorname));
 	dvend->vendorpec = vendorspec;
 
+	if (dict_index_add(rh, DICT_VEND_ID, DICT_VEND_NAME, dvend) < 0)
+	{
+		rc_log(LOG_CRIT, "rc_dict_addvend: out of memory");
+		free(dvend);
+		return NULL;
+	}
+
 	/* Insert it into the list */
 	dvend->next = rh->dictionary_vendors;
 	rh->dictionary_vendors = dvend;
 	return dvend;
 }
 
+/// @cond INTERNAL
+/* A BEGIN-VENDOR block whose reading is deferred to its first use */
+struct dict_block {
+	char		*filename;
+	long		offset;		/* of the line after BEGIN-VENDOR */
+	int		line;		/* of the BEGIN-VENDOR line */
+	int		read;		/* it was read, or failed to be */
+	uint32_t	vendorpec;
+	char		vendorname[RC_NAME_LENGTH + 1];
+};
+
+/* A key of an entry in a deferred block: the name of an attribute or a
+ * value, the name of the attribute of a value, or an attribute ID */
+struct dict_pending {
+	struct dict_pending	*next;
+	int			table;
+	uint64_t		num;	/* the ID, or 0 */
+	size_t			block;	/* index in rc_dict_lazy.blocks */
+	char			name[];	/* empty for an ID */
+};
+
+/* The blocks of a handle read by rc_read_dictionary_lazy(), in file
+ * order, and the keys of their entries. The keys are chained in buckets
+ * by dict_pending_hash(), in file order as well, so that blocks defining
+ * the same key are read in the order an eager read would. */
+struct rc_dict_lazy {
+	pthread_mutex_t		lock;	/* serializes lookups with reading blocks */
+	struct dict_block	*blocks;
+	size_t			n;
+	size_t			unread;
+	struct dict_pending	**bucket;
+	size_t			size;	/* a power of two, or 0 */
+	size_t			used;
+};
+
+/* How rc_dict_init() reads a file */
+struct dict_parse {
+	struct dict_sources	*srcs;	/* if not NULL, the files read are recorded there */
+	int			lazy;	/* defer BEGIN-VENDOR blocks */
+	struct dict_block const	*block;	/* read only this block */
+};
+
+static int dict_parse_file(rc_handle *rh, char const *filename,
+			   struct dict_parse const *p);
+static int is_unsigned_decimal(char const *s);
+
+/* Vendors are never deferred, so those known are found without
+ * reading any block */
+static DICT_VENDOR *dict_findvend(rc_handle const *rh, char const *vendorname)
+{
+	struct dict_key key = { vendorname, 0 };
+
+	return dict_lookup_loaded(rh, DICT_VEND_NAME, &key);
+}
+
+static size_t dict_pending_hash(int table, char const *name, uint64_t num)
+{
+	struct dict_key key = { name, num };
+
+	return dict_hash(&key) + table;
+}
+
+/* Appends a key to its bucket */
+static void dict_pending_put(struct rc_dict_lazy *lz, struct dict_pending *e)
+{
+	struct dict_pending **pp;
+
+	pp = &lz->bucket[dict_pending_hash(e->table, e->name, e->num) &
+			 (lz->size - 1)];
+	while (*pp != NULL)
+		pp = &(*pp)->next;
+	e->next = NULL;
+	*pp = e;
+}
+
+/* Makes room for @count more keys; there are at most as many keys as
+ * buckets */
+static int dict_pending_reserve(struct rc_dict_lazy *lz, size_t count)
+{
+	struct dict_pending **old = lz->bucket, *e, *next;
+	size_t oldsize = lz->size, i;
+
+	if (lz->used + count <= lz->size)
+		return 0;
+
+	lz->size = oldsize ? oldsize : DICT_TABLE_MIN;
+	while (lz->used + count > lz->size)
+		lz->size *= 2;
+	lz->bucket = calloc(lz->size, sizeof(*lz->bucket));
+	if (lz->bucket == NULL) {
+		lz->bucket = old;
+		lz->size = oldsize;
+		return -1;
+	}
+
+	for (i = 0; i < oldsize; i++) {
+		for (e = old[i]; e != NULL; e = next) {
+			next = e->next;
+			dict_pending_put(lz, e);
+		}
+	}
+	free(old);
+	return 0;
+}
+
+/* Appends a key to the list at @tail */
+static int dict_pending_new(struct dict_pending ***tail, int table,
+			    char const *name, uint64_t num)
+{
+	size_t len = strlen(name);
+	struct dict_pending *e;
+
+	e = malloc(sizeof(*e) + len + 1);
+	if (e == NULL)
+		return -1;
+	e->next = NULL;
+	e->table = table;
+	e->num = num;
+	memcpy(e->name, name, len + 1);
+
+	**tail = e;
+	*tail = &e->next;
+	return 0;
+}
+
+/* Records the keys of an ATTRIBUTE or VALUE line of a deferred block.
+ * A line the parser would reject is recorded as far as it can be; the
+ * error is reported when the block is read. */
+static int dict_pending_line(rc_handle const *rh, char *saveptr,
+			     char const *tok, uint32_t vendorpec,
+			     struct dict_pending ***tail)
+{
+	char *name_t, *val_t, *opt_t, *cp1, *optptr;
+	DICT_VENDOR *dvend;
+
+	if (strcmp(tok, "ATTRIBUTE") == 0) {
+		name_t = strtok_r(NULL, " \t\r\n", &saveptr);
+		val_t = strtok_r(NULL, " \t\r\n", &saveptr);
+		(void)strtok_r(NULL, " \t\r\n", &saveptr);
+		opt_t = strtok_r(NULL, " \t\r\n", &saveptr);
+		if (name_t == NULL)
+			return 0;
+		if (dict_pending_new(tail, DICT_ATTR_NAME, name_t, 0) < 0)
+			return -1;
+		if (val_t == NULL || !is_unsigned_decimal(val_t))
+			return 0;
+
+		/* as in rc_dict_init(), every option names a vendor */
+		for (cp1 = opt_t != NULL ? strtok_r(opt_t, ",", &optptr) : NULL;
+		     cp1 != NULL; cp1 = strtok_r(NULL, ",", &optptr)) {
+			if (strncmp(cp1, "vendor=", 7) == 0)
+				cp1 += 7;
+			dvend = dict_findvend(rh, cp1);
+			if (dvend != NULL)
+				vendorpec = dvend->vendorpec;
+		}
+		return dict_pending_new(tail, DICT_ATTR_ID, "",
+			RADCLI_VENDOR_ATTR_SET((uint32_t)atoi(val_t), vendorpec));
+	}
+
+	if (strcmp(tok, "VALUE") == 0) {
+		val_t = strtok_r(NULL, " \t\r\n", &saveptr);
+		name_t = strtok_r(NULL, " \t\r\n", &saveptr);
+		if (val_t == NULL || name_t == NULL)
+			return 0;
+		/* values are indexed by the name of their attribute alone */
+		if (dict_pending_new(tail, DICT_VAL_ATTR, val_t, 0) < 0 ||
+		    dict_pending_new(tail, DICT_VAL_NAME, name_t, 0) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/* Records the block starting after the current line of @dictfd and the
+ * keys of its entries, and skips to its END-VENDOR line. A block with
+ * an $INCLUDE line is not deferred, as the keys of the file included
+ * are not known without reading it: 1 is returned, with @dictfd and
+ * @line_no put back to the start of the block. */
+static int dict_defer_block(rc_handle *rh, FILE *dictfd, char const *filename,
+			    DICT_VENDOR const *v, char **buffer, size_t *bufsize,
+			    int *line_no)
+{
+	struct rc_dict_lazy *lz = rh->dict_lazy;
+	struct dict_pending *keys = NULL, **tail = &keys, *e;
+	struct dict_block *b;
+	char *saveptr, *tok, *cp;
+	size_t count = 0;
+	long offset;
+	int line = *line_no, ret = -1;
+
+	offset = ftell(dictfd);
+	if (offset < 0) {
+		rc_log(LOG_ERR, "rc_dict_init: cannot defer vendor %s in dictionary %s: %s",
+		       v->vendorname, filename, strerror(errno));
+		return -1;
+	}
+
+	while (getline(buffer, bufsize, dictfd) != -1) {
+		(*line_no)++;
+		cp = strchr(*buffer, '#');
+		if (cp != NULL)
+			*cp = '\0';
+		tok = strtok_r(*buffer, " \t\r\n", &saveptr);
+		if (tok == NULL)
+			continue;
+		if (strcmp(tok, "END-VENDOR") == 0)
+			break;
+		if (strcmp(tok, "$INCLUDE") == 0) {
+			if (fseek(dictfd, offset, SEEK_SET) != 0) {
+				rc_log(LOG_ERR, "rc_dict_init: cannot seek in dictionary %s: %s",
+				       filename, strerror(errno));
+				goto cleanup;
+			}
+			*line_no = line;
+			ret = 1;
+			goto cleanup;
+		}
+		if (dict_pending_line(rh, saveptr, tok, v->vendorpec, &tail) < 0)
+			goto nomem;
+	}
+
+	for (e = keys; e != NULL; e = e->next)
+		count++;
+	if (dict_pending_reserve(lz, count) < 0)
+		goto nomem;
+
+	b = realloc(lz->blocks, (lz->n + 1) * sizeof(*b));
+	if (b == NULL)
+		goto nomem;
+	lz->blocks = b;
+	b = &lz->blocks[lz->n];
+
+	b->filename = strdup(filename);
+	if (b->filename == NULL)
+		goto nomem;
+	b->offset = offset;
+	b->line = line;
+	b->read = 0;
+	b->vendorpec = v->vendorpec;
+	strlcpy(b->vendorname, v->vendorname, sizeof(b->vendorname));
+
+	while (keys != NULL) {
+		e = keys;
+		keys = e->next;
+		e->block = lz->n;
+		dict_pending_put(lz, e);
+		lz->used++;
+	}
+	lz->n++;
+	lz->unread++;
+	return 0;
+
+nomem:
+	rc_log(LOG_CRIT, "rc_dict_init: out of memory");
+cleanup:
+	while (keys != NULL) {
+		e = keys;
+		keys = e->next;
+		free(e);
+	}
+	return ret;
+}
+/// @endcond
+
 /* Parse the input dictionary-config and initialize the dictionary.
  *
  * Read all ATTRIBUTES into the dictionary_attributes list.
@@ -153,6 +711,7 @@ DICT_VENDOR *rc_dict_addvend(rc_handle *rh, char const * namestr, uint32_t vendo
  * @param rh       a handle to parsed configuration.
  * @param dictfd   a handle to the dictionary config.
  * @param filename the name of the dictionary file.
+ * @param p        how the file is read, see struct dict_parse.
  * @return 0 on success, -1 on failure.
  */
 /// @cond INTERNAL
@@ -167,7 +726,8 @@ static int is_unsigned_decimal(char const *s)
 	return 1;
 }
 
-static int rc_dict_init(rc_handle *rh, FILE *dictfd, char const *filename)
+static int rc_dict_init(rc_handle *rh, FILE *dictfd, char const *filename,
+			struct dict_parse const *p)
 {
 	char            namestr[AUTH_ID_LEN];
 	char            valstr[AUTH_ID_LEN];
@@ -179,8 +739,6 @@ static int rc_dict_init(rc_handle *rh, FILE *dictfd, char const *filename)
 	char            *saveptr;
 	char            *tok;
 	int             line_no = 0;
-	DICT_ATTR      *attr;
-	DICT_VALUE     *dval;
 	DICT_VENDOR    *dvend;
 	char            *buffer = NULL;
 	size_t          bufsize = 0;
@@ -188,12 +746,19 @@ static int rc_dict_init(rc_handle *rh, FILE *dictfd, char const *filename)
 	int             type;
 	unsigned attr_vendorspec = 0;
 	const char *pfilename = filename;
+	struct dict_parse inc = { p->srcs, p->lazy, NULL };
 
 	if (pfilename == NULL)
 	{
 		pfilename = "memory";
 	}
 
+	if (p->block != NULL)
+	{
+		attr_vendorspec = p->block->vendorpec;
+		line_no = p->block->line;
+	}
+
 	while (getline (&buffer, &bufsize, dictfd) != -1)
 	{
 		line_no++;
@@ -317,7 +882,7 @@ static int rc_dict_init(rc_handle *rh, FILE *dictfd, char const *filename)
 					}
 					if (strncmp(cp1, "vendor=", 7) == 0)
 						cp1 += 7;
-					dvend = rc_dict_findvend(rh, cp1);
+					dvend = dict_findvend(rh, cp1);
 					if (dvend == NULL) {
 						rc_log(LOG_ERR,
 							"rc_dict_init: unknown Vendor-Id %s on line %d of "
@@ -327,24 +892,12 @@ static int rc_dict_init(rc_handle *rh, FILE *dictfd, char const *filename)
 				}
 			}
 
-			/* Create a new attribute for the list */
-			if ((attr = malloc (sizeof (DICT_ATTR))) == NULL)
+			if (rc_dict_addattr(rh, namestr, value, type,
+					    dvend != NULL ? dvend->vendorpec :
+							    attr_vendorspec) == NULL)
 			{
-				rc_log(LOG_CRIT, "rc_dict_init: out of memory");
 				goto error;
 			}
-			strlcpy (attr->name, namestr, sizeof(attr->name));
-			attr->type = type;
-
-			if (dvend != NULL) {
-				attr->value = RADCLI_VENDOR_ATTR_SET(value, dvend->vendorpec);
-			} else {
-				attr->value = RADCLI_VENDOR_ATTR_SET(value, attr_vendorspec);
-			}
-
-			/* Insert it into the list */
-			attr->next = rh->dictionary_attributes;
-			rh->dictionary_attributes = attr;
 		}
 		else if (strcmp (tok, "VALUE") == 0)
 		{
@@ -394,19 +947,10 @@ static int rc_dict_init(rc_handle *rh, FILE *dictfd, char const *filename)
 			}
 			value = atoi (valstr);
 
-			/* Create a new VALUE entry for the list */
-			if ((dval = malloc (sizeof (DICT_VALUE))) == NULL)
+			if (rc_dict_addval(rh, attrstr, namestr, value) == NULL)
 			{
-				rc_log(LOG_CRIT, "rc_dict_init: out of memory");
 				goto error;
 			}
-			strlcpy (dval->attrname, attrstr, sizeof(dval->attrname));
-			strlcpy (dval->name, namestr, sizeof(dval->name));
-			dval->value = value;
-
-			/* Insert it into the list */
-			dval->next = rh->dictionary_values;
-			rh->dictionary_values = dval;
 		}
 		else if ((filename != NULL) &&
 				(strcmp (tok, "$INCLUDE") == 0))
@@ -429,28 +973,31 @@ static int rc_dict_init(rc_handle *rh, FILE *dictfd, char const *filename)
 			strlcpy(ifilename, path_t, sizeof(ifilename));
 			/* Append directory if necessary */
 			if (path_t[0] != '/') {
+				/* filename may be read-only, it is not modified */
 				cp = strrchr(filename, '/');
 				if (cp != NULL) {
-					*cp = '\0';
-					strlcpy(ifilename, filename, sizeof(ifilename));
-					strlcat(ifilename, "/", sizeof(ifilename));
-					strlcat(ifilename, path_t, sizeof(ifilename));
-					*cp = '/';
+					snprintf(ifilename, sizeof(ifilename), "%.*s/%s",
+						 (int)(cp - filename), filename, path_t);
 				}
 			}
-			if (rc_read_dictionary(rh, ifilename) < 0)
+			if (dict_parse_file(rh, ifilename, &inc) < 0)
 			{
 				goto error;
 			}
 		}
 		else if (strcmp (tok, "END-VENDOR") == 0)
 		{
+			if (p->block != NULL)
+			{
+				break;
+			}
 			attr_vendorspec = 0;
 		}
 		else if (strcmp (tok, "BEGIN-VENDOR") == 0)
 		{
 			DICT_VENDOR *v;
 			char *name_t;
+			int deferred;
 
 			/* Read the vendor name */
 			name_t = strtok_r(NULL, " \t\r\n", &saveptr);
@@ -462,7 +1009,7 @@ static int rc_dict_init(rc_handle *rh, FILE *dictfd, char const *filename)
 				goto error;
 			}
 
-			v = rc_dict_findvend(rh, name_t);
+			v = dict_findvend(rh, name_t);
 			if (v == NULL) {
 				rc_log(LOG_ERR,
 					"rc_dict_init: unknown Vendor %s on line %d of "
@@ -470,6 +1017,20 @@ static int rc_dict_init(rc_handle *rh, FILE *dictfd, char const *filename)
 				goto error;
 			}
 
+			if (p->lazy && filename != NULL)
+			{
+				deferred = dict_defer_block(rh, dictfd, filename, v,
+							    &buffer, &bufsize, &line_no);
+				if (deferred < 0)
+				{
+					goto error;
+				}
+				if (deferred == 0)
+				{
+					continue;
+				}
+			}
+
 			attr_vendorspec = v->vendorpec;
 		}
 		else if (strcmp (tok, "VENDOR") == 0)
@@ -508,19 +1069,10 @@ static int rc_dict_init(rc_handle *rh, FILE *dictfd, char const *filename)
 			}
 			value = atoi (valstr);
 
-			/* Create a new VENDOR entry for the list */
-			dvend = malloc(sizeof(DICT_VENDOR));
-			if (dvend == NULL)
+			if (rc_dict_addvend(rh, attrstr, value) == NULL)
 			{
-				rc_log(LOG_CRIT, "rc_dict_init: out of memory");
 				goto error;
 			}
-			strlcpy (dvend->vendorname, attrstr, sizeof(dvend->vendorname));
-			dvend->vendorpec = value;
-
-			/* Insert it into the list */
-			dvend->next = rh->dictionary_vendors;
-			rh->dictionary_vendors = dvend;
 		}
 	}
 	free(buffer);
@@ -530,24 +1082,12 @@ error:
 	free(buffer);
 	return -1;
 }
-/// @endcond
 
-/** @brief Initialize the dictionary
- *
- * Read all ATTRIBUTES into the dictionary_attributes list.
- * Read all VALUES into the dictionary_values list.
- *
- * @param rh a handle to parsed configuration.
- * @param filename the name of the dictionary file.
- * @return 0 on success, -1 on failure.
- */
-int rc_read_dictionary (rc_handle *rh, char const *filename)
+static int dict_parse_file(rc_handle *rh, char const *filename,
+			   struct dict_parse const *p)
 {
 	FILE    *dictfd;
-	int     ret_val = 0;
-
-	if (rh->first_dict_read != NULL && strcmp(filename, rh->first_dict_read) == 0)
-		return 0;
+	int     ret_val;
 
 	if ((dictfd = fopen (filename, "r")) == NULL)
 	{
@@ -556,15 +1096,192 @@ int rc_read_dictionary (rc_handle *rh, char const *filename)
 		return -1;
 	}
 
-	ret_val = rc_dict_init(rh, dictfd, filename);
+	if (p->srcs != NULL && dict_sources_add(p->srcs, filename, fileno(dictfd)) < 0)
+	{
+		fclose (dictfd);
+		return -1;
+	}
+
+	if (p->block != NULL && fseek(dictfd, p->block->offset, SEEK_SET) != 0)
+	{
+		rc_log(LOG_ERR, "rc_read_dictionary couldn't seek in dictionary %s: %s",
+				filename, strerror(errno));
+		fclose (dictfd);
+		return -1;
+	}
+
+	ret_val = rc_dict_init(rh, dictfd, filename, p);
 
 	fclose (dictfd);
 
+	return ret_val;
+}
+
+/* Reads a dictionary file and the files it includes */
+int dict_read_file(rc_handle *rh, char const *filename,
+		   struct dict_sources *srcs)
+{
+	struct dict_parse p = { srcs, 0, NULL };
+
+	return dict_parse_file(rh, filename, &p);
+}
+
+/* Reads a deferred block. A block that cannot be read is not tried
+ * again, with what was read of it kept. */
+static void dict_lazy_read(rc_handle *rh, size_t i)
+{
+	struct rc_dict_lazy *lz = rh->dict_lazy;
+	struct dict_block *b = &lz->blocks[i];
+	struct dict_parse p = { NULL, 0, b };
+
+	b->read = 1;
+	lz->unread--;
+	if (dict_parse_file(rh, b->filename, &p) < 0)
+		rc_log(LOG_ERR, "rc_read_dictionary: couldn't read vendor %s "
+		       "on line %d of dictionary %s", b->vendorname, b->line,
+		       b->filename);
+}
+
+/* Reads the deferred blocks holding an entry with the key, in file
+ * order, and looks it up again. Called with the lazy lock held. */
+static void *dict_lazy_lookup(rc_handle *rh, int table,
+			      struct dict_key const *key)
+{
+	struct rc_dict_lazy *lz = rh->dict_lazy;
+	struct dict_pending *e;
+	char const *name = "";
+	uint64_t num = 0;
+	int found = 0;
+
+	switch (table) {
+	case DICT_ATTR_ID:
+		num = key->num;
+		break;
+	case DICT_ATTR_NAME:
+	case DICT_VAL_NAME:
+	case DICT_VAL_ATTR:
+		name = key->name;
+		break;
+	default:
+		/* vendors are not deferred */
+		return NULL;
+	}
+
+	if (name == NULL || lz->size == 0)
+		return NULL;
+
+	for (e = lz->bucket[dict_pending_hash(table, name, num) & (lz->size - 1)];
+	     e != NULL; e = e->next) {
+		if (e->table == table && e->num == num &&
+		    strcasecmp(e->name, name) == 0 && !lz->blocks[e->block].read) {
+			dict_lazy_read(rh, e->block);
+			found = 1;
+		}
+	}
+
+	return found ? dict_lookup_loaded(rh, table, key) : NULL;
+}
+
+/* Looks a key up as dict_lookup_loaded() does; on handles with deferred
+ * vendor blocks, those holding the key are read when it is not found
+ * otherwise */
+static void *dict_lookup(rc_handle const *rh, int table,
+			 struct dict_key const *key)
+{
+	struct rc_dict_lazy *lz = rh->dict_lazy;
+	void *entry;
+
+	if (lz == NULL)
+		return dict_lookup_loaded(rh, table, key);
+
+	pthread_mutex_lock(&lz->lock);
+	entry = dict_lookup_loaded(rh, table, key);
+	if (entry == NULL && lz->unread > 0)
+		entry = dict_lazy_lookup((rc_handle *)rh, table, key);
+	pthread_mutex_unlock(&lz->lock);
+	return entry;
+}
+
+static int dict_read(rc_handle *rh, char const *filename, int lazy)
+{
+	struct dict_parse p = { NULL, lazy, NULL };
+	int     ret_val;
+
+	if (rh->first_dict_read != NULL && strcmp(filename, rh->first_dict_read) == 0)
+		return 0;
+
+	if (rh->dict_index == NULL && rh->dict == NULL &&
+	    (rh->dict = dict_cache_map(filename)) != NULL)
+	{
+		ret_val = 0;
+	}
+	else
+	{
+		if (lazy && rh->dict_lazy == NULL)
+		{
+			rh->dict_lazy = calloc(1, sizeof(*rh->dict_lazy));
+			if (rh->dict_lazy == NULL)
+			{
+				rc_log(LOG_CRIT, "rc_read_dictionary: out of memory");
+				return -1;
+			}
+			pthread_mutex_init(&rh->dict_lazy->lock, NULL);
+		}
+		ret_val = dict_parse_file(rh, filename, &p);
+	}
+
 	if (rh->first_dict_read == NULL)
 		rh->first_dict_read = strdup(filename);
 
 	return ret_val;
 }
+/// @endcond
+
+/** @brief Initialize the dictionary
+ *
+ * Read all ATTRIBUTES into the dictionary_attributes list.
+ * Read all VALUES into the dictionary_values list.
+ *
+ * When a cache compiled from the file by rc_compile_dictionary() exists
+ * and none of the files it was compiled from changed since, the cache
+ * is mapped instead of reading the files. That is done only while the
+ * handle has no dictionary entries of its own, so that entries added
+ * later still take precedence.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param filename the name of the dictionary file.
+ * @return 0 on success, -1 on failure.
+ */
+int rc_read_dictionary (rc_handle *rh, char const *filename)
+{
+	return dict_read(rh, filename, 0);
+}
+
+/** @brief Initialize the dictionary, deferring vendor blocks
+ *
+ * Reads the dictionary as rc_read_dictionary() does, except that the
+ * ATTRIBUTE and VALUE lines of BEGIN-VENDOR blocks are not parsed into
+ * entries; only the VENDOR lines and the entries outside blocks are.
+ * The names and IDs the lines of a block define are indexed instead, and
+ * a lookup that misses reads the blocks defining the key it is for, and
+ * none other. So the time and memory the dictionary takes depend on the
+ * vendors used rather than those installed, and looking up a name that
+ * is not defined reads nothing. A block with an $INCLUDE line is read
+ * at once.
+ *
+ * Lookups on the handle take a lock, and the files must stay in place
+ * while it is used. Errors in a block are logged when it is read rather
+ * than reported here. A cache compiled by rc_compile_dictionary() is
+ * used as by rc_read_dictionary().
+ *
+ * @param rh a handle to parsed configuration.
+ * @param filename the name of the dictionary file.
+ * @return 0 on success, -1 on failure.
+ */
+int rc_read_dictionary_lazy (rc_handle *rh, char const *filename)
+{
+	return dict_read(rh, filename, 1);
+}
 
 /** @brief Initialize the dictionary from Buffer
  *
@@ -580,6 +1297,7 @@ int rc_read_dictionary_from_buffer (rc_handle *rh, char const *buf, size_t size)
 {
 	FILE      *dictfd;
 	int       ret_val = 0;
+	struct dict_parse p = { NULL, 0, NULL };
 
 	if ((dictfd = fmemopen ((void *)buf, size, "r")) == NULL)
 	{
@@ -588,7 +1306,7 @@ int rc_read_dictionary_from_buffer (rc_handle *rh, char const *buf, size_t size)
 		return -1;
 	}
 
-	ret_val = rc_dict_init(rh, dictfd, NULL);
+	ret_val = rc_dict_init(rh, dictfd, NULL, &p);
 
 	fclose (dictfd);
 
@@ -603,18 +1321,9 @@ int rc_read_dictionary_from_buffer (rc_handle *rh, char const *buf, size_t size)
  */
 DICT_ATTR *rc_dict_getattr(rc_handle const *rh, uint64_t attribute)
 {
-	DICT_ATTR      *attr;
+	struct dict_key key = { NULL, attribute };
 
-	attr = rh->dictionary_attributes;
-	while (attr != NULL)
-	{
-		if (attr->value == attribute)
-		{
-			return attr;
-		}
-		attr = attr->next;
-	}
-	return NULL;
+	return dict_lookup(rh, DICT_ATTR_ID, &key);
 }
 
 /** @brief Lookup a DICT_ATTR by its name
@@ -626,18 +1335,9 @@ DICT_ATTR *rc_dict_getattr(rc_handle const *rh, uint64_t attribute)
  */
 DICT_ATTR *rc_dict_findattr(rc_handle const *rh, char const *attrname)
 {
-	DICT_ATTR      *attr;
+	struct dict_key key = { attrname, 0 };
 
-	attr = rh->dictionary_attributes;
-	while (attr != NULL)
-	{
-		if (strcasecmp (attr->name, attrname) == 0)
-		{
-			return attr;
-		}
-		attr = attr->next;
-	}
-	return NULL;
+	return dict_lookup(rh, DICT_ATTR_NAME, &key);
 }
 
 
@@ -649,17 +1349,9 @@ DICT_ATTR *rc_dict_findattr(rc_handle const *rh, char const *attrname)
  */
 DICT_VALUE *rc_dict_findval(rc_handle const *rh, char const *valname)
 {
-	DICT_VALUE     *val;
-	val = rh->dictionary_values;
-	while (val != NULL)
-	{
-		if (strcasecmp (val->name, valname) == 0)
-		{
-			return val;
-		}
-		val = val->next;
-	}
-	return NULL;
+	struct dict_key key = { valname, 0 };
+
+	return dict_lookup(rh, DICT_VAL_NAME, &key);
 }
 
 /** @brief Lookup a DICT_VENDOR by its name
@@ -670,12 +1362,9 @@ DICT_VALUE *rc_dict_findval(rc_handle const *rh, char const *valname)
  */
 DICT_VENDOR *rc_dict_findvend(rc_handle const *rh, char const *vendorname)
 {
-	DICT_VENDOR	*vend;
+	struct dict_key key = { vendorname, 0 };
 
-	for (vend = rh->dictionary_vendors; vend != NULL; vend = vend->next)
-		if (strcasecmp(vend->vendorname, vendorname) == 0)
-			return vend;
-	return NULL;
+	return dict_lookup(rh, DICT_VEND_NAME, &key);
 }
 
 /** @brief Lookup a DICT_VENDOR by its IANA number
@@ -686,12 +1375,9 @@ DICT_VENDOR *rc_dict_findvend(rc_handle const *rh, char const *vendorname)
  */
 DICT_VENDOR *rc_dict_getvend (rc_handle const *rh, uint32_t vendorspec)
 {
-        DICT_VENDOR      *vend;
+	struct dict_key key = { NULL, vendorspec };
 
-	for (vend = rh->dictionary_vendors; vend != NULL; vend = vend->next)
-		if (vend->vendorpec == vendorspec)
-			return vend;
-	return NULL;
+	return dict_lookup(rh, DICT_VEND_ID, &key);
 }
 
 /** @brief Get DICT_VALUE based on attribute name and integer value number
@@ -703,22 +1389,15 @@ DICT_VENDOR *rc_dict_getvend (rc_handle const *rh, uint32_t vendorspec)
  */
 DICT_VALUE *rc_dict_getval(rc_handle const *rh, uint32_t value, char const *attrname)
 {
-	DICT_VALUE     *val;
+	struct dict_key key = { attrname, value };
 
-	val = rh->dictionary_values;
-	while (val != NULL)
-	{
-		if (strcasecmp (val->attrname, attrname) == 0 &&
-				val->value == value)
-		{
-			return val;
-		}
-		val = val->next;
-	}
-	return NULL;
+	return dict_lookup(rh, DICT_VAL_ATTR, &key);
 }
 
 /** @brief Frees the allocated dictionary
+ *
+ * The built-in dictionary and any shared dictionary or cache are
+ * detached as well, so that no lookup succeeds until a dictionary is read again.
  *
  * @param rh a handle to parsed configuration.
  */
@@ -727,6 +1406,8 @@ void rc_dict_free(rc_handle *rh)
 	DICT_ATTR	*attr, *nattr;
 	DICT_VALUE	*val, *nval;
 	DICT_VENDOR	*vend, *nvend;
+	int		i;
+	size_t		j;
 
 	for (attr = rh->dictionary_attributes; attr != NULL; attr = nattr) {
 		nattr = attr->next;
@@ -743,5 +1424,36 @@ void rc_dict_free(rc_handle *rh)
 	rh->dictionary_attributes = NULL;
 	rh->dictionary_values = NULL;
 	rh->dictionary_vendors = NULL;
+	rh->dict_rfc = 0;
+	if (rh->dict != NULL) {
+		rc_dict_unref(rh->dict);
+		rh->dict = NULL;
+	}
+
+	if (rh->dict_index != NULL) {
+		for (i = 0; i < DICT_TABLES; i++)
+			free(rh->dict_index->t[i].slot);
+		free(rh->dict_index);
+		rh->dict_index = NULL;
+	}
+
+	if (rh->dict_lazy != NULL) {
+		struct rc_dict_lazy *lz = rh->dict_lazy;
+		struct dict_pending *e, *next;
+
+		for (j = 0; j < lz->size; j++) {
+			for (e = lz->bucket[j]; e != NULL; e = next) {
+				next = e->next;
+				free(e);
+			}
+		}
+		free(lz->bucket);
+		for (j = 0; j < lz->n; j++)
+			free(lz->blocks[j].filename);
+		free(lz->blocks);
+		pthread_mutex_destroy(&lz->lock);
+		free(lz);
+		rh->dict_lazy = NULL;
+	}
 }
 /** @} */
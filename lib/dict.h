@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2026, Nikos Mavrogiannopoulos.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _DICT_H
+#define _DICT_H
+
+#include <config.h>
+#include <pthread.h>
+
+/* The hash tables over the dictionary, see dict.c */
+enum {
+	DICT_ATTR_ID,
+	DICT_ATTR_NAME,
+	DICT_VAL_NAME,
+	DICT_VAL_ATTR,
+	DICT_VEND_ID,
+	DICT_VEND_NAME,
+	DICT_TABLES
+};
+
+/* What a table is keyed on: a name, a number, or both */
+struct dict_key {
+	char const	*name;
+	uint64_t	num;
+};
+
+/* A read-only dictionary held in arrays, such as the built-in one or a
+ * mapped cache. Each table slot holds the index + 1 of an entry, or 0
+ * when empty; entries are placed with dict_static_hash() and linear
+ * probing, and the tables are at most half full. */
+struct dict_static {
+	DICT_ATTR const		*attrs;
+	DICT_VALUE const	*values;
+	DICT_VENDOR const	*vendors;
+	uint32_t const		*slot[DICT_TABLES];
+	size_t			size[DICT_TABLES]; /* powers of two */
+};
+
+/* A file a dictionary was read from, as it was when read */
+struct dict_source {
+	char		*path;
+	uint64_t	size;
+	int64_t		mtime_sec;
+	int64_t		mtime_nsec;
+};
+
+struct dict_sources {
+	struct dict_source	*src;
+	size_t			n;
+};
+
+/* A read-only dictionary image, either a mapped cache or built in
+ * memory, that handles refer to */
+struct rc_dict {
+	struct dict_static	s;
+	void			*map;	/* the mapped cache, or NULL */
+	void			*img;	/* the image built in memory, or NULL */
+	size_t			len;
+	pthread_mutex_t		lock;	/* protects refs */
+	unsigned		refs;
+};
+
+void dict_entry_key(int table, void const *entry, struct dict_key *key);
+int dict_key_eq(struct dict_key const *a, struct dict_key const *b);
+uint32_t dict_static_hash(struct dict_key const *key);
+int dict_read_file(rc_handle *rh, char const *filename,
+		   struct dict_sources *srcs);
+
+struct rc_dict *dict_cache_map(char const *filename);
+int dict_sources_add(struct dict_sources *srcs, char const *filename, int fd);
+void dict_sources_free(struct dict_sources *srcs);
+
+#endif
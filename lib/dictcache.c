@@ -0,0 +1,714 @@
+/*
+ * Copyright (c) 2026, Nikos Mavrogiannopoulos.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @defgroup radcli-api Main API
+ * @brief Main API Functions
+ *
+ * @{
+ */
+
+#include <config.h>
+#include <includes.h>
+#include <radcli/radcli.h>
+#include <sys/mman.h>
+#include "util.h"
+#include "dict.h"
+
+/* rc_compile_dictionary() reads a dictionary with everything it
+ * includes and writes it out as one image: the entries, the hash tables
+ * over them in the layout of struct dict_static, and the size and
+ * modification time of each file read. Positions are offsets from the
+ * start of the image, so rc_read_dictionary() maps it read-only and
+ * uses it in place; processes mapping the same cache share its pages.
+ *
+ * The image is in the byte order and structure layout of the host that
+ * wrote it, which the header records; a cache that does not match, is
+ * malformed, or whose files changed since it was written is ignored
+ * and the dictionary is read as usual. The cache is replaced by
+ * renaming a new file over it, so that processes which mapped the old
+ * one keep it intact.
+ *
+ * An image, mapped or built in memory by rc_dict_load(), is held by a
+ * reference counted struct rc_dict. Handles attached to it only read
+ * it, so the lookups of handles on different threads need no lock;
+ * only the reference count has one. */
+
+/// @cond INTERNAL
+#define DICT_CACHE_MAGIC	"RCDICT\r\n"
+#define DICT_CACHE_VERSION	1
+#define DICT_CACHE_ENDIAN	0x01020304
+
+/* Appended to the dictionary file name by default */
+#define DICT_CACHE_SUFFIX	".cache"
+
+/* Every section starts at a multiple of this */
+#define DICT_CACHE_ALIGN	8
+#define CACHE_ALIGN(x)	(((x) + DICT_CACHE_ALIGN - 1) & ~(uint64_t)(DICT_CACHE_ALIGN - 1))
+
+struct dict_cache_hdr {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	endian;		/* DICT_CACHE_ENDIAN as written */
+	uint32_t	hdr_size;
+	uint32_t	attr_size;	/* sizeof(DICT_ATTR) */
+	uint32_t	value_size;	/* sizeof(DICT_VALUE) */
+	uint32_t	vendor_size;	/* sizeof(DICT_VENDOR) */
+	uint32_t	nattrs;
+	uint32_t	nvalues;
+	uint32_t	nvendors;
+	uint32_t	nsources;
+	uint32_t	table_size[DICT_TABLES];
+	uint64_t	image_size;
+	uint64_t	attrs_off;
+	uint64_t	values_off;
+	uint64_t	vendors_off;
+	uint64_t	sources_off;	/* of struct dict_cache_src[nsources] */
+	uint64_t	table_off[DICT_TABLES];
+};
+
+struct dict_cache_src {
+	uint64_t	size;
+	int64_t		mtime_sec;
+	int64_t		mtime_nsec;
+	uint64_t	path_off;	/* of a NUL terminated string */
+};
+
+/* Records a dictionary file that was opened as @fd */
+int dict_sources_add(struct dict_sources *srcs, char const *filename, int fd)
+{
+	struct dict_source *src;
+	struct stat st;
+	char *path;
+
+	if (fstat(fd, &st) == -1) {
+		rc_log(LOG_ERR, "rc_compile_dictionary: cannot stat %s: %s",
+		       filename, strerror(errno));
+		return -1;
+	}
+
+	/* the cache may be used from another working directory */
+	path = realpath(filename, NULL);
+	if (path == NULL)
+		path = strdup(filename);
+	if (path == NULL)
+		goto oom;
+
+	src = realloc(srcs->src, (srcs->n + 1) * sizeof(*src));
+	if (src == NULL) {
+		free(path);
+		goto oom;
+	}
+	srcs->src = src;
+
+	src = &srcs->src[srcs->n++];
+	src->path = path;
+	src->size = st.st_size;
+	src->mtime_sec = st.st_mtim.tv_sec;
+	src->mtime_nsec = st.st_mtim.tv_nsec;
+	return 0;
+
+oom:
+	rc_log(LOG_CRIT, "rc_compile_dictionary: out of memory");
+	return -1;
+}
+
+void dict_sources_free(struct dict_sources *srcs)
+{
+	size_t i;
+
+	for (i = 0; i < srcs->n; i++)
+		free(srcs->src[i].path);
+	free(srcs->src);
+	srcs->src = NULL;
+	srcs->n = 0;
+}
+
+/* Smallest power of two that is at least twice n, as in gen-dict.awk */
+static uint32_t cache_table_size(uint32_t n)
+{
+	uint32_t size = 4;
+
+	while (size < 2 * (uint64_t)n)
+		size *= 2;
+	return size;
+}
+
+static void const *cache_entry(uint8_t const *img,
+			       struct dict_cache_hdr const *h, int table,
+			       uint32_t i)
+{
+	switch (table) {
+	case DICT_ATTR_ID:
+	case DICT_ATTR_NAME:
+		return img + h->attrs_off + (size_t)i * sizeof(DICT_ATTR);
+	case DICT_VAL_NAME:
+	case DICT_VAL_ATTR:
+		return img + h->values_off + (size_t)i * sizeof(DICT_VALUE);
+	default:
+		return img + h->vendors_off + (size_t)i * sizeof(DICT_VENDOR);
+	}
+}
+
+static uint32_t cache_entries(struct dict_cache_hdr const *h, int table)
+{
+	switch (table) {
+	case DICT_ATTR_ID:
+	case DICT_ATTR_NAME:
+		return h->nattrs;
+	case DICT_VAL_NAME:
+	case DICT_VAL_ATTR:
+		return h->nvalues;
+	default:
+		return h->nvendors;
+	}
+}
+
+/* Places the entries of a table in the order they were added; an entry
+ * replaces an earlier one with the same key, as in dict_put() */
+static void cache_fill_table(uint8_t *img, struct dict_cache_hdr const *h,
+			     int table)
+{
+	uint32_t *slot = (uint32_t *)(img + h->table_off[table]);
+	uint32_t mask = h->table_size[table] - 1;
+	uint32_t n = cache_entries(h, table);
+	struct dict_key key, k;
+	uint32_t i, s;
+
+	for (i = 0; i < n; i++) {
+		dict_entry_key(table, cache_entry(img, h, table, i), &key);
+		for (s = dict_static_hash(&key) & mask; slot[s] != 0;
+		     s = (s + 1) & mask) {
+			dict_entry_key(table, cache_entry(img, h, table, slot[s] - 1), &k);
+			if (dict_key_eq(&k, &key))
+				break;
+		}
+		slot[s] = i + 1;
+	}
+}
+
+/* Lays out the image of the dictionary of @rh */
+static uint8_t *cache_build(rc_handle const *rh,
+			    struct dict_sources const *srcs, size_t *len)
+{
+	struct dict_cache_hdr h;
+	struct dict_cache_src *csrc;
+	DICT_ATTR const *attr;
+	DICT_VALUE const *val;
+	DICT_VENDOR const *vend;
+	DICT_ATTR *a;
+	DICT_VALUE *v;
+	DICT_VENDOR *d;
+	uint8_t *img;
+	uint64_t off;
+	uint32_t i;
+	int t;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, DICT_CACHE_MAGIC, sizeof(h.magic));
+	h.version = DICT_CACHE_VERSION;
+	h.endian = DICT_CACHE_ENDIAN;
+	h.hdr_size = sizeof(h);
+	h.attr_size = sizeof(DICT_ATTR);
+	h.value_size = sizeof(DICT_VALUE);
+	h.vendor_size = sizeof(DICT_VENDOR);
+
+	for (attr = rh->dictionary_attributes; attr != NULL; attr = attr->next)
+		h.nattrs++;
+	for (val = rh->dictionary_values; val != NULL; val = val->next)
+		h.nvalues++;
+	for (vend = rh->dictionary_vendors; vend != NULL; vend = vend->next)
+		h.nvendors++;
+	h.nsources = srcs->n;
+
+	off = CACHE_ALIGN(sizeof(h));
+	h.attrs_off = off;
+	off = CACHE_ALIGN(off + (uint64_t)h.nattrs * sizeof(DICT_ATTR));
+	h.values_off = off;
+	off = CACHE_ALIGN(off + (uint64_t)h.nvalues * sizeof(DICT_VALUE));
+	h.vendors_off = off;
+	off = CACHE_ALIGN(off + (uint64_t)h.nvendors * sizeof(DICT_VENDOR));
+	for (t = 0; t < DICT_TABLES; t++) {
+		h.table_size[t] = cache_table_size(cache_entries(&h, t));
+		h.table_off[t] = off;
+		off = CACHE_ALIGN(off + (uint64_t)h.table_size[t] * sizeof(uint32_t));
+	}
+	h.sources_off = off;
+	off += (uint64_t)h.nsources * sizeof(struct dict_cache_src);
+	for (i = 0; i < h.nsources; i++)
+		off += strlen(srcs->src[i].path) + 1;
+	h.image_size = CACHE_ALIGN(off);
+
+	if (h.image_size > SIZE_MAX || (img = calloc(1, h.image_size)) == NULL) {
+		rc_log(LOG_CRIT, "rc_compile_dictionary: out of memory");
+		return NULL;
+	}
+	memcpy(img, &h, sizeof(h));
+
+	/* the lists are newest first; the image keeps the order of addition */
+	a = (DICT_ATTR *)(img + h.attrs_off) + h.nattrs;
+	for (attr = rh->dictionary_attributes; attr != NULL; attr = attr->next) {
+		a--;
+		strlcpy(a->name, attr->name, sizeof(a->name));
+		a->value = attr->value;
+		a->type = attr->type;
+		a->next = NULL;
+	}
+	v = (DICT_VALUE *)(img + h.values_off) + h.nvalues;
+	for (val = rh->dictionary_values; val != NULL; val = val->next) {
+		v--;
+		strlcpy(v->attrname, val->attrname, sizeof(v->attrname));
+		strlcpy(v->name, val->name, sizeof(v->name));
+		v->value = val->value;
+		v->next = NULL;
+	}
+	d = (DICT_VENDOR *)(img + h.vendors_off) + h.nvendors;
+	for (vend = rh->dictionary_vendors; vend != NULL; vend = vend->next) {
+		d--;
+		strlcpy(d->vendorname, vend->vendorname, sizeof(d->vendorname));
+		d->vendorpec = vend->vendorpec;
+		d->next = NULL;
+	}
+
+	for (t = 0; t < DICT_TABLES; t++)
+		cache_fill_table(img, &h, t);
+
+	csrc = (struct dict_cache_src *)(img + h.sources_off);
+	off = h.sources_off + (uint64_t)h.nsources * sizeof(*csrc);
+	for (i = 0; i < h.nsources; i++) {
+		csrc[i].size = srcs->src[i].size;
+		csrc[i].mtime_sec = srcs->src[i].mtime_sec;
+		csrc[i].mtime_nsec = srcs->src[i].mtime_nsec;
+		csrc[i].path_off = off;
+		strcpy((char *)img + off, srcs->src[i].path);
+		off += strlen(srcs->src[i].path) + 1;
+	}
+
+	*len = h.image_size;
+	return img;
+}
+
+/* Writes @img to @path through a temporary file renamed over it */
+static int cache_write(char const *path, uint8_t const *img, size_t len)
+{
+	char tmp[PATH_MAX];
+	size_t done;
+	ssize_t n;
+	int fd;
+
+	if ((size_t)snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= sizeof(tmp)) {
+		rc_log(LOG_ERR, "rc_compile_dictionary: %s: name too long", path);
+		return -1;
+	}
+
+	fd = mkstemp(tmp);
+	if (fd == -1) {
+		rc_log(LOG_ERR, "rc_compile_dictionary: cannot create %s: %s",
+		       tmp, strerror(errno));
+		return -1;
+	}
+
+	/* readable by the processes that will map it */
+	if (fchmod(fd, 0644) == -1)
+		goto fail;
+
+	for (done = 0; done < len; done += n) {
+		n = write(fd, img + done, len - done);
+		if (n == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			goto fail;
+		}
+	}
+
+	if (close(fd) == -1) {
+		fd = -1;
+		goto fail;
+	}
+	fd = -1;
+
+	if (rename(tmp, path) == -1)
+		goto fail;
+	return 0;
+
+fail:
+	rc_log(LOG_ERR, "rc_compile_dictionary: cannot write %s: %s",
+	       path, strerror(errno));
+	if (fd != -1)
+		close(fd);
+	unlink(tmp);
+	return -1;
+}
+
+/* Checks that the mapped image is one this host can use, and that
+ * nothing in it points outside of it */
+static int cache_check(uint8_t const *img, size_t len)
+{
+	struct dict_cache_hdr const *h = (struct dict_cache_hdr const *)img;
+	struct dict_cache_src const *csrc;
+	DICT_ATTR const *a;
+	DICT_VALUE const *v;
+	DICT_VENDOR const *d;
+	uint32_t const *slot;
+	uint32_t i, n, used;
+	int t;
+
+#define REGION_OK(off, n, elem) \
+	((off) % DICT_CACHE_ALIGN == 0 && (off) <= len && \
+	 (uint64_t)(n) <= (len - (off)) / (elem))
+
+	if (len < sizeof(*h) ||
+	    memcmp(h->magic, DICT_CACHE_MAGIC, sizeof(h->magic)) != 0 ||
+	    h->version != DICT_CACHE_VERSION ||
+	    h->endian != DICT_CACHE_ENDIAN ||
+	    h->hdr_size != sizeof(*h) ||
+	    h->attr_size != sizeof(DICT_ATTR) ||
+	    h->value_size != sizeof(DICT_VALUE) ||
+	    h->vendor_size != sizeof(DICT_VENDOR) ||
+	    h->image_size != len)
+		return -1;
+
+	if (!REGION_OK(h->attrs_off, h->nattrs, sizeof(DICT_ATTR)) ||
+	    !REGION_OK(h->values_off, h->nvalues, sizeof(DICT_VALUE)) ||
+	    !REGION_OK(h->vendors_off, h->nvendors, sizeof(DICT_VENDOR)) ||
+	    !REGION_OK(h->sources_off, h->nsources, sizeof(*csrc)))
+		return -1;
+
+	/* every table has a free slot, so that probing ends */
+	for (t = 0; t < DICT_TABLES; t++) {
+		if (h->table_size[t] == 0 ||
+		    (h->table_size[t] & (h->table_size[t] - 1)) != 0 ||
+		    !REGION_OK(h->table_off[t], h->table_size[t], sizeof(uint32_t)))
+			return -1;
+
+		slot = (uint32_t const *)(img + h->table_off[t]);
+		n = cache_entries(h, t);
+		used = 0;
+		for (i = 0; i < h->table_size[t]; i++) {
+			if (slot[i] > n)
+				return -1;
+			if (slot[i] != 0)
+				used++;
+		}
+		if (used > h->table_size[t] / 2)
+			return -1;
+	}
+
+	a = (DICT_ATTR const *)(img + h->attrs_off);
+	for (i = 0; i < h->nattrs; i++) {
+		if (memchr(a[i].name, '\0', sizeof(a[i].name)) == NULL)
+			return -1;
+	}
+	v = (DICT_VALUE const *)(img + h->values_off);
+	for (i = 0; i < h->nvalues; i++) {
+		if (memchr(v[i].attrname, '\0', sizeof(v[i].attrname)) == NULL ||
+		    memchr(v[i].name, '\0', sizeof(v[i].name)) == NULL)
+			return -1;
+	}
+	d = (DICT_VENDOR const *)(img + h->vendors_off);
+	for (i = 0; i < h->nvendors; i++) {
+		if (memchr(d[i].vendorname, '\0', sizeof(d[i].vendorname)) == NULL)
+			return -1;
+	}
+
+	csrc = (struct dict_cache_src const *)(img + h->sources_off);
+	for (i = 0; i < h->nsources; i++) {
+		if (csrc[i].path_off >= len ||
+		    memchr(img + csrc[i].path_off, '\0', len - csrc[i].path_off) == NULL)
+			return -1;
+	}
+#undef REGION_OK
+
+	return 0;
+}
+
+/* Whether the files the image was compiled from are unchanged */
+static int cache_fresh(uint8_t const *img)
+{
+	struct dict_cache_hdr const *h = (struct dict_cache_hdr const *)img;
+	struct dict_cache_src const *csrc;
+	struct stat st;
+	uint32_t i;
+
+	csrc = (struct dict_cache_src const *)(img + h->sources_off);
+	for (i = 0; i < h->nsources; i++) {
+		if (stat((char const *)img + csrc[i].path_off, &st) == -1)
+			return 0;
+		if ((uint64_t)st.st_size != csrc[i].size ||
+		    (int64_t)st.st_mtim.tv_sec != csrc[i].mtime_sec ||
+		    (int64_t)st.st_mtim.tv_nsec != csrc[i].mtime_nsec)
+			return 0;
+	}
+	return 1;
+}
+
+/* A dictionary over @img, holding one reference */
+static struct rc_dict *dict_new(uint8_t const *img)
+{
+	struct dict_cache_hdr const *h = (struct dict_cache_hdr const *)img;
+	struct rc_dict *dict;
+	int t;
+
+	dict = calloc(1, sizeof(*dict));
+	if (dict == NULL) {
+		rc_log(LOG_CRIT, "rc_dict_load: out of memory");
+		return NULL;
+	}
+
+	if (pthread_mutex_init(&dict->lock, NULL) != 0) {
+		rc_log(LOG_CRIT, "rc_dict_load: cannot initialize mutex");
+		free(dict);
+		return NULL;
+	}
+	dict->refs = 1;
+
+	dict->s.attrs = (DICT_ATTR const *)(img + h->attrs_off);
+	dict->s.values = (DICT_VALUE const *)(img + h->values_off);
+	dict->s.vendors = (DICT_VENDOR const *)(img + h->vendors_off);
+	for (t = 0; t < DICT_TABLES; t++) {
+		dict->s.slot[t] = (uint32_t const *)(img + h->table_off[t]);
+		dict->s.size[t] = h->table_size[t];
+	}
+	return dict;
+}
+
+/* Maps the cache of the dictionary @filename, if there is one that can
+ * be used */
+struct rc_dict *dict_cache_map(char const *filename)
+{
+	struct rc_dict *dict;
+	char path[PATH_MAX];
+	struct stat st;
+	void *map;
+	size_t len;
+	int fd;
+
+	if ((size_t)snprintf(path, sizeof(path), "%s%s", filename,
+			     DICT_CACHE_SUFFIX) >= sizeof(path))
+		return NULL;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		if (errno != ENOENT)
+			rc_log(LOG_ERR, "rc_read_dictionary: cannot open %s: %s",
+			       path, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) == -1 || st.st_size <= 0 ||
+	    (uint64_t)st.st_size > SIZE_MAX) {
+		rc_log(LOG_ERR, "rc_read_dictionary: %s is not a dictionary cache",
+		       path);
+		close(fd);
+		return NULL;
+	}
+	len = st.st_size;
+
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		rc_log(LOG_ERR, "rc_read_dictionary: cannot map %s: %s",
+		       path, strerror(errno));
+		return NULL;
+	}
+
+	if (cache_check(map, len) < 0) {
+		rc_log(LOG_ERR, "rc_read_dictionary: %s is not a dictionary cache "
+		       "of this host, reading %s", path, filename);
+		goto fail;
+	}
+
+	if (!cache_fresh(map)) {
+		rc_log(LOG_INFO, "rc_read_dictionary: %s is out of date, reading %s",
+		       path, filename);
+		goto fail;
+	}
+
+	dict = dict_new(map);
+	if (dict == NULL)
+		goto fail;
+	dict->map = map;
+	dict->len = len;
+	return dict;
+
+fail:
+	munmap(map, len);
+	return NULL;
+}
+
+/* Reads the dictionary @filename, with the files it includes, into an
+ * image; the files read are recorded in @srcs */
+static uint8_t *dict_compile(char const *filename, struct dict_sources *srcs,
+			     size_t *len)
+{
+	rc_handle *rh;
+	uint8_t *img = NULL;
+
+	rh = rc_new();
+	if (rh == NULL)
+		return NULL;
+	rc_dict_rfc_attach(rh);
+
+	if (dict_read_file(rh, filename, srcs) == 0)
+		img = cache_build(rh, srcs, len);
+
+	rc_destroy(rh);
+	return img;
+}
+/// @endcond
+
+/** @brief Compiles a dictionary into a cache
+ *
+ * Reads the dictionary @p filename together with the files it includes,
+ * and writes them as a single image that rc_read_dictionary() and
+ * rc_dict_load() map instead of reading the files, for as long as none
+ * of them changes. The built-in dictionary is available to the files
+ * read, as with rc_read_config(), but is not copied into the cache.
+ *
+ * An existing cache is replaced atomically; processes that mapped it
+ * keep using the old one.
+ *
+ * @param filename the name of the dictionary file.
+ * @param cachefile the cache to write, or NULL for @p filename with
+ *	".cache" appended, which is where rc_read_dictionary() looks.
+ * @return 0 on success, -1 on failure.
+ */
+int rc_compile_dictionary(char const *filename, char const *cachefile)
+{
+	struct dict_sources srcs = { NULL, 0 };
+	char path[PATH_MAX];
+	uint8_t *img;
+	size_t len;
+	int ret = -1;
+
+	if (cachefile == NULL) {
+		if ((size_t)snprintf(path, sizeof(path), "%s%s", filename,
+				     DICT_CACHE_SUFFIX) >= sizeof(path)) {
+			rc_log(LOG_ERR, "rc_compile_dictionary: %s: name too long",
+			       filename);
+			return -1;
+		}
+		cachefile = path;
+	}
+
+	img = dict_compile(filename, &srcs, &len);
+	if (img != NULL)
+		ret = cache_write(cachefile, img, len);
+
+	free(img);
+	dict_sources_free(&srcs);
+	return ret;
+}
+
+/** @brief Loads a dictionary to be shared by handles
+ *
+ * Reads the dictionary @p filename together with the files it includes,
+ * or maps its cache (see rc_compile_dictionary()), into a read-only
+ * dictionary that any number of handles can use through
+ * rc_dict_attach(). Such a dictionary is never modified, so handles on
+ * different threads look it up without locking. The built-in dictionary
+ * is available to the files read, as with rc_read_config(), but is not
+ * part of the result.
+ *
+ * @param filename the name of the dictionary file.
+ * @return the dictionary, to be released with rc_dict_unref(), or NULL
+ *	on failure.
+ */
+rc_dict *rc_dict_load(char const *filename)
+{
+	struct dict_sources srcs = { NULL, 0 };
+	struct rc_dict *dict;
+	uint8_t *img;
+	size_t len;
+
+	dict = dict_cache_map(filename);
+	if (dict != NULL)
+		return dict;
+
+	img = dict_compile(filename, &srcs, &len);
+	dict_sources_free(&srcs);
+	if (img == NULL)
+		return NULL;
+
+	dict = dict_new(img);
+	if (dict == NULL) {
+		free(img);
+		return NULL;
+	}
+	dict->img = img;
+	dict->len = len;
+	return dict;
+}
+
+/** @brief Makes a handle use a shared dictionary
+ *
+ * The handle takes a reference to @p dict, released by rc_dict_free()
+ * or rc_destroy(), and drops the one to any dictionary attached before.
+ * Entries the handle reads or adds itself take precedence over those of
+ * @p dict, which take precedence over the built-in dictionary.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param dict a dictionary returned by rc_dict_load().
+ */
+void rc_dict_attach(rc_handle *rh, rc_dict *dict)
+{
+	pthread_mutex_lock(&dict->lock);
+	dict->refs++;
+	pthread_mutex_unlock(&dict->lock);
+
+	if (rh->dict != NULL)
+		rc_dict_unref(rh->dict);
+	rh->dict = dict;
+}
+
+/** @brief Releases a reference to a shared dictionary
+ *
+ * The dictionary is freed with its last reference, that is once
+ * rc_dict_unref() was called for rc_dict_load() and every handle it was
+ * attached to was freed with rc_dict_free() or rc_destroy().
+ *
+ * @param dict a dictionary returned by rc_dict_load(), or NULL.
+ */
+void rc_dict_unref(rc_dict *dict)
+{
+	unsigned refs;
+
+	if (dict == NULL)
+		return;
+
+	pthread_mutex_lock(&dict->lock);
+	refs = --dict->refs;
+	pthread_mutex_unlock(&dict->lock);
+	if (refs > 0)
+		return;
+
+	if (dict->map != NULL)
+		munmap(dict->map, dict->len);
+	free(dict->img);
+	pthread_mutex_destroy(&dict->lock);
+	free(dict);
+}
+/** @} */
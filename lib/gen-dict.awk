@@ -1,22 +1,217 @@
 #!/usr/bin/awk -f
-# gen-dict.awk: generates a C string literal from a RADIUS dictionary file.
+# gen-dict.awk: compiles a RADIUS dictionary file into C tables.
 # Usage: awk -f gen-dict.awk etc/dictionary > lib/dict_rfc_gen.h
 #
-# $INCLUDE directives are stripped — the embedded dictionary is self-contained.
+# The attributes, values and vendors become static const arrays, each
+# indexed by two open addressing hash tables laid out here, so that
+# attaching the built-in dictionary to a handle costs neither parsing
+# nor memory. dict_static_hash() in dict.c computes the same hash; the two
+# must agree. A later definition of a key replaces the earlier one in
+# its slot, as rc_dict_add*() do at run time.
+#
+# $INCLUDE directives are skipped — the built-in dictionary is
+# self-contained.
+
+function fail(msg) {
+    printf "gen-dict.awk: %s on line %d\n", msg, NR > "/dev/stderr"
+    err = 1
+    exit 1
+}
+
+# ASCII letters folded to lower case, independent of the locale
+function fold(s,    r, c, i, k) {
+    r = ""
+    for (i = 1; i <= length(s); i++) {
+        c = substr(s, i, 1)
+        k = index(UPPER, c)
+        r = r (k ? substr(LOWER, k, 1) : c)
+    }
+    return r
+}
+
+# djb2 of the folded name, followed by the two 32-bit halves of the
+# number, modulo 2^32
+function hash(name, hi, lo,    h, i, n, c) {
+    h = 5381
+    name = fold(name)
+    n = length(name)
+    for (i = 1; i <= n; i++) {
+        c = substr(name, i, 1)
+        if (!(c in ord))
+            fail("non-ASCII name " name)
+        h = (h * 33 + ord[c]) % 4294967296
+    }
+    h = (h * 33 + hi) % 4294967296
+    h = (h * 33 + lo) % 4294967296
+    return h
+}
+
+# Smallest power of two that is at least twice n
+function tsize(n,    s) {
+    s = 4
+    while (s < 2 * n)
+        s *= 2
+    return s
+}
+
+# Adds entry i to table t, keyed on name (compared without regard to
+# case, "" for none) and the number hi:lo
+function put(t, i, name, hi, lo,    s, size) {
+    size = tsize(count[tbase[t]])
+    s = hash(name, hi, lo) % size
+    while ((t, s) in slot) {
+        if (kname[t, slot[t, s]] == fold(name) &&
+            khi[t, slot[t, s]] == hi && klo[t, slot[t, s]] == lo)
+            break
+        s = (s + 1) % size
+    }
+    slot[t, s] = i
+    kname[t, i] = fold(name)
+    khi[t, i] = hi
+    klo[t, i] = lo
+}
+
+function emit_table(t, cname,    s, size) {
+    size = tsize(count[tbase[t]])
+    printf "static const uint32_t %s[%d] = {", cname, size
+    for (s = 0; s < size; s++) {
+        if (s % 12 == 0)
+            printf "\n\t"
+        else
+            printf " "
+        printf "%d,", ((t, s) in slot) ? slot[t, s] + 1 : 0
+    }
+    print "\n};"
+}
+
+function cstr(s) {
+    gsub(/\\/, "\\\\", s)
+    gsub(/"/, "\\\"", s)
+    return "\"" s "\""
+}
 
 BEGIN {
-    print "/* Generated from etc/dictionary by gen-dict.awk — do not edit */"
-    print "static const char rc_rfc_dictionary[] ="
+    for (i = 1; i < 128; i++)
+        ord[sprintf("%c", i)] = i
+    UPPER = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+    LOWER = "abcdefghijklmnopqrstuvwxyz"
+
+    types["string"] = "PW_TYPE_STRING"
+    types["integer"] = "PW_TYPE_INTEGER"
+    types["ipaddr"] = "PW_TYPE_IPADDR"
+    types["ipv4addr"] = "PW_TYPE_IPADDR"
+    types["ipv6addr"] = "PW_TYPE_IPV6ADDR"
+    types["ipv6prefix"] = "PW_TYPE_IPV6PREFIX"
+    types["date"] = "PW_TYPE_DATE"
+
+    # which list each table indexes
+    tbase["attr_id"] = "attr"; tbase["attr_name"] = "attr"
+    tbase["val_name"] = "val"; tbase["val_attr"] = "val"
+    tbase["vend_id"] = "vend"; tbase["vend_name"] = "vend"
+
+    count["attr"] = count["val"] = count["vend"] = 0
+    vendorspec = 0
+}
+
+{ sub(/#.*/, "") }
+
+NF == 0 || $1 == "$INCLUDE" { next }
+
+$1 == "ATTRIBUTE" {
+    if (NF < 4 || $3 !~ /^[0-9]+$/)
+        fail("invalid attribute")
+    if (!($4 in types))
+        fail("invalid type")
+    v = vendorspec
+    if (NF >= 5) {
+        opt = $5
+        sub(/^vendor=/, "", opt)
+        if (!(fold(opt) in vendpec))
+            fail("unknown Vendor-Id " opt)
+        v = vendpec[fold(opt)]
+    }
+    n = count["attr"]++
+    aname[n] = $2; aid[n] = $3; avend[n] = v; atype[n] = types[$4]
+    next
+}
+
+$1 == "VALUE" {
+    if (NF < 4 || $4 !~ /^[0-9]+$/)
+        fail("invalid value entry")
+    n = count["val"]++
+    vattr[n] = $2; vname[n] = $3; vval[n] = $4
+    next
 }
 
-/^\$INCLUDE/ { next }
+$1 == "VENDOR" {
+    if (NF < 3 || $3 !~ /^[0-9]+$/)
+        fail("invalid Vendor-Id")
+    n = count["vend"]++
+    dname[n] = $2; dpec[n] = $3
+    vendpec[fold($2)] = $3
+    next
+}
 
-{
-    gsub(/\\/, "\\\\")
-    gsub(/"/, "\\\"")
-    printf "    \"%s\\n\"\n", $0
+$1 == "BEGIN-VENDOR" {
+    if (!(fold($2) in vendpec))
+        fail("unknown Vendor " $2)
+    vendorspec = vendpec[fold($2)]
+    next
 }
 
+$1 == "END-VENDOR" { vendorspec = 0; next }
+
+{ fail("unknown keyword " $1) }
+
 END {
-    print "    ;"
+    if (err)
+        exit 1
+
+    for (i = 0; i < count["attr"]; i++) {
+        put("attr_id", i, "", avend[i], aid[i])
+        put("attr_name", i, aname[i], 0, 0)
+    }
+    for (i = 0; i < count["val"]; i++) {
+        put("val_name", i, vname[i], 0, 0)
+        put("val_attr", i, vattr[i], 0, vval[i])
+    }
+    for (i = 0; i < count["vend"]; i++) {
+        put("vend_id", i, "", 0, dpec[i])
+        put("vend_name", i, dname[i], 0, 0)
+    }
+
+    print "/* Generated from etc/dictionary by gen-dict.awk — do not edit */"
+    print ""
+
+    # %.0f rather than %d, which may not reach 2^32
+    printf "static const DICT_ATTR rc_rfc_attrs[%d] = {\n", count["attr"] ? count["attr"] : 1
+    for (i = 0; i < count["attr"]; i++)
+        printf "\t{ %s, RADCLI_VENDOR_ATTR_SET(%.0fU, %.0fU), %s, NULL },\n",
+            cstr(aname[i]), aid[i], avend[i], atype[i]
+    if (!count["attr"])
+        print "\t{ \"\" }"
+    print "};"
+    print ""
+    printf "static const DICT_VALUE rc_rfc_values[%d] = {\n", count["val"] ? count["val"] : 1
+    for (i = 0; i < count["val"]; i++)
+        printf "\t{ %s, %s, %.0fU, NULL },\n", cstr(vattr[i]), cstr(vname[i]), vval[i]
+    if (!count["val"])
+        print "\t{ \"\" }"
+    print "};"
+    print ""
+    printf "static const DICT_VENDOR rc_rfc_vendors[%d] = {\n", count["vend"] ? count["vend"] : 1
+    for (i = 0; i < count["vend"]; i++)
+        printf "\t{ %s, %.0fU, NULL },\n", cstr(dname[i]), dpec[i]
+    if (!count["vend"])
+        print "\t{ \"\" }"
+    print "};"
+    print ""
+
+    print "/* Index + 1 of the entry in each slot, 0 when empty */"
+    emit_table("attr_id", "rc_rfc_attr_id")
+    emit_table("attr_name", "rc_rfc_attr_name")
+    emit_table("val_name", "rc_rfc_val_name")
+    emit_table("val_attr", "rc_rfc_val_attr")
+    emit_table("vend_id", "rc_rfc_vend_id")
+    emit_table("vend_name", "rc_rfc_vend_name")
 }
@@ -17,6 +17,10 @@
 #include <radcli/radcli.h>
 #include "util.h"
 
+#if defined(__linux__)
+#include <linux/in6.h>
+#endif
+
 #define HOSTBUF_SIZE 1024
 
 /*- Returns a struct addrinfo from a host name or address in textual notation.
@@ -35,6 +39,8 @@ struct addrinfo *rc_getaddrinfo (char const *host, unsigned flags)
 	hints.ai_socktype = SOCK_DGRAM;
 	if (flags & PW_AI_PASSIVE)
 		hints.ai_flags = AI_PASSIVE;
+	if (flags & PW_AI_NUMERIC)
+		hints.ai_flags |= AI_NUMERICHOST;
 
 	if (flags & PW_AI_AUTH)
 		service = "radius";
@@ -43,6 +49,8 @@ struct addrinfo *rc_getaddrinfo (char const *host, unsigned flags)
  
 	err = getaddrinfo(host, service, &hints, &res);
 	if (err != 0) {
+		if ((flags & PW_AI_NUMERIC) && err == EAI_NONAME)
+			return NULL;
 		rc_log(LOG_ERR, "rc_getaddrinfo: %s: %s", host ? host : "(null)", gai_strerror(err));
  		return NULL;
  	}
@@ -153,6 +161,47 @@ int rc_get_srcaddr(struct sockaddr *lia, const struct sockaddr *ria)
 	return OK_RC;
 }
 
+/* Applies the use-public-addr setting to an IPv6 socket
+ *
+ * Asks the kernel to prefer a public (non-temporary) IPv6 source
+ * address when use-public-addr is set to true.
+ *
+ * @param rh a handle to parsed configuration
+ * @param sockfd an IPv6 socket
+ * @return OK_RC on success, ERROR_RC if the option could not be set.
+ */
+/// @cond INTERNAL
+int rc_prefer_public_addr(rc_handle *rh, int sockfd)
+{
+	char *non_temp_addr = rc_conf_str(rh, "use-public-addr");
+
+	if (non_temp_addr == NULL || strcasecmp(non_temp_addr, "true") != 0)
+		return OK_RC;
+
+#if defined(__linux__)
+	int sock_opt = IPV6_PREFER_SRC_PUBLIC;
+	if (setsockopt(sockfd, IPPROTO_IPV6, IPV6_ADDR_PREFERENCES,
+			&sock_opt, sizeof(sock_opt)) != 0) {
+		rc_log(LOG_ERR, "rc_send_server: setsockopt: %s",
+			strerror(errno));
+		return ERROR_RC;
+	}
+#elif defined(BSD) || defined(__APPLE__)
+	int sock_opt = 0;
+	if (setsockopt(sockfd, IPPROTO_IPV6, IPV6_PREFER_TEMPADDR,
+		&sock_opt, sizeof(sock_opt)) != 0) {
+		rc_log(LOG_ERR, "rc_send_server: setsockopt: %s",
+			strerror(errno));
+		return ERROR_RC;
+	}
+#else
+	rc_log(LOG_INFO, "rc_send_server: Usage of non-temporary IPv6"
+			" address is not supported in this system");
+#endif
+	return OK_RC;
+}
+/// @endcond
+
 /* Find our source address
  *
  * Get the IP address to be used as a source address
@@ -187,6 +236,7 @@ void rc_own_bind_addr(rc_handle *rh, struct sockaddr_storage *lia)
 		}
 
 		memcpy(lia, info->ai_addr, info->ai_addrlen);
+		freeaddrinfo(info);
        }
 
        return;
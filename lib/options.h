@@ -34,22 +34,39 @@ static OPTION config_options_default[] = {
 {"serv-auth-type",	OT_STR, ST_UNDEF, NULL}, /* alias for serv-type */
 {"namespace",		OT_STR, ST_UNDEF, NULL}, 
 {"use-public-addr",	OT_STR, ST_UNDEF, NULL},
+{"udp-connect",		OT_STR, ST_UNDEF, NULL},
 {"tls-verify-hostname",	OT_STR, ST_UNDEF, NULL},
 {"require-message-authenticator", OT_STR, ST_UNDEF, NULL}, /* default: required; set "no" for legacy servers */
 {"tls-ca-file",		OT_STR, ST_UNDEF, NULL},
 {"tls-cert-file",	OT_STR, ST_UNDEF, NULL},
 {"tls-key-file",	OT_STR, ST_UNDEF, NULL},
+{"tls-sessions",	OT_INT, ST_UNDEF, NULL},
+{"tls-warm-sessions",	OT_INT, ST_UNDEF, NULL},
 {"nas-identifier",	OT_STR, ST_UNDEF, NULL},
 {"nas-ip",		OT_STR, ST_UNDEF, NULL},
 {"authserver",		OT_SRV, ST_UNDEF, NULL},
 {"acctserver",		OT_SRV, ST_UNDEF, NULL},
+{"authserver-balance",	OT_STR, ST_UNDEF, NULL},
+{"acctserver-balance",	OT_STR, ST_UNDEF, NULL},
+{"authserver-weights",	OT_STR, ST_UNDEF, NULL},
+{"acctserver-weights",	OT_STR, ST_UNDEF, NULL},
 {"servers",		OT_STR, ST_UNDEF, NULL},
+{"resolve-ttl",		OT_INT, ST_UNDEF, NULL},
 {"dictionary",		OT_STR, ST_UNDEF, NULL},
+{"dictionary-lazy",	OT_STR, ST_UNDEF, NULL},
 {"default_realm",	OT_STR, ST_UNDEF, NULL},
 {"radius_timeout",	OT_INT, ST_UNDEF, NULL},
+{"radius_timeout_ms",	OT_INT, ST_UNDEF, NULL},
+{"radius_deadline_ms",	OT_INT, ST_UNDEF, NULL},
 {"radius_retries",	OT_INT,	ST_UNDEF, NULL},
 {"radius_deadtime",	OT_INT, ST_UNDEF, NULL},
+{"retransmit",		OT_STR, ST_UNDEF, NULL},
+{"rto-min-ms",		OT_INT, ST_UNDEF, NULL},
+{"rto-max-ms",		OT_INT, ST_UNDEF, NULL},
+{"hedge-delay-ms",	OT_INT, ST_UNDEF, NULL},
+{"hedge-percentile",	OT_INT, ST_UNDEF, NULL},
 {"bindaddr",		OT_STR, ST_UNDEF, NULL},
+{"srcaddr-ttl",		OT_INT, ST_UNDEF, NULL},
 {"clientdebug",		OT_INT, ST_UNDEF, NULL},
 /* Deprecated options */
 {"login_radius",	OT_STR, ST_UNDEF, NULL},
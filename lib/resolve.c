@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2026, Nikos Mavrogiannopoulos.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @defgroup radcli-api Main API
+ * @brief Main API Functions
+ *
+ * @{
+ */
+
+#include <config.h>
+#include <includes.h>
+#include <radcli/radcli.h>
+#include <pthread.h>
+#include "util.h"
+#include "resolve.h"
+
+/* Delay before a name whose lookup failed is tried again; its previous
+ * addresses are used meanwhile. */
+#define RESOLVE_RETRY 30
+
+/* Upper bound on the number of names cached per handle. When full, the
+ * least recently used one is replaced. */
+#define RESOLVE_MAX 64
+
+/// @cond INTERNAL
+struct resolve_ent {
+	char *host;
+	unsigned flags;			/* PW_AI_AUTH, PW_AI_ACCT or 0 */
+	struct addrinfo *info;		/* from getaddrinfo() */
+	time_t expires;			/* 0: numeric address, never expires */
+	unsigned long used;
+	unsigned refreshing;		/* a lookup is under way */
+};
+
+struct rc_resolver {
+	pthread_mutex_t lock;
+	struct resolve_ent ents[RESOLVE_MAX];
+	unsigned size;
+	unsigned long tick;
+	int ttl;
+};
+/// @endcond
+
+/** Releases an address list returned by rc_resolve()
+ *
+ * @param info the list, may be NULL.
+ */
+/// @cond INTERNAL
+void rc_addrinfo_free(struct addrinfo *info)
+{
+	struct addrinfo *next;
+
+	while (info != NULL) {
+		next = info->ai_next;
+		free(info);
+		info = next;
+	}
+}
+/// @endcond
+
+/* Copies an address list, each entry and its address in a single
+ * allocation, so that callers own their copy while the cached list may
+ * be replaced by another thread. */
+/// @cond INTERNAL
+static struct addrinfo *addrinfo_dup(const struct addrinfo *info)
+{
+	struct addrinfo *head = NULL, **tail = &head, *p;
+
+	for (; info != NULL; info = info->ai_next) {
+		p = malloc(sizeof(*p) + info->ai_addrlen);
+		if (p == NULL) {
+			rc_log(LOG_CRIT, "%s: out of memory", __func__);
+			rc_addrinfo_free(head);
+			return NULL;
+		}
+
+		memcpy(p, info, sizeof(*p));
+		p->ai_addr = (struct sockaddr *)(p + 1);
+		memcpy(p->ai_addr, info->ai_addr, info->ai_addrlen);
+		p->ai_canonname = NULL;
+		p->ai_next = NULL;
+
+		*tail = p;
+		tail = &p->ai_next;
+	}
+
+	return head;
+}
+/// @endcond
+
+/// @cond INTERNAL
+static struct resolve_ent *resolve_find(struct rc_resolver *res,
+					char const *host, unsigned flags)
+{
+	unsigned i;
+
+	for (i = 0; i < res->size; i++) {
+		if (res->ents[i].flags == flags &&
+		    strcmp(res->ents[i].host, host) == 0)
+			return &res->ents[i];
+	}
+
+	return NULL;
+}
+/// @endcond
+
+/* Stores the addresses of a name, taking ownership of info. Called with
+ * res->lock held. */
+/// @cond INTERNAL
+static int resolve_add(struct rc_resolver *res, char const *host,
+		       unsigned flags, struct addrinfo *info, time_t expires)
+{
+	struct resolve_ent *ent;
+	char *name;
+	unsigned i;
+
+	name = strdup(host);
+	if (name == NULL) {
+		rc_log(LOG_CRIT, "%s: out of memory", __func__);
+		return -1;
+	}
+
+	if (res->size < RESOLVE_MAX) {
+		ent = &res->ents[res->size++];
+	} else {
+		ent = &res->ents[0];
+		for (i = 1; i < res->size; i++) {
+			if (res->ents[i].used < ent->used)
+				ent = &res->ents[i];
+		}
+		free(ent->host);
+		freeaddrinfo(ent->info);
+	}
+
+	memset(ent, 0, sizeof(*ent));
+	ent->host = name;
+	ent->flags = flags;
+	ent->info = info;
+	ent->expires = expires;
+	ent->used = ++res->tick;
+	return 0;
+}
+/// @endcond
+
+/* Parses the configured server addresses that are numeric once, so that
+ * requests to them never consult the resolver. */
+/// @cond INTERNAL
+static void resolve_numeric(rc_handle *rh, struct rc_resolver *res,
+			    char const *optname, unsigned flags)
+{
+	struct addrinfo *info;
+	SERVER *srv;
+	unsigned i;
+
+	srv = rc_conf_srv(rh, optname);
+	if (srv == NULL)
+		return;
+
+	for (i = 0; i < srv->max; i++) {
+		if (resolve_find(res, srv->name[i], flags) != NULL)
+			continue;
+
+		info = rc_getaddrinfo(srv->name[i], flags | PW_AI_NUMERIC);
+		if (info == NULL)
+			continue;
+
+		if (resolve_add(res, srv->name[i], flags, info, 0) < 0)
+			freeaddrinfo(info);
+	}
+}
+/// @endcond
+
+/** Allocates the resolver cache of a handle
+ *
+ * Numeric addresses of the configured servers are parsed here; host
+ * names are resolved on first use.
+ *
+ * @param rh a handle to parsed configuration.
+ * @return 0 on success, -1 on failure.
+ */
+/// @cond INTERNAL
+int rc_resolver_init(rc_handle *rh)
+{
+	struct rc_resolver *res;
+	int ttl;
+
+	if (rh->resolver != NULL)
+		return 0;
+
+	ttl = rc_conf_int_default(rh, "resolve-ttl", RESOLVE_TTL);
+	if (ttl < 0) {
+		rc_log(LOG_ERR, "%s: resolve-ttl must not be negative", __func__);
+		return -1;
+	}
+
+	res = calloc(1, sizeof(*res));
+	if (res == NULL) {
+		rc_log(LOG_CRIT, "%s: out of memory", __func__);
+		return -1;
+	}
+
+	if (pthread_mutex_init(&res->lock, NULL) != 0) {
+		rc_log(LOG_CRIT, "%s: cannot initialize mutex", __func__);
+		free(res);
+		return -1;
+	}
+
+	res->ttl = ttl;
+	resolve_numeric(rh, res, "authserver", PW_AI_AUTH);
+	resolve_numeric(rh, res, "acctserver", PW_AI_ACCT);
+
+	rh->resolver = res;
+	return 0;
+}
+/// @endcond
+
+/* rc_getaddrinfo() in the network namespace of the handle, which the
+ * queries to the DNS servers go out from */
+/// @cond INTERNAL
+static struct addrinfo *resolve_lookup(rc_handle const *rh, char const *host,
+				       unsigned flags)
+{
+	struct addrinfo *info;
+	int prev;
+
+	if (rc_enter_netns(rh, &prev) == -1)
+		return NULL;
+
+	info = rc_getaddrinfo(host, flags);
+
+	if (rc_leave_netns(rh, &prev) == -1) {
+		if (info != NULL)
+			freeaddrinfo(info);
+		return NULL;
+	}
+
+	return info;
+}
+/// @endcond
+
+/* Looks up a name and stores its addresses. The entry of the name, if
+ * any, was marked as refreshing by the caller. When the lookup fails, the
+ * previous addresses are kept for up to RESOLVE_RETRY more seconds.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param host the name of the server.
+ * @param flags PW_AI_AUTH, PW_AI_ACCT or 0.
+ * @param now the current time.
+ * @param out if non-NULL, set to a copy of the addresses now cached for
+ *  the name, or NULL.
+ * @return 0 on success, -1 if the lookup failed.
+ */
+/// @cond INTERNAL
+static int resolve_refresh(rc_handle const *rh, char const *host,
+			   unsigned flags, time_t now, struct addrinfo **out)
+{
+	struct rc_resolver *res = rh->resolver;
+	struct resolve_ent *ent;
+	struct addrinfo *info, *ret = NULL;
+
+	info = resolve_lookup(rh, host, flags);
+
+	pthread_mutex_lock(&res->lock);
+	/* the entry may have been replaced while the lock was dropped */
+	ent = resolve_find(res, host, flags);
+	if (ent != NULL)
+		ent->refreshing = 0;
+
+	if (info == NULL) {
+		if (ent != NULL) {
+			rc_log(LOG_WARNING, "%s: using the previous addresses of %s",
+			       __func__, host);
+			ent->expires = now + (res->ttl < RESOLVE_RETRY ?
+					      res->ttl : RESOLVE_RETRY);
+			ent->used = ++res->tick;
+			if (out != NULL)
+				ret = addrinfo_dup(ent->info);
+		}
+		pthread_mutex_unlock(&res->lock);
+		if (out != NULL)
+			*out = ret;
+		return -1;
+	}
+
+	if (out != NULL)
+		ret = addrinfo_dup(info);
+	if (ent != NULL) {
+		freeaddrinfo(ent->info);
+		ent->info = info;
+		ent->expires = now + res->ttl;
+		ent->used = ++res->tick;
+	} else if (res->ttl == 0 ||
+		   resolve_add(res, host, flags, info, now + res->ttl) < 0) {
+		freeaddrinfo(info);
+	}
+	pthread_mutex_unlock(&res->lock);
+
+	if (out != NULL)
+		*out = ret;
+	return 0;
+}
+/// @endcond
+
+/** Returns the addresses of a server name, from the cache when possible
+ *
+ * A cached name is looked up again once it is older than resolve-ttl.
+ * Only the caller that finds it expired waits for the lookup; other
+ * threads keep using the previous addresses meanwhile, and they are also
+ * kept when the lookup fails, so that a slow or failing DNS server does
+ * not hold up every request. rc_resolve_refresh() looks names up before
+ * they expire, for applications that want no request to wait.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param host the name or address of the server.
+ * @param flags PW_AI_AUTH, PW_AI_ACCT or 0, as for rc_getaddrinfo().
+ * @return an address list to release with rc_addrinfo_free(), or NULL.
+ */
+/// @cond INTERNAL
+struct addrinfo *rc_resolve(rc_handle const *rh, char const *host, unsigned flags)
+{
+	struct rc_resolver *res = rh->resolver;
+	struct resolve_ent *ent;
+	struct addrinfo *info, *ret = NULL;
+	time_t now;
+
+	flags &= PW_AI_AUTH | PW_AI_ACCT;
+
+	if (res == NULL || host == NULL) {
+		info = resolve_lookup(rh, host, flags);
+		if (info == NULL)
+			return NULL;
+		ret = addrinfo_dup(info);
+		freeaddrinfo(info);
+		return ret;
+	}
+
+	now = time(NULL);
+
+	pthread_mutex_lock(&res->lock);
+	ent = resolve_find(res, host, flags);
+	if (ent != NULL && (ent->expires == 0 || now < ent->expires ||
+			    ent->refreshing)) {
+		ent->used = ++res->tick;
+		ret = addrinfo_dup(ent->info);
+		pthread_mutex_unlock(&res->lock);
+		return ret;
+	}
+	if (ent != NULL)
+		ent->refreshing = 1;
+	pthread_mutex_unlock(&res->lock);
+
+	resolve_refresh(rh, host, flags, now, &ret);
+	return ret;
+}
+/// @endcond
+
+/** Looks up again the server names whose cached addresses expire soon
+ *
+ * rc_resolve() lets the first request that finds a name expired wait for
+ * its lookup. An application that wants no request to wait for DNS can
+ * call this function periodically, e.g. from a watchdog thread, more
+ * often than every 30 seconds: names that expire within that time, or
+ * within half of resolve-ttl if that is shorter, are looked up now. This
+ * function blocks for the lookups; requests sent from other threads
+ * meanwhile keep using the previous addresses.
+ *
+ * @param rh a handle to parsed configuration.
+ * @return the number of names looked up, or -1 if a lookup failed, in
+ *  which case the previous addresses of that name are kept.
+ */
+int rc_resolve_refresh(rc_handle *rh)
+{
+	struct rc_resolver *res = rh->resolver;
+	struct resolve_ent *ent;
+	char *hosts[RESOLVE_MAX];
+	unsigned flags[RESOLVE_MAX];
+	unsigned i, n = 0;
+	time_t now, ahead;
+	int ret = 0;
+
+	if (res == NULL)
+		return 0;
+
+	now = time(NULL);
+
+	pthread_mutex_lock(&res->lock);
+	ahead = res->ttl / 2 < RESOLVE_RETRY ? res->ttl / 2 : RESOLVE_RETRY;
+	for (i = 0; i < res->size; i++) {
+		ent = &res->ents[i];
+		if (ent->expires == 0 || ent->refreshing ||
+		    now + ahead < ent->expires)
+			continue;
+		hosts[n] = strdup(ent->host);
+		if (hosts[n] == NULL) {
+			rc_log(LOG_CRIT, "%s: out of memory", __func__);
+			continue;
+		}
+		flags[n++] = ent->flags;
+		ent->refreshing = 1;
+	}
+	pthread_mutex_unlock(&res->lock);
+
+	for (i = 0; i < n; i++) {
+		if (resolve_refresh(rh, hosts[i], flags[i], now, NULL) < 0)
+			ret = -1;
+		else if (ret >= 0)
+			ret++;
+		free(hosts[i]);
+	}
+
+	return ret;
+}
+
+/** Releases the resolver cache of a handle
+ *
+ * @param rh a handle to parsed configuration.
+ */
+/// @cond INTERNAL
+void rc_resolver_free(rc_handle *rh)
+{
+	struct rc_resolver *res = rh->resolver;
+	unsigned i;
+
+	if (res == NULL)
+		return;
+
+	for (i = 0; i < res->size; i++) {
+		free(res->ents[i].host);
+		freeaddrinfo(res->ents[i].info);
+	}
+
+	pthread_mutex_destroy(&res->lock);
+	free(res);
+	rh->resolver = NULL;
+}
+/// @endcond
+
+/** @} */
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2026, Nikos Mavrogiannopoulos.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <config.h>
+#include <includes.h>
+#include <radcli/radcli.h>
+#include <pthread.h>
+#include "util.h"
+#include "rtt.h"
+
+/* With "retransmit adaptive", a RADIUS/UDP request waits for a reply
+ * for an RTO derived from the round-trip times measured to its server,
+ * as TCP does (RFC 6298), bounded by rto-min-ms and rto-max-ms. Each
+ * retransmission doubles it, and every timeout gets up to 10% of random
+ * jitter, so that clients do not retransmit in lockstep (RFC 5080,
+ * section 2.2.1). Only replies to a first transmission are measured
+ * (Karn's algorithm).
+ *
+ * The same measurements give the delay after which rc_aaa_submit()
+ * hedges an Access-Request, see rc_rtt_hedge(). */
+
+/* Default rto-min-ms */
+#define RTO_MIN 100
+
+/* Upper bound on the number of servers measured per handle. When full,
+ * the least recently used one is replaced. */
+#define RTT_MAX 64
+
+/* Round-trip times kept per server for hedge-percentile, and how many
+ * must have been measured before the percentile replaces hedge-delay-ms */
+#define RTT_HIST 32
+#define HEDGE_MIN_SAMPLES 8
+
+/// @cond INTERNAL
+struct rtt_ent {
+	struct sockaddr_storage addr;
+	double srtt;			/* smoothed round-trip time, seconds */
+	double rttvar;			/* its variation */
+	float hist[RTT_HIST];		/* the last round-trip times */
+	unsigned nhist;			/* measured so far */
+	unsigned long used;
+};
+
+struct rc_rtt {
+	pthread_mutex_t lock;
+	struct rtt_ent ents[RTT_MAX];
+	unsigned size;
+	unsigned long tick;
+	int adaptive;			/* retransmit adaptive, on RADIUS/UDP */
+	double min;			/* rto-min-ms, in seconds */
+	double max;			/* rto-max-ms, in seconds */
+	double hedge_delay;		/* hedge-delay-ms, in seconds */
+	int hedge_pct;			/* hedge-percentile */
+};
+/// @endcond
+
+/// @cond INTERNAL
+static int rtt_same(const struct sockaddr *a, const struct sockaddr_storage *b)
+{
+	if (a->sa_family != b->ss_family)
+		return 0;
+
+	if (a->sa_family == AF_INET)
+		return ((const struct sockaddr_in *)a)->sin_port ==
+		       ((const struct sockaddr_in *)b)->sin_port &&
+		       memcmp(&((const struct sockaddr_in *)a)->sin_addr,
+			      &((const struct sockaddr_in *)b)->sin_addr,
+			      sizeof(struct in_addr)) == 0;
+
+	return ((const struct sockaddr_in6 *)a)->sin6_port ==
+	       ((const struct sockaddr_in6 *)b)->sin6_port &&
+	       memcmp(&((const struct sockaddr_in6 *)a)->sin6_addr,
+		      &((const struct sockaddr_in6 *)b)->sin6_addr,
+		      sizeof(struct in6_addr)) == 0;
+}
+
+/* Called with rtt->lock held */
+static struct rtt_ent *rtt_find(struct rc_rtt *rtt, const struct sockaddr *peer)
+{
+	unsigned i;
+
+	for (i = 0; i < rtt->size; i++) {
+		if (rtt_same(peer, &rtt->ents[i].addr)) {
+			rtt->ents[i].used = ++rtt->tick;
+			return &rtt->ents[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* @t with up to 10% added or taken off at random */
+static double rtt_jitter(double t)
+{
+	return t + t * ((random() % 2001) - 1000) / 10000.0;
+}
+/// @endcond
+
+/** Reads the retransmission and hedging options of a handle
+ *
+ * Nothing is allocated unless hedging is enabled, or "retransmit
+ * adaptive" is set and the transport is RADIUS/UDP; RADIUS/TCP and
+ * RADIUS/TLS do not retransmit on a connection (RFC 6613), and DTLS is
+ * left to its fixed timers.
+ *
+ * @param rh a handle to parsed configuration, with its transport set.
+ * @return 0 on success, -1 on an invalid option or failure.
+ */
+/// @cond INTERNAL
+int rc_rtt_init(rc_handle *rh)
+{
+	struct rc_rtt *rtt;
+	char const *txt;
+	int adaptive = 0, min = 0, max = 0, delay, pct;
+
+	if (rh->rtt != NULL)
+		return 0;
+
+	txt = rc_conf_str(rh, "retransmit");
+	if (txt != NULL && strcasecmp(txt, "adaptive") == 0) {
+		adaptive = 1;
+	} else if (txt != NULL && strcasecmp(txt, "fixed") != 0) {
+		rc_log(LOG_ERR, "%s: unknown retransmit: %s", __func__, txt);
+		return -1;
+	}
+
+	if (adaptive) {
+		min = rc_conf_int_default(rh, "rto-min-ms", RTO_MIN);
+		max = rc_conf_int_default(rh, "rto-max-ms",
+					  rc_conf_timeout_ms(rh));
+		if (min <= 0 || max < min) {
+			rc_log(LOG_ERR, "%s: rto-min-ms must be positive and at most rto-max-ms",
+			       __func__);
+			return -1;
+		}
+	}
+
+	delay = rc_conf_int_default(rh, "hedge-delay-ms", 0);
+	pct = rc_conf_int_default(rh, "hedge-percentile", 0);
+	if (delay < 0 || pct < 0 || pct > 99) {
+		rc_log(LOG_ERR, "%s: hedge-delay-ms must not be negative and hedge-percentile must be within 0 and 99",
+		       __func__);
+		return -1;
+	}
+
+	if (rh->so_type != RC_SOCKET_UDP)
+		adaptive = 0;
+
+	if (!adaptive && delay == 0 && pct == 0)
+		return 0;
+
+	rtt = calloc(1, sizeof(*rtt));
+	if (rtt == NULL) {
+		rc_log(LOG_CRIT, "%s: out of memory", __func__);
+		return -1;
+	}
+
+	if (pthread_mutex_init(&rtt->lock, NULL) != 0) {
+		rc_log(LOG_CRIT, "%s: cannot initialize mutex", __func__);
+		free(rtt);
+		return -1;
+	}
+
+	rtt->adaptive = adaptive;
+	rtt->min = min / 1000.0;
+	rtt->max = max / 1000.0;
+	rtt->hedge_delay = delay / 1000.0;
+	rtt->hedge_pct = pct;
+
+	rh->rtt = rtt;
+	return 0;
+}
+/// @endcond
+
+/** Returns how long to wait for a reply to the first transmission
+ *
+ * @param rh a handle to parsed configuration.
+ * @param peer the address of the server.
+ * @param timeout radius_timeout, used for a server not measured yet.
+ * @return the time in seconds; @p timeout unless retransmission is adaptive.
+ */
+/// @cond INTERNAL
+double rc_rtt_first(rc_handle const *rh, const struct sockaddr *peer,
+		    double timeout)
+{
+	struct rc_rtt *rtt = rh->rtt;
+	struct rtt_ent *ent;
+	double rto = timeout, var;
+
+	if (rtt == NULL || !rtt->adaptive)
+		return timeout;
+
+	pthread_mutex_lock(&rtt->lock);
+	ent = rtt_find(rtt, peer);
+	if (ent != NULL) {
+		var = 4 * ent->rttvar;
+		rto = ent->srtt + (var > 0.001 ? var : 0.001);
+	}
+	pthread_mutex_unlock(&rtt->lock);
+
+	if (rto < rtt->min)
+		rto = rtt->min;
+	if (rto > rtt->max)
+		rto = rtt->max;
+
+	return rtt_jitter(rto);
+}
+/// @endcond
+
+/** Returns how long to wait for a reply to a retransmission
+ *
+ * @param rh a handle to parsed configuration.
+ * @param rto the time waited for the previous transmission.
+ * @return the time in seconds; @p rto unless retransmission is adaptive.
+ */
+/// @cond INTERNAL
+double rc_rtt_next(rc_handle const *rh, double rto)
+{
+	struct rc_rtt *rtt = rh->rtt;
+
+	if (rtt == NULL || !rtt->adaptive)
+		return rto;
+
+	if (2 * rto > rtt->max)
+		return rtt_jitter(rtt->max);
+
+	return rtt_jitter(2 * rto);
+}
+/// @endcond
+
+/** Records the round-trip time of a request answered on its first transmission
+ *
+ * @param rh a handle to parsed configuration.
+ * @param peer the address of the server.
+ * @param rtt_s the time from the transmission to the reply, in seconds.
+ */
+/// @cond INTERNAL
+void rc_rtt_sample(rc_handle const *rh, const struct sockaddr *peer,
+		   double rtt_s)
+{
+	struct rc_rtt *rtt = rh->rtt;
+	struct rtt_ent *ent;
+	unsigned i;
+
+	if (rtt == NULL || rtt_s < 0)
+		return;
+
+	pthread_mutex_lock(&rtt->lock);
+	ent = rtt_find(rtt, peer);
+	if (ent != NULL) {
+		ent->rttvar = 0.75 * ent->rttvar +
+			      0.25 * (ent->srtt > rtt_s ? ent->srtt - rtt_s :
+						      rtt_s - ent->srtt);
+		ent->srtt = 0.875 * ent->srtt + 0.125 * rtt_s;
+		ent->hist[ent->nhist++ % RTT_HIST] = rtt_s;
+		pthread_mutex_unlock(&rtt->lock);
+		return;
+	}
+
+	if (rtt->size < RTT_MAX) {
+		ent = &rtt->ents[rtt->size++];
+	} else {
+		ent = &rtt->ents[0];
+		for (i = 1; i < RTT_MAX; i++) {
+			if (rtt->ents[i].used < ent->used)
+				ent = &rtt->ents[i];
+		}
+	}
+
+	memset(&ent->addr, 0, sizeof(ent->addr));
+	memcpy(&ent->addr, peer, peer->sa_family == AF_INET6 ?
+	       sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+	ent->srtt = rtt_s;
+	ent->rttvar = rtt_s / 2;
+	ent->hist[0] = rtt_s;
+	ent->nhist = 1;
+	ent->used = ++rtt->tick;
+	pthread_mutex_unlock(&rtt->lock);
+}
+/// @endcond
+
+/** Returns how long an Access-Request waits for its server before it is hedged
+ *
+ * That is the hedge-percentile of the round-trip times last measured to
+ * the server, once there are enough of them, and hedge-delay-ms
+ * otherwise.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param peer the address of the server.
+ * @return the time in seconds, or 0 if the request is not to be hedged.
+ */
+/// @cond INTERNAL
+double rc_rtt_hedge(rc_handle const *rh, const struct sockaddr *peer)
+{
+	struct rc_rtt *rtt = rh->rtt;
+	struct rtt_ent *ent;
+	float sorted[RTT_HIST], t;
+	double delay;
+	unsigned i, j, n = 0;
+
+	if (rtt == NULL)
+		return 0;
+
+	delay = rtt->hedge_delay;
+	if (rtt->hedge_pct == 0)
+		return delay;
+
+	pthread_mutex_lock(&rtt->lock);
+	ent = rtt_find(rtt, peer);
+	if (ent != NULL && ent->nhist >= HEDGE_MIN_SAMPLES) {
+		n = ent->nhist < RTT_HIST ? ent->nhist : RTT_HIST;
+		memcpy(sorted, ent->hist, n * sizeof(sorted[0]));
+	}
+	pthread_mutex_unlock(&rtt->lock);
+
+	if (n == 0)
+		return delay;
+
+	for (i = 1; i < n; i++) {
+		t = sorted[i];
+		for (j = i; j > 0 && sorted[j - 1] > t; j--)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = t;
+	}
+
+	/* the nearest-rank percentile */
+	return sorted[(n * rtt->hedge_pct + 99) / 100 - 1];
+}
+/// @endcond
+
+/** Releases the round-trip time estimates of a handle
+ *
+ * @param rh a handle to parsed configuration.
+ */
+/// @cond INTERNAL
+void rc_rtt_free(rc_handle *rh)
+{
+	struct rc_rtt *rtt = rh->rtt;
+
+	if (rtt == NULL)
+		return;
+
+	pthread_mutex_destroy(&rtt->lock);
+	free(rtt);
+	rh->rtt = NULL;
+}
+/// @endcond
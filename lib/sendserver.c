@@ -18,26 +18,21 @@
 #include "util.h"
 #include "rc-md5.h"
 #include "rc-hmac.h"
+#include "resolve.h"
+#include "rtt.h"
+#include "srcaddr.h"
 
 #if defined(HAVE_GNUTLS)
 # include <gnutls/gnutls.h>
 # include <gnutls/crypto.h>
 #endif
 
-#if defined(__linux__)
-#include <linux/in6.h>
-#endif
-
 
-#define SCLOSE(fd) if (sfuncs->close_fd) sfuncs->close_fd(fd)
+#define SCLOSE(fd) if (sfuncs->close_fd) sfuncs->close_fd(sfuncs->ptr, fd)
 
 /// @cond INTERNAL
 static void rc_random_vector(unsigned char[AUTH_VECTOR_LEN]);
 /// @endcond
-/// @cond INTERNAL
-static int rc_check_reply(AUTH_HDR *, int, char const *, unsigned char const *,
-			  unsigned char);
-/// @endcond
 
 /**
  * @defgroup radcli-api Main API
@@ -196,6 +191,17 @@ static void strappend(char *dest, unsigned max_size, int *pos, const char *src)
 }
 /// @endcond
 
+/* Whether a socket error means the server cannot be reached, so that
+ * the request is failed over rather than given up. ECONNREFUSED and
+ * EHOSTUNREACH are reported for ICMP errors on a connected UDP socket
+ * (udp-connect). */
+/// @cond INTERNAL
+static int unreachable(int e)
+{
+	return e == ENETUNREACH || e == EHOSTUNREACH || e == ECONNREFUSED;
+}
+/// @endcond
+
 
 /// @cond INTERNAL
 static int populate_ctx(RC_AAA_CTX ** ctx, char secret[MAX_SECRET_LENGTH + 1],
@@ -230,7 +236,8 @@ static int populate_ctx(RC_AAA_CTX ** ctx, char secret[MAX_SECRET_LENGTH + 1],
  */
 int rc_send_server(rc_handle * rh, SEND_DATA * data, char *msg, rc_type type)
 {
-	return rc_send_server_ctx(rh, NULL, data, msg, type, 0);
+	return rc_send_server_ctx(rh, NULL, data, msg, type, 0,
+				  data->timeout * 1000, 0);
 }
 
 /* Verify items in returned packet
@@ -243,8 +250,8 @@ int rc_send_server(rc_handle * rh, SEND_DATA * data, char *msg, rc_type type)
  * @return OK_RC upon success, BADRESP_RC if anything looks funny.
  */
 /// @cond INTERNAL
-static int rc_check_reply(AUTH_HDR * auth, int bufferlen, char const *secret,
-			  unsigned char const *vector, uint8_t seq_nbr)
+int rc_check_reply(AUTH_HDR * auth, int bufferlen, char const *secret,
+		   unsigned char const *vector, uint8_t seq_nbr)
 {
 	int secretlen;
 	int totallen;
@@ -403,6 +410,251 @@ static int validate_message_authenticator(const uint8_t *recv_buffer,
 	return rc_memcmp(ma_copy, digest, MD5_DIGEST_SIZE);
 }
 
+/** Builds the wire form of a request
+ *
+ * Fills in NAS-IP-Address/NAS-IPv6-Address and NAS-Identifier as
+ * configured, packs @c data->send_pairs and computes the Request
+ * Authenticator (and Message-Authenticator for Access-Requests).
+ *
+ * @param rh a handle to parsed configuration.
+ * @param data the request; @c send_pairs may be modified.
+ * @param secret the secret shared with the server.
+ * @param our_sockaddr the local address the request is sent from.
+ * @param vector receives the Request Authenticator.
+ * @param buf a buffer of %RC_BUFFER_LEN bytes receiving the packet.
+ * @return the packet length, or ERROR_RC on failure.
+ */
+/// @cond INTERNAL
+int rc_build_request(rc_handle *rh, SEND_DATA *data, char *secret,
+		     const struct sockaddr_storage *our_sockaddr,
+		     unsigned char vector[AUTH_VECTOR_LEN], uint8_t *buf)
+{
+	AUTH_HDR *auth;
+	const struct sockaddr_storage *ss_set = NULL;
+	int total_length;
+	size_t secretlen;
+	uint16_t tlen;
+	char *p;
+
+	/*
+	 * Fill in NAS-IP-Address (if needed)
+	 */
+	if (rh->nas_addr_set) {
+		rc_avpair_remove(&(data->send_pairs), PW_NAS_IP_ADDRESS, 0);
+		rc_avpair_remove(&(data->send_pairs), PW_NAS_IPV6_ADDRESS, 0);
+
+		ss_set = &rh->nas_addr;
+	} else if (rc_avpair_get(data->send_pairs, PW_NAS_IP_ADDRESS, 0) == NULL &&
+	    	   rc_avpair_get(data->send_pairs, PW_NAS_IPV6_ADDRESS, 0) == NULL) {
+
+	    	ss_set = our_sockaddr;
+	}
+
+	if (ss_set) {
+		if (ss_set->ss_family == AF_INET) {
+			uint32_t ip;
+			ip = *((uint32_t
+				*) (&((struct sockaddr_in *)ss_set)->
+				    sin_addr));
+			ip = ntohl(ip);
+
+			rc_avpair_add(rh, &(data->send_pairs),
+				      PW_NAS_IP_ADDRESS, &ip, 0, 0);
+		} else {
+			void *p;
+			p = &((struct sockaddr_in6 *)ss_set)->sin6_addr;
+
+			rc_avpair_add(rh, &(data->send_pairs),
+				      PW_NAS_IPV6_ADDRESS, p, 16, 0);
+		}
+	}
+
+	/*
+	 * Fill in NAS-Identifier (if needed)
+	 */
+	p = rc_conf_str(rh, "nas-identifier");
+	if (p != NULL) {
+		rc_avpair_remove(&(data->send_pairs), PW_NAS_IDENTIFIER, 0);
+		rc_avpair_add(rh, &(data->send_pairs),
+			      PW_NAS_IDENTIFIER, p, -1, 0);
+	}
+
+	/* Build a request */
+	auth = (AUTH_HDR *) buf;
+	auth->code = data->code;
+	auth->id = data->seq_nbr;
+
+	if (data->code == PW_ACCOUNTING_REQUEST) {
+		total_length = rc_pack_list(data->send_pairs, secret, auth, RC_MAX_PACKET_LEN);
+		if (total_length < 0)
+			return ERROR_RC;
+
+		tlen = htons((unsigned short)total_length);
+		memcpy(&auth->length, &tlen, sizeof(uint16_t));
+
+		memset((char *)auth->vector, 0, AUTH_VECTOR_LEN);
+		secretlen = strlen(secret);
+		memcpy((char *)auth + total_length, secret, secretlen);
+		rc_md5_calc(vector, (unsigned char *)auth,
+			    total_length + secretlen);
+		memcpy((char *)auth->vector, (char *)vector, AUTH_VECTOR_LEN);
+	} else {
+		rc_random_vector(vector);
+		memcpy((char *)auth->vector, (char *)vector, AUTH_VECTOR_LEN);
+
+		/* Leave 2+MD5_DIGEST_SIZE bytes for Message-Authenticator (added below) */
+		total_length = rc_pack_list(data->send_pairs, secret, auth,
+					    RC_MAX_PACKET_LEN - (2 + MD5_DIGEST_SIZE));
+		if (total_length < 0)
+			return ERROR_RC;
+
+		total_length = add_msg_auth_attr(rh, secret, auth, total_length);
+
+		auth->length = htons((unsigned short)total_length);
+	}
+
+	return total_length;
+}
+/// @endcond
+
+/** Bounds-checks every attribute of a received reply
+ *
+ * @param recv_buffer the reply.
+ * @param length the reply length, already trimmed to its RADIUS length.
+ * @param server_name the server the reply came from, for logging.
+ * @param port the server's port, for logging.
+ * @return OK_RC if every attribute is well-formed, ERROR_RC otherwise.
+ */
+/// @cond INTERNAL
+int rc_validate_reply_attrs(uint8_t *recv_buffer, int length,
+			    const char *server_name, int port)
+{
+	pkt_buf rb;
+	uint8_t attr_type, attr_len;
+
+	pb_init_read(&rb, recv_buffer, length, RC_BUFFER_LEN);
+	assert(pb_pull(&rb, AUTH_HDR_LEN) == 0);
+	while (pb_len(&rb) > 0) {
+		if (pb_peek_byte(&rb, 0, &attr_type) < 0 ||
+		    pb_peek_byte(&rb, 1, &attr_len)  < 0) {
+			rc_log(LOG_ERR,
+			       "rc_send_server: recvfrom: %s:%d: truncated attribute",
+			       server_name, port);
+			return ERROR_RC;
+		}
+		if (attr_type == 0) {
+			rc_log(LOG_ERR,
+			       "rc_send_server: recvfrom: %s:%d: attribute zero is invalid",
+			       server_name, port);
+			return ERROR_RC;
+		}
+		if (attr_len < 2) {
+			rc_log(LOG_ERR,
+			       "rc_send_server: recvfrom: %s:%d: attribute length is too small",
+			       server_name, port);
+			return ERROR_RC;
+		}
+		if (attr_len > pb_len(&rb)) {
+			rc_log(LOG_ERR,
+			       "rc_send_server: recvfrom: %s:%d: attribute overflows the packet",
+			       server_name, port);
+			return ERROR_RC;
+		}
+		assert(pb_pull(&rb, attr_len) == 0);
+	}
+
+	return OK_RC;
+}
+/// @endcond
+
+/** Applies the Message-Authenticator checks to a reply to an Access-Request
+ *
+ * @param rh a handle to parsed configuration.
+ * @param recv_buffer the reply.
+ * @param receive_pairs the attributes decoded from the reply.
+ * @param secret the secret shared with the server.
+ * @param vector the Request Authenticator of the request.
+ * @param server_name the server the reply came from, for logging.
+ * @param port the server's port, for logging.
+ * @return OK_RC if the reply is acceptable, ERROR_RC otherwise.
+ */
+/// @cond INTERNAL
+int rc_validate_reply_msg_auth(rc_handle *rh, const uint8_t *recv_buffer,
+			       VALUE_PAIR *receive_pairs, const char *secret,
+			       const unsigned char *vector,
+			       const char *server_name, int port)
+{
+	const AUTH_HDR *recv_auth = (const AUTH_HDR *)recv_buffer;
+	int length = ntohs(recv_auth->length) - AUTH_HDR_LEN;
+	char *p;
+
+	/* Per draft-ietf-radext-deprecating-radius, Message-Authenticator MUST
+	 * be the first attribute in Access-Request responses to prevent MD5
+	 * prefix attacks (BLAST RADIUS). Not required for Accounting-Response. */
+
+	/* Verify MA whenever present, regardless of position.
+	 * An incorrect MA always causes rejection. */
+	if (rc_avpair_get(receive_pairs, PW_MESSAGE_AUTHENTICATOR, 0)) {
+		if (validate_message_authenticator(recv_buffer, length, secret, vector)) {
+			rc_log(LOG_ERR,
+			       "rc_send_server: recvfrom: %s:%d: received attribute Message-Authenticator is incorrect",
+			       server_name, port);
+			return ERROR_RC;
+		}
+	}
+
+	/* Enforce BLAST RADIUS: MA must also be the first attribute.
+	 * Per draft-ietf-radext-deprecating-radius-10 Section 4, this
+	 * mitigation MUST be applied to RADIUS/UDP and RADIUS/TCP, and
+	 * MUST NOT be applied to RADIUS/TLS or RADIUS/DTLS: those
+	 * transports are already integrity-protected end-to-end, so the
+	 * MD5-prefix collision this guards against isn't reachable. */
+	if (rh->so_type != RC_SOCKET_TLS && rh->so_type != RC_SOCKET_DTLS) {
+		if (length == 0 ||
+		    recv_buffer[AUTH_HDR_LEN] != PW_MESSAGE_AUTHENTICATOR) {
+			p = rc_conf_str(rh, "require-message-authenticator");
+			if (p == NULL || (strcasecmp(p, "false") != 0 && strcasecmp(p, "no") != 0)) {
+				rc_log(LOG_ERR,
+				       "rc_send_server: recvfrom: %s:%d: required attribute Message-Authenticator is missing or not first",
+				       server_name, port);
+				return ERROR_RC;
+			}
+		}
+	}
+
+	return OK_RC;
+}
+/// @endcond
+
+/** Maps the code of a verified reply to the result returned to callers
+ *
+ * @param code the RADIUS code of the reply.
+ * @return OK_RC, REJECT_RC, CHALLENGE_RC or BADRESP_RC.
+ */
+/// @cond INTERNAL
+int rc_reply_result(uint8_t code)
+{
+	switch (code) {
+	case PW_ACCESS_ACCEPT:
+	case PW_PASSWORD_ACK:
+	case PW_ACCOUNTING_RESPONSE:
+		return OK_RC;
+
+	case PW_ACCESS_REJECT:
+	case PW_PASSWORD_REJECT:
+		return REJECT_RC;
+
+	case PW_ACCESS_CHALLENGE:
+		return CHALLENGE_RC;
+
+	default:
+		rc_log(LOG_ERR, "rc_send_server: received RADIUS server response neither ACCEPT nor REJECT, code=%d is invalid",
+		       code);
+		return BADRESP_RC;
+	}
+}
+/// @endcond
+
 /** Sends a request to a RADIUS server and waits for the reply
  *
  * @param rh a handle to parsed configuration
@@ -416,16 +668,22 @@ static int validate_message_authenticator(const uint8_t *recv_buffer,
  *  reply; @c data->timeout and @c data->retries are not consulted in that
  *  case. Used by rc_acct_async() for best-effort, non-blocking
  *  notifications. TIMEOUT_RC is never returned when @p no_wait is set.
+ * @param timeout_ms how long to wait for the reply to a transmission, in
+ *  milliseconds; it replaces @c data->timeout.
+ * @param deadline if non-zero, the rc_getmtime() by which the request must
+ *  be answered; waiting stops there and TIMEOUT_RC is returned even if
+ *  retries are left.
  * @return OK_RC (0) on success, CHALLENGE_RC when an Access-Challenge
  *  response is received, TIMEOUT_RC on timeout, REJECT_RC on access reject,
  *  or negative on failure as return value.
  */
 int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
-		       char *msg, rc_type type, int no_wait)
+		       char *msg, rc_type type, int no_wait,
+		       int timeout_ms, double deadline)
 {
 	int sockfd = -1;
 	AUTH_HDR *auth, *recv_auth;
-	char *server_name, *p;	/* Name of server to query */
+	char *server_name;	/* Name of server to query */
 	struct sockaddr_storage our_sockaddr;
 	struct addrinfo *auth_addr = NULL;
 	socklen_t salen;
@@ -435,40 +693,27 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 	int retry_max;
 	const rc_sockets_override *sfuncs;
 	unsigned discover_local_ip;
-	size_t secretlen;
 	char secret[MAX_SECRET_LENGTH + 1];
 	unsigned char vector[AUTH_VECTOR_LEN];
 	uint8_t recv_buffer[RC_BUFFER_LEN];
 	uint8_t send_buffer[RC_BUFFER_LEN];
-	uint16_t tlen;
-	pkt_buf rb;
-	uint8_t attr_type, attr_len;
 	int retries;
 	VALUE_PAIR *vp;
 	struct pollfd pfd;
-	double start_time, timeout;
-	struct sockaddr_storage *ss_set = NULL;
+	int replied, resend, wait_ms;
+	double start_time, timeout, rto;
 	char *server_type = "auth";
-	char *ns = NULL;
-	int ns_def_hdl = 0;
 
 	server_name = data->server;
 	if (server_name == NULL || server_name[0] == '\0')
 		return ERROR_RC;
 
-	ns = rc_conf_str(rh, "namespace"); /* Check for namespace config */
-	if (ns != NULL) {
-		if(-1 == rc_set_netns(ns, &ns_def_hdl)) {
-			rc_log(LOG_ERR, "rc_send_server: namespace %s set failed", ns);
-			return ERROR_RC;
-		}
-	}
 	if ((vp = rc_avpair_get(data->send_pairs, PW_SERVICE_TYPE, 0)) &&
 	    (vp->lvalue == PW_ADMINISTRATIVE)) {
 		strlcpy(secret, MGMT_POLL_SECRET, sizeof(secret));
 		auth_addr =
-		    rc_getaddrinfo(server_name,
-				   type == AUTH ? PW_AI_AUTH : PW_AI_ACCT);
+		    rc_resolve(rh, server_name,
+			       type == AUTH ? PW_AI_AUTH : PW_AI_ACCT);
 		if (auth_addr == NULL) {
 			result = ERROR_RC;
 			goto exit_error;
@@ -481,7 +726,7 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 		   else
 		   {
 		 */
-		if (rc_find_server_addr
+		if (rc_find_server
 		    (rh, server_name, &auth_addr, secret, type) != 0) {
 			rc_log(LOG_ERR,
 			       "rc_send_server: unable to find server: %s",
@@ -499,14 +744,6 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 		strlcpy(secret, sfuncs->static_secret, sizeof(secret));
 	}
 
-	if (sfuncs->lock) {
-		if (sfuncs->lock(sfuncs->ptr) != 0) {
-			rc_log(LOG_ERR, "%s: lock error", __func__);
-			result = ERROR_RC;
-			goto exit_error;
-		}
-	}
-
 	rc_own_bind_addr(rh, &our_sockaddr);
 	discover_local_ip = 0;
 	if (our_sockaddr.ss_family == AF_INET) {
@@ -519,7 +756,7 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 	DEBUG(LOG_ERR, "DEBUG: rc_send_server: creating socket to: %s",
 	      server_name);
 	if (discover_local_ip) {
-		result = rc_get_srcaddr(SA(&our_sockaddr), auth_addr->ai_addr);
+		result = rc_srcaddr_get(rh, SA(&our_sockaddr), auth_addr->ai_addr);
 		if (result != OK_RC) {
 			memset(secret, '\0', sizeof(secret));
 			rc_log(LOG_ERR,
@@ -528,51 +765,8 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 		}
 	}
 
-	if (sfuncs->get_fd) {
-		sockfd = sfuncs->get_fd(sfuncs->ptr, SA(&our_sockaddr));
-		if (sockfd < 0) {
-			memset(secret, '\0', sizeof(secret));
-			rc_log(LOG_ERR, "rc_send_server: socket: %s",
-			       strerror(errno));
-			result = ERROR_RC;
-			goto cleanup;
-		}
-	}
-
-	if(our_sockaddr.ss_family  == AF_INET6) {
-		/* Check for IPv6 non-temporary address support */
-		char *non_temp_addr = rc_conf_str(rh, "use-public-addr");
-		if (non_temp_addr && (strcasecmp(non_temp_addr, "true") == 0)) {
-#if defined(__linux__)
-			int sock_opt = IPV6_PREFER_SRC_PUBLIC;
-			if (setsockopt(sockfd, IPPROTO_IPV6, IPV6_ADDR_PREFERENCES,
-					&sock_opt, sizeof(sock_opt)) != 0) {
-				rc_log(LOG_ERR, "rc_send_server: setsockopt: %s",
-					strerror(errno));
-				result = ERROR_RC;
-				goto cleanup;
-			}
-#elif defined(BSD) || defined(__APPLE__)
-			int sock_opt = 0;
-			if (setsockopt(sockfd, IPPROTO_IPV6, IPV6_PREFER_TEMPADDR,
-				&sock_opt, sizeof(sock_opt)) != 0) {
-				rc_log(LOG_ERR, "rc_send_server: setsockopt: %s",
-					strerror(errno));
-				result = ERROR_RC;
-				goto cleanup;
-			}
-#else
-			rc_log(LOG_INFO, "rc_send_server: Usage of non-temporary IPv6"
-					" address is not supported in this system");
-#endif
-		}
-	}
-
-	retry_max = data->retries;	/* Max. numbers to try for reply */
-	retries = 0;		/* Init retry cnt for blocking call */
-
 	if (data->svc_port) {
-		if (our_sockaddr.ss_family == AF_INET)
+		if (auth_addr->ai_family == AF_INET)
 			((struct sockaddr_in *)auth_addr->ai_addr)->sin_port =
 			    htons((unsigned short)data->svc_port);
 		else
@@ -580,86 +774,42 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 			    htons((unsigned short)data->svc_port);
 	}
 
-	/*
-	 * Fill in NAS-IP-Address (if needed)
-	 */
-	if (rh->nas_addr_set) {
-		rc_avpair_remove(&(data->send_pairs), PW_NAS_IP_ADDRESS, 0);
-		rc_avpair_remove(&(data->send_pairs), PW_NAS_IPV6_ADDRESS, 0);
-
-		ss_set = &rh->nas_addr;
-	} else if (rc_avpair_get(data->send_pairs, PW_NAS_IP_ADDRESS, 0) == NULL &&
-	    	   rc_avpair_get(data->send_pairs, PW_NAS_IPV6_ADDRESS, 0) == NULL) {
-
-	    	ss_set = &our_sockaddr;
-	}
-
-	if (ss_set) {
-		if (ss_set->ss_family == AF_INET) {
-			uint32_t ip;
-			ip = *((uint32_t
-				*) (&((struct sockaddr_in *)ss_set)->
-				    sin_addr));
-			ip = ntohl(ip);
-
-			rc_avpair_add(rh, &(data->send_pairs),
-				      PW_NAS_IP_ADDRESS, &ip, 0, 0);
-		} else {
-			void *p;
-			p = &((struct sockaddr_in6 *)ss_set)->sin6_addr;
-
-			rc_avpair_add(rh, &(data->send_pairs),
-				      PW_NAS_IPV6_ADDRESS, p, 16, 0);
+	if (sfuncs->get_fd) {
+		sockfd = sfuncs->get_fd(sfuncs->ptr, SA(&our_sockaddr),
+					auth_addr->ai_addr);
+		if (sockfd < 0) {
+			result = unreachable(errno) ? NETUNREACH_RC : ERROR_RC;
+			memset(secret, '\0', sizeof(secret));
+			rc_log(LOG_ERR, "rc_send_server: socket: %s",
+			       strerror(errno));
+			goto cleanup;
 		}
+		/* RADIUS/TLS pipelines requests on a shared session; the
+		 * transport picks an Identifier unused on it. */
+		if (sfuncs->get_id)
+			data->seq_nbr = sfuncs->get_id(sfuncs->ptr, sockfd);
 	}
 
-	/*
-	 * Fill in NAS-Identifier (if needed)
-	 */
-	p = rc_conf_str(rh, "nas-identifier");
-	if (p != NULL) {
-		rc_avpair_remove(&(data->send_pairs), PW_NAS_IDENTIFIER, 0);
-		rc_avpair_add(rh, &(data->send_pairs),
-			      PW_NAS_IDENTIFIER, p, -1, 0);
+	if (our_sockaddr.ss_family == AF_INET6 &&
+	    rc_prefer_public_addr(rh, sockfd) != OK_RC) {
+		memset(secret, '\0', sizeof(secret));
+		result = ERROR_RC;
+		goto cleanup;
 	}
 
-	/* Build a request */
-	auth = (AUTH_HDR *) send_buffer;
-	auth->code = data->code;
-	auth->id = data->seq_nbr;
+	retry_max = data->retries;	/* Max. numbers to try for reply */
+	retries = 0;		/* Init retry cnt for blocking call */
+	rto = rc_rtt_first(rh, auth_addr->ai_addr, timeout_ms / 1000.0);
 
-	if (data->code == PW_ACCOUNTING_REQUEST) {
+	if (data->code == PW_ACCOUNTING_REQUEST)
 		server_type = "acct";
-		total_length = rc_pack_list(data->send_pairs, secret, auth, RC_MAX_PACKET_LEN);
-		if (total_length < 0) {
-			result = ERROR_RC;
-			goto cleanup;
-		}
 
-		tlen = htons((unsigned short)total_length);
-		memcpy(&auth->length, &tlen, sizeof(uint16_t));
-
-		memset((char *)auth->vector, 0, AUTH_VECTOR_LEN);
-		secretlen = strlen(secret);
-		memcpy((char *)auth + total_length, secret, secretlen);
-		rc_md5_calc(vector, (unsigned char *)auth,
-			    total_length + secretlen);
-		memcpy((char *)auth->vector, (char *)vector, AUTH_VECTOR_LEN);
-	} else {
-		rc_random_vector(vector);
-		memcpy((char *)auth->vector, (char *)vector, AUTH_VECTOR_LEN);
-
-		/* Leave 2+MD5_DIGEST_SIZE bytes for Message-Authenticator (added below) */
-		total_length = rc_pack_list(data->send_pairs, secret, auth,
-					    RC_MAX_PACKET_LEN - (2 + MD5_DIGEST_SIZE));
-		if (total_length < 0) {
-			result = ERROR_RC;
-			goto cleanup;
-		}
-
-		total_length = add_msg_auth_attr(rh, secret, auth, total_length);
-
-		auth->length = htons((unsigned short)total_length);
+	auth = (AUTH_HDR *) send_buffer;
+	total_length = rc_build_request(rh, data, secret, &our_sockaddr,
+					vector, send_buffer);
+	if (total_length < 0) {
+		result = ERROR_RC;
+		goto cleanup;
 	}
 
 	if (radcli_debug) {
@@ -673,8 +823,8 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 			    NI_NUMERICHOST);
 
 		DEBUG(LOG_ERR,
-		      "DEBUG: timeout=%d retries=%d local %s : 0, remote %s : %u\n",
-		      data->timeout, retry_max, our_addr_txt, auth_addr_txt,
+		      "DEBUG: timeout=%dms retries=%d local %s : 0, remote %s : %u\n",
+		      timeout_ms, retry_max, our_addr_txt, auth_addr_txt,
 		      data->svc_port);
 	}
 
@@ -687,19 +837,18 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 					   auth_addr->ai_addrlen);
 		} while (result == -1 && errno == EINTR);
 		if (result == -1) {
-			result = errno == ENETUNREACH ? NETUNREACH_RC : ERROR_RC;
+			result = unreachable(errno) ? NETUNREACH_RC : ERROR_RC;
 			rc_log(LOG_ERR, "%s: socket: %s", __FUNCTION__,
 			       strerror(errno));
 			goto cleanup;
 		}
 
 		if (no_wait) {
-			/* Fire-and-forget: no reply to wait for, so close the
-			 * socket and capture the request's own secret/vector
-			 * (REQ-NET-TEARDOWN-001, REQ-NET-SEC-009) right here,
-			 * instead of falling through to the receive/switch
-			 * path below that expects a parsed response. */
-			SCLOSE(sockfd);
+			/* Fire-and-forget: no reply to wait for, so capture
+			 * the request's own secret/vector (REQ-NET-SEC-009)
+			 * right here, instead of falling through to the
+			 * receive/switch path below that expects a parsed
+			 * response. */
 			result = populate_ctx(ctx, secret, vector);
 			memset(secret, '\0', sizeof(secret));
 			if (result != OK_RC)
@@ -708,34 +857,41 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 			goto cleanup;
 		}
 
-		/* Re-fetch fd: sendto() may have triggered a TLS session
-		 * restart (restart_session), replacing the underlying socket. */
-		if (sfuncs->get_active_fd) {
-			int new_fd = sfuncs->get_active_fd(sfuncs->ptr);
-			if (new_fd >= 0)
-				sockfd = new_fd;
-		}
+		/* sendto() may have restarted a TLS session; the transport
+		 * keeps finding it by the same fd (REQ-NET-NET-008). */
 		pfd.fd = sockfd;
 		pfd.events = POLLIN;
-		pfd.revents = 0;
+		replied = 0;
+		resend = 0;
 		start_time = rc_getmtime();
-		for (timeout = data->timeout; timeout > 0;
-		     timeout -= rc_getmtime() - start_time) {
-			result = poll(&pfd, 1, timeout * 1000);
-			if (result != -1 || errno != EINTR)
+		for (;;) {
+			timeout = rto - (rc_getmtime() - start_time);
+			if (deadline > 0 && timeout > deadline - rc_getmtime())
+				timeout = deadline - rc_getmtime();
+			if (timeout <= 0) {
+				result = 0;
+				break;
+			}
+			/* rounded up, so as not to wake up just before the
+			 * deadline and retransmit */
+			wait_ms = (int)(timeout * 1000 + 0.999);
+			pfd.revents = 0;
+			if (sfuncs->wait) {
+				result = sfuncs->wait(sfuncs->ptr, sockfd,
+						      wait_ms);
+				if (result == 1)
+					pfd.revents = POLLIN;
+			} else {
+				result = poll(&pfd, 1, wait_ms);
+			}
+			if (result == -1 && errno == EINTR)
+				continue;
+			/* with udp-connect, an ICMP error shows as POLLERR
+			 * and is read by recvfrom() below */
+			if (result != 1 ||
+			    (pfd.revents & (POLLIN | POLLERR)) == 0)
 				break;
-		}
-
-		if (result == -1) {
-			rc_log(LOG_ERR, "rc_send_server: poll: %s",
-			       strerror(errno));
-			memset(secret, '\0', sizeof(secret));
-			SCLOSE(sockfd);
-			result = ERROR_RC;
-			goto cleanup;
-		}
 
-		if (result == 1 && (pfd.revents & POLLIN) != 0) {
 			salen = auth_addr->ai_addrlen;
 			do {
 				length = sfuncs->recvfrom(sfuncs->ptr, sockfd,
@@ -755,9 +911,24 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 				       strerror(e));
 				if (length == -1 && (e == EAGAIN || e == EINTR))
 					continue;
-				SCLOSE(sockfd);
+				/* A reused RADIUS/TCP or RADIUS/TLS connection may
+				 * have been closed by the server before it read the
+				 * request; the retransmission goes out on a new one. */
+				if (length == -1 && e == ECONNRESET &&
+				    (rh->so_type == RC_SOCKET_TCP ||
+				     rh->so_type == RC_SOCKET_TLS ||
+				     rh->so_type == RC_SOCKET_DTLS) &&
+				    retries < retry_max) {
+					result = 0;
+					resend = 1;
+					break;
+				}
 				memset(secret, '\0', sizeof(secret));
-				result = ERROR_RC;
+				/* a connection that keeps failing, or a server
+				 * whose host refused the datagram, lets the
+				 * caller fail over to the next server */
+				result = e == ECONNRESET || unreachable(e) ?
+					 NETUNREACH_RC : ERROR_RC;
 				goto cleanup;
 			}
 
@@ -768,7 +939,6 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 				rc_log(LOG_ERR,
 				       "rc_send_server: recvfrom: %s:%d: reply is too short",
 				       server_name, data->svc_port);
-				SCLOSE(sockfd);
 				memset(secret, '\0', sizeof(secret));
 				result = ERROR_RC;
 				goto cleanup;
@@ -777,20 +947,45 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 			result =
 			    rc_check_reply(recv_auth, RC_BUFFER_LEN, secret,
 					   vector, data->seq_nbr);
-			if (result != BADRESPID_RC) {
-				/* if a message that doesn't match our ID was received, then ignore
-				 * it, and try to receive more, until timeout. That is because in
-				 * DTLS the channel is shared, and we may receive duplicates or
-				 * out-of-order packets. */
+			if (result == OK_RC) {
+				/* a reply after a retransmission may answer
+				 * either transmission; only the first is timed */
+				if (retries == 0)
+					rc_rtt_sample(rh, auth_addr->ai_addr,
+						      rc_getmtime() - start_time);
+				replied = 1;
 				break;
 			}
+			/* A reply that doesn't match our ID, or that matches
+			 * it but fails authentication, is ignored and we keep
+			 * waiting for the remaining time. DTLS shares one
+			 * channel across requests, and a pooled UDP socket may
+			 * still receive a late reply to an earlier request
+			 * that happened to use the same ID, or a forged one. */
 		}
 
+		if (resend) {
+			retries++;
+			continue;
+		}
+
+		if (result == -1) {
+			rc_log(LOG_ERR, "rc_send_server: poll: %s",
+			       strerror(errno));
+			memset(secret, '\0', sizeof(secret));
+			result = ERROR_RC;
+			goto cleanup;
+		}
+
+		if (replied)
+			break;
+
 		/*
 		 * Timed out waiting for response.  Retry "retry_max" times
 		 * before giving up.  If retry_max = 0, don't retry at all.
 		 */
-		if (retries++ >= retry_max) {
+		if (retries++ >= retry_max ||
+		    (deadline > 0 && rc_getmtime() >= deadline)) {
 			char radius_server_ip[128];
 			struct sockaddr_in *si =
 			    (struct sockaddr_in *)auth_addr->ai_addr;
@@ -799,11 +994,11 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 			rc_log(LOG_ERR,
 			       "rc_send_server: no reply from RADIUS %s server %s:%u",
 			       server_type, radius_server_ip, data->svc_port);
-			SCLOSE(sockfd);
 			memset(secret, '\0', sizeof(secret));
 			result = TIMEOUT_RC;
 			goto cleanup;
 		}
+		rto = rc_rtt_next(rh, rto);
 	}
 
 	/*
@@ -815,47 +1010,11 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 	/*
 	 *      Verify that it's a valid RADIUS packet before doing ANYTHING with it.
 	 */
-	pb_init_read(&rb, recv_buffer, length, RC_BUFFER_LEN);
-	assert(pb_pull(&rb, AUTH_HDR_LEN) == 0);
-	while (pb_len(&rb) > 0) {
-		if (pb_peek_byte(&rb, 0, &attr_type) < 0 ||
-		    pb_peek_byte(&rb, 1, &attr_len)  < 0) {
-			rc_log(LOG_ERR,
-			       "rc_send_server: recvfrom: %s:%d: truncated attribute",
-			       server_name, data->svc_port);
-			SCLOSE(sockfd);
-			memset(secret, '\0', sizeof(secret));
-			result = ERROR_RC;
-			goto cleanup;
-		}
-		if (attr_type == 0) {
-			rc_log(LOG_ERR,
-			       "rc_send_server: recvfrom: %s:%d: attribute zero is invalid",
-			       server_name, data->svc_port);
-			SCLOSE(sockfd);
-			memset(secret, '\0', sizeof(secret));
-			result = ERROR_RC;
-			goto cleanup;
-		}
-		if (attr_len < 2) {
-			rc_log(LOG_ERR,
-			       "rc_send_server: recvfrom: %s:%d: attribute length is too small",
-			       server_name, data->svc_port);
-			SCLOSE(sockfd);
-			memset(secret, '\0', sizeof(secret));
-			result = ERROR_RC;
-			goto cleanup;
-		}
-		if (attr_len > pb_len(&rb)) {
-			rc_log(LOG_ERR,
-			       "rc_send_server: recvfrom: %s:%d: attribute overflows the packet",
-			       server_name, data->svc_port);
-			SCLOSE(sockfd);
-			memset(secret, '\0', sizeof(secret));
-			result = ERROR_RC;
-			goto cleanup;
-		}
-		assert(pb_pull(&rb, attr_len) == 0);
+	if (rc_validate_reply_attrs(recv_buffer, length, server_name,
+				    data->svc_port) != OK_RC) {
+		memset(secret, '\0', sizeof(secret));
+		result = ERROR_RC;
+		goto cleanup;
 	}
 
 	length = ntohs(recv_auth->length) - AUTH_HDR_LEN;
@@ -866,50 +1025,19 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 		data->receive_pairs = NULL;
 	}
 
-	SCLOSE(sockfd);
 	result = populate_ctx(ctx, secret, vector);
 	if (result != OK_RC) {
 		memset(secret, '\0', sizeof(secret));
 		goto cleanup;
 	}
 
-	/* Per draft-ietf-radext-deprecating-radius, Message-Authenticator MUST
-	 * be the first attribute in Access-Request responses to prevent MD5
-	 * prefix attacks (BLAST RADIUS). Not required for Accounting-Response. */
-	if (type == AUTH) {
-		/* Verify MA whenever present, regardless of position.
-		 * An incorrect MA always causes rejection. */
-		if (rc_avpair_get(data->receive_pairs, PW_MESSAGE_AUTHENTICATOR, 0)) {
-			if (validate_message_authenticator(recv_buffer, length, secret, vector)) {
-				rc_log(LOG_ERR,
-				       "rc_send_server: recvfrom: %s:%d: received attribute Message-Authenticator is incorrect",
-				       server_name, data->svc_port);
-				memset(secret, '\0', sizeof(secret));
-				result = ERROR_RC;
-				goto cleanup;
-			}
-		}
-
-		/* Enforce BLAST RADIUS: MA must also be the first attribute.
-		 * Per draft-ietf-radext-deprecating-radius-10 Section 4, this
-		 * mitigation MUST be applied to RADIUS/UDP and RADIUS/TCP, and
-		 * MUST NOT be applied to RADIUS/TLS or RADIUS/DTLS: those
-		 * transports are already integrity-protected end-to-end, so the
-		 * MD5-prefix collision this guards against isn't reachable. */
-		if (rh->so_type != RC_SOCKET_TLS && rh->so_type != RC_SOCKET_DTLS) {
-			if (length == 0 ||
-			    recv_buffer[AUTH_HDR_LEN] != PW_MESSAGE_AUTHENTICATOR) {
-				p = rc_conf_str(rh, "require-message-authenticator");
-				if (p == NULL || (strcasecmp(p, "false") != 0 && strcasecmp(p, "no") != 0)) {
-					rc_log(LOG_ERR,
-					       "rc_send_server: recvfrom: %s:%d: required attribute Message-Authenticator is missing or not first",
-					       server_name, data->svc_port);
-					memset(secret, '\0', sizeof(secret));
-					result = ERROR_RC;
-					goto cleanup;
-				}
-			}
-		}
+	if (type == AUTH &&
+	    rc_validate_reply_msg_auth(rh, recv_buffer, data->receive_pairs,
+				       secret, vector, server_name,
+				       data->svc_port) != OK_RC) {
+		memset(secret, '\0', sizeof(secret));
+		result = ERROR_RC;
+		goto cleanup;
 	}
 
 	memset(secret, '\0', sizeof(secret));
@@ -928,44 +1056,16 @@ int rc_send_server_ctx(rc_handle * rh, RC_AAA_CTX ** ctx, SEND_DATA * data,
 		}
 	}
 
-	switch (recv_auth->code) {
-	case PW_ACCESS_ACCEPT:
-	case PW_PASSWORD_ACK:
-	case PW_ACCOUNTING_RESPONSE:
-		result = OK_RC;
-		break;
-
-	case PW_ACCESS_REJECT:
-	case PW_PASSWORD_REJECT:
-		result = REJECT_RC;
-		break;
-
-	case PW_ACCESS_CHALLENGE:
-		result = CHALLENGE_RC;
-		break;
+	result = rc_reply_result(recv_auth->code);
 
-	default:
-		rc_log(LOG_ERR, "rc_send_server: received RADIUS server response neither ACCEPT nor REJECT, code=%d is invalid",
-		       recv_auth->code);
-		result = BADRESP_RC;
+ cleanup:
+	if (sockfd >= 0) {
+		SCLOSE(sockfd);
 	}
 
- cleanup:
 	if (auth_addr)
-		freeaddrinfo(auth_addr);
+		rc_addrinfo_free(auth_addr);
 
-	if (sfuncs->unlock) {
-		if (sfuncs->unlock(sfuncs->ptr) != 0) {
-			rc_log(LOG_ERR, "%s: unlock error", __func__);
-		}
-	}
  exit_error:
-	if (ns != NULL) {
-		if(-1 == rc_reset_netns(&ns_def_hdl)) {
-			rc_log(LOG_ERR, "rc_send_server: namespace %s reset failed", ns);
-			result = ERROR_RC;
-		}
-	}
-
 	return result;
 }
@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2026, Nikos Mavrogiannopoulos.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <includes.h>
+#include <radcli/radcli.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "resolve.h"
+#include "servers.h"
+
+/* The servers file is checked for changes at most this often, in
+ * seconds, so that a lookup normally makes no system call. */
+#define SERVERS_RECHECK 1
+
+/// @cond INTERNAL
+struct servers_ent {
+	uint8_t addr[16];	/* struct in_addr or struct in6_addr */
+	unsigned len;		/* 0 for an empty slot */
+	unsigned line;		/* index in secrets[] */
+};
+
+/* The servers file parsed into an open-addressing hash table, keyed by
+ * the addresses each line resolves to. */
+struct servers_idx {
+	struct servers_ent *tab;
+	unsigned mask;
+	char **secrets;		/* one per entry, in file order */
+	unsigned nsecrets;
+	unsigned names;		/* entries given as host names */
+	time_t loaded;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+};
+
+struct rc_servers {
+	pthread_mutex_t lock;
+	struct servers_idx *idx;
+	time_t checked;
+	unsigned loading;	/* a thread is reading the file */
+	int ttl;
+};
+/// @endcond
+
+/// @cond INTERNAL
+static void servers_idx_free(struct servers_idx *idx)
+{
+	unsigned i;
+
+	if (idx == NULL)
+		return;
+
+	for (i = 0; i < idx->nsecrets; i++) {
+		memset(idx->secrets[i], '\0', strlen(idx->secrets[i]));
+		free(idx->secrets[i]);
+	}
+	free(idx->secrets);
+	free(idx->tab);
+	free(idx);
+}
+/// @endcond
+
+/// @cond INTERNAL
+static struct servers_ent *servers_slot(const struct servers_idx *idx,
+					const uint8_t *addr, unsigned len)
+{
+	uint32_t h = 2166136261u;	/* FNV-1a */
+	unsigned i;
+
+	for (i = 0; i < len; i++) {
+		h ^= addr[i];
+		h *= 16777619u;
+	}
+
+	/* the table is never more than half full */
+	i = h & idx->mask;
+	while (idx->tab[i].len != 0 &&
+	       (idx->tab[i].len != len ||
+		memcmp(idx->tab[i].addr, addr, len) != 0))
+		i = (i + 1) & idx->mask;
+
+	return &idx->tab[i];
+}
+/// @endcond
+
+/* Reads the servers file. Each "hostname secret" line is resolved once
+ * here; for the paired "name1/name2 secret" form the entry is matched by
+ * the addresses of name1, as rc_find_server_addr() always did. When an
+ * address appears on several lines, the first one wins.
+ */
+/// @cond INTERNAL
+static struct servers_idx *servers_load(const char *path)
+{
+	struct servers_idx *idx;
+	struct servers_ent *found = NULL, *ents;
+	unsigned nfound = 0, afound = 0, asecrets = 0, size, i;
+	struct addrinfo *info = NULL, *p;
+	struct stat st;
+	FILE *fp;
+	char *buffer = NULL, *buffer_save, *h, *s, **secrets;
+	size_t bufsize = 0;
+	char hostnm[AUTH_ID_LEN + 1];
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		rc_log(LOG_ERR, "rc_find_server: couldn't open file: %s: %s",
+		       strerror(errno), path);
+		return NULL;
+	}
+
+	idx = calloc(1, sizeof(*idx));
+	if (idx == NULL)
+		goto oom;
+
+	idx->loaded = time(NULL);
+	if (fstat(fileno(fp), &st) == 0) {
+		idx->dev = st.st_dev;
+		idx->ino = st.st_ino;
+		idx->size = st.st_size;
+		idx->mtime = st.st_mtime;
+	}
+
+	while (getline(&buffer, &bufsize, fp) != -1) {
+		if (*buffer == '#')
+			continue;
+
+		if ((h = strtok_r(buffer, " \t\n", &buffer_save)) == NULL) /* first hostname */
+			continue;
+
+		strlcpy(hostnm, h, AUTH_ID_LEN);
+
+		if ((s = strtok_r(NULL, " \t\n", &buffer_save)) == NULL) /* and secret field */
+			continue;
+
+		hostnm[strcspn(hostnm, "/")] = '\0';
+
+		info = rc_getaddrinfo(hostnm, PW_AI_NUMERIC);
+		if (info == NULL) {
+			info = rc_getaddrinfo(hostnm, 0);
+			if (info == NULL)
+				continue;
+			idx->names++;
+		}
+
+		if (idx->nsecrets == asecrets) {
+			asecrets = asecrets ? asecrets * 2 : 16;
+			secrets = realloc(idx->secrets, asecrets * sizeof(*secrets));
+			if (secrets == NULL)
+				goto oom;
+			idx->secrets = secrets;
+		}
+		idx->secrets[idx->nsecrets] = strndup(s, MAX_SECRET_LENGTH - 1);
+		if (idx->secrets[idx->nsecrets] == NULL)
+			goto oom;
+		idx->nsecrets++;
+
+		for (p = info; p != NULL; p = p->ai_next) {
+			if (p->ai_family != AF_INET && p->ai_family != AF_INET6)
+				continue;
+
+			if (nfound == afound) {
+				afound = afound ? afound * 2 : 16;
+				ents = realloc(found, afound * sizeof(*ents));
+				if (ents == NULL)
+					goto oom;
+				found = ents;
+			}
+			found[nfound].len = SA_GET_INLEN(p->ai_addr);
+			memcpy(found[nfound].addr, SA_GET_INADDR(p->ai_addr),
+			       found[nfound].len);
+			found[nfound].line = idx->nsecrets - 1;
+			nfound++;
+		}
+
+		freeaddrinfo(info);
+		info = NULL;
+	}
+
+	for (size = 8; size < 2 * nfound; size <<= 1)
+		;
+	idx->tab = calloc(size, sizeof(*idx->tab));
+	if (idx->tab == NULL)
+		goto oom;
+	idx->mask = size - 1;
+
+	for (i = 0; i < nfound; i++) {
+		ents = servers_slot(idx, found[i].addr, found[i].len);
+		if (ents->len == 0)
+			*ents = found[i];
+	}
+	goto cleanup;
+
+ oom:
+	rc_log(LOG_CRIT, "%s: out of memory", __func__);
+	servers_idx_free(idx);
+	idx = NULL;
+
+ cleanup:
+	if (info != NULL)
+		freeaddrinfo(info);
+	free(found);
+	free(buffer);
+	fclose(fp);
+
+	return idx;
+}
+/// @endcond
+
+/// @cond INTERNAL
+static int servers_lookup(const struct servers_idx *idx,
+			  const struct addrinfo *info, char *secret)
+{
+	const struct addrinfo *p;
+	const struct servers_ent *ent;
+	unsigned line = UINT_MAX;
+
+	for (p = info; p != NULL; p = p->ai_next) {
+		if (p->ai_family != AF_INET && p->ai_family != AF_INET6)
+			continue;
+
+		ent = servers_slot(idx, SA_GET_INADDR(p->ai_addr),
+				   SA_GET_INLEN(p->ai_addr));
+		if (ent->len != 0 && ent->line < line)
+			line = ent->line;
+	}
+
+	if (line == UINT_MAX)
+		return -1;
+
+	memset(secret, '\0', MAX_SECRET_LENGTH);
+	strlcpy(secret, idx->secrets[line], MAX_SECRET_LENGTH);
+	return 0;
+}
+/// @endcond
+
+/* Whether the file must be read again: it changed on disk, or it names
+ * hosts whose addresses are older than resolve-ttl. Called with
+ * sv->lock held. */
+/// @cond INTERNAL
+static int servers_stale(const struct rc_servers *sv, const char *path,
+			 time_t now)
+{
+	const struct servers_idx *idx = sv->idx;
+	struct stat st;
+
+	if (idx == NULL)
+		return 1;
+
+	if (idx->names != 0 && now - idx->loaded >= sv->ttl)
+		return 1;
+
+	if (stat(path, &st) != 0)
+		return 0;	/* keep the entries already read */
+
+	return st.st_dev != idx->dev || st.st_ino != idx->ino ||
+	       st.st_size != idx->size || st.st_mtime != idx->mtime;
+}
+/// @endcond
+
+/** Reads the servers file of a handle, if one is configured
+ *
+ * A file that cannot be read is not an error here; it is reported when
+ * a request needs it, as before.
+ *
+ * @param rh a handle to parsed configuration.
+ * @return 0 on success, -1 on failure.
+ */
+/// @cond INTERNAL
+int rc_servers_init(rc_handle *rh)
+{
+	struct rc_servers *sv;
+	const char *path;
+
+	path = rc_conf_str(rh, "servers");
+	if (path == NULL || rh->servers != NULL)
+		return 0;
+
+	sv = calloc(1, sizeof(*sv));
+	if (sv == NULL) {
+		rc_log(LOG_CRIT, "%s: out of memory", __func__);
+		return -1;
+	}
+
+	if (pthread_mutex_init(&sv->lock, NULL) != 0) {
+		rc_log(LOG_CRIT, "%s: cannot initialize mutex", __func__);
+		free(sv);
+		return -1;
+	}
+
+	sv->ttl = rc_conf_int_default(rh, "resolve-ttl", RESOLVE_TTL);
+	sv->idx = servers_load(path);
+	sv->checked = time(NULL);
+
+	rh->servers = sv;
+	return 0;
+}
+/// @endcond
+
+/** Looks up the secret of a server in the servers file
+ *
+ * The file is read again when it changed, which is checked at most once
+ * a second; meanwhile, and while another thread reads it, lookups use
+ * the entries read before.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param info the addresses of the server.
+ * @param secret will hold the server's secret (of %MAX_SECRET_LENGTH).
+ * @return 0 on success, -1 if no entry matches or there is no file.
+ */
+/// @cond INTERNAL
+int rc_servers_find(rc_handle const *rh, const struct addrinfo *info,
+		    char *secret)
+{
+	struct rc_servers *sv = rh->servers;
+	struct servers_idx *idx, *old = NULL;
+	const char *path;
+	time_t now;
+	int ret;
+
+	path = rc_conf_str(rh, "servers");
+	if (path == NULL)
+		return -1;
+
+	if (sv == NULL) {
+		/* rc_apply_config() was not called on this handle */
+		idx = servers_load(path);
+		if (idx == NULL)
+			return -1;
+		ret = servers_lookup(idx, info, secret);
+		servers_idx_free(idx);
+		return ret;
+	}
+
+	now = time(NULL);
+
+	pthread_mutex_lock(&sv->lock);
+	if (!sv->loading && now - sv->checked >= SERVERS_RECHECK) {
+		sv->checked = now;
+		if (servers_stale(sv, path, now)) {
+			sv->loading = 1;
+			pthread_mutex_unlock(&sv->lock);
+
+			idx = servers_load(path);
+
+			pthread_mutex_lock(&sv->lock);
+			sv->loading = 0;
+			if (idx != NULL) {
+				old = sv->idx;
+				sv->idx = idx;
+			}
+		}
+	}
+
+	ret = -1;
+	if (sv->idx != NULL)
+		ret = servers_lookup(sv->idx, info, secret);
+	pthread_mutex_unlock(&sv->lock);
+
+	servers_idx_free(old);
+	return ret;
+}
+/// @endcond
+
+/** Releases the servers file index of a handle
+ *
+ * @param rh a handle to parsed configuration.
+ */
+/// @cond INTERNAL
+void rc_servers_free(rc_handle *rh)
+{
+	struct rc_servers *sv = rh->servers;
+
+	if (sv == NULL)
+		return;
+
+	servers_idx_free(sv->idx);
+	pthread_mutex_destroy(&sv->lock);
+	free(sv);
+	rh->servers = NULL;
+}
+/// @endcond
@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2026, Nikos Mavrogiannopoulos.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <includes.h>
+#include <radcli/radcli.h>
+#include <pthread.h>
+#include <poll.h>
+#include "util.h"
+#include "sockpool.h"
+
+/* Upper bound on the number of idle sockets kept per handle. Sockets
+ * beyond it are closed when returned, so a burst of concurrent callers
+ * does not pin descriptors for the lifetime of the handle. */
+#define SOCKPOOL_IDLE_MAX 8
+
+/// @cond INTERNAL
+struct sockpool_ent {
+	int fd;
+	unsigned busy;
+	unsigned broken;		/* close instead of pooling on put */
+	int stream;			/* RADIUS/TCP connection */
+	int connected;			/* UDP socket connected to peer */
+	struct sockaddr_storage addr;	/* bound address, port zeroed */
+	struct sockaddr_storage peer;	/* server, stream and connected sockets */
+};
+
+struct rc_sockpool {
+	pthread_mutex_t lock;
+	struct sockpool_ent *ents;
+	unsigned size;
+	unsigned alloc;
+};
+/// @endcond
+
+/// @cond INTERNAL
+static int same_addr(const struct sockaddr_storage *a, const struct sockaddr *b)
+{
+	if (a->ss_family != b->sa_family)
+		return 0;
+
+	if (b->sa_family == AF_INET)
+		return memcmp(&((const struct sockaddr_in *)a)->sin_addr,
+			      &((const struct sockaddr_in *)b)->sin_addr,
+			      sizeof(struct in_addr)) == 0;
+
+	return memcmp(&((const struct sockaddr_in6 *)a)->sin6_addr,
+		      &((const struct sockaddr_in6 *)b)->sin6_addr,
+		      sizeof(struct in6_addr)) == 0 &&
+	       ((const struct sockaddr_in6 *)a)->sin6_scope_id ==
+	       ((const struct sockaddr_in6 *)b)->sin6_scope_id;
+}
+/// @endcond
+
+/// @cond INTERNAL
+static int same_peer(const struct sockaddr_storage *a, const struct sockaddr *b)
+{
+	if (!same_addr(a, b))
+		return 0;
+
+	if (b->sa_family == AF_INET)
+		return ((const struct sockaddr_in *)a)->sin_port ==
+		       ((const struct sockaddr_in *)b)->sin_port;
+
+	return ((const struct sockaddr_in6 *)a)->sin6_port ==
+	       ((const struct sockaddr_in6 *)b)->sin6_port;
+}
+/// @endcond
+
+/* Discards datagrams queued on an idle socket, e.g. a reply that
+ * arrived after its request had already timed out. They would be
+ * rejected by rc_check_reply() anyway; dropping them here just avoids
+ * waking up the next request for nothing.
+ */
+/// @cond INTERNAL
+static void sockpool_drain(int fd)
+{
+	uint8_t buf[64];
+	ssize_t ret;
+
+	do {
+		ret = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+	} while (ret >= 0 || errno == EINTR);
+}
+/// @endcond
+
+/** Allocates the socket pool of a handle
+ *
+ * @param rh a handle to parsed configuration.
+ * @return 0 on success, -1 on failure.
+ */
+/// @cond INTERNAL
+int rc_sockpool_init(rc_handle *rh)
+{
+	struct rc_sockpool *pool;
+
+	if (rh->sockpool != NULL)
+		return 0;
+
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL) {
+		rc_log(LOG_CRIT, "%s: out of memory", __func__);
+		return -1;
+	}
+
+	if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+		rc_log(LOG_CRIT, "%s: cannot initialize mutex", __func__);
+		free(pool);
+		return -1;
+	}
+
+	rh->sockpool = pool;
+	return 0;
+}
+/// @endcond
+
+/* Adds a freshly created busy socket to the pool. On allocation failure
+ * the socket is still usable; rc_sockpool_put() closes sockets it does
+ * not know about. */
+/// @cond INTERNAL
+static void sockpool_add(struct rc_sockpool *pool, int fd, int stream,
+			 const struct sockaddr *addr, const struct sockaddr *peer)
+{
+	struct sockpool_ent *ents, *ent;
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->size == pool->alloc) {
+		ents = realloc(pool->ents, (pool->alloc + 4) * sizeof(*ents));
+		if (ents == NULL) {
+			pthread_mutex_unlock(&pool->lock);
+			return;
+		}
+		pool->ents = ents;
+		pool->alloc += 4;
+	}
+	ent = &pool->ents[pool->size];
+	memset(ent, 0, sizeof(*ent));
+	ent->fd = fd;
+	ent->busy = 1;
+	ent->stream = stream;
+	ent->connected = !stream && peer != NULL;
+	memcpy(&ent->addr, addr, SA_LEN(addr));
+	if (peer != NULL)
+		memcpy(&ent->peer, peer, SA_LEN(peer));
+	pool->size++;
+	pthread_mutex_unlock(&pool->lock);
+}
+/// @endcond
+
+/// @cond INTERNAL
+static int sockpool_new(rc_handle const *rh, struct sockaddr *our_sockaddr,
+		       int type)
+{
+	int sockfd;
+
+	sockfd = rc_socket(rh, our_sockaddr->sa_family, type, 0);
+	if (sockfd < 0) {
+		return -1;
+	}
+
+	if (bind(sockfd, SA(our_sockaddr), SA_LEN(our_sockaddr)) < 0) {
+		close(sockfd);
+		return -1;
+	}
+
+	return sockfd;
+}
+/// @endcond
+
+/// @cond INTERNAL
+static void zero_port(struct sockaddr *sa)
+{
+	if (sa->sa_family == AF_INET)
+		((struct sockaddr_in *)sa)->sin_port = 0;
+	else
+		((struct sockaddr_in6 *)sa)->sin6_port = 0;
+}
+/// @endcond
+
+/** Returns a bound UDP socket for exclusive use by one request
+ *
+ * An idle socket bound to the same local address is reused when
+ * available; otherwise a new one is created and added to the pool.
+ * Each socket is handed to a single request at a time, so that
+ * concurrent callers on the same handle never read each other's
+ * replies.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param our_sockaddr the local address to bind to; its port is zeroed.
+ * @return the socket descriptor, or -1 on failure.
+ */
+/// @cond INTERNAL
+int rc_sockpool_get(rc_handle *rh, struct sockaddr *our_sockaddr)
+{
+	struct rc_sockpool *pool = rh->sockpool;
+	unsigned i;
+	int sockfd;
+
+	zero_port(our_sockaddr);
+
+	pthread_mutex_lock(&pool->lock);
+	for (i = 0; i < pool->size; i++) {
+		if (pool->ents[i].busy == 0 && pool->ents[i].stream == 0 &&
+		    pool->ents[i].connected == 0 &&
+		    same_addr(&pool->ents[i].addr, our_sockaddr)) {
+			pool->ents[i].busy = 1;
+			sockfd = pool->ents[i].fd;
+			pthread_mutex_unlock(&pool->lock);
+
+			sockpool_drain(sockfd);
+			return sockfd;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	sockfd = sockpool_new(rh, our_sockaddr, SOCK_DGRAM);
+	if (sockfd < 0)
+		return -1;
+
+	sockpool_add(pool, sockfd, 0, our_sockaddr, NULL);
+	return sockfd;
+}
+/// @endcond
+
+/** Returns a UDP socket connected to a server for exclusive use by one request
+ *
+ * As rc_sockpool_get(), but the socket is connected to @p peer, so that
+ * an ICMP error the server's host sends back, such as port unreachable,
+ * is reported by the next receive on it (udp-connect). An idle socket
+ * from the same local address to @p peer is reused when available;
+ * draining it also clears an error left over from an earlier request.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param our_sockaddr the local address to bind to; its port is zeroed.
+ * @param peer the server address, including its port.
+ * @return the socket descriptor, or -1 on failure.
+ */
+/// @cond INTERNAL
+int rc_sockpool_get_connected(rc_handle *rh, struct sockaddr *our_sockaddr,
+			      const struct sockaddr *peer)
+{
+	struct rc_sockpool *pool = rh->sockpool;
+	unsigned i;
+	int sockfd, e;
+
+	zero_port(our_sockaddr);
+
+	pthread_mutex_lock(&pool->lock);
+	for (i = 0; i < pool->size; i++) {
+		if (pool->ents[i].busy == 0 && pool->ents[i].connected &&
+		    same_addr(&pool->ents[i].addr, our_sockaddr) &&
+		    same_peer(&pool->ents[i].peer, peer)) {
+			pool->ents[i].busy = 1;
+			sockfd = pool->ents[i].fd;
+			pthread_mutex_unlock(&pool->lock);
+
+			sockpool_drain(sockfd);
+			return sockfd;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	sockfd = sockpool_new(rh, our_sockaddr, SOCK_DGRAM);
+	if (sockfd < 0)
+		return -1;
+
+	if (connect(sockfd, peer, SA_LEN(peer)) != 0) {
+		e = errno;
+		close(sockfd);
+		errno = e;
+		return -1;
+	}
+
+	sockpool_add(pool, sockfd, 0, our_sockaddr, peer);
+	return sockfd;
+}
+/// @endcond
+
+/** Returns a RADIUS/TCP socket to a server for exclusive use by one request
+ *
+ * An idle connection from the same local address to @p peer is reused
+ * when available. Idle connections with anything to read are dropped
+ * instead: either the server closed them, or a late reply to an
+ * earlier, timed out request is queued and the stream can no longer be
+ * trusted to start at a packet boundary. Otherwise a new bound but
+ * unconnected socket is returned; the caller connects it on its first
+ * send (see REQ-NET-NET-004).
+ *
+ * A read timeout of radius_timeout seconds is set on new sockets, so that
+ * a server sending a partial packet cannot block a reader indefinitely.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param our_sockaddr the local address to bind to; its port is zeroed.
+ * @param peer the server address, including its port.
+ * @return the socket descriptor, or -1 on failure.
+ */
+/// @cond INTERNAL
+int rc_sockpool_get_stream(rc_handle *rh, struct sockaddr *our_sockaddr,
+			   const struct sockaddr *peer)
+{
+	struct rc_sockpool *pool = rh->sockpool;
+	struct pollfd pfd;
+	struct timeval tv;
+	unsigned i;
+	int sockfd, ms;
+
+	zero_port(our_sockaddr);
+
+	pthread_mutex_lock(&pool->lock);
+	for (i = 0; i < pool->size; i++) {
+		if (pool->ents[i].busy != 0 || pool->ents[i].stream == 0 ||
+		    !same_addr(&pool->ents[i].addr, our_sockaddr) ||
+		    !same_peer(&pool->ents[i].peer, peer))
+			continue;
+
+		pfd.fd = pool->ents[i].fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 0) != 0) {
+			close(pool->ents[i].fd);
+			pool->ents[i] = pool->ents[pool->size - 1];
+			pool->size--;
+			i--;
+			continue;
+		}
+
+		pool->ents[i].busy = 1;
+		sockfd = pool->ents[i].fd;
+		pthread_mutex_unlock(&pool->lock);
+		return sockfd;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	sockfd = sockpool_new(rh, our_sockaddr, SOCK_STREAM);
+	if (sockfd < 0)
+		return -1;
+
+	ms = rc_conf_timeout_ms(rh);
+	tv.tv_sec = ms / 1000;
+	tv.tv_usec = (ms % 1000) * 1000;
+	if (ms > 0)
+		setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	sockpool_add(pool, sockfd, 1, our_sockaddr, peer);
+	return sockfd;
+}
+/// @endcond
+
+/** Marks a pooled socket as unusable
+ *
+ * The socket is closed instead of pooled when it is returned with
+ * rc_sockpool_put(). Used for RADIUS/TCP connections whose stream is
+ * no longer synchronized at a packet boundary, or that failed.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param fd the socket descriptor.
+ */
+/// @cond INTERNAL
+void rc_sockpool_discard(rc_handle *rh, int fd)
+{
+	struct rc_sockpool *pool = rh->sockpool;
+	unsigned i;
+
+	pthread_mutex_lock(&pool->lock);
+	for (i = 0; i < pool->size; i++) {
+		if (pool->ents[i].fd == fd) {
+			pool->ents[i].broken = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+/// @endcond
+
+/** Returns a socket obtained with rc_sockpool_get() to the pool
+ *
+ * @param rh a handle to parsed configuration.
+ * @param fd the socket descriptor.
+ */
+/// @cond INTERNAL
+void rc_sockpool_put(rc_handle *rh, int fd)
+{
+	struct rc_sockpool *pool = rh->sockpool;
+	unsigned i, idle = 0;
+	int found = -1;
+
+	pthread_mutex_lock(&pool->lock);
+	for (i = 0; i < pool->size; i++) {
+		if (pool->ents[i].fd == fd)
+			found = i;
+		else if (pool->ents[i].busy == 0)
+			idle++;
+	}
+
+	if (found >= 0 && pool->ents[found].broken == 0 &&
+	    idle < SOCKPOOL_IDLE_MAX) {
+		pool->ents[found].busy = 0;
+		pthread_mutex_unlock(&pool->lock);
+		return;
+	}
+
+	if (found >= 0) {
+		pool->ents[found] = pool->ents[pool->size - 1];
+		pool->size--;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	close(fd);
+}
+/// @endcond
+
+/** Closes every pooled socket and releases the pool
+ *
+ * @param rh a handle to parsed configuration.
+ */
+/// @cond INTERNAL
+void rc_sockpool_free(rc_handle *rh)
+{
+	struct rc_sockpool *pool = rh->sockpool;
+	unsigned i;
+
+	if (pool == NULL)
+		return;
+
+	for (i = 0; i < pool->size; i++)
+		close(pool->ents[i].fd);
+
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->ents);
+	free(pool);
+	rh->sockpool = NULL;
+}
+/// @endcond
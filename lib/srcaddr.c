@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2026, Nikos Mavrogiannopoulos.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <config.h>
+#include <includes.h>
+#include <radcli/radcli.h>
+#include <pthread.h>
+#include "util.h"
+#include "srcaddr.h"
+
+#ifdef __linux__
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+/* Without bindaddr, the local address a request goes out from, and puts
+ * in NAS-IP-Address, is the one the kernel routes to the server from.
+ * rc_get_srcaddr() learns it with a socket of its own; the answer is
+ * kept per server address for srcaddr-ttl seconds. On Linux, a
+ * non-blocking rtnetlink socket subscribed to address and route changes
+ * is read on every lookup, and anything on it empties the cache. */
+
+/* Default srcaddr-ttl */
+#define SRCADDR_TTL 60
+
+/* Upper bound on the number of server addresses cached per handle. When
+ * full, the least recently used one is replaced. */
+#define SRCADDR_MAX 64
+
+/// @cond INTERNAL
+struct srcaddr_ent {
+	struct sockaddr_storage dst;	/* server address, port ignored */
+	struct sockaddr_storage src;
+	time_t expires;
+	unsigned long used;
+};
+
+struct rc_srcaddr {
+	pthread_mutex_t lock;
+	struct srcaddr_ent ents[SRCADDR_MAX];
+	unsigned size;
+	unsigned long tick;
+	int ttl;
+	int nl;				/* rtnetlink socket, or -1 */
+	int nl_opened;			/* opening it was attempted */
+};
+/// @endcond
+
+/// @cond INTERNAL
+static int srcaddr_same(const struct sockaddr *a, const struct sockaddr_storage *b)
+{
+	if (a->sa_family != b->ss_family)
+		return 0;
+
+	if (a->sa_family == AF_INET)
+		return memcmp(&((const struct sockaddr_in *)a)->sin_addr,
+			      &((const struct sockaddr_in *)b)->sin_addr,
+			      sizeof(struct in_addr)) == 0;
+
+	return memcmp(&((const struct sockaddr_in6 *)a)->sin6_addr,
+		      &((const struct sockaddr_in6 *)b)->sin6_addr,
+		      sizeof(struct in6_addr)) == 0 &&
+	       ((const struct sockaddr_in6 *)a)->sin6_scope_id ==
+	       ((const struct sockaddr_in6 *)b)->sin6_scope_id;
+}
+
+/* Called with c->lock held */
+static struct srcaddr_ent *srcaddr_find(struct rc_srcaddr *c,
+					const struct sockaddr *dst)
+{
+	unsigned i;
+
+	for (i = 0; i < c->size; i++) {
+		if (srcaddr_same(dst, &c->ents[i].dst))
+			return &c->ents[i];
+	}
+
+	return NULL;
+}
+
+/* Opens the rtnetlink socket on first use, so that it belongs to the
+ * network namespace the requests are sent from, and empties the cache
+ * if an address or route changed since the last lookup. Called with
+ * c->lock held. */
+static void srcaddr_check(rc_handle const *rh, struct rc_srcaddr *c)
+{
+#ifdef __linux__
+	struct sockaddr_nl snl;
+	uint8_t buf[4096];
+	ssize_t ret;
+	int changed = 0;
+
+	if (!c->nl_opened) {
+		c->nl_opened = 1;
+		c->nl = rc_socket(rh, AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+		if (c->nl < 0) {
+			DEBUG(LOG_INFO, "%s: netlink: %s; relying on srcaddr-ttl",
+			      __func__, strerror(errno));
+			return;
+		}
+
+		memset(&snl, 0, sizeof(snl));
+		snl.nl_family = AF_NETLINK;
+		snl.nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR |
+				RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+		if (bind(c->nl, (struct sockaddr *)&snl, sizeof(snl)) < 0) {
+			DEBUG(LOG_INFO, "%s: netlink: %s; relying on srcaddr-ttl",
+			      __func__, strerror(errno));
+			close(c->nl);
+			c->nl = -1;
+		}
+		return;
+	}
+
+	if (c->nl < 0)
+		return;
+
+	/* the messages themselves do not matter; a full socket buffer
+	 * (ENOBUFS) means some were lost */
+	for (;;) {
+		ret = recv(c->nl, buf, sizeof(buf), MSG_DONTWAIT);
+		if (ret > 0 || (ret < 0 && errno == ENOBUFS))
+			changed = 1;
+		else if (ret < 0 && errno == EINTR)
+			continue;
+		else
+			break;
+	}
+
+	if (changed) {
+		DEBUG(LOG_INFO, "%s: addresses or routes changed", __func__);
+		c->size = 0;
+	}
+#endif
+}
+/// @endcond
+
+/** Allocates the source address cache of a handle
+ *
+ * @param rh a handle to parsed configuration.
+ * @return 0 on success, -1 on an invalid srcaddr-ttl or failure.
+ */
+/// @cond INTERNAL
+int rc_srcaddr_init(rc_handle *rh)
+{
+	struct rc_srcaddr *c;
+	int ttl;
+
+	if (rh->srcaddr != NULL)
+		return 0;
+
+	ttl = rc_conf_int_default(rh, "srcaddr-ttl", SRCADDR_TTL);
+	if (ttl < 0) {
+		rc_log(LOG_ERR, "%s: srcaddr-ttl must not be negative", __func__);
+		return -1;
+	}
+
+	if (ttl == 0)
+		return 0;
+
+	c = calloc(1, sizeof(*c));
+	if (c == NULL) {
+		rc_log(LOG_CRIT, "%s: out of memory", __func__);
+		return -1;
+	}
+
+	if (pthread_mutex_init(&c->lock, NULL) != 0) {
+		rc_log(LOG_CRIT, "%s: cannot initialize mutex", __func__);
+		free(c);
+		return -1;
+	}
+
+	c->ttl = ttl;
+	c->nl = -1;
+
+	rh->srcaddr = c;
+	return 0;
+}
+/// @endcond
+
+/* rc_get_srcaddr() in the network namespace of the handle */
+/// @cond INTERNAL
+static int srcaddr_lookup(rc_handle const *rh, struct sockaddr *lia,
+			  const struct sockaddr *ria)
+{
+	int prev, result;
+
+	if (rc_enter_netns(rh, &prev) == -1)
+		return ERROR_RC;
+
+	result = rc_get_srcaddr(lia, ria);
+
+	if (rc_leave_netns(rh, &prev) == -1)
+		return ERROR_RC;
+
+	return result;
+}
+/// @endcond
+
+/** Returns the local address that routes to a server, from the cache when possible
+ *
+ * Like rc_get_srcaddr(), which it calls on a miss; the port of the
+ * returned address is not meaningful.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param lia the local address, in a buffer the size of a sockaddr_storage.
+ * @param ria the server address.
+ * @return OK_RC, NETUNREACH_RC or ERROR_RC, as rc_get_srcaddr().
+ */
+/// @cond INTERNAL
+int rc_srcaddr_get(rc_handle const *rh, struct sockaddr *lia,
+		   const struct sockaddr *ria)
+{
+	struct rc_srcaddr *c = rh->srcaddr;
+	struct srcaddr_ent *ent;
+	time_t now;
+	unsigned i;
+	int result;
+
+	if (c == NULL)
+		return srcaddr_lookup(rh, lia, ria);
+
+	now = time(NULL);
+
+	pthread_mutex_lock(&c->lock);
+	srcaddr_check(rh, c);
+	ent = srcaddr_find(c, ria);
+	if (ent != NULL && now < ent->expires) {
+		ent->used = ++c->tick;
+		memcpy(lia, &ent->src, SA_LEN(SA(&ent->src)));
+		pthread_mutex_unlock(&c->lock);
+		return OK_RC;
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	result = srcaddr_lookup(rh, lia, ria);
+	if (result != OK_RC)
+		return result;
+
+	pthread_mutex_lock(&c->lock);
+	/* the entry may have been replaced while the lock was dropped */
+	ent = srcaddr_find(c, ria);
+	if (ent == NULL && c->size < SRCADDR_MAX) {
+		ent = &c->ents[c->size++];
+	} else if (ent == NULL) {
+		ent = &c->ents[0];
+		for (i = 1; i < c->size; i++) {
+			if (c->ents[i].used < ent->used)
+				ent = &c->ents[i];
+		}
+	}
+
+	memset(ent, 0, sizeof(*ent));
+	memcpy(&ent->dst, ria, SA_LEN(ria));
+	memcpy(&ent->src, lia, SA_LEN(lia));
+	ent->expires = now + c->ttl;
+	ent->used = ++c->tick;
+	pthread_mutex_unlock(&c->lock);
+
+	return OK_RC;
+}
+/// @endcond
+
+/** Releases the source address cache of a handle
+ *
+ * @param rh a handle to parsed configuration.
+ */
+/// @cond INTERNAL
+void rc_srcaddr_free(rc_handle *rh)
+{
+	struct rc_srcaddr *c = rh->srcaddr;
+
+	if (c == NULL)
+		return;
+
+	if (c->nl >= 0)
+		close(c->nl);
+	pthread_mutex_destroy(&c->lock);
+	free(c);
+	rh->srcaddr = NULL;
+}
+/// @endcond
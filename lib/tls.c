@@ -28,6 +28,7 @@
 #include <radcli/radcli.h>
 #include "util.h"
 #include "tls.h"
+#include "resolve.h"
 
 #ifdef HAVE_GNUTLS
 
@@ -66,68 +67,499 @@ typedef struct tls_int_st {
 				  * finished (or started) its handshake. */
 	unsigned need_restart;
 	unsigned skip_hostname_check; /* whether to verify hostname */
-	pthread_mutex_t lock;
 	time_t last_msg;
 	time_t last_restart;
+	unsigned server;	/* index of its server in tls_st.srv */
+	gnutls_datum_t resume;	/* data to resume the last established session
+				 * with; kept across restart_session() */
 } tls_int_st;
 
-typedef struct tls_st {
+/* A request handed out by tls_get_fd(). Its descriptor is a duplicate of
+ * the session's socket, by which the other transport calls find it. */
+typedef struct tls_req_st {
+	int fd;			/* descriptor returned by tls_get_fd() */
+	unsigned ses;		/* index of the session it uses */
+	uint8_t id;		/* Identifier reserved for it on the session */
+	unsigned gen;		/* connection it was last sent on */
+	unsigned done;		/* a reply is waiting in @reply */
+	size_t len;
+	uint8_t reply[RC_BUFFER_LEN];
+	struct tls_req_st *next;
+} tls_req_st;
+
+/* What the requests sharing a session know about it. Kept apart from
+ * tls_int_st, which restart_session() replaces as a whole. Protected by
+ * tls_st.lock. */
+typedef struct tls_use_st {
+	tls_req_st *pending[256]; /* by Identifier */
+	unsigned inflight;	/* number of entries in pending */
+	unsigned next_id;	/* where the search for a free Identifier starts */
+	unsigned gen;		/* bumped whenever the connection fails */
+	unsigned sending;	/* a thread is in gnutls_record_send() */
+	unsigned reading;	/* a thread is reading replies off the session */
+	unsigned exclusive;	/* the session is being (re)connected or probed */
+} tls_use_st;
+
+/* A configured authserver. */
+typedef struct tls_srv_st {
+	char hostname[256];
+	unsigned port;
 	gnutls_psk_client_credentials_t psk_cred;
+	struct sockaddr_storage addr; /* its address; protected by tls_st.lock */
+	time_t down_since;	/* when it last failed, 0 once it answers;
+				 * protected by tls_st.lock */
+} tls_srv_st;
+
+typedef struct tls_st {
 	gnutls_certificate_credentials_t x509_cred;
-	struct tls_int_st ctx;	/* one for ACCT and another for AUTH */
+	pthread_mutex_t lock;	/* protects use[], reqs and srv[] */
+	pthread_cond_t cond;	/* broadcast on every change under lock */
+	unsigned servers;	/* number of entries in srv */
+	struct tls_srv_st *srv;
+	unsigned per_server;	/* tls-sessions */
+	unsigned sessions;	/* number of entries in ctx and use: the
+				 * per_server sessions of each server, in
+				 * the order of srv */
+	unsigned warm;		/* sessions per server connected up front
+				 * and kept so */
+	int hold;		/* seconds a failed server is not
+				 * reconnected on the request path */
+	struct tls_int_st *ctx;	/* the sessions, established on first use */
+	struct tls_use_st *use;
+	tls_req_st *reqs;	/* requests handed out */
 	unsigned flags; /* the flags set on init */
 	rc_handle *rh; /* a pointer to our owner */
 } tls_st;
 
 /// @cond INTERNAL
-static int restart_session(rc_handle *rh, tls_st *st);
+static int restart_session(rc_handle *rh, tls_st *st, tls_int_st *ses);
+/// @endcond
+
+/* Requests are pipelined: each one reserves an Identifier on a session
+ * and many of them share it. Sending only holds the session for the
+ * duration of gnutls_record_send(). Replies are read by one of the
+ * waiting requests at a time, which hands each to its request by
+ * Identifier (tls_wait()). Reconnecting or probing a session needs it
+ * exclusively, and waits until nobody is sending or reading.
+ *
+ * Unless noted otherwise the functions below are called with st->lock
+ * held.
+ */
+
+/// @cond INTERNAL
+#ifdef HAVE_CLOCK_GETTIME
+# define TLS_COND_CLOCK CLOCK_MONOTONIC
+#endif
+
+/* Waits on st->cond until signalled or until @deadline, a time as
+ * returned by rc_getmtime(). */
+static void tls_timedwait(tls_st *st, double deadline)
+{
+	struct timespec ts;
+	double left = deadline - rc_getmtime();
+
+	if (left <= 0)
+		return;
+
+#ifdef TLS_COND_CLOCK
+	clock_gettime(TLS_COND_CLOCK, &ts);
+#else
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		ts.tv_sec = tv.tv_sec;
+		ts.tv_nsec = tv.tv_usec * 1000;
+	}
+#endif
+	ts.tv_sec += (time_t)left;
+	ts.tv_nsec += (long)((left - (time_t)left) * 1000000000.0);
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	pthread_cond_timedwait(&st->cond, &st->lock, &ts);
+}
+/// @endcond
+
+/// @cond INTERNAL
+static int tls_cond_init(pthread_cond_t *cond)
+{
+#ifdef TLS_COND_CLOCK
+	pthread_condattr_t attr;
+	int ret;
+
+	if (pthread_condattr_init(&attr) != 0)
+		return -1;
+	ret = pthread_condattr_setclock(&attr, TLS_COND_CLOCK);
+	if (ret == 0)
+		ret = pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+	return ret;
+#else
+	return pthread_cond_init(cond, NULL);
+#endif
+}
+/// @endcond
+
+/// @cond INTERNAL
+static tls_req_st *tls_find(tls_st *st, int fd)
+{
+	tls_req_st *req;
+
+	for (req = st->reqs; req != NULL; req = req->next) {
+		if (req->fd == fd)
+			return req;
+	}
+	return NULL;
+}
+/// @endcond
+
+/* Marks the session broken: the requests that were sent on it stop
+ * waiting for their replies, and the next one to send reconnects it. */
+/// @cond INTERNAL
+static void tls_fail(tls_st *st, tls_int_st *ses)
+{
+	tls_use_st *use = &st->use[ses - st->ctx];
+
+	if (ses->need_restart == 0) {
+		ses->need_restart = 1;
+		use->gen++;
+		/* wakes up a request blocked reading the session */
+		if (ses->sockfd != -1)
+			shutdown(ses->sockfd, SHUT_RD);
+	}
+	st->srv[ses->server].down_since = time(0);
+	pthread_cond_broadcast(&st->cond);
+}
+/// @endcond
+
+/* (Re)connects a session held exclusively, and records whether its
+ * server could be reached. Called without st->lock held. */
+/// @cond INTERNAL
+static int tls_restart(tls_st *st, tls_int_st *ses)
+{
+	int ret;
+
+	ret = restart_session(st->rh, st, ses);
+
+	pthread_mutex_lock(&st->lock);
+	st->srv[ses->server].down_since = ret < 0 ? time(0) : 0;
+	pthread_mutex_unlock(&st->lock);
+
+	return ret;
+}
+/// @endcond
+
+/* Returns with the session connected and not held exclusively by
+ * another thread, reconnecting it first if needed. Returns -1 with
+ * errno set to ENETUNREACH if it could not be connected. When there
+ * are other servers to fail over to, a server that failed less than
+ * st->hold seconds ago is not even tried (REQ-NET-NET-027). */
+/// @cond INTERNAL
+static int tls_ready(tls_st *st, tls_int_st *ses)
+{
+	tls_use_st *use = &st->use[ses - st->ctx];
+	tls_srv_st *srv = &st->srv[ses->server];
+	int ret;
+
+	while (use->exclusive)
+		pthread_cond_wait(&st->cond, &st->lock);
+
+	if (ses->need_restart == 0)
+		return 0;
+
+	if (st->servers > 1 && srv->down_since != 0 &&
+	    time(0) - srv->down_since < st->hold) {
+		errno = ENETUNREACH;
+		return -1;
+	}
+
+	use->exclusive = 1;
+	while (use->sending || use->reading)
+		pthread_cond_wait(&st->cond, &st->lock);
+	pthread_mutex_unlock(&st->lock);
+
+	ret = tls_restart(st, ses);
+
+	pthread_mutex_lock(&st->lock);
+	use->exclusive = 0;
+	pthread_cond_broadcast(&st->cond);
+
+	if (ret < 0)
+		errno = ENETUNREACH;
+	return ret;
+}
 /// @endcond
 
+/* Picks the session of @server for a new request: the least loaded established
+ * one, or a session not connected yet when every established session
+ * already has requests in flight. Sessions that are broken or being
+ * reconnected are only picked when there is nothing else, so that the
+ * requests move over to a warm session (REQ-NET-NET-026). Returns NULL
+ * when all sessions have used up their Identifiers. */
 /// @cond INTERNAL
-static int tls_get_fd(void *ptr, struct sockaddr *our_sockaddr)
+static tls_int_st *tls_pick(tls_st *st, unsigned server)
+{
+	tls_use_st *use;
+	int best = -1, broken = -1, spare = -1;
+	unsigned i;
+
+	for (i = server * st->per_server; i < (server + 1) * st->per_server; i++) {
+		use = &st->use[i];
+		if (use->inflight == 0 && use->exclusive == 0 &&
+		    st->ctx[i].init == 0) {
+			if (spare == -1)
+				spare = i;
+			continue;
+		}
+		if (use->inflight >= 256)
+			continue;
+		if (use->exclusive || st->ctx[i].need_restart) {
+			if (broken == -1 || use->inflight < st->use[broken].inflight)
+				broken = i;
+			continue;
+		}
+		if (best == -1 || use->inflight < st->use[best].inflight)
+			best = i;
+	}
+
+	if (spare != -1 && (best == -1 || st->use[best].inflight > 0))
+		return &st->ctx[spare];
+	if (best != -1)
+		return &st->ctx[best];
+	if (broken != -1)
+		return &st->ctx[broken];
+	return NULL;
+}
+/// @endcond
+
+/// @cond INTERNAL
+static int same_peer(const struct sockaddr_storage *a, const struct sockaddr *b)
+{
+	if (a->ss_family != b->sa_family)
+		return 0;
+
+	if (b->sa_family == AF_INET)
+		return ((const struct sockaddr_in *)a)->sin_port ==
+		       ((const struct sockaddr_in *)b)->sin_port &&
+		       memcmp(&((const struct sockaddr_in *)a)->sin_addr,
+			      &((const struct sockaddr_in *)b)->sin_addr,
+			      sizeof(struct in_addr)) == 0;
+
+	return ((const struct sockaddr_in6 *)a)->sin6_port ==
+	       ((const struct sockaddr_in6 *)b)->sin6_port &&
+	       memcmp(&((const struct sockaddr_in6 *)a)->sin6_addr,
+		      &((const struct sockaddr_in6 *)b)->sin6_addr,
+		      sizeof(struct in6_addr)) == 0;
+}
+/// @endcond
+
+/* Resolves the address of a server the way rc_send_server_ctx() does,
+ * and stores it in srv->addr. Called without st->lock held. */
+/// @cond INTERNAL
+static int tls_resolve(tls_st *st, tls_srv_st *srv)
+{
+	struct addrinfo *info;
+
+	info = rc_resolve(st->rh, srv->hostname, PW_AI_AUTH);
+	if (info == NULL)
+		return -1;
+
+	if (info->ai_family == AF_INET)
+		((struct sockaddr_in *)info->ai_addr)->sin_port = htons(srv->port);
+	else
+		((struct sockaddr_in6 *)info->ai_addr)->sin6_port = htons(srv->port);
+
+	pthread_mutex_lock(&st->lock);
+	memcpy(&srv->addr, info->ai_addr, info->ai_addrlen);
+	pthread_mutex_unlock(&st->lock);
+
+	rc_addrinfo_free(info);
+	return 0;
+}
+/// @endcond
+
+/* Finds the server a request to @peer is for; the name of a server may
+ * resolve differently by now. Returns -1 if it is none of them. Called
+ * without st->lock held. */
+/// @cond INTERNAL
+static int tls_server(tls_st *st, const struct sockaddr *peer)
+{
+	unsigned j;
+	int found = -1;
+
+	if (st->servers == 1)
+		return 0;
+
+	pthread_mutex_lock(&st->lock);
+	for (j = 0; j < st->servers && found == -1; j++) {
+		if (same_peer(&st->srv[j].addr, peer))
+			found = j;
+	}
+	pthread_mutex_unlock(&st->lock);
+
+	for (j = 0; j < st->servers && found == -1; j++) {
+		if (tls_resolve(st, &st->srv[j]) < 0)
+			continue;
+		pthread_mutex_lock(&st->lock);
+		if (same_peer(&st->srv[j].addr, peer))
+			found = j;
+		pthread_mutex_unlock(&st->lock);
+	}
+
+	return found;
+}
+/// @endcond
+
+/* Called without st->lock held. */
+/// @cond INTERNAL
+static int tls_get_fd(void *ptr, struct sockaddr *our_sockaddr,
+		      const struct sockaddr *peer)
 {
 	tls_st *st = ptr;
-	if (st->ctx.need_restart != 0) {
-		if (restart_session(st->rh, st) < 0)
-			return -1;
+	tls_req_st *req;
+	tls_int_st *ses;
+	tls_use_st *use;
+	unsigned i, id = 0;
+	int server, e;
+
+	server = tls_server(st, peer);
+	if (server < 0) {
+		rc_log(LOG_ERR, "%s: request is not for a configured authserver",
+		       __func__);
+		errno = EINVAL;
+		return -1;
+	}
+
+	req = calloc(1, sizeof(*req));
+	if (req == NULL)
+		return -1;
+
+	pthread_mutex_lock(&st->lock);
+	while ((ses = tls_pick(st, server)) == NULL)
+		pthread_cond_wait(&st->cond, &st->lock);
+
+	use = &st->use[ses - st->ctx];
+	for (i = 0; i < 256; i++) {
+		id = (use->next_id + i) & 0xff;
+		if (use->pending[id] == NULL)
+			break;
 	}
-	return st->ctx.sockfd;
+	/* don't reuse an Identifier right away; a late reply to its
+	 * previous request may still be on the way */
+	use->next_id = id + 1;
+	use->pending[id] = req;
+	use->inflight++;
+	req->ses = ses - st->ctx;
+	req->id = id;
+
+	if (tls_ready(st, ses) < 0) {
+		e = errno;
+		goto fail;
+	}
+
+	req->fd = dup(ses->sockfd);
+	if (req->fd == -1) {
+		/* the session's socket is gone; reconnect on next use */
+		tls_fail(st, ses);
+		e = ENETUNREACH;
+		goto fail;
+	}
+	req->gen = use->gen;
+	req->next = st->reqs;
+	st->reqs = req;
+	pthread_mutex_unlock(&st->lock);
+
+	return req->fd;
+
+ fail:
+	use->pending[id] = NULL;
+	use->inflight--;
+	pthread_cond_broadcast(&st->cond);
+	pthread_mutex_unlock(&st->lock);
+	free(req);
+	errno = e;
+	return -1;
 }
 /// @endcond
 
+/* Called without st->lock held. */
 /// @cond INTERNAL
-static int tls_get_active_fd(void *ptr)
+static int tls_get_id(void *ptr, int fd)
 {
 	tls_st *st = ptr;
-	return st->ctx.sockfd;
+	tls_req_st *req;
+	int id = -1;
+
+	pthread_mutex_lock(&st->lock);
+	req = tls_find(st, fd);
+	if (req != NULL)
+		id = req->id;
+	pthread_mutex_unlock(&st->lock);
+
+	return id;
+}
+/// @endcond
+
+/* The session stays open; this only frees the request's Identifier and
+ * descriptor (REQ-NET-TEARDOWN-002). Called without st->lock held. */
+/// @cond INTERNAL
+static void tls_close_fd(void *ptr, int fd)
+{
+	tls_st *st = ptr;
+	tls_req_st **p, *req = NULL;
+	tls_use_st *use;
+
+	pthread_mutex_lock(&st->lock);
+	for (p = &st->reqs; *p != NULL; p = &(*p)->next) {
+		if ((*p)->fd == fd) {
+			req = *p;
+			*p = req->next;
+			break;
+		}
+	}
+	if (req != NULL) {
+		use = &st->use[req->ses];
+		use->pending[req->id] = NULL;
+		use->inflight--;
+		pthread_cond_broadcast(&st->cond);
+	}
+	pthread_mutex_unlock(&st->lock);
+
+	if (req != NULL) {
+		close(req->fd);
+		free(req);
+	}
 }
 /// @endcond
 
-/* Used from the GNUTLS_E_AGAIN/GNUTLS_E_INTERRUPTED retry branches of
- * tls_sendto()/tls_recvfrom(): GnuTLS requires retrying the record call
- * with the same arguments once @events is ready on the session fd.
+/* Used from the GNUTLS_E_AGAIN/GNUTLS_E_INTERRUPTED retry branch of
+ * tls_sendto(): GnuTLS requires retrying the record call with the same
+ * arguments once @events is ready on the session fd.
  * Waits up to the configured radius_timeout, safe against poll() itself
  * being interrupted by a signal (retried against the same, non-extending
  * deadline, so neither a signal nor a run of spurious EAGAINs can make
- * the wait unbounded). On timeout or error, logs, marks the session for
- * restart and sets errno=EIO.
+ * the wait unbounded). On timeout or error, logs and sets errno=EIO; the
+ * caller marks the session for restart.
  *
  * Returns 1 if the caller should retry the gnutls_record_*() call, or -1
- * if it should give up (matching the calling convention of tls_sendto()/
- * tls_recvfrom() themselves).
+ * if it should give up (matching the calling convention of tls_sendto()
+ * itself). Called without st->lock held.
  */
 /// @cond INTERNAL
-static int tls_wait_or_give_up(tls_st *st, short events, const char *what)
+static int tls_wait_or_give_up(tls_st *st, tls_int_st *ses, short events,
+			       const char *what)
 {
-	double start_time = rc_getmtime();
-	int timeout = rc_conf_int(st->rh, "radius_timeout");
+	int timeout = rc_conf_timeout_ms(st->rh);
+	double deadline;
 
 	if (timeout <= 0)
-		timeout = 1;
+		timeout = 1000;
+	deadline = rc_getmtime() + timeout / 1000.0;
 
-	for (; timeout > 0; timeout -= (int)(rc_getmtime() - start_time)) {
-		struct pollfd pfd = { st->ctx.sockfd, events, 0 };
-		int ret = poll(&pfd, 1, timeout * 1000);
+	for (; timeout > 0; timeout = (int)((deadline - rc_getmtime()) * 1000)) {
+		struct pollfd pfd = { ses->sockfd, events, 0 };
+		int ret = poll(&pfd, 1, timeout);
 
 		if (ret > 0)
 			return 1;
@@ -143,11 +575,11 @@ static int tls_wait_or_give_up(tls_st *st, short events, const char *what)
 	rc_log(LOG_ERR, "%s: timeout waiting to %s TLS data", __func__, what);
 give_up:
 	errno = EIO;
-	st->ctx.need_restart = 1;
 	return -1;
 }
 /// @endcond
 
+/* Called without st->lock held. */
 /// @cond INTERNAL
 static ssize_t tls_sendto(void *ptr, int sockfd,
 			   const void *buf, size_t len,
@@ -155,20 +587,41 @@ static ssize_t tls_sendto(void *ptr, int sockfd,
 			   socklen_t addrlen)
 {
 	tls_st *st = ptr;
+	tls_req_st *req;
+	tls_int_st *ses;
+	tls_use_st *use;
 	int ret;
 
-	if (st->ctx.need_restart != 0) {
-		if (restart_session(st->rh, st) < 0) {
-			errno = EIO;
+	pthread_mutex_lock(&st->lock);
+	req = tls_find(st, sockfd);
+	if (req == NULL) {
+		pthread_mutex_unlock(&st->lock);
+		errno = EBADF;
+		return -1;
+	}
+	ses = &st->ctx[req->ses];
+	use = &st->use[req->ses];
+
+	for (;;) {
+		if (tls_ready(st, ses) < 0) {
+			pthread_mutex_unlock(&st->lock);
+			errno = ENETUNREACH;
 			return -1;
 		}
+		if (use->sending == 0)
+			break;
+		pthread_cond_wait(&st->cond, &st->lock);
 	}
+	use->sending = 1;
+	req->gen = use->gen;
+	req->done = 0;
+	pthread_mutex_unlock(&st->lock);
 
 	for (;;) {
-		ret = gnutls_record_send(st->ctx.session, buf, len);
+		ret = gnutls_record_send(ses->session, buf, len);
 		if (ret == GNUTLS_E_AGAIN || ret == GNUTLS_E_INTERRUPTED) {
-			if (tls_wait_or_give_up(st, POLLOUT, "send") < 0)
-				return -1;
+			if (tls_wait_or_give_up(st, ses, POLLOUT, "send") < 0)
+				break;
 			continue;
 		}
 
@@ -176,61 +629,58 @@ static ssize_t tls_sendto(void *ptr, int sockfd,
 			rc_log(LOG_ERR, "%s: error in sending: %s", __func__,
 			       gnutls_strerror(ret));
 			errno = EIO;
-			st->ctx.need_restart = 1;
-			return -1;
 		}
 
 		break;
 	}
 
-	st->ctx.last_msg = time(0);
-	return ret;
-}
-/// @endcond
-
-/// @cond INTERNAL
-static int tls_lock(void *ptr)
-{
-	tls_st *st = ptr;
-
-	return pthread_mutex_lock(&st->ctx.lock);
-}
-/// @endcond
-
-/// @cond INTERNAL
-static int tls_unlock(void *ptr)
-{
-	tls_st *st = ptr;
+	pthread_mutex_lock(&st->lock);
+	use->sending = 0;
+	if (ret < 0)
+		tls_fail(st, ses);
+	else
+		ses->last_msg = time(0);
+	pthread_cond_broadcast(&st->cond);
+	pthread_mutex_unlock(&st->lock);
 
-	return pthread_mutex_unlock(&st->ctx.lock);
+	if (ret < 0) {
+		/* lets rc_aaa_ctx_server() fail over to the next server */
+		errno = ENETUNREACH;
+		return -1;
+	}
+	return ret;
 }
 /// @endcond
 
+/* Reads one record off the session, waiting at most @timeout ms for it.
+ * Returns its length, 0 if there was none, or -1 if the session failed.
+ * Called without st->lock held, by the thread that set use->reading. */
 /// @cond INTERNAL
-static ssize_t tls_recvfrom(void *ptr, int sockfd,
-			     void *buf, size_t len,
-			     int flags, struct sockaddr *src_addr,
-			     socklen_t * addrlen)
+static int tls_read_record(tls_int_st *ses, uint8_t *buf, size_t len,
+			   int timeout)
 {
-	tls_st *st = ptr;
+	struct pollfd pfd = { ses->sockfd, POLLIN, 0 };
 	int ret;
 
-	for (;;) {
-		ret = gnutls_record_recv(st->ctx.session, buf, len);
-		if (ret == GNUTLS_E_AGAIN || ret == GNUTLS_E_INTERRUPTED ||
-		    ret == GNUTLS_E_HEARTBEAT_PING_RECEIVED || ret == GNUTLS_E_HEARTBEAT_PONG_RECEIVED) {
-			if (tls_wait_or_give_up(st, POLLIN, "receive") < 0)
-				return -1;
-			continue;
+	if (gnutls_record_check_pending(ses->session) == 0) {
+		ret = poll(&pfd, 1, timeout);
+		if (ret == 0 || (ret == -1 && errno == EINTR))
+			return 0;
+		if (ret == -1) {
+			rc_log(LOG_ERR, "%s: poll: %s", __func__, strerror(errno));
+			return -1;
 		}
-		break;
 	}
 
+	ret = gnutls_record_recv(ses->session, buf, len);
+	if (ret == GNUTLS_E_AGAIN || ret == GNUTLS_E_INTERRUPTED ||
+	    ret == GNUTLS_E_HEARTBEAT_PING_RECEIVED || ret == GNUTLS_E_HEARTBEAT_PONG_RECEIVED)
+		return 0;
+
 	if (ret == GNUTLS_E_WARNING_ALERT_RECEIVED) {
 		rc_log(LOG_ERR, "%s: received alert: %s", __func__,
-		       gnutls_alert_get_name(gnutls_alert_get(st->ctx.session)));
-		errno = EINTR;
-		return -1;
+		       gnutls_alert_get_name(gnutls_alert_get(ses->session)));
+		return 0;
 	}
 
 	/* RFC6614 says: "After the TLS session is established, RADIUS packet payloads are
@@ -248,12 +698,131 @@ static ssize_t tls_recvfrom(void *ptr, int sockfd,
 	if (ret <= 0) {
 		rc_log(LOG_ERR, "%s: error in receiving: %s", __func__,
 		       gnutls_strerror(ret));
-		errno = EIO;
-		st->ctx.need_restart = 1;
 		return -1;
 	}
 
-	st->ctx.last_msg = time(0);
+	return ret;
+}
+/// @endcond
+
+/* Hands a reply read off the session to the request waiting for it. */
+/// @cond INTERNAL
+static void tls_dispatch(tls_st *st, tls_int_st *ses, const uint8_t *buf,
+			 size_t len)
+{
+	tls_use_st *use = &st->use[ses - st->ctx];
+	tls_req_st *req;
+
+	ses->last_msg = time(0);
+
+	if (len < 2) {
+		rc_log(LOG_ERR, "%s: reply is too short", __func__);
+		return;
+	}
+
+	req = use->pending[buf[1]];
+	if (req == NULL || req->gen != use->gen) {
+		rc_log(LOG_DEBUG, "%s: no request waiting for reply with id %u",
+		       __func__, (unsigned)buf[1]);
+		return;
+	}
+
+	memcpy(req->reply, buf, len);
+	req->len = len;
+	req->done = 1;
+	st->srv[ses->server].down_since = 0;
+}
+/// @endcond
+
+/* Waits up to @timeout ms for the reply to the request on @fd, reading
+ * the session for all requests using it if no other thread does.
+ * Returns 1 when tls_recvfrom() has something to report: the reply, or
+ * the failure of the session. Returns 0 on timeout. Called without
+ * st->lock held. */
+/// @cond INTERNAL
+static int tls_wait(void *ptr, int fd, int timeout)
+{
+	tls_st *st = ptr;
+	tls_req_st *req;
+	tls_int_st *ses;
+	tls_use_st *use;
+	uint8_t buf[RC_BUFFER_LEN];
+	double deadline = rc_getmtime() + timeout / 1000.0;
+	int left, ret;
+
+	pthread_mutex_lock(&st->lock);
+	req = tls_find(st, fd);
+	if (req == NULL) {
+		pthread_mutex_unlock(&st->lock);
+		errno = EBADF;
+		return -1;
+	}
+	ses = &st->ctx[req->ses];
+	use = &st->use[req->ses];
+
+	for (;;) {
+		if (req->done || req->gen != use->gen) {
+			ret = 1;
+			break;
+		}
+		left = (int)((deadline - rc_getmtime()) * 1000);
+		if (left <= 0) {
+			ret = 0;
+			break;
+		}
+		if (use->reading || use->exclusive) {
+			tls_timedwait(st, deadline);
+			continue;
+		}
+
+		use->reading = 1;
+		pthread_mutex_unlock(&st->lock);
+		ret = tls_read_record(ses, buf, sizeof(buf), left);
+		pthread_mutex_lock(&st->lock);
+		use->reading = 0;
+
+		if (ret > 0)
+			tls_dispatch(st, ses, buf, ret);
+		else if (ret < 0)
+			tls_fail(st, ses);
+		pthread_cond_broadcast(&st->cond);
+	}
+	pthread_mutex_unlock(&st->lock);
+
+	return ret;
+}
+/// @endcond
+
+/* Returns the reply tls_wait() found for the request, or fails with
+ * ECONNRESET if the session failed first. Called without st->lock held. */
+/// @cond INTERNAL
+static ssize_t tls_recvfrom(void *ptr, int sockfd,
+			     void *buf, size_t len,
+			     int flags, struct sockaddr *src_addr,
+			     socklen_t * addrlen)
+{
+	tls_st *st = ptr;
+	tls_req_st *req;
+	ssize_t ret;
+
+	pthread_mutex_lock(&st->lock);
+	req = tls_find(st, sockfd);
+	if (req == NULL) {
+		errno = EBADF;
+		ret = -1;
+	} else if (req->done) {
+		ret = req->len < len ? req->len : len;
+		memcpy(buf, req->reply, ret);
+		req->done = 0;
+	} else if (req->gen != st->use[req->ses].gen) {
+		errno = ECONNRESET;
+		ret = -1;
+	} else {
+		errno = EAGAIN;
+		ret = -1;
+	}
+	pthread_mutex_unlock(&st->lock);
+
 	return ret;
 }
 /// @endcond
@@ -302,27 +871,58 @@ static int cert_verify_callback(gnutls_session_t session)
 }
 /// @endcond
 
+/* Sends close_notify so the peer receives a proper TLS/DTLS shutdown
+ * alert. Only valid once the handshake actually completed -- e.g. a
+ * connect() failure leaves an initialized session with no negotiated
+ * cipher state, and gnutls_bye() on that is not meaningful. */
+/// @cond INTERNAL
+static void session_bye(tls_int_st *ses)
+{
+	int ret;
+
+	if (ses->session && ses->sockfd != -1 && ses->handshake_done) {
+		do {
+			ret = gnutls_bye(ses->session, GNUTLS_SHUT_WR);
+		} while (ret == GNUTLS_E_INTERRUPTED);
+		ses->handshake_done = 0;
+	}
+}
+/// @endcond
+
+/* Keeps the data needed to resume the session once it is replaced. Under
+ * TLS 1.3 that is only possible after the server sent a ticket; asking
+ * for the data before that would wait for one on the socket. */
+/// @cond INTERNAL
+static void session_save(tls_int_st *ses)
+{
+	gnutls_datum_t data;
+
+	if (ses->init == 0 || ses->handshake_done == 0)
+		return;
+
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+	if (gnutls_protocol_get_version(ses->session) == GNUTLS_TLS1_3 &&
+	    (gnutls_session_get_flags(ses->session) & GNUTLS_SFLAGS_SESSION_TICKET) == 0)
+		return;
+#endif
+
+	if (gnutls_session_get_data2(ses->session, &data) < 0)
+		return;
+
+	gnutls_free(ses->resume.data);
+	ses->resume = data;
+}
+/// @endcond
+
 /// @cond INTERNAL
 static void deinit_session(tls_int_st *ses)
 {
 	if (ses->init != 0) {
-		int ret;
 		ses->init = 0;
 		if (ses->session) {
-			/* Send close_notify before closing the socket so the peer
-			 * receives a proper TLS/DTLS shutdown alert. Only valid
-			 * once the handshake actually completed -- e.g. a
-			 * connect() failure leaves an initialized session with
-			 * no negotiated cipher state, and gnutls_bye() on that
-			 * is not meaningful. */
-			if (ses->sockfd != -1 && ses->handshake_done) {
-				do {
-					ret = gnutls_bye(ses->session, GNUTLS_SHUT_WR);
-				} while (ret == GNUTLS_E_INTERRUPTED);
-			}
+			session_bye(ses);
 			gnutls_deinit(ses->session);
 		}
-		pthread_mutex_destroy(&ses->lock);
 		if (ses->sockfd != -1)
 			close(ses->sockfd);
 	}
@@ -333,8 +933,9 @@ static void deinit_session(tls_int_st *ses)
 static int init_session(rc_handle *rh, tls_int_st *ses,
 			const char *hostname, unsigned port,
 			struct sockaddr_storage *our_sockaddr,
-			int timeout,
-			unsigned secflags)
+			int timeout, /* handshake timeout, in ms */
+			unsigned secflags,
+			const gnutls_datum_t *resume)
 {
 	int sockfd, ret, e, sock_flags;
 	struct addrinfo *info;
@@ -347,8 +948,7 @@ static int init_session(rc_handle *rh, tls_int_st *ses,
 	ses->init = 1;
 	ses->handshake_done = 0;
 
-	pthread_mutex_init(&ses->lock, NULL);
-	sockfd = socket(our_sockaddr->ss_family, (secflags&SEC_FLAG_DTLS)?SOCK_DGRAM:SOCK_STREAM, 0);
+	sockfd = rc_socket(rh, our_sockaddr->ss_family, (secflags&SEC_FLAG_DTLS)?SOCK_DGRAM:SOCK_STREAM, 0);
 	if (sockfd < 0) {
 		rc_log(LOG_ERR,
 		       "%s: cannot open socket", __func__);
@@ -379,13 +979,15 @@ static int init_session(rc_handle *rh, tls_int_st *ses,
 	memcpy(&ses->our_sockaddr, our_sockaddr, sizeof(*our_sockaddr));
 	if (!(secflags&SEC_FLAG_DTLS)) {
 		if (timeout > 0) {
-			gnutls_handshake_set_timeout(ses->session, timeout*1000);
+			gnutls_handshake_set_timeout(ses->session, timeout);
 		} else {
 			gnutls_handshake_set_timeout(ses->session, GNUTLS_DEFAULT_HANDSHAKE_TIMEOUT);
 		}
 	} else { /* DTLS */
 		if (timeout > 0)
-			gnutls_dtls_set_timeouts(ses->session, 1000, timeout*1000);
+			gnutls_dtls_set_timeouts(ses->session,
+						 timeout < 1000 ? timeout : 1000,
+						 timeout);
 	}
 
 	gnutls_transport_set_int(ses->session, sockfd);
@@ -398,10 +1000,10 @@ static int init_session(rc_handle *rh, tls_int_st *ses,
 		ses->skip_hostname_check = 1;
 	}
 
-	if (st && st->psk_cred) {
+	if (st && st->srv[ses->server].psk_cred) {
 		cred_set = 1;
 		gnutls_credentials_set(ses->session,
-				       GNUTLS_CRD_PSK, st->psk_cred);
+				       GNUTLS_CRD_PSK, st->srv[ses->server].psk_cred);
 
 		ret = gnutls_priority_set_direct(ses->session, "NORMAL:-KX-ALL:+ECDHE-PSK:+DHE-PSK:+PSK:-VERS-TLS1.0", NULL);
 		if (ret < 0) {
@@ -425,8 +1027,18 @@ static int init_session(rc_handle *rh, tls_int_st *ses,
 	gnutls_server_name_set(ses->session, GNUTLS_NAME_DNS,
 			       hostname, strlen(hostname));
 
-	info =
-	    rc_getaddrinfo(hostname, PW_AI_AUTH);
+	/* An abbreviated handshake skips the key exchange and the
+	 * certificate verification; the server falls back to a full one
+	 * if it no longer accepts the data. */
+	if (resume != NULL && resume->data != NULL) {
+		ret = gnutls_session_set_data(ses->session, resume->data,
+					      resume->size);
+		if (ret < 0)
+			rc_log(LOG_DEBUG, "%s: cannot resume session: %s",
+			       __func__, gnutls_strerror(ret));
+	}
+
+	info = rc_resolve(rh, hostname, PW_AI_AUTH);
 	if (info == NULL) {
 		ret = -1;
 		rc_log(LOG_ERR, "%s: cannot resolve %s", __func__,
@@ -461,7 +1073,7 @@ static int init_session(rc_handle *rh, tls_int_st *ses,
 
 	/* we connect since we are talking to a single server */
 	ret = connect(sockfd, info->ai_addr, info->ai_addrlen);
-	freeaddrinfo(info);
+	rc_addrinfo_free(info);
 	if (ret == -1) {
 		e = errno;
 		ret = -1;
@@ -502,6 +1114,10 @@ static int init_session(rc_handle *rh, tls_int_st *ses,
 		goto cleanup;
 	}
 
+	if (gnutls_session_is_resumed(ses->session) != 0)
+		rc_log(LOG_DEBUG, "%s: resumed TLS/DTLS session with [%s]:%d",
+		       __func__, hostname, port);
+
 	ses->handshake_done = 1;
 	return 0;
  cleanup:
@@ -516,7 +1132,7 @@ static int init_session(rc_handle *rh, tls_int_st *ses,
 #define TIME_ALIVE 120
 
 /// @cond INTERNAL
-static int restart_session(rc_handle *rh, tls_st *st)
+static int restart_session(rc_handle *rh, tls_st *st, tls_int_st *ses)
 {
 	/* init_session() assumes a zeroed struct: REQ-NET-NET-016 */
 	struct tls_int_st tmps = { 0 };
@@ -529,25 +1145,45 @@ static int restart_session(rc_handle *rh, tls_st *st)
 	 * attempt reconnection regardless of how recently we last tried.
 	 * When need_restart is 0 (proactive check from rc_check_tls via a
 	 * failed heartbeat), keep the guard to avoid rapid reconnect loops. */
-	if (now - st->ctx.last_restart < TIME_ALIVE && !st->ctx.need_restart)
+	if (now - ses->last_restart < TIME_ALIVE && !ses->need_restart)
 		return -1;
 
-	st->ctx.last_restart = now;
+	ses->last_restart = now;
 
-	timeout = rc_conf_int(rh, "radius_timeout");
+	timeout = rc_conf_timeout_ms(rh);
 
-	/* reinitialize this session */
-	ret = init_session(rh, &tmps, st->ctx.hostname, st->ctx.port, &st->ctx.our_sockaddr, timeout, st->flags);
+	/* reinitialize this session, resuming the old one if possible */
+	session_save(ses);
+	tmps.server = ses->server;
+	ret = init_session(rh, &tmps, ses->hostname, ses->port, &ses->our_sockaddr, timeout, st->flags,
+			   &ses->resume);
 	if (ret < 0) {
 		rc_log(LOG_ERR, "%s: error in re-initializing TLS session", __func__);
 		return -1;
 	}
 
-	if (tmps.sockfd == st->ctx.sockfd)
-		st->ctx.sockfd = -1;
-	deinit_session(&st->ctx);
-	memcpy(&st->ctx, &tmps, sizeof(tmps));
-	st->ctx.need_restart = 0;
+	if (ses->init != 0 && tmps.sockfd != ses->sockfd) {
+		/* Move the new connection onto the old descriptor, so that
+		 * the one returned by rc_tls_fd() stays valid. Requests keep
+		 * their own duplicate of the old one until they are done. */
+		session_bye(ses);
+		if (dup2(tmps.sockfd, ses->sockfd) == -1) {
+			rc_log(LOG_ERR, "%s: dup2: %s", __func__, strerror(errno));
+			deinit_session(&tmps);
+			return -1;
+		}
+		close(tmps.sockfd);
+		tmps.sockfd = ses->sockfd;
+		gnutls_transport_set_int(tmps.session, tmps.sockfd);
+		ses->sockfd = -1;
+	} else if (tmps.sockfd == ses->sockfd) {
+		ses->sockfd = -1;
+	}
+	tmps.resume = ses->resume;
+	deinit_session(ses);
+	memcpy(ses, &tmps, sizeof(tmps));
+	gnutls_session_set_ptr(ses->session, ses);
+	ses->need_restart = 0;
 
 	return 0;
 }
@@ -556,7 +1192,8 @@ static int restart_session(rc_handle *rh, tls_st *st)
 /** @brief Returns the file descriptor of the TLS/DTLS session
  *
  * This can also be used as a test for the application to see
- * whether TLS or DTLS are in use.
+ * whether TLS or DTLS are in use. When @b tls-sessions allows more
+ * than one session, this is the descriptor of the first one.
  *
  * @param rh a handle to parsed configuration
  * @return the file descriptor used by the TLS session, or -1 on error
@@ -570,17 +1207,20 @@ int rc_tls_fd(rc_handle * rh)
 
 	st = rh->so.ptr;
 
-	if (st->ctx.init != 0) {
-		return st->ctx.sockfd;
+	if (st->ctx[0].init != 0) {
+		return st->ctx[0].sockfd;
 	}
 	return -1;
 }
 
 /** @brief Check established TLS/DTLS channels for operation and reconnect if needed
  *
- * Probes the TLS or DTLS session with a TLS heartbeat and reconnects if the
- * session is dead.  Must be called when no other thread is using the session
- * (e.g., from a dedicated watchdog thread that holds the lock).
+ * Probes the idle TLS or DTLS sessions with a TLS heartbeat and reconnects
+ * those that are dead.  Sessions with requests in flight at the time of the
+ * call are skipped, so this may be called from a watchdog thread while other
+ * threads send requests on the same handle.  Sessions kept warm by
+ * @b tls-warm-sessions that are not connected, e.g. because the server
+ * was unreachable earlier, are connected.
  *
  * @note It is recommended not to use this function.  The TLS heartbeat
  * extension (RFC 6520) has been disabled or removed by default in many
@@ -597,7 +1237,9 @@ int rc_tls_fd(rc_handle * rh)
 int rc_check_tls(rc_handle * rh)
 {
 	tls_st *st;
+	tls_int_st *ses;
 	time_t now = time(0);
+	unsigned i;
 	int ret;
 
 	if (rh->so_type != RC_SOCKET_TLS && rh->so_type != RC_SOCKET_DTLS)
@@ -605,54 +1247,152 @@ int rc_check_tls(rc_handle * rh)
 
 	st = rh->so.ptr;
 
-	if (st->ctx.init != 0) {
-		if (st->ctx.need_restart != 0) {
-			restart_session(rh, st);
-		} else if (now - st->ctx.last_msg > TIME_ALIVE) {
-			ret = gnutls_heartbeat_ping(st->ctx.session, 64, 4, GNUTLS_HEARTBEAT_WAIT);
+	for (i = 0; i < st->sessions; i++) {
+		pthread_mutex_lock(&st->lock);
+		if (st->use[i].inflight || st->use[i].exclusive ||
+		    (st->ctx[i].init == 0 && i >= st->warm)) {
+			pthread_mutex_unlock(&st->lock);
+			continue;
+		}
+		st->use[i].exclusive = 1;
+		pthread_mutex_unlock(&st->lock);
+
+		ses = &st->ctx[i];
+		if (ses->need_restart != 0) {
+			tls_restart(st, ses);
+		} else if (now - ses->last_msg > TIME_ALIVE) {
+			ret = gnutls_heartbeat_ping(ses->session, 64, 4, GNUTLS_HEARTBEAT_WAIT);
 			if (ret < 0) {
-				restart_session(rh, st);
+				tls_restart(st, ses);
 			}
-			st->ctx.last_msg = now;
+			ses->last_msg = now;
 		}
+
+		pthread_mutex_lock(&st->lock);
+		st->use[i].exclusive = 0;
+		pthread_cond_broadcast(&st->cond);
+		pthread_mutex_unlock(&st->lock);
 	}
 	return 0;
 }
 
 /** @} */
 
+/// @cond INTERNAL
+static void tls_free(tls_st *st)
+{
+	tls_req_st *req;
+	unsigned i;
+
+	while ((req = st->reqs) != NULL) {
+		st->reqs = req->next;
+		close(req->fd);
+		free(req);
+	}
+
+	if (st->ctx) {
+		for (i = 0; i < st->sessions; i++) {
+			if (st->ctx[i].init != 0)
+				deinit_session(&st->ctx[i]);
+			gnutls_free(st->ctx[i].resume.data);
+		}
+	}
+	if (st->x509_cred)
+		gnutls_certificate_free_credentials(st->x509_cred);
+	if (st->srv) {
+		for (i = 0; i < st->servers; i++) {
+			if (st->srv[i].psk_cred)
+				gnutls_psk_free_client_credentials(st->srv[i].psk_cred);
+		}
+	}
+	pthread_cond_destroy(&st->cond);
+	pthread_mutex_destroy(&st->lock);
+	free(st->ctx);
+	free(st->use);
+	free(st->srv);
+}
+/// @endcond
+
 /*- This function will deinitialize a previously initialed DTLS or TLS session.
  *
  * @param rh the configuration handle.
  -*/
 void rc_deinit_tls(rc_handle * rh)
 {
-	tls_st *st = rh->so.ptr;
-	char *ns = NULL;
-	int ns_def_hdl = 0;
-
-	if (st) {
-		ns = rc_conf_str(rh, "namespace"); /* Check for namespace config */
-		if (ns != NULL) {
-			if(-1 == rc_set_netns(ns, &ns_def_hdl)) {
-				rc_log(LOG_ERR, "rc_send_server: namespace %s set failed", ns);
-				return;
-			}
-		}
-		if (st->ctx.init != 0)
-			deinit_session(&st->ctx);
-		if (st->x509_cred)
-			gnutls_certificate_free_credentials(st->x509_cred);
-		if (st->psk_cred)
-			gnutls_psk_free_client_credentials(st->psk_cred);
-		if (ns != NULL) {
-			if(-1 == rc_reset_netns(&ns_def_hdl))
-			rc_log(LOG_ERR, "rc_send_server: namespace %s reset failed", ns);
-		}
-	}
+	tls_st *st;
+
+	/* rh->so.ptr belongs to whichever transport is configured */
+	if (rh->so_type != RC_SOCKET_TLS && rh->so_type != RC_SOCKET_DTLS)
+		return;
+
+	st = rh->so.ptr;
+	if (st)
+		tls_free(st);
 	free(st);
 }
 
+/* Sets up PSK credentials from a server secret of the form
+ * psk@username@hexkey. */
+/// @cond INTERNAL
+static int psk_init(gnutls_psk_client_credentials_t *cred, const char *pskkey)
+{
+	char *p;
+	char username[64];
+	gnutls_datum_t hexkey;
+	int username_len;
+	int ret;
+
+	if (strncmp(pskkey, "psk@", 4) != 0) {
+		rc_log(LOG_ERR,
+		       "%s: server secret is set but does not start with 'psk@'",
+		       __func__);
+		return -1;
+	}
+	pskkey+=4;
+
+	if ((p = strchr(pskkey, '@')) == NULL) {
+		rc_log(LOG_ERR,
+		       "%s: PSK key is not in 'username@hexkey' format",
+		       __func__);
+		return -1;
+	}
+
+	username_len = p - pskkey;
+	if (username_len + 1 > sizeof(username)) {
+		rc_log(LOG_ERR,
+		       "%s: PSK username too big", __func__);
+		return -1;
+	}
+
+	strlcpy(username, pskkey, username_len + 1);
+
+	p++;
+	hexkey.data = (uint8_t*)p;
+	hexkey.size = strlen(p);
+
+	ret = gnutls_psk_allocate_client_credentials(cred);
+	if (ret < 0) {
+		rc_log(LOG_ERR,
+		       "%s: error in setting PSK credentials: %s",
+		       __func__, gnutls_strerror(ret));
+		return -1;
+	}
+
+	ret =
+	    gnutls_psk_set_client_credentials(*cred,
+					      username, &hexkey,
+					      GNUTLS_PSK_KEY_HEX);
+	if (ret < 0) {
+		rc_log(LOG_ERR,
+		       "%s: error in setting PSK key: %s",
+		       __func__, gnutls_strerror(ret));
+		return -1;
+	}
+
+	return 0;
+}
+/// @endcond
+
 /*- Initialize a configuration for TLS or DTLS
  *
  * This function will initialize the handle for TLS or DTLS.
@@ -669,23 +1409,12 @@ int rc_init_tls(rc_handle * rh, unsigned flags)
 	const char *ca_file = rc_conf_str(rh, "tls-ca-file");
 	const char *cert_file = rc_conf_str(rh, "tls-cert-file");
 	const char *key_file = rc_conf_str(rh, "tls-key-file");
-	const char *pskkey = NULL;
 	SERVER *authservers;
-	char hostname[256];	/* server's hostname */
-	unsigned port;		/* server's port */
-	char *ns = NULL;
-	int ns_def_hdl = 0;
+	int sessions, warm;
+	unsigned i, j;
 
 	memset(&rh->so, 0, sizeof(rh->so));
 
-	ns = rc_conf_str(rh, "namespace"); /* Check for namespace config */
-	if (ns != NULL) {
-		if(-1 == rc_set_netns(ns, &ns_def_hdl)) {
-			rc_log(LOG_ERR, "rc_send_server: namespace %s set failed", ns);
-			return -1;
-		}
-	}
-
 	if (flags & SEC_FLAG_DTLS) {
 		rh->so_type = RC_SOCKET_DTLS;
 		rh->so.static_secret = DEFAULT_DTLS_SECRET;
@@ -705,6 +1434,57 @@ int rc_init_tls(rc_handle * rh, unsigned flags)
 	st->rh = rh;
 	st->flags = flags;
 
+	if (pthread_mutex_init(&st->lock, NULL) != 0) {
+		free(st);
+		st = NULL;
+		ret = -1;
+		goto cleanup;
+	}
+	if (tls_cond_init(&st->cond) != 0) {
+		pthread_mutex_destroy(&st->lock);
+		free(st);
+		st = NULL;
+		ret = -1;
+		goto cleanup;
+	}
+
+	sessions = rc_conf_int_default(rh, "tls-sessions", 1);
+	if (sessions <= 0) {
+		rc_log(LOG_ERR, "%s: tls-sessions must be positive", __func__);
+		ret = -1;
+		goto cleanup;
+	}
+	warm = rc_conf_int_default(rh, "tls-warm-sessions", 0);
+	if (warm < 0 || warm > sessions) {
+		rc_log(LOG_ERR, "%s: tls-warm-sessions must be between 0 and tls-sessions",
+		       __func__);
+		ret = -1;
+		goto cleanup;
+	}
+
+	authservers = rc_conf_srv(rh, "authserver");
+	if (authservers == NULL || authservers->max <= 0) {
+		rc_log(LOG_ERR,
+		       "%s: cannot find authserver", __func__);
+		ret = -1;
+		goto cleanup;
+	}
+
+	st->srv = calloc(authservers->max, sizeof(tls_srv_st));
+	st->ctx = calloc(authservers->max * sessions, sizeof(tls_int_st));
+	st->use = calloc(authservers->max * sessions, sizeof(tls_use_st));
+	if (st->srv == NULL || st->ctx == NULL || st->use == NULL) {
+		ret = -1;
+		goto cleanup;
+	}
+	st->servers = authservers->max;
+	st->per_server = sessions;
+	st->sessions = authservers->max * sessions;
+	st->warm = warm;
+	st->hold = rc_conf_int_default(rh, "radius_deadtime", 0);
+	if (st->hold <= 0)
+		st->hold = (rc_conf_timeout_ms(rh) + 999) / 1000;
+
 	rh->so.ptr = st;
 
 	if (ca_file || (key_file && cert_file)) {
@@ -750,122 +1530,64 @@ int rc_init_tls(rc_handle * rh, unsigned flags)
 						       cert_verify_callback);
 	}
 
-	/* Read the PSK key if any */
-	authservers = rc_conf_srv(rh, "authserver");
-	if (authservers == NULL) {
-		rc_log(LOG_ERR,
-		       "%s: cannot find authserver", __func__);
-		ret = -1;
-		goto cleanup;
-	}
-	if (authservers->max > 1) {
-		ret = -1;
-		rc_log(LOG_ERR,
-		       "%s: too many auth servers for TLS/DTLS; only one is allowed",
-		       __func__);
-		goto cleanup;
-	}
-	strlcpy(hostname, authservers->name[0], sizeof(hostname));
-	port = authservers->port[0];
-	if (authservers->secret[0])
-		pskkey = authservers->secret[0];
-
-	if (pskkey && pskkey[0] != 0) {
-		char *p;
-		char username[64];
-		gnutls_datum_t hexkey;
-		int username_len;
-
-		if (strncmp(pskkey, "psk@", 4) != 0) {
-			ret = -1;
-			rc_log(LOG_ERR,
-			       "%s: server secret is set but does not start with 'psk@'",
-			       __func__);
-			goto cleanup;
-		}
-		pskkey+=4;
-
-		if ((p = strchr(pskkey, '@')) == NULL) {
-			ret = -1;
-			rc_log(LOG_ERR,
-			       "%s: PSK key is not in 'username@hexkey' format",
-			       __func__);
-			goto cleanup;
-		}
-
-		username_len = p - pskkey;
-		if (username_len + 1 > sizeof(username)) {
-			rc_log(LOG_ERR,
-			       "%s: PSK username too big", __func__);
-			ret = -1;
-			goto cleanup;
-		}
-
-		strlcpy(username, pskkey, username_len + 1);
+	for (j = 0; j < st->servers; j++) {
+		tls_srv_st *srv = &st->srv[j];
 
-		p++;
-		hexkey.data = (uint8_t*)p;
-		hexkey.size = strlen(p);
+		strlcpy(srv->hostname, authservers->name[j], sizeof(srv->hostname));
+		srv->port = authservers->port[j];
 
-		ret = gnutls_psk_allocate_client_credentials(&st->psk_cred);
-		if (ret < 0) {
-			ret = -1;
-			rc_log(LOG_ERR,
-			       "%s: error in setting PSK credentials: %s",
-			       __func__, gnutls_strerror(ret));
-			goto cleanup;
+		/* Read the PSK key if any */
+		if (authservers->secret[j] && authservers->secret[j][0] != 0) {
+			if (psk_init(&srv->psk_cred, authservers->secret[j]) < 0) {
+				ret = -1;
+				goto cleanup;
+			}
 		}
 
-		ret =
-		    gnutls_psk_set_client_credentials(st->psk_cred,
-						      username, &hexkey,
-						      GNUTLS_PSK_KEY_HEX);
-		if (ret < 0) {
-			ret = -1;
-			rc_log(LOG_ERR,
-			       "%s: error in setting PSK key: %s",
-			       __func__, gnutls_strerror(ret));
-			goto cleanup;
-		}
+		/* to recognize the server in tls_get_fd(); retried there if
+		 * the name cannot be resolved yet */
+		if (st->servers > 1)
+			tls_resolve(st, srv);
 	}
 
-	/* Defer TCP connect + TLS handshake to first use.
-	 * tls_sendto() checks need_restart != 0 and calls restart_session(),
-	 * which calls init_session() with these stored parameters. */
-	strlcpy(st->ctx.hostname, hostname, sizeof(st->ctx.hostname));
-	st->ctx.port = port;
-	memcpy(&st->ctx.our_sockaddr, &our_sockaddr, sizeof(our_sockaddr));
-	st->ctx.need_restart = 1;
+	/* Defer TCP connect + TLS handshake to first use of each session,
+	 * unless it is to be kept warm (below). tls_get_fd() checks
+	 * need_restart != 0 and calls restart_session(), which calls
+	 * init_session() with these stored parameters. */
+	for (i = 0; i < st->sessions; i++) {
+		tls_srv_st *srv = &st->srv[i / st->per_server];
+
+		strlcpy(st->ctx[i].hostname, srv->hostname, sizeof(st->ctx[i].hostname));
+		st->ctx[i].port = srv->port;
+		st->ctx[i].server = i / st->per_server;
+		memcpy(&st->ctx[i].our_sockaddr, &our_sockaddr, sizeof(our_sockaddr));
+		st->ctx[i].need_restart = 1;
+	}
 
 	rh->so.get_fd = tls_get_fd;
-	rh->so.get_active_fd = tls_get_active_fd;
+	rh->so.close_fd = tls_close_fd;
 	rh->so.sendto = tls_sendto;
 	rh->so.recvfrom = tls_recvfrom;
-	rh->so.lock = tls_lock;
-	rh->so.unlock = tls_unlock;
-	if (ns != NULL) {
-		if(-1 == rc_reset_netns(&ns_def_hdl)) {
-			rc_log(LOG_ERR, "rc_send_server: namespace %s reset failed", ns);
-			ret = -1;
-			goto cleanup;
-		}
+	rh->so.get_id = tls_get_id;
+	rh->so.wait = tls_wait;
+
+	/* Connect the warm sessions now rather than on the request path. A
+	 * server that cannot be reached yet is not an error; its sessions
+	 * are connected on first use as usual. */
+	for (i = 0; i < st->sessions; i++) {
+		if (i % st->per_server >= st->warm)
+			continue;
+		if (tls_restart(st, &st->ctx[i]) < 0)
+			rc_log(LOG_ERR, "%s: cannot connect to %s in advance",
+			       __func__, st->ctx[i].hostname);
 	}
+
 	return 0;
  cleanup:
-	if (st) {
-		if (st->ctx.init != 0)
-			deinit_session(&st->ctx);
-		if (st->x509_cred)
-			gnutls_certificate_free_credentials(st->x509_cred);
-		if (st->psk_cred)
-			gnutls_psk_free_client_credentials(st->psk_cred);
-	}
+	if (st)
+		tls_free(st);
 	free(st);
 	rh->so.ptr = NULL;
-	if (ns != NULL) {
-		if(-1 == rc_reset_netns(&ns_def_hdl))
-		rc_log(LOG_ERR, "rc_send_server: namespace %s reset failed", ns);
-	}
 	return ret;
 }
 
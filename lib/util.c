@@ -255,3 +255,83 @@ int rc_reset_netns(int *prev_ns_handle)
 #endif    
     return rc;
 }
+
+/*- Enters the network namespace of the handle, if it has one.
+ *
+ * The switch is undone with rc_leave_netns(). Only socket creation and
+ * name lookups need it: a socket stays in the namespace it was created
+ * in, so the sockets kept in the pool of the handle are used without
+ * switching again.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param prev_ns_handle set to the handle of the previous namespace, or -1.
+ *
+ * @return 0 on success, -1 when failure.
+ -*/
+int rc_enter_netns(rc_handle const *rh, int *prev_ns_handle)
+{
+	char *ns = rc_conf_str(rh, "namespace");
+
+	*prev_ns_handle = -1;
+	if (ns == NULL)
+		return 0;
+
+	if (rc_set_netns(ns, prev_ns_handle) == -1) {
+		rc_log(LOG_ERR, "namespace %s set failed", ns);
+		return -1;
+	}
+	return 0;
+}
+
+/*- Returns to the namespace rc_enter_netns() left.
+ *
+ * @param rh a handle to parsed configuration.
+ * @param prev_ns_handle as set by rc_enter_netns(); it becomes invalid.
+ *
+ * @return 0 on success, -1 when failure.
+ -*/
+int rc_leave_netns(rc_handle const *rh, int *prev_ns_handle)
+{
+	if (*prev_ns_handle < 0)
+		return 0;
+
+	if (rc_reset_netns(prev_ns_handle) == -1) {
+		rc_log(LOG_ERR, "namespace %s reset failed",
+		       rc_conf_str(rh, "namespace"));
+		return -1;
+	}
+	return 0;
+}
+
+/*- Creates a socket in the network namespace of the handle.
+ *
+ * As socket(2), but when the namespace option is set the socket is
+ * created inside that namespace, and the calling thread is back in its
+ * own one on return.
+ *
+ * @param rh a handle to parsed configuration.
+ *
+ * @return the socket descriptor, or -1 with errno set.
+ -*/
+int rc_socket(rc_handle const *rh, int domain, int type, int protocol)
+{
+	int prev, fd, e;
+
+	if (rc_enter_netns(rh, &prev) == -1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fd = socket(domain, type, protocol);
+	e = errno;
+
+	if (rc_leave_netns(rh, &prev) == -1) {
+		if (fd >= 0)
+			close(fd);
+		fd = -1;
+		e = EINVAL;
+	}
+
+	errno = e;
+	return fd;
+}
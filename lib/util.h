@@ -68,13 +68,20 @@ size_t rc_strlcpy(char *dst, char const *src, size_t siz);
 #define PW_AI_PASSIVE		1
 #define PW_AI_AUTH		(1<<1)
 #define PW_AI_ACCT		(1<<2)
+#define PW_AI_NUMERIC		(1<<3)	/* numeric host only, no error logged */
 
 struct addrinfo *rc_getaddrinfo (char const *host, unsigned flags);
 void rc_own_bind_addr(rc_handle *rh, struct sockaddr_storage *lia);
+int rc_prefer_public_addr(rc_handle *rh, int sockfd);
 double rc_getmtime(void);
 int rc_str2tm (char const *valstr, struct tm *tm);
 int rc_set_netns(const char *net_namespace, int *prev_ns_handle);
 int rc_reset_netns(int *prev_ns_handle);
+int rc_enter_netns(rc_handle const *rh, int *prev_ns_handle);
+int rc_leave_netns(rc_handle const *rh, int *prev_ns_handle);
+int rc_socket(rc_handle const *rh, int domain, int type, int protocol);
+int rc_conf_int_default(rc_handle const *rh, char const *optname, int def);
+int rc_conf_timeout_ms(rc_handle const *rh);
 
 #undef rc_log
 
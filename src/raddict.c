@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2026, Nikos Mavrogiannopoulos.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * raddict.c - compiles a dictionary and the files it includes into the
+ * cache that rc_read_dictionary() maps instead of reading them.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <radcli/radcli.h>
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: raddict [-o cache_file] dictionary\n");
+	fprintf(stderr, "       -o cache_file - Write the cache there instead of next to the dictionary.\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	char *cachefile = NULL;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "ho:")) != -1) {
+		switch (ch) {
+		case 'o':
+			cachefile = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1)
+		usage();
+
+#if HAVE_DECL_LOG_PERROR
+	openlog("raddict", LOG_PERROR, LOG_USER);
+#else
+	openlog("raddict", 0, LOG_USER);
+#endif
+
+	if (rc_compile_dictionary(argv[0], cachefile) != 0) {
+		fprintf(stderr, "raddict: cannot compile %s\n", argv[0]);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,135 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== Adaptive retransmission tests ====="
+echo " 1. A lost packet is retransmitted after the measured RTO, not radius_timeout"
+echo " 2. Every request is still answered"
+echo " 3. A reply whose authenticator does not verify is not measured"
+echo "========================================="
+
+if ! python3 -c '' 2>/dev/null; then
+	echo "This test requires python3"
+	exit 77
+fi
+
+. ${srcdir}/common.sh
+
+PID=$$
+TMPFILE=tmp$$.out
+LOG=radius-server-$PID.log
+SRVPID=""
+
+eval "$GETPORT"
+
+function finish {
+	test -n "${SRVPID}" && kill ${SRVPID} >/dev/null 2>&1
+	rm -f $TMPFILE $LOG
+	rm -f radiusclient-temp$PID.conf
+	rm -f servers-temp$PID
+}
+trap finish EXIT
+
+count_requests() {
+	grep -c "received Access-Request" $1
+}
+
+# start_server <radius_timeout> <server options...>
+start_server() {
+	local timeout=$1
+	shift
+
+	python3 ${srcdir}/radius-server.py --port ${PORT} --secret testing123 "$@" >$LOG 2>&1 &
+	SRVPID=$!
+	for i in 1 2 3 4 5 6 7 8; do
+		check_if_port_in_use ${PORT} && break
+		sleep 0.5
+	done
+
+	cat >radiusclient-temp$PID.conf <<EOF2
+nas-identifier my-nas-id
+authserver  127.0.0.1:${PORT}
+acctserver  127.0.0.1:${PORT}
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  ${timeout}
+radius_retries  2
+retransmit  adaptive
+rto-min-ms  200
+bindaddr    *
+EOF2
+}
+
+cat >servers-temp$PID <<EOF2
+127.0.0.1	testing123
+EOF2
+
+# every second packet is lost: after the first request, each one is
+# answered on its retransmission
+start_server 3 --drop-every 2
+
+REQ='AUTH\nUser-Name=test\nPassword=test\n\n'
+
+START=$(date +%s%N)
+printf "$REQ$REQ$REQ$REQ$REQ" | \
+	${top_builddir}/src/radiusclient -f radiusclient-temp$PID.conf -s >$TMPFILE 2>&1
+RET=$?
+ELAPSED=$(( ($(date +%s%N) - START) / 1000000 ))
+sed 's/^/         | /' $TMPFILE
+
+if test $RET != 0 || test "$(grep -c '^0$' $TMPFILE)" != 5; then
+	echo "[ FAIL ] not every request was answered"
+	exit 1
+fi
+
+# 1 transmission for the first request, 2 for each of the others
+if test "$(count_requests $LOG)" != 9; then
+	echo "[ FAIL ] server received $(count_requests $LOG) requests, expected 9"
+	cat $LOG
+	exit 1
+fi
+
+# with fixed timers the four losses cost 12 seconds
+if test $ELAPSED -ge 3000; then
+	echo "[ FAIL ] 5 requests took ${ELAPSED} ms"
+	exit 1
+fi
+echo "[  OK  ] 4 lost packets were retransmitted in ${ELAPSED} ms in total"
+
+kill ${SRVPID} >/dev/null 2>&1
+wait ${SRVPID} 2>/dev/null
+SRVPID=""
+
+# the first request is answered at once, but with a bad authenticator,
+# which is ignored like a lost reply; its first retransmission is lost and
+# the second one answered. Had the bad reply been timed, the lost first
+# transmission of the second request would be resent after rto-min-ms
+# rather than radius_timeout.
+eval "$GETPORT"
+start_server 2 --bad-authenticator 1 --drop-every 2
+
+START=$(date +%s%N)
+printf "$REQ$REQ" | \
+	${top_builddir}/src/radiusclient -f radiusclient-temp$PID.conf -s >$TMPFILE 2>&1
+ELAPSED=$(( ($(date +%s%N) - START) / 1000000 ))
+sed 's/^/         | /' $TMPFILE
+
+if test "$(grep -c '^0$' $TMPFILE)" != 2; then
+	echo "[ FAIL ] not every request was answered"
+	cat $LOG
+	exit 1
+fi
+
+# three lost replies, each waited for radius_timeout less the 10% jitter
+if test $ELAPSED -lt 5400; then
+	echo "[ FAIL ] the lost packet was retransmitted after ${ELAPSED} ms"
+	exit 1
+fi
+echo "[  OK  ] a bad reply left the RTO at radius_timeout (${ELAPSED} ms)"
+
+exit 0
@@ -0,0 +1,236 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== Asynchronous request engine tests ====="
+echo " 1. Concurrent requests share a socket with distinct identifiers"
+echo " 2. More than 256 requests spill over to a second socket"
+echo " 3. Callbacks can submit further requests"
+echo " 4. Accounting requests complete through the engine"
+echo " 5. A silent server is retried and then failed over"
+echo " 6. Requests time out when no server replies"
+echo " 7. An application poll() loop can drive the engine"
+echo " 8. A large accounting batch completes through rc_acct_batch()"
+echo " 9. radius_deadline_ms ends requests before failover"
+echo "10. rc_acct_batch() returns when dispatching fails"
+echo "============================================="
+
+if ! python3 -c '' 2>/dev/null; then
+	echo "This test requires python3"
+	exit 77
+fi
+
+. ${srcdir}/common.sh
+
+PID=$$
+TMPFILE=tmp$$.out
+LOG1=radius-server1-$PID.log
+LOG2=radius-server2-$PID.log
+LOG3=radius-server3-$PID.log
+SRVPID1=""
+SRVPID2=""
+SRVPID3=""
+
+eval "$GETPORT"; PORT1=$PORT
+eval "$GETPORT"; PORT2=$PORT
+eval "$GETPORT"; PORT3=$PORT
+
+function finish {
+	test -n "${SRVPID1}" && kill ${SRVPID1} >/dev/null 2>&1
+	test -n "${SRVPID2}" && kill ${SRVPID2} >/dev/null 2>&1
+	test -n "${SRVPID3}" && kill ${SRVPID3} >/dev/null 2>&1
+	rm -f $TMPFILE $LOG1 $LOG2 $LOG3
+	rm -f radiusclient-temp$PID.conf
+	rm -f servers-temp$PID
+}
+trap finish EXIT
+
+wait_for_server() {
+	local port="$1"
+	local i
+	for i in 1 2 3 4 5 6 7 8; do
+		check_if_port_in_use ${port} && return 0
+		sleep 0.5
+	done
+	return 1
+}
+
+# write_config <authserver> <acctserver> <retries> [<extra option>]
+write_config() {
+	cat >radiusclient-temp$PID.conf <<EOF2
+nas-identifier my-nas-id
+authserver  $1
+acctserver  $2
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  1
+radius_retries  $3
+bindaddr    127.0.0.1
+$4
+EOF2
+}
+
+# run_engine <server log to reset> <args...>
+# The servers append to their logs, so truncating one between runs is safe.
+run_engine() {
+	local log="$1"
+	shift
+	: >$log
+	${top_builddir}/tests/async-engine -f radiusclient-temp$PID.conf "$@" >$TMPFILE 2>&1
+	RET=$?
+	sed 's/^/         | /' $TMPFILE
+}
+
+python3 ${srcdir}/radius-server.py --port ${PORT1} --secret testing123 >>$LOG1 2>&1 &
+SRVPID1=$!
+python3 ${srcdir}/radius-server.py --port ${PORT2} --secret testing123 >>$LOG2 2>&1 &
+SRVPID2=$!
+python3 ${srcdir}/radius-server.py --port ${PORT3} --secret testing123 --no-reply >>$LOG3 2>&1 &
+SRVPID3=$!
+wait_for_server ${PORT1} || { echo "[ FAIL ] server 1 did not start"; exit 1; }
+wait_for_server ${PORT2} || { echo "[ FAIL ] server 2 did not start"; exit 1; }
+wait_for_server ${PORT3} || { echo "[ FAIL ] server 3 did not start"; exit 1; }
+
+echo "127.0.0.1/127.0.0.1	testing123" >servers-temp$PID
+
+count_requests() {
+	grep -c "received $2" $1
+}
+
+# pairs <log>: distinct (source port, identifier) pairs seen by a server
+pairs() {
+	sed -n 's/.*received [A-Za-z-]* id=\([0-9]*\) from 127.0.0.1:\([0-9]*\)$/\2 \1/p' $1 | sort -u
+}
+
+write_config "127.0.0.1:${PORT1}" "127.0.0.1:${PORT2}" 1
+
+# 1. Concurrent requests on one socket
+run_engine $LOG1 -n 200
+if test $RET != 0; then
+	echo "[ FAIL ] 200 concurrent requests did not all succeed"
+	exit 1
+fi
+PORTS=$(pairs $LOG1 | cut -d' ' -f1 | sort -u | wc -l)
+IDS=$(pairs $LOG1 | wc -l)
+if test "$PORTS" != 1 || test "$IDS" != 200; then
+	echo "[ FAIL ] expected 200 identifiers on one socket, got $IDS on $PORTS"
+	exit 1
+fi
+echo "[  OK  ] 200 concurrent requests used 200 identifiers on one socket"
+
+# 2. Identifier exhaustion opens a second socket
+run_engine $LOG1 -n 300
+if test $RET != 0; then
+	echo "[ FAIL ] 300 concurrent requests did not all succeed"
+	exit 1
+fi
+PORTS=$(pairs $LOG1 | cut -d' ' -f1 | sort -u | wc -l)
+IDS=$(pairs $LOG1 | wc -l)
+if test "$PORTS" != 2 || test "$IDS" != 300; then
+	echo "[ FAIL ] expected 300 identifiers on two sockets, got $IDS on $PORTS"
+	exit 1
+fi
+echo "[  OK  ] 300 concurrent requests spread over two sockets"
+
+# 3. Submitting from a completion callback
+run_engine $LOG1 -n 5 -c
+if test $RET != 0 || test "$(count_requests $LOG1 Access-Request)" != 10; then
+	echo "[ FAIL ] requests submitted from callbacks did not complete"
+	exit 1
+fi
+echo "[  OK  ] requests submitted from callbacks completed"
+
+# 4. Accounting
+run_engine $LOG2 -n 20 -a
+if test $RET != 0 || test "$(count_requests $LOG2 Accounting-Request)" != 20; then
+	echo "[ FAIL ] accounting requests did not complete"
+	exit 1
+fi
+echo "[  OK  ] accounting requests completed"
+
+# 5. Retransmission and failover: the first server never answers
+write_config "127.0.0.1:${PORT3},127.0.0.1:${PORT1}" "127.0.0.1:${PORT2}" 1
+: >$LOG3
+run_engine $LOG1 -n 10
+if test $RET != 0; then
+	echo "[ FAIL ] requests were not failed over to the second server"
+	exit 1
+fi
+if test "$(count_requests $LOG3 Access-Request)" != 20 ||
+   test "$(count_requests $LOG1 Access-Request)" != 10; then
+	echo "[ FAIL ] expected 2 attempts per request on the silent server"
+	cat $LOG3
+	exit 1
+fi
+echo "[  OK  ] silent server was retried, then failed over"
+
+# 6. Timeout when no server replies (TIMEOUT_RC is 1)
+write_config "127.0.0.1:${PORT3}" "127.0.0.1:${PORT2}" 1
+run_engine $LOG3 -n 10 -e 1
+if test $RET != 0 || test "$(count_requests $LOG3 Access-Request)" != 20; then
+	echo "[ FAIL ] requests to a silent server did not time out"
+	exit 1
+fi
+echo "[  OK  ] requests to a silent server timed out"
+
+# 7. External event loop: rc_aaa_fds()/rc_aaa_timeout()/rc_process_events()
+write_config "127.0.0.1:${PORT3},127.0.0.1:${PORT1}" "127.0.0.1:${PORT2}" 1
+run_engine $LOG1 -n 300 -l
+if test $RET != 0 || test "$(count_requests $LOG1 Access-Request)" != 300; then
+	echo "[ FAIL ] requests driven from an external loop did not complete"
+	exit 1
+fi
+echo "[  OK  ] requests driven from an external loop completed, with failover"
+
+# 8. Batched accounting: more requests than the batch window keeps in flight
+write_config "127.0.0.1:${PORT1}" "127.0.0.1:${PORT2}" 1
+run_engine $LOG2 -n 3000 -b
+if test $RET != 0 || test "$(count_requests $LOG2 Accounting-Request)" != 3000; then
+	echo "[ FAIL ] accounting batch did not complete"
+	exit 1
+fi
+PORTS=$(pairs $LOG2 | cut -d' ' -f1 | sort -u | wc -l)
+if test "$PORTS" -gt 4; then
+	echo "[ FAIL ] accounting batch used $PORTS sockets"
+	exit 1
+fi
+echo "[  OK  ] accounting batch of 3000 completed over $PORTS sockets"
+
+# 9. The deadline ends requests after 2 of their 3 transmissions to the
+# silent server, before they fail over to the one that answers
+write_config "127.0.0.1:${PORT3},127.0.0.1:${PORT1}" "127.0.0.1:${PORT2}" 2 \
+	"radius_deadline_ms 1500"
+: >$LOG3
+run_engine $LOG1 -n 10 -e 1
+if test $RET != 0 || test "$(count_requests $LOG3 Access-Request)" != 20 ||
+   test "$(count_requests $LOG1 Access-Request)" != 0; then
+	echo "[ FAIL ] requests did not time out at radius_deadline_ms"
+	exit 1
+fi
+echo "[  OK  ] requests timed out at radius_deadline_ms"
+
+# 10. The first window of a batch goes to the silent server; once the
+# Access-Request sent beside it is answered, poll() fails. Every entry,
+# in flight or never sent, reports ERROR_RC well before a retransmission.
+write_config "127.0.0.1:${PORT1}" "127.0.0.1:${PORT3}" 1
+: >$LOG3
+START=$(date +%s%N)
+run_engine $LOG1 -n 1500 -b -x -e -1
+ELAPSED=$(( ($(date +%s%N) - START) / 1000000 ))
+SENT=$(count_requests $LOG3 Accounting-Request)
+if test $RET != 0 || test $ELAPSED -ge 1000; then
+	echo "[ FAIL ] batch did not fail at once when dispatching failed (${ELAPSED} ms)"
+	exit 1
+fi
+if test "$SENT" -gt 1024; then
+	echo "[ FAIL ] $SENT batch requests were sent after dispatching failed"
+	exit 1
+fi
+echo "[  OK  ] batch failed in ${ELAPSED} ms with $SENT of 1500 requests sent"
+
+exit 0
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2026 Nikos Mavrogiannopoulos
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Driver for the asynchronous request engine.
+ *
+ * Submits -n requests at once with rc_aaa_submit() (Access-Request, or
+ * Accounting-Request with -a), runs rc_aaa_dispatch() until all have
+ * completed, and checks that every callback reported the result given
+ * with -e (OK_RC by default). With -c each completion submits one more
+ * request from inside its callback, until -n further requests were sent.
+ * With -b the requests are instead sent as one rc_acct_batch() call.
+ * With -x an Access-Request is submitted before the batch; its callback,
+ * run from within rc_acct_batch(), lowers the descriptor limit so that
+ * the next poll() of rc_aaa_dispatch() fails with EINVAL.
+ * With -l the engine is driven from the program's own poll() loop through
+ * rc_aaa_fds(), rc_aaa_timeout() and rc_process_events() instead of
+ * rc_aaa_dispatch(). With -w the requests are sent a second time, that
+ * many seconds after the first ones completed, over the same handle.
+ *
+ * Exit code: 0 when every request completed with the expected result.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <poll.h>
+#include <sys/resource.h>
+
+#include <radcli/radcli.h>
+
+#define MAX_FDS 16
+
+struct state {
+	VALUE_PAIR *send;
+	rc_standard_codes type;
+	int expected;
+	unsigned chain;
+	unsigned completed;
+	unsigned failed;
+};
+
+static void done(rc_handle *rh, int result, VALUE_PAIR *received, void *arg)
+{
+	struct state *st = arg;
+
+	st->completed++;
+	if (result != st->expected) {
+		fprintf(stderr, "async-engine: request completed with %d\n",
+			result);
+		st->failed++;
+	}
+	rc_avpair_free(received);
+
+	if (st->chain > 0) {
+		st->chain--;
+		if (rc_aaa_submit(rh, 0, st->send, 1, st->type, done, st) != OK_RC)
+			st->failed++;
+	}
+}
+
+static struct rlimit fd_limit;
+
+/* poll() fails with EINVAL when asked for more descriptors than the
+ * process may open */
+static void starve_fds(rc_handle *rh, int result, VALUE_PAIR *received,
+		       void *arg)
+{
+	struct rlimit none = fd_limit;
+
+	rc_avpair_free(received);
+	none.rlim_cur = 0;
+	if (setrlimit(RLIMIT_NOFILE, &none) != 0)
+		perror("async-engine: setrlimit");
+}
+
+/* An application event loop: waits on the engine's sockets and timer
+ * itself, and only calls into radcli to process what is ready. */
+static int external_loop(rc_handle *rh)
+{
+	struct pollfd pfds[MAX_FDS];
+	unsigned n;
+	int ret;
+
+	do {
+		n = rc_aaa_fds(rh, pfds, MAX_FDS);
+		if (n == 0 || n > MAX_FDS) {
+			fprintf(stderr, "async-engine: %u engine sockets\n", n);
+			return -1;
+		}
+		if (poll(pfds, n, rc_aaa_timeout(rh)) < 0)
+			return -1;
+		ret = rc_process_events(rh);
+	} while (ret > 0);
+
+	return ret;
+}
+
+static int run_batch(rc_handle *rh, struct state *st, unsigned count)
+{
+	VALUE_PAIR **sends;
+	int *results;
+	unsigned i;
+	int ret;
+
+	sends = calloc(count, sizeof(*sends));
+	results = calloc(count, sizeof(*results));
+	if (sends == NULL || results == NULL)
+		return -1;
+
+	for (i = 0; i < count; i++)
+		sends[i] = st->send;
+
+	ret = rc_acct_batch(rh, 0, sends, count, results);
+	for (i = 0; i < count; i++) {
+		st->completed++;
+		if (results[i] != st->expected) {
+			fprintf(stderr, "async-engine: request %u completed with %d\n",
+				i, results[i]);
+			st->failed++;
+		}
+	}
+
+	free(sends);
+	free(results);
+	return ret < 0 ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct state st;
+	rc_handle *rh;
+	char *rc_conf = NULL;
+	unsigned i, count = 1, total, round, rounds = 1, idle = 0;
+	int ch, ret = 0, external = 0, batch = 0, starve = 0;
+	uint32_t status = 1;
+
+	memset(&st, 0, sizeof(st));
+	st.type = PW_ACCESS_REQUEST;
+	st.expected = OK_RC;
+
+	while ((ch = getopt(argc, argv, "abclxf:n:e:w:")) != -1) {
+		switch (ch) {
+		case 'a':
+			st.type = PW_ACCOUNTING_REQUEST;
+			break;
+		case 'b':
+			st.type = PW_ACCOUNTING_REQUEST;
+			batch = 1;
+			break;
+		case 'c':
+			st.chain = 1;
+			break;
+		case 'l':
+			external = 1;
+			break;
+		case 'x':
+			starve = 1;
+			break;
+		case 'f':
+			rc_conf = optarg;
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'e':
+			st.expected = atoi(optarg);
+			break;
+		case 'w':
+			idle = atoi(optarg);
+			rounds = 2;
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	if (rc_conf == NULL)
+		exit(1);
+
+	if (st.chain)
+		st.chain = count;
+	total = (count + st.chain) * rounds;
+
+	openlog("async-engine", LOG_PERROR, LOG_USER);
+
+	if ((rh = rc_read_config(rc_conf)) == NULL) {
+		fprintf(stderr, "async-engine: error reading config\n");
+		exit(1);
+	}
+
+	if (rc_read_dictionary(rh, rc_conf_str(rh, "dictionary")) != 0) {
+		fprintf(stderr, "async-engine: error reading dictionary\n");
+		exit(1);
+	}
+
+	if (rc_avpair_add(rh, &st.send, PW_USER_NAME, "test", -1, 0) == NULL)
+		exit(1);
+	if (st.type == PW_ACCOUNTING_REQUEST) {
+		if (rc_avpair_add(rh, &st.send, PW_ACCT_STATUS_TYPE, &status,
+				  -1, 0) == NULL)
+			exit(1);
+	} else {
+		if (rc_avpair_add(rh, &st.send, PW_USER_PASSWORD, "test", -1,
+				  0) == NULL)
+			exit(1);
+	}
+
+	if (batch) {
+		if (starve) {
+			VALUE_PAIR *auth = NULL;
+
+			if (getrlimit(RLIMIT_NOFILE, &fd_limit) != 0 ||
+			    rc_avpair_add(rh, &auth, PW_USER_NAME, "test", -1, 0) == NULL ||
+			    rc_avpair_add(rh, &auth, PW_USER_PASSWORD, "test", -1, 0) == NULL ||
+			    rc_aaa_submit(rh, 0, auth, 1, PW_ACCESS_REQUEST,
+					  starve_fds, NULL) != OK_RC)
+				exit(1);
+			rc_avpair_free(auth);
+		}
+		ret = run_batch(rh, &st, count);
+		if (starve)
+			setrlimit(RLIMIT_NOFILE, &fd_limit);
+		goto finish;
+	}
+
+	for (round = 0; round < rounds; round++) {
+		if (round > 0) {
+			sleep(idle);
+			st.chain = total / rounds - count;
+		}
+
+		for (i = 0; i < count; i++) {
+			if (rc_aaa_submit(rh, 0, st.send, 1, st.type, done,
+					  &st) != OK_RC) {
+				fprintf(stderr, "async-engine: submit %u failed\n", i);
+				exit(1);
+			}
+		}
+
+		if (rc_aaa_pending(rh) != count) {
+			fprintf(stderr, "async-engine: %u pending, expected %u\n",
+				rc_aaa_pending(rh), count);
+			exit(1);
+		}
+
+		if (external) {
+			ret = external_loop(rh);
+		} else {
+			do {
+				ret = rc_aaa_dispatch(rh, -1);
+			} while (ret > 0);
+		}
+		if (ret < 0)
+			break;
+	}
+
+ finish:
+	printf("completed=%u failed=%u\n", st.completed, st.failed);
+
+	rc_avpair_free(st.send);
+	rc_destroy(rh);
+
+	if (ret < 0 || st.completed != total || st.failed != 0)
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,113 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== Server load balancing tests ====="
+echo " 1. round-robin spreads requests evenly over the authservers"
+echo " 2. weighted spreads them by authserver-weights"
+echo " 3. least-outstanding spreads sequential requests evenly"
+echo "======================================="
+
+if ! python3 -c '' 2>/dev/null; then
+	echo "This test requires python3"
+	exit 77
+fi
+
+. ${srcdir}/common.sh
+
+PID=$$
+TMPFILE=tmp$$.out
+LOG1=radius-server1-$PID.log
+LOG2=radius-server2-$PID.log
+SRVPID1=""
+SRVPID2=""
+
+eval "$GETPORT"; PORT1=$PORT
+eval "$GETPORT"; PORT2=$PORT
+
+function finish {
+	test -n "${SRVPID1}" && kill ${SRVPID1} >/dev/null 2>&1
+	test -n "${SRVPID2}" && kill ${SRVPID2} >/dev/null 2>&1
+	rm -f $TMPFILE $LOG1 $LOG2
+	rm -f radiusclient-temp$PID.conf
+	rm -f servers-temp$PID
+}
+trap finish EXIT
+
+wait_for_server() {
+	local port="$1"
+	local i
+	for i in 1 2 3 4 5 6 7 8; do
+		check_if_port_in_use ${port} && return 0
+		sleep 0.5
+	done
+	return 1
+}
+
+count_requests() {
+	grep -c "received Access-Request" $1
+}
+
+python3 ${srcdir}/radius-server.py --port ${PORT1} --secret testing123 >$LOG1 2>&1 &
+SRVPID1=$!
+python3 ${srcdir}/radius-server.py --port ${PORT2} --secret testing123 >$LOG2 2>&1 &
+SRVPID2=$!
+wait_for_server ${PORT1} || { echo "[ FAIL ] server 1 did not start"; exit 1; }
+wait_for_server ${PORT2} || { echo "[ FAIL ] server 2 did not start"; exit 1; }
+
+cat >servers-temp$PID <<EOF2
+127.0.0.1	testing123
+127.0.0.2	testing123
+EOF2
+
+REQ='AUTH\nUser-Name=test\nPassword=test\n\n'
+
+# run_balance <name> <policy> <extra option> <expected 1> <expected 2>
+# sends 6 requests through one handle and checks how many each server got
+run_balance() {
+	local name="$1" policy="$2" extra="$3" exp1="$4" exp2="$5"
+	local before1 before2 got1 got2
+
+	cat >radiusclient-temp$PID.conf <<EOF2
+nas-identifier my-nas-id
+authserver  127.0.0.1:${PORT1},127.0.0.2:${PORT2}
+acctserver  127.0.0.1:${PORT1}
+authserver-balance ${policy}
+${extra}
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  3
+radius_retries  2
+bindaddr    *
+EOF2
+
+	before1=$(count_requests $LOG1)
+	before2=$(count_requests $LOG2)
+
+	printf "$REQ$REQ$REQ$REQ$REQ$REQ" | \
+		${top_builddir}/src/radiusclient -f radiusclient-temp$PID.conf -s >$TMPFILE 2>&1
+	if test $? != 0 || test "$(grep -c '^0$' $TMPFILE)" != 6; then
+		sed 's/^/         | /' $TMPFILE
+		echo "[ FAIL ] ${name}: not every request was answered"
+		exit 1
+	fi
+
+	got1=$(( $(count_requests $LOG1) - before1 ))
+	got2=$(( $(count_requests $LOG2) - before2 ))
+	if test $got1 != $exp1 || test $got2 != $exp2; then
+		echo "[ FAIL ] ${name}: servers received $got1 and $got2 requests, expected $exp1 and $exp2"
+		exit 1
+	fi
+	echo "[  OK  ] ${name}: servers received $got1 and $got2 requests"
+}
+
+run_balance "round-robin" round-robin "" 3 3
+run_balance "weighted" weighted "authserver-weights 2,1" 4 2
+run_balance "least-outstanding" least-outstanding "" 3 3
+
+exit 0
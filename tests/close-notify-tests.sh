@@ -69,14 +69,19 @@ wait_for_server() {
 	return 1
 }
 
-# Start radius-server.py once; reused as plain-UDP backend for both modes.
-eval "$GETPORT"
-BEPORT=${PORT}
-python3 "${srcdir}/radius-server.py" \
-	--port "${BEPORT}" --secret testing123 --msg-auth correct \
-	>/dev/null 2>&1 &
-BEPID=$!
-wait_for_server || { echo "FAIL: radius-server.py did not start"; exit 1; }
+# start_backend SECRET — starts radius-server.py as the plain-UDP backend.
+# The client verifies the reply with the fixed secret of its transport
+# ("radsec" for TLS, "radius/dtls" for DTLS), so the backend signs with it.
+start_backend() {
+	test -n "${BEPID}" && kill ${BEPID} >/dev/null 2>&1
+	eval "$GETPORT"
+	BEPORT=${PORT}
+	python3 "${srcdir}/radius-server.py" \
+		--port "${BEPORT}" --secret "$1" --msg-auth correct \
+		>/dev/null 2>&1 &
+	BEPID=$!
+	wait_for_server || { echo "FAIL: radius-server.py did not start"; exit 1; }
+}
 
 # Common servers file (address must match authserver; secret ignored for TLS/DTLS).
 echo "127.0.0.1/127.0.0.1	testing123" >"${SERVERS_FILE}"
@@ -141,6 +146,7 @@ run_close_notify_test() {
 	return 0
 }
 
+start_backend radsec
 run_close_notify_test tls
 if test $? -ne 0; then
 	echo "FAIL: TLS close_notify not sent (deinit_session() missing gnutls_bye())"
@@ -148,6 +154,7 @@ if test $? -ne 0; then
 fi
 echo "[  OK  ] TLS: close_notify sent correctly"
 
+start_backend radius/dtls
 run_close_notify_test dtls
 if test $? -ne 0; then
 	echo "FAIL: DTLS close_notify not sent (deinit_session() missing gnutls_bye())"
@@ -216,6 +216,78 @@ static void test_servers_file_long_line(void)
 	rc_destroy(rh);
 }
 
+/* The servers file is read once into an index and read again when it
+ * changes on disk (checked at most once a second). The first line that
+ * matches an address wins, as with the former line-by-line scan. */
+static void test_servers_file_reload(void)
+{
+	rc_handle *rh;
+	char *path;
+	char servers_path[64];
+	char conf_path[64];
+	char conf[512];
+	struct addrinfo *info = NULL;
+	char secret[MAX_SECRET_LENGTH];
+	FILE *fp;
+	int n;
+
+	const char first[] =
+		"# comment\n"
+		"192.0.2.1 secretA\n"
+		"127.0.0.1/127.0.0.2 secretB\n"
+		"127.0.0.1 secretC\n";
+	path = write_conf(first, sizeof(first) - 1);
+	strcpy(servers_path, path);
+
+	n = snprintf(conf, sizeof(conf),
+		     "authserver 127.0.0.1:1\n"
+		     "acctserver 127.0.0.1:1\n"
+		     "radius_timeout 5\n"
+		     "radius_retries 1\n"
+		     "servers %s\n", servers_path);
+	path = write_conf(conf, (size_t)n);
+	strcpy(conf_path, path);
+
+	rh = rc_read_config(conf_path);
+	unlink(conf_path);
+	if (rh == NULL) {
+		unlink(servers_path);
+		fprintf(stderr, "error: config with a servers file was rejected\n");
+		exit(1);
+	}
+
+	if (rc_find_server_addr(rh, "127.0.0.1", &info, secret, AUTH) != 0 ||
+	    strcmp(secret, "secretB") != 0) {
+		unlink(servers_path);
+		fprintf(stderr, "error: expected 'secretB' from the first matching "
+				"servers-file line\n");
+		exit(1);
+	}
+	freeaddrinfo(info);
+
+	/* let the next lookup check the file again */
+	sleep(2);
+	fp = fopen(servers_path, "w");
+	if (fp == NULL) {
+		perror("fopen");
+		exit(1);
+	}
+	fprintf(fp, "127.0.0.1 secretD-longer\n");
+	fclose(fp);
+
+	if (rc_find_server_addr(rh, "127.0.0.1", &info, secret, AUTH) != 0 ||
+	    strcmp(secret, "secretD-longer") != 0) {
+		unlink(servers_path);
+		fprintf(stderr, "error: secret = '%s', expected 'secretD-longer' "
+				"after the servers file changed\n", secret);
+		exit(1);
+	}
+	freeaddrinfo(info);
+	unlink(servers_path);
+
+	rc_destroy(rh);
+}
+
 /* commit 25d4339: line-buffer handling in rc_read_config().
  * (a) last line without a trailing newline must not have its real last
  *     byte stripped as if it were a '\n'. */
@@ -338,6 +410,369 @@ static void test_keyword_trailing_whitespace_only(void)
 	rc_destroy(rh);
 }
 
+/* resolve-ttl bounds how long server addresses are cached; a negative
+ * value is rejected by rc_apply_config(), while 0 (no caching) is valid. */
+static void test_resolve_ttl(void)
+{
+	rc_handle *rh;
+	char *path;
+
+	const char zero[] =
+		"authserver 127.0.0.1:1\n"
+		"acctserver 127.0.0.1:1\n"
+		"radius_timeout 5\n"
+		"radius_retries 1\n"
+		"resolve-ttl 0\n";
+	path = write_conf(zero, sizeof(zero) - 1);
+	rh = rc_read_config(path);
+	unlink(path);
+	if (rh == NULL) {
+		fprintf(stderr, "error: resolve-ttl 0 was rejected\n");
+		exit(1);
+	}
+	rc_destroy(rh);
+
+	const char negative[] =
+		"authserver 127.0.0.1:1\n"
+		"acctserver 127.0.0.1:1\n"
+		"radius_timeout 5\n"
+		"radius_retries 1\n"
+		"resolve-ttl -1\n";
+	path = write_conf(negative, sizeof(negative) - 1);
+	rh = rc_read_config(path);
+	unlink(path);
+	if (rh != NULL) {
+		fprintf(stderr, "error: resolve-ttl -1 was accepted\n");
+		rc_destroy(rh);
+		exit(1);
+	}
+}
+
+static void ignore_reply(rc_handle *rh, int result, VALUE_PAIR *received,
+			 void *arg)
+{
+	rc_avpair_free(received);
+}
+
+static void submit_or_die(rc_handle *rh)
+{
+	VALUE_PAIR *send = NULL;
+
+	if (rc_avpair_add(rh, &send, PW_USER_NAME, "test", -1, 0) == NULL ||
+	    rc_aaa_submit(rh, 0, send, 0, PW_ACCOUNTING_REQUEST,
+			  ignore_reply, NULL) != OK_RC) {
+		fprintf(stderr, "error: request to localhost was not sent\n");
+		exit(1);
+	}
+	rc_avpair_free(send);
+}
+
+/* A host name is cached by the first request to it. rc_resolve_refresh()
+ * looks it up again only once it is within half of resolve-ttl of expiring,
+ * and a request that finds it expired looks it up itself. "localhost"
+ * resolves from the hosts file, and the requests go to a closed loopback
+ * port; they are dropped unanswered by rc_destroy(). */
+static void test_resolve_refresh(void)
+{
+	rc_handle *rh;
+	char *path;
+	int ret;
+
+	const char conf[] =
+		"authserver localhost:1:testing123\n"
+		"acctserver localhost:1:testing123\n"
+		"radius_timeout 5\n"
+		"radius_retries 1\n"
+		"resolve-ttl 3\n";
+	path = write_conf(conf, sizeof(conf) - 1);
+	rh = rc_read_config(path);
+	unlink(path);
+	if (rh == NULL) {
+		fprintf(stderr, "error: resolve-ttl 3 was rejected\n");
+		exit(1);
+	}
+
+	if ((ret = rc_resolve_refresh(rh)) != 0) {
+		fprintf(stderr, "error: %d names refreshed before any was used\n", ret);
+		exit(1);
+	}
+
+	submit_or_die(rh);
+	if ((ret = rc_resolve_refresh(rh)) != 0) {
+		fprintf(stderr, "error: %d names refreshed right after a lookup\n", ret);
+		exit(1);
+	}
+
+	sleep(2);
+	if ((ret = rc_resolve_refresh(rh)) != 1) {
+		fprintf(stderr, "error: %d names refreshed before expiry, expected 1\n", ret);
+		exit(1);
+	}
+	if ((ret = rc_resolve_refresh(rh)) != 0) {
+		fprintf(stderr, "error: %d names refreshed twice\n", ret);
+		exit(1);
+	}
+
+	/* expired: the request itself looks the name up again */
+	sleep(3);
+	submit_or_die(rh);
+	if ((ret = rc_resolve_refresh(rh)) != 0) {
+		fprintf(stderr, "error: %d names still stale after a request "
+				"refreshed them\n", ret);
+		exit(1);
+	}
+
+	rc_destroy(rh);
+}
+
+/* authserver-balance and authserver-weights are validated when the
+ * configuration is applied, weights against the authserver list. */
+static void expect_config(const char *conf, size_t len, int valid,
+			  const char *what)
+{
+	rc_handle *rh;
+	char *path;
+
+	path = write_conf(conf, len);
+	rh = rc_read_config(path);
+	unlink(path);
+	if ((rh != NULL) != valid) {
+		fprintf(stderr, "error: %s was %s\n", what,
+			valid ? "rejected" : "accepted");
+		exit(1);
+	}
+	if (rh != NULL)
+		rc_destroy(rh);
+}
+
+static void test_balance_options(void)
+{
+#define BALANCE_CONF \
+	"authserver 127.0.0.1:1,127.0.0.2:1\n" \
+	"acctserver 127.0.0.1:1\n" \
+	"radius_timeout 5\n" \
+	"radius_retries 1\n"
+
+	const char weighted[] = BALANCE_CONF
+		"authserver-balance weighted\n"
+		"authserver-weights 3, 1\n";
+	expect_config(weighted, sizeof(weighted) - 1, 1, "authserver-weights 3, 1");
+
+	const char unknown[] = BALANCE_CONF
+		"authserver-balance random\n";
+	expect_config(unknown, sizeof(unknown) - 1, 0, "authserver-balance random");
+
+	const char too_many[] = BALANCE_CONF
+		"authserver-weights 1,1,1\n";
+	expect_config(too_many, sizeof(too_many) - 1, 0, "a weight per missing server");
+
+	const char zero[] = BALANCE_CONF
+		"authserver-weights 1,0\n";
+	expect_config(zero, sizeof(zero) - 1, 0, "authserver-weights 1,0");
+
+	const char junk[] = BALANCE_CONF
+		"acctserver-weights 2x\n";
+	expect_config(junk, sizeof(junk) - 1, 0, "acctserver-weights 2x");
+#undef BALANCE_CONF
+}
+
+/* retransmit, rto-min-ms and rto-max-ms are validated when the
+ * configuration is applied. */
+static void test_retransmit_options(void)
+{
+#define RTO_CONF \
+	"authserver 127.0.0.1:1\n" \
+	"acctserver 127.0.0.1:1\n" \
+	"radius_timeout 2\n" \
+	"radius_retries 1\n"
+
+	const char adaptive[] = RTO_CONF
+		"retransmit adaptive\n"
+		"rto-min-ms 50\n";
+	expect_config(adaptive, sizeof(adaptive) - 1, 1, "retransmit adaptive");
+
+	const char unknown[] = RTO_CONF
+		"retransmit exponential\n";
+	expect_config(unknown, sizeof(unknown) - 1, 0, "retransmit exponential");
+
+	/* rto-max-ms defaults to radius_timeout */
+	const char above_max[] = RTO_CONF
+		"retransmit adaptive\n"
+		"rto-min-ms 2500\n";
+	expect_config(above_max, sizeof(above_max) - 1, 0, "rto-min-ms above rto-max-ms");
+
+	const char zero[] = RTO_CONF
+		"retransmit adaptive\n"
+		"rto-min-ms 0\n";
+	expect_config(zero, sizeof(zero) - 1, 0, "rto-min-ms 0");
+#undef RTO_CONF
+}
+
+/* radius_timeout_ms and radius_deadline_ms must not be negative */
+static void test_timeout_options(void)
+{
+#define TIMEOUT_CONF \
+	"authserver 127.0.0.1:1\n" \
+	"acctserver 127.0.0.1:1\n" \
+	"radius_timeout 2\n" \
+	"radius_retries 1\n"
+
+	const char ms[] = TIMEOUT_CONF
+		"radius_timeout_ms 250\n"
+		"radius_deadline_ms 2000\n";
+	expect_config(ms, sizeof(ms) - 1, 1, "radius_timeout_ms 250");
+
+	const char timeout[] = TIMEOUT_CONF
+		"radius_timeout_ms -1\n";
+	expect_config(timeout, sizeof(timeout) - 1, 0, "radius_timeout_ms -1");
+
+	const char deadline[] = TIMEOUT_CONF
+		"radius_deadline_ms -5\n";
+	expect_config(deadline, sizeof(deadline) - 1, 0, "radius_deadline_ms -5");
+#undef TIMEOUT_CONF
+}
+
+/* hedge-delay-ms must not be negative, and hedge-percentile must be
+ * within 0 and 99 */
+static void test_hedge_options(void)
+{
+#define HEDGE_CONF \
+	"authserver 127.0.0.1:1,127.0.0.1:2\n" \
+	"acctserver 127.0.0.1:1\n" \
+	"radius_timeout 2\n" \
+	"radius_retries 1\n"
+
+	const char hedge[] = HEDGE_CONF
+		"hedge-delay-ms 300\n"
+		"hedge-percentile 95\n";
+	expect_config(hedge, sizeof(hedge) - 1, 1, "hedge-percentile 95");
+
+	const char delay[] = HEDGE_CONF
+		"hedge-delay-ms -1\n";
+	expect_config(delay, sizeof(delay) - 1, 0, "hedge-delay-ms -1");
+
+	const char pct[] = HEDGE_CONF
+		"hedge-percentile 100\n";
+	expect_config(pct, sizeof(pct) - 1, 0, "hedge-percentile 100");
+#undef HEDGE_CONF
+}
+
+/* udp-connect takes yes or no */
+static void test_udp_connect_option(void)
+{
+#define UDP_CONF \
+	"authserver 127.0.0.1:1\n" \
+	"acctserver 127.0.0.1:1\n" \
+	"radius_timeout 2\n" \
+	"radius_retries 1\n"
+
+	const char yes[] = UDP_CONF
+		"udp-connect yes\n";
+	expect_config(yes, sizeof(yes) - 1, 1, "udp-connect yes");
+
+	const char maybe[] = UDP_CONF
+		"udp-connect maybe\n";
+	expect_config(maybe, sizeof(maybe) - 1, 0, "udp-connect maybe");
+#undef UDP_CONF
+}
+
+static void test_dictionary_lazy_option(void)
+{
+#define LAZY_CONF \
+	"authserver 127.0.0.1:1\n" \
+	"acctserver 127.0.0.1:1\n" \
+	"radius_timeout 2\n" \
+	"radius_retries 1\n"
+
+	const char yes[] = LAZY_CONF
+		"dictionary-lazy yes\n";
+	expect_config(yes, sizeof(yes) - 1, 1, "dictionary-lazy yes");
+
+	const char maybe[] = LAZY_CONF
+		"dictionary-lazy maybe\n";
+	expect_config(maybe, sizeof(maybe) - 1, 0, "dictionary-lazy maybe");
+#undef LAZY_CONF
+}
+
+/* srcaddr-ttl must not be negative; 0 turns the cache off */
+static void test_srcaddr_ttl_option(void)
+{
+#define SRCADDR_CONF \
+	"authserver 127.0.0.1:1\n" \
+	"acctserver 127.0.0.1:1\n" \
+	"radius_timeout 2\n" \
+	"radius_retries 1\n"
+
+	const char off[] = SRCADDR_CONF
+		"srcaddr-ttl 0\n";
+	expect_config(off, sizeof(off) - 1, 1, "srcaddr-ttl 0");
+
+	const char negative[] = SRCADDR_CONF
+		"srcaddr-ttl -1\n";
+	expect_config(negative, sizeof(negative) - 1, 0, "srcaddr-ttl -1");
+#undef SRCADDR_CONF
+}
+
+/* The built-in dictionary is attached from compiled tables. Lookups must
+ * behave as when it was parsed: any case for names, the later of two
+ * definitions of a number, and entries added to the handle first. */
+static void test_builtin_dictionary(void)
+{
+	rc_handle *rh;
+	DICT_ATTR *attr;
+	DICT_VALUE *dval;
+	DICT_VENDOR *vend;
+	char *path;
+
+	const char conf[] =
+		"authserver 127.0.0.1:1\n"
+		"acctserver 127.0.0.1:1\n"
+		"radius_timeout 2\n"
+		"radius_retries 1\n";
+	path = write_conf(conf, sizeof(conf) - 1);
+	rh = rc_read_config(path);
+	unlink(path);
+	if (rh == NULL) {
+		fprintf(stderr, "error: configuration was rejected\n");
+		exit(1);
+	}
+
+	attr = rc_dict_findattr(rh, "user-NAME");
+	assert(attr != NULL && attr->value == PW_USER_NAME);
+	assert(attr->type == PW_TYPE_STRING);
+
+	/* Password and User-Password are both attribute 2 */
+	attr = rc_dict_getattr(rh, PW_USER_PASSWORD);
+	assert(attr != NULL && strcmp(attr->name, "User-Password") == 0);
+
+	vend = rc_dict_findvend(rh, "dsl-forum");
+	assert(vend != NULL && vend->vendorpec == 3561);
+	assert(rc_dict_getvend(rh, 3561) == vend);
+
+	attr = rc_dict_getattr(rh, RADCLI_VENDOR_ATTR_SET(1, 3561));
+	assert(attr != NULL && strcmp(attr->name, "Agent-Circuit-Id") == 0);
+	assert(rc_dict_getattr(rh, RADCLI_VENDOR_ATTR_SET(1, 3562)) == NULL);
+
+	dval = rc_dict_getval(rh, PW_FRAMED, "service-type");
+	assert(dval != NULL && strcmp(dval->name, "Framed-User") == 0);
+	dval = rc_dict_findval(rh, "FRAMED-USER");
+	assert(dval != NULL && dval->value == PW_FRAMED);
+	assert(rc_dict_findattr(rh, "No-Such-Attribute") == NULL);
+
+	/* entries of the handle take precedence */
+	assert(rc_dict_addattr(rh, "User-Name", 240, PW_TYPE_INTEGER, 0) != NULL);
+	attr = rc_dict_findattr(rh, "User-Name");
+	assert(attr != NULL && attr->value == 240);
+	attr = rc_dict_getattr(rh, PW_USER_NAME);
+	assert(attr != NULL && attr->type == PW_TYPE_STRING);
+
+	rc_dict_free(rh);
+	assert(rc_dict_findattr(rh, "Service-Type") == NULL);
+	assert(rc_dict_getvend(rh, 3561) == NULL);
+
+	rc_destroy(rh);
+}
+
 /* commit 8c4e3ac: "no acctserver specified" must be suppressed for
  * serv-type tls/dtls, and still logged otherwise. rh->so_type is not set
  * until rc_apply_config() runs (called internally by rc_read_config() via
@@ -422,10 +857,21 @@ int main(void)
 	test_server_list_bound();
 	test_prefix_match_secret();
 	test_servers_file_long_line();
+	test_servers_file_reload();
 	test_last_line_no_newline();
 	test_long_line_no_truncation();
 	test_keyword_trailing_whitespace_only();
 	test_acctserver_log_suppression();
+	test_resolve_ttl();
+	test_resolve_refresh();
+	test_balance_options();
+	test_retransmit_options();
+	test_timeout_options();
+	test_hedge_options();
+	test_udp_connect_option();
+	test_dictionary_lazy_option();
+	test_srcaddr_ttl_option();
+	test_builtin_dictionary();
 
 	printf("config-unit: all tests passed\n");
 	return 0;
@@ -0,0 +1,135 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== Timeout and deadline tests ====="
+echo " 1. radius_timeout_ms fails over from a silent server in milliseconds"
+echo " 2. radius_deadline_ms bounds a request across retries and failover"
+echo "======================================"
+
+if ! python3 -c '' 2>/dev/null; then
+	echo "This test requires python3"
+	exit 77
+fi
+
+. ${srcdir}/common.sh
+
+PID=$$
+TMPFILE=tmp$$.out
+LOG1=radius-server1-$PID.log
+LOG2=radius-server2-$PID.log
+LOG3=radius-server3-$PID.log
+SRVPID1=""
+SRVPID2=""
+SRVPID3=""
+
+eval "$GETPORT"; PORT1=$PORT
+eval "$GETPORT"; PORT2=$PORT
+eval "$GETPORT"; PORT3=$PORT
+
+function finish {
+	test -n "${SRVPID1}" && kill ${SRVPID1} >/dev/null 2>&1
+	test -n "${SRVPID2}" && kill ${SRVPID2} >/dev/null 2>&1
+	test -n "${SRVPID3}" && kill ${SRVPID3} >/dev/null 2>&1
+	rm -f $TMPFILE $LOG1 $LOG2 $LOG3
+	rm -f radiusclient-temp$PID.conf
+	rm -f servers-temp$PID
+}
+trap finish EXIT
+
+wait_for_server() {
+	local port="$1"
+	local i
+	for i in 1 2 3 4 5 6 7 8; do
+		check_if_port_in_use ${port} && return 0
+		sleep 0.5
+	done
+	return 1
+}
+
+count_requests() {
+	grep -c "received Access-Request" $1
+}
+
+# servers 1 and 2 are silent, server 3 answers
+python3 ${srcdir}/radius-server.py --port ${PORT1} --secret testing123 --no-reply >$LOG1 2>&1 &
+SRVPID1=$!
+python3 ${srcdir}/radius-server.py --port ${PORT2} --secret testing123 --no-reply >$LOG2 2>&1 &
+SRVPID2=$!
+python3 ${srcdir}/radius-server.py --port ${PORT3} --secret testing123 >$LOG3 2>&1 &
+SRVPID3=$!
+wait_for_server ${PORT1} || { echo "[ FAIL ] server 1 did not start"; exit 1; }
+wait_for_server ${PORT2} || { echo "[ FAIL ] server 2 did not start"; exit 1; }
+wait_for_server ${PORT3} || { echo "[ FAIL ] server 3 did not start"; exit 1; }
+
+cat >servers-temp$PID <<EOF2
+127.0.0.1	testing123
+127.0.0.2	testing123
+127.0.0.3	testing123
+EOF2
+
+REQ='AUTH\nUser-Name=test\nPassword=test\n\n'
+
+# run_client <servers> <extra options>: sends one request, sets ELAPSED (ms)
+run_client() {
+	cat >radiusclient-temp$PID.conf <<EOF2
+nas-identifier my-nas-id
+authserver  $1
+acctserver  127.0.0.1:${PORT1}
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  1
+radius_retries  2
+$2
+bindaddr    *
+EOF2
+
+	START=$(date +%s%N)
+	printf "$REQ" | \
+		${top_builddir}/src/radiusclient -f radiusclient-temp$PID.conf -s >$TMPFILE 2>&1
+	ELAPSED=$(( ($(date +%s%N) - START) / 1000000 ))
+}
+
+# 1. three transmissions of 200 ms to server 1, then server 3 answers
+run_client "127.0.0.1:${PORT1},127.0.0.3:${PORT3}" "radius_timeout_ms 200"
+if test "$(grep -c '^0$' $TMPFILE)" != 1; then
+	sed 's/^/         | /' $TMPFILE
+	echo "[ FAIL ] the request was not answered by server 3"
+	exit 1
+fi
+if test "$(count_requests $LOG1)" != 3; then
+	echo "[ FAIL ] server 1 received $(count_requests $LOG1) requests, expected 3"
+	exit 1
+fi
+if test $ELAPSED -ge 2000; then
+	echo "[ FAIL ] failing over took ${ELAPSED} ms"
+	exit 1
+fi
+echo "[  OK  ] failed over after 3 transmissions of 200 ms in ${ELAPSED} ms"
+
+# 2. without the deadline, two silent servers cost 6 seconds
+BEFORE1=$(count_requests $LOG1)
+run_client "127.0.0.1:${PORT1},127.0.0.2:${PORT2},127.0.0.3:${PORT3}" "radius_deadline_ms 1500"
+if test "$(grep -c '^1$' $TMPFILE)" != 1; then
+	sed 's/^/         | /' $TMPFILE
+	echo "[ FAIL ] the request did not fail"
+	exit 1
+fi
+if test $ELAPSED -lt 1400 || test $ELAPSED -ge 3000; then
+	echo "[ FAIL ] the request failed after ${ELAPSED} ms, expected 1500"
+	exit 1
+fi
+if test "$(( $(count_requests $LOG1) - BEFORE1 ))" != 2 ||
+   test "$(count_requests $LOG2)" != 0 || test "$(count_requests $LOG3)" != 1; then
+	echo "[ FAIL ] servers received $(( $(count_requests $LOG1) - BEFORE1 )), $(count_requests $LOG2) and $(( $(count_requests $LOG3) - 1 )) requests, expected 2, 0 and 0"
+	cat $LOG1 $LOG2 $LOG3
+	exit 1
+fi
+echo "[  OK  ] the request timed out after ${ELAPSED} ms"
+
+exit 0
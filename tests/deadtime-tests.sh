@@ -0,0 +1,108 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== Server dead time tests ====="
+echo " 1. Requests after a timeout skip the dead server"
+echo " 2. Once radius_deadtime passes, the server is probed once"
+echo "=================================="
+
+if ! python3 -c '' 2>/dev/null; then
+	echo "This test requires python3"
+	exit 77
+fi
+
+. ${srcdir}/common.sh
+
+PID=$$
+TMPFILE=tmp$$.out
+LOG1=radius-server1-$PID.log
+LOG2=radius-server2-$PID.log
+SRVPID1=""
+SRVPID2=""
+
+eval "$GETPORT"; PORT1=$PORT
+eval "$GETPORT"; PORT2=$PORT
+
+function finish {
+	test -n "${SRVPID1}" && kill ${SRVPID1} >/dev/null 2>&1
+	test -n "${SRVPID2}" && kill ${SRVPID2} >/dev/null 2>&1
+	rm -f $TMPFILE $LOG1 $LOG2
+	rm -f radiusclient-temp$PID.conf
+	rm -f servers-temp$PID
+}
+trap finish EXIT
+
+wait_for_server() {
+	local port="$1"
+	local i
+	for i in 1 2 3 4 5 6 7 8; do
+		check_if_port_in_use ${port} && return 0
+		sleep 0.5
+	done
+	return 1
+}
+
+count_requests() {
+	grep -c "received Access-Request" $1
+}
+
+python3 ${srcdir}/radius-server.py --port ${PORT1} --secret testing123 --no-reply >$LOG1 2>&1 &
+SRVPID1=$!
+python3 ${srcdir}/radius-server.py --port ${PORT2} --secret testing123 >$LOG2 2>&1 &
+SRVPID2=$!
+wait_for_server ${PORT1} || { echo "[ FAIL ] server 1 did not start"; exit 1; }
+wait_for_server ${PORT2} || { echo "[ FAIL ] server 2 did not start"; exit 1; }
+
+cat >radiusclient-temp$PID.conf <<EOF2
+nas-identifier my-nas-id
+authserver  127.0.0.1:${PORT1},127.0.0.2:${PORT2}
+acctserver  127.0.0.1:${PORT1}
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  1
+radius_retries  2
+radius_deadtime 4
+bindaddr    *
+EOF2
+cat >servers-temp$PID <<EOF2
+127.0.0.1	testing123
+127.0.0.2	testing123
+EOF2
+
+REQ='AUTH\nUser-Name=test\nPassword=test\n\n'
+
+# radiusclient -s sends every request through the same handle; the pause
+# lets the dead time of server 1 (marked dead after 3 seconds) run out
+# before the last request.
+( printf "$REQ$REQ$REQ"; sleep 9; printf "$REQ" ) | \
+	${top_builddir}/src/radiusclient -f radiusclient-temp$PID.conf -s >$TMPFILE 2>&1
+RET=$?
+sed 's/^/         | /' $TMPFILE
+
+if test $RET != 0 || test "$(grep -c '^0$' $TMPFILE)" != 4; then
+	echo "[ FAIL ] not every request was answered by server 2"
+	exit 1
+fi
+
+# 3 transmissions for the first request, 1 probe for the last one
+if test "$(count_requests $LOG1)" != 4; then
+	echo "[ FAIL ] server 1 received $(count_requests $LOG1) requests, expected 4"
+	cat $LOG1
+	exit 1
+fi
+echo "[  OK  ] requests skipped the dead server"
+
+if test "$(count_requests $LOG2)" != 4; then
+	echo "[ FAIL ] server 2 received $(count_requests $LOG2) requests, expected 4"
+	cat $LOG2
+	exit 1
+fi
+echo "[  OK  ] the dead server was probed once after radius_deadtime"
+
+exit 0
@@ -28,6 +28,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #include <radcli/radcli.h>
 
@@ -62,6 +64,312 @@ char bad_value_value_dict[] =
 char bad_vendor_pec_dict[] =
 "VENDOR          Bogus       18311x     Large\n";
 
+/* A later definition of a name or number takes precedence, as it did
+ * when lookups walked the lists newest first */
+char redefined_dict[] =
+"VENDOR          Acme       9999\n"
+"ATTRIBUTE	Old-Name		210	integer\n"
+"ATTRIBUTE	New-Name		210	string\n"
+"ATTRIBUTE	Same-Name		211	integer\n"
+"ATTRIBUTE	Same-Name		212	integer\n"
+"ATTRIBUTE	Acme-Attr		210	integer Acme\n"
+"VALUE	Same-Name		One	1\n"
+"VALUE	Same-Name		Two	2\n"
+"VALUE	Same-Name		Uno	1\n";
+
+/* A dictionary tree for rc_compile_dictionary(), and a second one whose
+ * cache is put in place of the first one's to tell the two apart */
+char cache_main_dict[] =
+"VENDOR          Acme       9999\n"
+"ATTRIBUTE	Main-Attr		220	integer\n"
+"ATTRIBUTE	Main-Attr		221	string\n"
+"VALUE	Main-Attr		On	1\n"
+"$INCLUDE dictionary.acme\n";
+char cache_acme_dict[] =
+"BEGIN-VENDOR	Acme\n"
+"ATTRIBUTE	Acme-Attr		1	integer\n"
+"END-VENDOR	Acme\n";
+char cache_other_dict[] =
+"ATTRIBUTE	Other-Attr		230	integer\n";
+
+/* A dictionary tree for rc_read_dictionary_lazy(), with an entry after
+ * a block to check that reading resumes there, and a block including
+ * a file, which is read at once */
+char lazy_main_dict[] =
+"VENDOR          Acme       9999\n"
+"VENDOR          Other      8888\n"
+"VENDOR          Third      7777\n"
+"ATTRIBUTE	Main-Attr		220	integer\n"
+"$INCLUDE dictionary.acme\n"
+"$INCLUDE dictionary.other\n"
+"BEGIN-VENDOR	Third\n"
+"$INCLUDE dictionary.third\n"
+"END-VENDOR	Third\n";
+char lazy_acme_dict[] =
+"BEGIN-VENDOR	Acme\n"
+"ATTRIBUTE	Acme-Attr		1	integer\n"
+"ATTRIBUTE	Acme-Mode		2	integer\n"
+"VALUE	Acme-Mode		Fast	1\n"
+"END-VENDOR	Acme\n"
+"ATTRIBUTE	After-Acme		240	integer\n";
+char lazy_other_dict[] =
+"BEGIN-VENDOR	Other\n"
+"ATTRIBUTE	Other-Attr		1	integer\n"
+"VALUE	Acme-Attr		Slow	2\n"
+"END-VENDOR	Other\n";
+char lazy_third_dict[] =
+"ATTRIBUTE	Third-Attr		1	integer\n";
+
+static void write_file(char const *path, char const *data, char const *mode)
+{
+	FILE *fp = fopen(path, mode);
+
+	assert(fp != NULL);
+	assert(fputs(data, fp) >= 0);
+	assert(fclose(fp) == 0);
+}
+
+static void test_dictionary_cache(void)
+{
+	char dir[] = "dict-cache-XXXXXX";
+	char mainf[64], acmef[64], otherf[64], cachef[64], othercachef[64];
+	rc_handle *rh;
+	DICT_ATTR *attr;
+
+	assert(mkdtemp(dir) != NULL);
+	snprintf(mainf, sizeof(mainf), "%s/dictionary", dir);
+	snprintf(acmef, sizeof(acmef), "%s/dictionary.acme", dir);
+	snprintf(otherf, sizeof(otherf), "%s/dictionary.other", dir);
+	snprintf(cachef, sizeof(cachef), "%s/dictionary.cache", dir);
+	snprintf(othercachef, sizeof(othercachef), "%s/dictionary.other.cache", dir);
+	write_file(mainf, cache_main_dict, "w");
+	write_file(acmef, cache_acme_dict, "w");
+	write_file(otherf, cache_other_dict, "w");
+
+	assert(rc_compile_dictionary(mainf, NULL) == 0);
+	assert(access(cachef, R_OK) == 0);
+
+	/* the cache holds the included file, and later definitions win */
+	rh = rc_new();
+	assert(rh != NULL);
+	assert(rc_read_dictionary(rh, mainf) == 0);
+	attr = rc_dict_findattr(rh, "main-attr");
+	assert(attr != NULL && ATTRID(attr->value) == 221);
+	assert(attr->type == PW_TYPE_STRING);
+	assert(rc_dict_getattr(rh, 220) != NULL);
+	attr = rc_dict_getattr(rh, RADCLI_VENDOR_ATTR_SET(1, 9999));
+	assert(attr != NULL && strcmp(attr->name, "Acme-Attr") == 0);
+	assert(rc_dict_getvend(rh, 9999) != NULL);
+	assert(rc_dict_getval(rh, 1, "MAIN-ATTR") != NULL);
+
+	/* entries added to the handle take precedence over the cache */
+	assert(rc_dict_addattr(rh, "Main-Attr", 222, PW_TYPE_INTEGER, 0) != NULL);
+	attr = rc_dict_findattr(rh, "Main-Attr");
+	assert(attr != NULL && ATTRID(attr->value) == 222);
+	assert(rc_dict_getattr(rh, 221) != NULL);
+	rc_dict_free(rh);
+	assert(rc_dict_findattr(rh, "Acme-Attr") == NULL);
+	rc_destroy(rh);
+
+	/* a cache is used as long as the files it was compiled from are
+	 * unchanged, whatever the file it is placed next to says */
+	assert(rc_compile_dictionary(otherf, cachef) == 0);
+	rh = rc_new();
+	assert(rh != NULL);
+	assert(rc_read_dictionary(rh, mainf) == 0);
+	assert(rc_dict_findattr(rh, "Other-Attr") != NULL);
+	assert(rc_dict_findattr(rh, "Main-Attr") == NULL);
+	rc_destroy(rh);
+
+	write_file(otherf, "ATTRIBUTE	Other-Attr-2	231	integer\n", "a");
+	rh = rc_new();
+	assert(rh != NULL);
+	assert(rc_read_dictionary(rh, mainf) == 0);
+	assert(rc_dict_findattr(rh, "Other-Attr") == NULL);
+	assert(rc_dict_findattr(rh, "Main-Attr") != NULL);
+	rc_destroy(rh);
+
+	/* a cache is not used once the handle has entries of its own */
+	assert(rc_compile_dictionary(otherf, cachef) == 0);
+	rh = rc_new();
+	assert(rh != NULL);
+	assert(rc_dict_addvend(rh, "Acme", 9999) != NULL);
+	assert(rc_read_dictionary(rh, mainf) == 0);
+	assert(rc_dict_findattr(rh, "Other-Attr") == NULL);
+	assert(rc_dict_findattr(rh, "Main-Attr") != NULL);
+	rc_destroy(rh);
+
+	/* a damaged cache is ignored */
+	assert(truncate(cachef, 100) == 0);
+	rh = rc_new();
+	assert(rh != NULL);
+	assert(rc_read_dictionary(rh, mainf) == 0);
+	assert(rc_dict_findattr(rh, "Main-Attr") != NULL);
+	assert(rc_dict_findattr(rh, "Other-Attr") == NULL);
+	rc_destroy(rh);
+
+	unlink(cachef);
+	unlink(othercachef);
+	unlink(mainf);
+	unlink(acmef);
+	unlink(otherf);
+	rmdir(dir);
+}
+
+static void test_lazy_dictionary(void)
+{
+	char dir[] = "dict-lazy-XXXXXX";
+	char mainf[64], acmef[64], otherf[64], thirdf[64];
+	rc_handle *rh;
+	DICT_ATTR *attr;
+	DICT_VALUE *dv;
+
+	assert(mkdtemp(dir) != NULL);
+	snprintf(mainf, sizeof(mainf), "%s/dictionary", dir);
+	snprintf(acmef, sizeof(acmef), "%s/dictionary.acme", dir);
+	snprintf(otherf, sizeof(otherf), "%s/dictionary.other", dir);
+	snprintf(thirdf, sizeof(thirdf), "%s/dictionary.third", dir);
+	write_file(mainf, lazy_main_dict, "w");
+	write_file(acmef, lazy_acme_dict, "w");
+	write_file(otherf, lazy_other_dict, "w");
+	write_file(thirdf, lazy_third_dict, "w");
+
+	/* vendors and the entries outside blocks are read at once */
+	rh = rc_new();
+	assert(rh != NULL);
+	assert(rc_read_dictionary_lazy(rh, mainf) == 0);
+	unlink(thirdf);
+	assert(rc_dict_findattr(rh, "Main-Attr") != NULL);
+	assert(rc_dict_findattr(rh, "After-Acme") != NULL);
+	assert(rc_dict_getvend(rh, 8888) != NULL);
+	assert(rc_dict_findvend(rh, "Acme") != NULL);
+	assert(rc_dict_findattr(rh, "Third-Attr") != NULL);
+
+	/* names and IDs no block defines read no block */
+	assert(rc_dict_findattr(rh, "Acme-Typo") == NULL);
+	assert(rc_dict_findval(rh, "No-Such-Value") == NULL);
+	assert(rc_dict_getval(rh, 1, "No-Such-Attr") == NULL);
+	assert(rc_dict_getattr(rh, RADCLI_VENDOR_ATTR_SET(3, 8888)) == NULL);
+
+	/* a block is read by the name of one of its attributes, and only
+	 * that block */
+	attr = rc_dict_findattr(rh, "acme-mode");
+	assert(attr != NULL && VENDOR(attr->value) == 9999);
+	assert(ATTRID(attr->value) == 2);
+	dv = rc_dict_getval(rh, 1, "Acme-Mode");
+	assert(dv != NULL && strcmp(dv->name, "Fast") == 0);
+
+	/* the other block was not read, so it is lost with its file */
+	unlink(otherf);
+	assert(rc_dict_getattr(rh, RADCLI_VENDOR_ATTR_SET(1, 8888)) == NULL);
+	assert(rc_dict_findattr(rh, "Other-Attr") == NULL);
+	rc_destroy(rh);
+
+	/* a block is read by the ID of one of its attributes, by the name
+	 * of one of its values, and by the attribute of one of its values,
+	 * whichever vendor the attribute is of */
+	write_file(otherf, lazy_other_dict, "w");
+	write_file(thirdf, lazy_third_dict, "w");
+	rh = rc_new();
+	assert(rh != NULL);
+	assert(rc_read_dictionary_lazy(rh, mainf) == 0);
+	attr = rc_dict_getattr(rh, RADCLI_VENDOR_ATTR_SET(1, 9999));
+	assert(attr != NULL && strcmp(attr->name, "Acme-Attr") == 0);
+	dv = rc_dict_findval(rh, "Fast");
+	assert(dv != NULL && dv->value == 1);
+	dv = rc_dict_getval(rh, 2, "Acme-Attr");
+	assert(dv != NULL && strcmp(dv->name, "Slow") == 0);
+	attr = rc_dict_findattr(rh, "Other-Attr");
+	assert(attr != NULL && VENDOR(attr->value) == 8888);
+	rc_dict_free(rh);
+	assert(rc_dict_findattr(rh, "Acme-Attr") == NULL);
+	rc_destroy(rh);
+
+	/* blocks not read yet are released with the handle */
+	rh = rc_new();
+	assert(rh != NULL);
+	assert(rc_read_dictionary_lazy(rh, mainf) == 0);
+	rc_destroy(rh);
+
+	unlink(mainf);
+	unlink(acmef);
+	unlink(otherf);
+	unlink(thirdf);
+	rmdir(dir);
+}
+
+#define SHARED_HANDLES 4
+
+static void *shared_lookups(void *arg)
+{
+	rc_handle *rh = arg;
+	DICT_ATTR *attr;
+	unsigned i;
+
+	for (i = 0; i < 10000; i++) {
+		attr = rc_dict_findattr(rh, "Acme-Attr");
+		assert(attr != NULL && VENDOR(attr->value) == 9999);
+		assert(rc_dict_getattr(rh, 221) != NULL);
+		assert(rc_dict_getval(rh, 1, "Main-Attr") != NULL);
+	}
+	return NULL;
+}
+
+static void test_shared_dictionary(void)
+{
+	char dir[] = "dict-shared-XXXXXX";
+	char mainf[64], acmef[64];
+	rc_handle *rh[SHARED_HANDLES];
+	pthread_t thr[SHARED_HANDLES];
+	rc_dict *dict;
+	DICT_ATTR *attr;
+	unsigned i;
+
+	assert(mkdtemp(dir) != NULL);
+	snprintf(mainf, sizeof(mainf), "%s/dictionary", dir);
+	snprintf(acmef, sizeof(acmef), "%s/dictionary.acme", dir);
+	write_file(mainf, cache_main_dict, "w");
+	write_file(acmef, cache_acme_dict, "w");
+
+	snprintf(acmef, sizeof(acmef), "%s/missing", dir);
+	assert(rc_dict_load(acmef) == NULL);
+
+	dict = rc_dict_load(mainf);
+	assert(dict != NULL);
+
+	for (i = 0; i < SHARED_HANDLES; i++) {
+		rh[i] = rc_new();
+		assert(rh[i] != NULL);
+		rc_dict_attach(rh[i], dict);
+	}
+	/* the handles hold the dictionary now */
+	rc_dict_unref(dict);
+
+	for (i = 0; i < SHARED_HANDLES; i++)
+		assert(pthread_create(&thr[i], NULL, shared_lookups, rh[i]) == 0);
+	for (i = 0; i < SHARED_HANDLES; i++)
+		assert(pthread_join(thr[i], NULL) == 0);
+
+	/* a handle's own entries take precedence, for that handle only */
+	assert(rc_dict_addattr(rh[0], "Main-Attr", 222, PW_TYPE_INTEGER, 0) != NULL);
+	attr = rc_dict_findattr(rh[0], "Main-Attr");
+	assert(attr != NULL && ATTRID(attr->value) == 222);
+	attr = rc_dict_findattr(rh[1], "Main-Attr");
+	assert(attr != NULL && ATTRID(attr->value) == 221);
+
+	rc_dict_free(rh[0]);
+	assert(rc_dict_findattr(rh[0], "Acme-Attr") == NULL);
+	assert(rc_dict_findattr(rh[1], "Acme-Attr") != NULL);
+
+	for (i = 0; i < SHARED_HANDLES; i++)
+		rc_destroy(rh[i]);
+
+	unlink(mainf);
+	snprintf(acmef, sizeof(acmef), "%s/dictionary.acme", dir);
+	unlink(acmef);
+	rmdir(dir);
+}
+
 int main(int argc, char **argv)
 {
 	rc_handle 	*rh = NULL;
@@ -253,6 +561,60 @@ int main(int argc, char **argv)
 
 	rc_dict_free(rh);
 
+	/* Lookups go through hash tables: later definitions win, vendor
+	 * attributes are kept apart, and the tables grow as needed */
+	ret = rc_read_dictionary_from_buffer(rh, redefined_dict, sizeof(redefined_dict));
+	if (ret != 0) {
+		fprintf(stderr, "error in %d\n", __LINE__);
+		exit(1);
+	}
+
+	attr = rc_dict_getattr(rh, 210);
+	assert(attr != NULL && strcmp(attr->name, "New-Name") == 0);
+	assert(attr->type == PW_TYPE_STRING);
+	assert(rc_dict_findattr(rh, "old-name") != NULL);
+
+	attr = rc_dict_findattr(rh, "SAME-NAME");
+	assert(attr != NULL && ATTRID(attr->value) == 212);
+
+	attr = rc_dict_getattr(rh, RADCLI_VENDOR_ATTR_SET(210, 9999));
+	assert(attr != NULL && strcmp(attr->name, "Acme-Attr") == 0);
+	assert(rc_dict_getattr(rh, RADCLI_VENDOR_ATTR_SET(210, 9998)) == NULL);
+
+	dv = rc_dict_getval(rh, 1, "same-name");
+	assert(dv != NULL && strcmp(dv->name, "Uno") == 0);
+	dv = rc_dict_getval(rh, 2, "Same-Name");
+	assert(dv != NULL && strcmp(dv->name, "Two") == 0);
+	assert(rc_dict_getval(rh, 3, "Same-Name") == NULL);
+	assert(rc_dict_getval(rh, 1, "Old-Name") == NULL);
+	dv = rc_dict_findval(rh, "ONE");
+	assert(dv != NULL && dv->value == 1);
+
+	{
+		char name[32];
+		unsigned i;
+
+		for (i = 0; i < 5000; i++) {
+			snprintf(name, sizeof(name), "Bulk-%u", i);
+			assert(rc_dict_addattr(rh, name, i % 256, PW_TYPE_INTEGER,
+					       1000 + i / 256) != NULL);
+			snprintf(name, sizeof(name), "Bulk-Value-%u", i);
+			assert(rc_dict_addval(rh, "Bulk-0", name, i) != NULL);
+		}
+		for (i = 0; i < 5000; i++) {
+			snprintf(name, sizeof(name), "bulk-%u", i);
+			attr = rc_dict_findattr(rh, name);
+			assert(attr != NULL);
+			assert(rc_dict_getattr(rh, RADCLI_VENDOR_ATTR_SET(i % 256, 1000 + i / 256)) == attr);
+			dv = rc_dict_getval(rh, i, "BULK-0");
+			assert(dv != NULL && dv->value == i);
+		}
+	}
+
+	rc_dict_free(rh);
+	assert(rc_dict_findattr(rh, "New-Name") == NULL);
+	assert(rc_dict_getvend(rh, 9999) == NULL);
+
 	/* Malformed numeric fields must be fully validated, not just their
 	 * first character (isdigit(*valstr) let "101abc" through): commit
 	 * 790407f. One case per ATTRIBUTE value / VALUE value / VENDOR PEC. */
@@ -276,6 +638,10 @@ int main(int argc, char **argv)
 
 	rc_destroy(rh);
 
+	test_dictionary_cache();
+	test_shared_dictionary();
+	test_lazy_dictionary();
+
 	return 0;
 
 }
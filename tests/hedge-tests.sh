@@ -0,0 +1,142 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== Hedged request tests ====="
+echo " 1. A slow server's Access-Requests are hedged to the next server"
+echo " 2. Requests answered within hedge-delay-ms are not hedged"
+echo " 3. A reply from the slow server wins over a silent hedge"
+echo "================================"
+
+if ! python3 -c '' 2>/dev/null; then
+	echo "This test requires python3"
+	exit 77
+fi
+
+. ${srcdir}/common.sh
+
+PID=$$
+TMPFILE=tmp$$.out
+LOG1=radius-server1-$PID.log
+LOG2=radius-server2-$PID.log
+LOG3=radius-server3-$PID.log
+SRVPID1=""
+SRVPID2=""
+SRVPID3=""
+
+eval "$GETPORT"; PORT1=$PORT
+eval "$GETPORT"; PORT2=$PORT
+eval "$GETPORT"; PORT3=$PORT
+
+function finish {
+	test -n "${SRVPID1}" && kill ${SRVPID1} >/dev/null 2>&1
+	test -n "${SRVPID2}" && kill ${SRVPID2} >/dev/null 2>&1
+	test -n "${SRVPID3}" && kill ${SRVPID3} >/dev/null 2>&1
+	rm -f $TMPFILE $LOG1 $LOG2 $LOG3
+	rm -f radiusclient-temp$PID.conf
+	rm -f servers-temp$PID
+}
+trap finish EXIT
+
+wait_for_server() {
+	local port="$1"
+	local i
+	for i in 1 2 3 4 5 6 7 8; do
+		check_if_port_in_use ${port} && return 0
+		sleep 0.5
+	done
+	return 1
+}
+
+count_requests() {
+	grep -c "received Access-Request" $1
+}
+
+# server 1 answers after a second, server 2 at once, server 3 never
+python3 ${srcdir}/radius-server.py --port ${PORT1} --secret testing123 --reply-delay 1 >>$LOG1 2>&1 &
+SRVPID1=$!
+python3 ${srcdir}/radius-server.py --port ${PORT2} --secret testing123 >>$LOG2 2>&1 &
+SRVPID2=$!
+python3 ${srcdir}/radius-server.py --port ${PORT3} --secret testing123 --no-reply >>$LOG3 2>&1 &
+SRVPID3=$!
+wait_for_server ${PORT1} || { echo "[ FAIL ] server 1 did not start"; exit 1; }
+wait_for_server ${PORT2} || { echo "[ FAIL ] server 2 did not start"; exit 1; }
+wait_for_server ${PORT3} || { echo "[ FAIL ] server 3 did not start"; exit 1; }
+
+echo "127.0.0.1/127.0.0.1	testing123" >servers-temp$PID
+
+# run_engine <authserver> <hedge-delay-ms>: sends 5 Access-Requests at
+# once, sets ELAPSED (ms); the driver fails unless each completes once
+run_engine() {
+	cat >radiusclient-temp$PID.conf <<EOF2
+nas-identifier my-nas-id
+authserver  $1
+acctserver  127.0.0.1:${PORT2}
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  3
+radius_retries  1
+hedge-delay-ms  $2
+bindaddr    127.0.0.1
+EOF2
+
+	: >$LOG1
+	: >$LOG2
+	: >$LOG3
+	START=$(date +%s%N)
+	${top_builddir}/tests/async-engine -f radiusclient-temp$PID.conf -n 5 >$TMPFILE 2>&1
+	RET=$?
+	ELAPSED=$(( ($(date +%s%N) - START) / 1000000 ))
+	sed 's/^/         | /' $TMPFILE
+}
+
+# 1. hedged after 200 ms, server 2 answers every copy
+run_engine "127.0.0.1:${PORT1},127.0.0.1:${PORT2}" 200
+if test $RET != 0; then
+	echo "[ FAIL ] the hedged requests did not complete once each"
+	exit 1
+fi
+if test "$(count_requests $LOG1)" != 5 || test "$(count_requests $LOG2)" != 5; then
+	echo "[ FAIL ] servers received $(count_requests $LOG1) and $(count_requests $LOG2) requests, expected 5 and 5"
+	exit 1
+fi
+if test $ELAPSED -ge 900; then
+	echo "[ FAIL ] the hedged requests took ${ELAPSED} ms"
+	exit 1
+fi
+echo "[  OK  ] the hedged requests completed in ${ELAPSED} ms"
+
+# 2. server 1 answers before the hedge is due
+run_engine "127.0.0.1:${PORT1},127.0.0.1:${PORT2}" 2000
+if test $RET != 0; then
+	echo "[ FAIL ] the requests did not complete"
+	exit 1
+fi
+if test "$(count_requests $LOG1)" != 5 || test "$(count_requests $LOG2)" != 0; then
+	echo "[ FAIL ] servers received $(count_requests $LOG1) and $(count_requests $LOG2) requests, expected 5 and 0"
+	exit 1
+fi
+echo "[  OK  ] requests answered within hedge-delay-ms were not hedged"
+
+# 3. the hedges go to a silent server; server 1 answers after a second
+run_engine "127.0.0.1:${PORT1},127.0.0.1:${PORT3}" 200
+if test $RET != 0; then
+	echo "[ FAIL ] the requests did not complete once each"
+	exit 1
+fi
+if test "$(count_requests $LOG1)" != 5 || test "$(count_requests $LOG3)" != 5; then
+	echo "[ FAIL ] servers received $(count_requests $LOG1) and $(count_requests $LOG3) requests, expected 5 and 5"
+	exit 1
+fi
+if test $ELAPSED -ge 2500; then
+	echo "[ FAIL ] the requests took ${ELAPSED} ms"
+	exit 1
+fi
+echo "[  OK  ] server 1 answered the hedged requests in ${ELAPSED} ms"
+
+exit 0
@@ -0,0 +1,94 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== Namespace socket reuse tests ====="
+echo " 1. Requests in a namespace reach a server only reachable from it"
+echo " 2. Consecutive requests share the socket created in the namespace"
+echo " 3. The asynchronous engine sends from the namespace too"
+echo "========================================"
+
+if ! python3 -c '' 2>/dev/null; then
+	echo "This test requires python3"
+	exit 77
+fi
+
+if ! which ping >/dev/null 2>&1; then
+	echo "This test requires ping"
+	exit 77
+fi
+
+TMPFILE=tmp$$.out
+LOG1=radius-server-ns-$$.log
+
+CLI_ADDRESS=10.203.7.1
+ADDRESS=10.203.8.1
+PID=$$
+SRVPID1=""
+NO_RADIUSD=1
+
+function finish {
+	test -n "${SRVPID1}" && kill ${SRVPID1} >/dev/null 2>&1
+	rm -f servers-temp$PID
+	rm -f $TMPFILE $LOG1
+	rm -f radiusclient-temp$PID.conf
+}
+
+. ${srcdir}/ns.sh
+
+${CMDNS2} python3 ${srcdir}/radius-server.py --port 1812 --secret testing123 >$LOG1 2>&1 &
+SRVPID1=$!
+for i in 1 2 3 4 5 6 7 8; do
+	grep -q "listening on port" $LOG1 && break
+	sleep 0.5
+done
+grep -q "listening on port" $LOG1 || { echo "[ FAIL ] server did not start"; exit 1; }
+
+echo "${ADDRESS}	testing123" >servers-temp$PID
+cat >radiusclient-temp$PID.conf <<EOF2
+nas-identifier my-nas-id
+authserver  ${ADDRESS}
+acctserver  ${ADDRESS}
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  2
+radius_retries  1
+namespace   ${NSNAME1}
+EOF2
+
+REQ='AUTH\nUser-Name=test\nPassword=test\n\n'
+
+# Test 1 & 2
+printf "$REQ$REQ$REQ" | \
+	${top_builddir}/src/radiusclient -f radiusclient-temp$PID.conf -s >$TMPFILE 2>&1
+if test $(grep -c "^Framed-Protocol *= 'PPP'$" $TMPFILE) != 3; then
+	echo "[ FAIL ] requests in the namespace were not answered"
+	cat $TMPFILE $LOG1
+	exit 1
+fi
+echo "[ PASS ] requests in the namespace were answered"
+
+PORTS=$(grep "received Access-Request" $LOG1 | sed 's/.*://' | sort -u | wc -l)
+if test "$PORTS" != 1; then
+	echo "[ FAIL ] requests came from $PORTS sockets, expected 1"
+	cat $LOG1
+	exit 1
+fi
+echo "[ PASS ] requests shared one socket"
+
+# Test 3
+: >$LOG1
+${top_builddir}/tests/async-engine -f radiusclient-temp$PID.conf -n 5 >$TMPFILE 2>&1
+if ! grep -q "completed=5 failed=0" $TMPFILE; then
+	echo "[ FAIL ] asynchronous requests in the namespace failed"
+	cat $TMPFILE $LOG1
+	exit 1
+fi
+echo "[ PASS ] asynchronous requests were answered"
+
+exit 0
@@ -25,13 +25,29 @@
 # server (freeradius + root + network namespaces) just to exercise the
 # client-side TLS handshake/hostname-verification path (see
 # tls-verify-hostname-tests.sh).
+#
+# --transport tcp speaks RADIUS/TCP (RFC 6613): every connection is logged
+# as it is accepted, all requests read off it in one go are answered with a
+# single write (as a server answering pipelined requests would), and
+# --close-after N closes a connection once N requests were answered on it.
+# --split-replies writes each reply in two parts a little apart, so that the
+# client has to reassemble packets across reads (see tcp-connection-tests.sh).
+#
+# Under --transport tls every connection is served by its own thread and
+# logged as it is accepted; --reply-delay holds each reply back for a while,
+# so that concurrent requests overlap (see tls-sessions-tests.sh). Requests
+# pipelined on a connection are delayed independently of each other.
 
 import argparse
 import hashlib
 import hmac
+import select
+import selectors
 import socket
 import ssl
 import struct
+import threading
+import time
 
 # RADIUS codes
 ACCESS_REQUEST      = 1
@@ -132,13 +148,16 @@ def compute_hmac_md5(packet, secret):
     """HMAC-MD5 over the full packet (MA value must already be zeroed)."""
     return hmac.new(secret.encode(), packet, hashlib.md5).digest()
 
-def handle_packet(data, secret, msg_auth_mode, attrs_mode='normal', no_reply=False):
+def handle_packet(data, secret, msg_auth_mode, attrs_mode='normal', no_reply=False,
+                  peer=None):
     """
     Parse an Access-Request or Accounting-Request and build the matching
     reply. Returns the response bytes, or None if the packet's code is not
     recognized or --no-reply was requested (the packet is still logged as
     received either way -- see the print() below -- it is simply not
     answered, e.g. to test a non-blocking/fire-and-forget client path).
+    peer is the client's (address, port), logged so that a test can tell
+    which client socket a request came from.
     """
     if len(data) < 20:
         return None
@@ -150,7 +169,8 @@ def handle_packet(data, secret, msg_auth_mode, attrs_mode='normal', no_reply=Fal
         return None
 
     code_name = 'Access-Request' if code == ACCESS_REQUEST else 'Accounting-Request'
-    print(f"radius-server: received {code_name} id={ident}", flush=True)
+    source = f" from {peer[0]}:{peer[1]}" if peer is not None else ""
+    print(f"radius-server: received {code_name} id={ident}{source}", flush=True)
 
     if no_reply:
         return None
@@ -206,44 +226,139 @@ def handle_packet(data, secret, msg_auth_mode, attrs_mode='normal', no_reply=Fal
 
     return packet
 
-def run(port, secret, msg_auth_mode, attrs_mode='normal', no_reply=False):
+def run(port, secret, msg_auth_mode, attrs_mode='normal', no_reply=False,
+        drop_every=0, reply_delay=0.0, bad_authenticator=0, forged_first=0):
     sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
     sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    # Room for a full batch window of requests (rc_acct_batch() keeps 1024
+    # in flight) while this process waits for the CPU.
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 * 1024 * 1024)
     sock.bind(('0.0.0.0', port))
     print(f"radius-server: listening on port {port}, msg-auth={msg_auth_mode}, "
-          f"attrs={attrs_mode}, no-reply={no_reply}", flush=True)
+          f"attrs={attrs_mode}, no-reply={no_reply}, drop-every={drop_every}, "
+          f"reply-delay={reply_delay}, bad-authenticator={bad_authenticator}, "
+          f"forged-first={forged_first}",
+          flush=True)
 
+    received = 0
+    replied = 0
+    # replies held back by reply_delay, due in the order they were queued
+    due = []
     while True:
-        data, addr = sock.recvfrom(4096)
-        response = handle_packet(data, secret, msg_auth_mode, attrs_mode, no_reply)
+        while due and due[0][0] <= time.monotonic():
+            _, response, peer = due.pop(0)
+            sock.sendto(response, peer)
+        sock.settimeout(max(due[0][0] - time.monotonic(), 0.001) if due else None)
+        try:
+            data, addr = sock.recvfrom(4096)
+        except socket.timeout:
+            continue
+        received += 1
+        response = handle_packet(data, secret, msg_auth_mode, attrs_mode, no_reply, addr)
+        if response is not None and drop_every and received % drop_every == 0:
+            print("radius-server: dropping reply", flush=True)
+            continue
+        if response is not None and replied < bad_authenticator:
+            # flip a bit of the Response Authenticator
+            print("radius-server: sending reply with a bad authenticator", flush=True)
+            response = response[:4] + bytes([response[4] ^ 1]) + response[5:]
+        if response is not None and replied < forged_first:
+            # a reply with the right ID that fails verification, as a
+            # late or spoofed one would, goes out before the real one
+            print("radius-server: sending a forged reply first", flush=True)
+            sock.sendto(response[:4] + bytes([response[4] ^ 1]) + response[5:], addr)
         if response is not None:
+            replied += 1
+        if response is not None and reply_delay:
+            due.append((time.monotonic() + reply_delay, response, addr))
+        elif response is not None:
             sock.sendto(response, addr)
 
-def recv_exact(conn, n):
-    """Read exactly n bytes from a stream socket, or return None on EOF."""
-    buf = b''
-    while len(buf) < n:
-        chunk = conn.recv(n - len(buf))
-        if not chunk:
-            return None
-        buf += chunk
-    return buf
-
-def recv_radius_packet(conn):
-    """Read one RADIUS PDU from a stream socket, framed by its own header
-    Length field (RFC 6614 uses no additional TCP-level framing)."""
-    header = recv_exact(conn, 4)
-    if header is None:
-        return None
-    (pkt_len,) = struct.unpack('!H', header[2:4])
-    if pkt_len < 20:
-        return None
-    rest = recv_exact(conn, pkt_len - 4)
-    if rest is None:
-        return None
-    return header + rest
+def run_tcp(port, secret, msg_auth_mode, attrs_mode='normal', close_after=0,
+            split_replies=False):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('0.0.0.0', port))
+    sock.listen(16)
+    print(f"radius-server: listening (TCP) on port {port}, msg-auth={msg_auth_mode}, "
+          f"attrs={attrs_mode}, close-after={close_after}, split-replies={split_replies}",
+          flush=True)
 
-def run_tls(port, secret, msg_auth_mode, tls_cert, tls_key, attrs_mode='normal'):
+    sel = selectors.DefaultSelector()
+    sel.register(sock, selectors.EVENT_READ)
+    # per connection: [peer, unparsed bytes, requests answered, closing]
+    conns = {}
+
+    def drop(conn):
+        sel.unregister(conn)
+        del conns[conn]
+        conn.close()
+
+    while True:
+        for key, _ in sel.select():
+            if key.fileobj is sock:
+                conn, addr = sock.accept()
+                print(f"radius-server: accepted connection from {addr[0]}:{addr[1]}",
+                      flush=True)
+                conns[conn] = [addr, b'', 0, False]
+                sel.register(conn, selectors.EVENT_READ)
+                continue
+
+            conn = key.fileobj
+            state = conns[conn]
+            try:
+                chunk = conn.recv(65536)
+            except OSError:
+                chunk = b''
+            if not chunk:
+                drop(conn)
+                continue
+            if state[3]:
+                # Requests after --close-after are discarded until the
+                # client closes too: closing with unread data would reset
+                # the connection and could destroy replies not yet read.
+                continue
+
+            state[1] += chunk
+            replies = []
+            closing = False
+            while len(state[1]) >= 4:
+                (pkt_len,) = struct.unpack('!H', state[1][2:4])
+                if pkt_len < 20 or pkt_len > 4096:
+                    closing = True
+                    break
+                if len(state[1]) < pkt_len:
+                    break
+                data, state[1] = state[1][:pkt_len], state[1][pkt_len:]
+                response = handle_packet(data, secret, msg_auth_mode, attrs_mode,
+                                         peer=state[0])
+                if response is not None:
+                    replies.append(response)
+                state[2] += 1
+                if close_after and state[2] >= close_after:
+                    closing = True
+                    break
+
+            try:
+                if split_replies:
+                    for response in replies:
+                        conn.sendall(response[:3])
+                        time.sleep(0.01)
+                        conn.sendall(response[3:])
+                elif replies:
+                    conn.sendall(b''.join(replies))
+            except OSError:
+                closing = True
+
+            if closing:
+                state[3] = True
+                try:
+                    conn.shutdown(socket.SHUT_WR)
+                except OSError:
+                    drop(conn)
+
+def run_tls(port, secret, msg_auth_mode, tls_cert, tls_key, attrs_mode='normal',
+            reply_delay=0.0):
     ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
     ctx.load_cert_chain(certfile=tls_cert, keyfile=tls_key)
     # This server only exercises the client's verification of the server's
@@ -254,34 +369,76 @@ def run_tls(port, secret, msg_auth_mode, tls_cert, tls_key, attrs_mode='normal')
     sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
     sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
     sock.bind(('0.0.0.0', port))
-    sock.listen(5)
+    sock.listen(16)
     print(f"radius-server: listening (TLS) on port {port}, msg-auth={msg_auth_mode}, attrs={attrs_mode}",
           flush=True)
 
-    while True:
-        conn, addr = sock.accept()
+    def serve(conn, addr):
         try:
             with ctx.wrap_socket(conn, server_side=True) as tls_conn:
-                while True:
-                    data = recv_radius_packet(tls_conn)
-                    if data is None:
-                        break
-                    response = handle_packet(data, secret, msg_auth_mode, attrs_mode)
-                    if response is not None:
-                        tls_conn.sendall(response)
+                if tls_conn.session_reused:
+                    print(f"radius-server: resumed TLS session from {addr[0]}:{addr[1]}",
+                          flush=True)
+                # Requests are read as they arrive and each is answered
+                # reply_delay after it was read, in a record of its own, so
+                # that requests pipelined on the connection are answered
+                # concurrently rather than one after the other.
+                tls_conn.setblocking(False)
+                buf = b''
+                due = []
+                eof = False
+                while not eof or due:
+                    now = time.monotonic()
+                    while due and due[0][0] <= now:
+                        tls_conn.setblocking(True)
+                        tls_conn.sendall(due.pop(0)[1])
+                        tls_conn.setblocking(False)
+                    if eof:
+                        time.sleep(max(0.0, due[0][0] - now) if due else 0)
+                        continue
+                    if not tls_conn.pending():
+                        wait = max(0.0, due[0][0] - now) if due else None
+                        if not select.select([tls_conn], [], [], wait)[0]:
+                            continue
+                    try:
+                        chunk = tls_conn.recv(65536)
+                    except (ssl.SSLWantReadError, ssl.SSLWantWriteError):
+                        continue
+                    if not chunk:
+                        eof = True
+                        continue
+                    buf += chunk
+                    while len(buf) >= 4:
+                        plen = struct.unpack('!H', buf[2:4])[0]
+                        if plen < 20:
+                            eof = True
+                            break
+                        if len(buf) < plen:
+                            break
+                        data, buf = buf[:plen], buf[plen:]
+                        response = handle_packet(data, secret, msg_auth_mode,
+                                                 attrs_mode, peer=addr)
+                        if response is not None:
+                            due.append((time.monotonic() + reply_delay, response))
         except (ssl.SSLError, OSError) as e:
             # Expected outcome of the hostname-mismatch tests: the client
             # aborts the handshake. Depending on how the client tears down
             # the connection this surfaces either as an SSLError (a TLS
             # alert was sent) or a plain OSError such as
             # ConnectionResetError (the client just dropped the TCP
-            # connection) -- either way it must not take the accept loop
-            # down with it, or every later connection would see
-            # "Connection refused" instead of a fresh handshake attempt.
+            # connection) -- either way it must only end this connection,
+            # not the server.
             print(f"radius-server: connection with {addr} failed: {e}", flush=True)
         finally:
             conn.close()
 
+    # Every connection is served by a thread of its own, so that a client
+    # keeping several sessions open gets answers on all of them.
+    while True:
+        conn, addr = sock.accept()
+        print(f"radius-server: accepted connection from {addr[0]}:{addr[1]}", flush=True)
+        threading.Thread(target=serve, args=(conn, addr), daemon=True).start()
+
 def main():
     parser = argparse.ArgumentParser(
         description='Minimal RADIUS server for Message-Authenticator testing')
@@ -295,23 +452,58 @@ def main():
                                  'malformed-overflow', 'unknown-attrs', 'int-badlen',
                                  'vsa-unknown-subattrs'],
                         default='normal')
-    parser.add_argument('--transport', choices=['udp', 'tls'], default='udp')
+    parser.add_argument('--transport', choices=['udp', 'tcp', 'tls'], default='udp')
     parser.add_argument('--tls-cert', help='PEM certificate file (required for --transport tls)')
     parser.add_argument('--tls-key', help='PEM private key file (required for --transport tls)')
     parser.add_argument('--no-reply', action='store_true',
                         help='Log each received Access-/Accounting-Request but send no response '
                              '(models a slow/unresponsive accounting server for testing a '
                              'non-blocking client path). UDP transport only.')
+    parser.add_argument('--drop-every', dest='drop_every', type=int, default=0,
+                        help='Answer every request but the Nth, 2Nth, ... received, to '
+                             'model packet loss. UDP transport only.')
+    parser.add_argument('--bad-authenticator', dest='bad_authenticator', type=int,
+                        default=0,
+                        help='Send the first N replies with a Response Authenticator '
+                             'that does not verify. UDP transport only.')
+    parser.add_argument('--forged-first', dest='forged_first', type=int, default=0,
+                        help='Precede the first N replies with a copy whose Response '
+                             'Authenticator does not verify. UDP transport only.')
+    parser.add_argument('--close-after', dest='close_after', type=int, default=0,
+                        help='Close each connection after answering this many requests. '
+                             'TCP transport only.')
+    parser.add_argument('--split-replies', dest='split_replies', action='store_true',
+                        help='Write every reply in two parts. TCP transport only.')
+    parser.add_argument('--reply-delay', dest='reply_delay', type=float, default=0.0,
+                        help='Wait this many seconds before answering each request. '
+                             'UDP and TLS transports only.')
     args = parser.parse_args()
 
+    if args.transport != 'tcp' and (args.close_after or args.split_replies):
+        parser.error('--close-after and --split-replies are only supported with '
+                     '--transport tcp')
+    if args.transport != 'udp' and (args.drop_every or args.bad_authenticator or
+                                    args.forged_first):
+        parser.error('--drop-every, --bad-authenticator and --forged-first are only '
+                     'supported with --transport udp')
+    if args.transport == 'tcp' and args.reply_delay:
+        parser.error('--reply-delay is only supported with --transport udp or tls')
+
     if args.transport == 'tls':
         if not args.tls_cert or not args.tls_key:
             parser.error('--transport tls requires --tls-cert and --tls-key')
         if args.no_reply:
             parser.error('--no-reply is only supported with --transport udp')
-        run_tls(args.port, args.secret, args.msg_auth, args.tls_cert, args.tls_key, args.attrs)
+        run_tls(args.port, args.secret, args.msg_auth, args.tls_cert, args.tls_key, args.attrs,
+                args.reply_delay)
+    elif args.transport == 'tcp':
+        if args.no_reply:
+            parser.error('--no-reply is only supported with --transport udp')
+        run_tcp(args.port, args.secret, args.msg_auth, args.attrs, args.close_after,
+                args.split_replies)
     else:
-        run(args.port, args.secret, args.msg_auth, args.attrs, args.no_reply)
+        run(args.port, args.secret, args.msg_auth, args.attrs, args.no_reply,
+            args.drop_every, args.reply_delay, args.bad_authenticator, args.forged_first)
 
 if __name__ == '__main__':
     main()
@@ -0,0 +1,227 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== RADIUS/TCP connection tests ====="
+echo " 1. Consecutive requests on one handle share one connection"
+echo " 2. A connection closed by the server is replaced"
+echo " 3. Replies split across reads are reassembled"
+echo " 4. Engine requests are pipelined on one connection"
+echo " 5. Coalesced and split replies are taken off the stream"
+echo " 6. Requests on a connection the server closes are resent"
+echo " 7. An application poll() loop can drive pipelined requests"
+echo " 8. An idle connection the server closed is replaced, not reused"
+echo "======================================="
+
+if ! python3 -c '' 2>/dev/null; then
+	echo "This test requires python3"
+	exit 77
+fi
+
+. ${srcdir}/common.sh
+
+PID=$$
+TMPFILE=tmp$$.out
+LOG1=radius-server1-$PID.log
+LOG2=radius-server2-$PID.log
+LOG3=radius-server3-$PID.log
+SRVPID1=""
+SRVPID2=""
+SRVPID3=""
+
+eval "$GETPORT"; PORT1=$PORT
+eval "$GETPORT"; PORT2=$PORT
+eval "$GETPORT"; PORT3=$PORT
+
+function finish {
+	test -n "${SRVPID1}" && kill ${SRVPID1} >/dev/null 2>&1
+	test -n "${SRVPID2}" && kill ${SRVPID2} >/dev/null 2>&1
+	test -n "${SRVPID3}" && kill ${SRVPID3} >/dev/null 2>&1
+	rm -f $TMPFILE $LOG1 $LOG2 $LOG3
+	rm -f radiusclient-temp$PID.conf
+	rm -f servers-temp$PID
+}
+trap finish EXIT
+
+wait_for_server() {
+	local port="$1"
+	local i
+	for i in 1 2 3 4 5 6 7 8; do
+		check_if_port_in_use ${port} && return 0
+		sleep 0.5
+	done
+	return 1
+}
+
+# write_config <port> <retries>
+write_config() {
+	cat >radiusclient-temp$PID.conf <<EOF2
+nas-identifier my-nas-id
+authserver  127.0.0.1:$1
+acctserver  127.0.0.1:$1
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  2
+radius_retries  $2
+bindaddr    127.0.0.1
+serv-type   tcp
+EOF2
+}
+
+# run_client <server log to reset>: two authentication requests and one
+# accounting request through the same handle
+run_client() {
+	: >$1
+	printf 'AUTH\nUser-Name=test\nPassword=test\n\nAUTH\nUser-Name=test\nPassword=test\n\nACCT\nUser-Name=test\nAcct-Status-Type=Start\n\n' | \
+		${top_builddir}/src/radiusclient -f radiusclient-temp$PID.conf -s >$TMPFILE 2>&1
+	RET=$?
+	sed 's/^/         | /' $TMPFILE
+	if test $RET != 0 || test "$(grep -c '^0$' $TMPFILE)" != 3; then
+		RET=1
+	fi
+}
+
+# run_engine <server log to reset> <args...>
+run_engine() {
+	local log="$1"
+	shift
+	: >$log
+	${top_builddir}/tests/async-engine -f radiusclient-temp$PID.conf "$@" >$TMPFILE 2>&1
+	RET=$?
+	sed 's/^/         | /' $TMPFILE
+}
+
+connections() {
+	grep -c "accepted connection" $1
+}
+
+# ids <log>: distinct identifiers seen by a server
+ids() {
+	sed -n 's/.*received [A-Za-z-]* id=\([0-9]*\) from .*/\1/p' $1 | sort -u | wc -l
+}
+
+# The servers append to their logs, so truncating one between runs is safe.
+python3 ${srcdir}/radius-server.py --transport tcp --port ${PORT1} --secret testing123 >>$LOG1 2>&1 &
+SRVPID1=$!
+python3 ${srcdir}/radius-server.py --transport tcp --port ${PORT2} --secret testing123 --close-after 1 >>$LOG2 2>&1 &
+SRVPID2=$!
+python3 ${srcdir}/radius-server.py --transport tcp --port ${PORT3} --secret testing123 --split-replies >>$LOG3 2>&1 &
+SRVPID3=$!
+wait_for_server ${PORT1} || { echo "[ FAIL ] server 1 did not start"; exit 1; }
+wait_for_server ${PORT2} || { echo "[ FAIL ] server 2 did not start"; exit 1; }
+wait_for_server ${PORT3} || { echo "[ FAIL ] server 3 did not start"; exit 1; }
+
+echo "127.0.0.1/127.0.0.1	testing123" >servers-temp$PID
+
+# 1. Connection reuse
+write_config ${PORT1} 1
+run_client $LOG1
+if test $RET != 0; then
+	echo "[ FAIL ] not every request succeeded"
+	exit 1
+fi
+if test "$(connections $LOG1)" != 1; then
+	echo "[ FAIL ] expected one connection, got $(connections $LOG1)"
+	cat $LOG1
+	exit 1
+fi
+echo "[  OK  ] three requests shared one connection"
+
+# 2. Reconnect
+write_config ${PORT2} 1
+run_client $LOG2
+if test $RET != 0; then
+	echo "[ FAIL ] requests failed after the server closed the connection"
+	cat $LOG2
+	exit 1
+fi
+if test "$(connections $LOG2)" != 3; then
+	echo "[ FAIL ] expected three connections, got $(connections $LOG2)"
+	cat $LOG2
+	exit 1
+fi
+echo "[  OK  ] closed connections were replaced"
+
+# 3. Reassembly in the blocking path
+write_config ${PORT3} 1
+run_client $LOG3
+if test $RET != 0; then
+	echo "[ FAIL ] split replies were not reassembled"
+	exit 1
+fi
+echo "[  OK  ] split replies were reassembled"
+
+# 4. Pipelining
+write_config ${PORT1} 1
+run_engine $LOG1 -n 200
+if test $RET != 0; then
+	echo "[ FAIL ] 200 pipelined requests did not all succeed"
+	exit 1
+fi
+if test "$(connections $LOG1)" != 1 || test "$(ids $LOG1)" != 200; then
+	echo "[ FAIL ] expected 200 identifiers on one connection, got $(ids $LOG1) on $(connections $LOG1)"
+	exit 1
+fi
+echo "[  OK  ] 200 requests were pipelined on one connection"
+
+# 5. Stream reassembly in the engine
+write_config ${PORT3} 1
+run_engine $LOG3 -n 50 -a
+if test $RET != 0; then
+	echo "[ FAIL ] split replies were not taken off the stream"
+	exit 1
+fi
+echo "[  OK  ] split replies were taken off the stream"
+
+# 6. Resending after the connection is lost; every connection answers
+# one request, so each resend round completes one of them
+write_config ${PORT2} 3
+run_engine $LOG2 -n 4
+if test $RET != 0; then
+	echo "[ FAIL ] requests were not resent on a new connection"
+	cat $LOG2
+	exit 1
+fi
+if test "$(connections $LOG2)" != 4; then
+	echo "[ FAIL ] expected four connections, got $(connections $LOG2)"
+	cat $LOG2
+	exit 1
+fi
+echo "[  OK  ] requests were resent on new connections"
+
+# 7. The engine driven by the test program's own poll() loop, which
+# waits for writability where rc_aaa_fds() asks for it
+write_config ${PORT1} 1
+run_engine $LOG1 -n 200 -l
+if test $RET != 0; then
+	echo "[ FAIL ] 200 requests did not all succeed from an application loop"
+	exit 1
+fi
+if test "$(connections $LOG1)" != 1; then
+	echo "[ FAIL ] expected one connection, got $(connections $LOG1)"
+	exit 1
+fi
+echo "[  OK  ] an application loop drove 200 pipelined requests"
+
+# 8. The server closes the connection after its reply, while the engine
+# holds it idle; the second request must go out on a new connection
+write_config ${PORT2} 1
+run_engine $LOG2 -n 1 -w 1
+if test $RET != 0; then
+	echo "[ FAIL ] the request after the idle connection was closed failed"
+	cat $LOG2
+	exit 1
+fi
+if test "$(connections $LOG2)" != 2 || test "$(grep -c 'received' $LOG2)" != 2; then
+	echo "[ FAIL ] expected two requests on two connections"
+	cat $LOG2
+	exit 1
+fi
+echo "[  OK  ] a closed idle connection was replaced"
+
+exit 0
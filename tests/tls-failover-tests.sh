@@ -0,0 +1,139 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== TLS multi-server failover tests ====="
+echo " 1. Requests go to the first authserver while it is up"
+echo " 2. Requests fail over to the warm session of the second one"
+echo "==========================================="
+
+if ! python3 -c 'import ssl' 2>/dev/null; then
+	echo "This test requires python3 with the ssl module"
+	exit 77
+fi
+
+. ${srcdir}/common.sh
+
+PID=$$
+TMPFILE=tmp$$.out
+LOG1=radius-server1-$PID.log
+LOG2=radius-server2-$PID.log
+STATEDIR=$(mktemp -d /tmp/tls-failover-XXXXXX)
+PID1=""
+PID2=""
+TESTPID=""
+
+eval "$GETPORT"
+PORT1=$PORT
+eval "$GETPORT"
+PORT2=$PORT
+if test "$PORT1" = "$PORT2"; then
+	PORT2=$((PORT1 + 1))
+fi
+
+function finish {
+	test -n "${PID1}" && kill ${PID1} >/dev/null 2>&1
+	test -n "${PID2}" && kill ${PID2} >/dev/null 2>&1
+	test -n "${TESTPID}" && kill ${TESTPID} >/dev/null 2>&1
+	rm -f $TMPFILE $LOG1 $LOG2
+	rm -f radiusclient-temp$PID.conf
+	rm -f servers-temp$PID
+	rm -rf "$STATEDIR"
+}
+trap finish EXIT
+
+wait_for_port_up() {
+	local i
+	for i in 1 2 3 4 5 6 7 8; do
+		check_if_port_in_use $1 && return 0
+		sleep 0.5
+	done
+	return 1
+}
+
+wait_for_state() {
+	local i
+	for i in $(seq 1 30); do
+		test -f "$STATEDIR/$1" && return 0
+		sleep 1
+	done
+	return 1
+}
+
+# start_server <port> <log>
+start_server() {
+	python3 ${srcdir}/radius-server.py \
+		--transport tls --port $1 --secret radsec \
+		--tls-cert ${srcdir}/raddb/cert-rsa.pem --tls-key ${srcdir}/raddb/key-rsa.pem \
+		>>$2 2>&1 &
+	wait_for_port_up $1 || { echo "[ FAIL ] server did not start"; exit 1; }
+}
+
+cat >radiusclient-temp$PID.conf <<EOF2
+serv-type tls
+tls-ca-file ${srcdir}/dtls/ca.pem
+tls-verify-hostname false
+tls-warm-sessions 1
+nas-identifier my-nas-id
+authserver  127.0.0.1:${PORT1}
+authserver  127.0.0.1:${PORT2}
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  5
+radius_retries  1
+bindaddr    *
+EOF2
+
+echo "127.0.0.1	testing123" >servers-temp$PID
+
+start_server ${PORT1} $LOG1
+PID1=$!
+start_server ${PORT2} $LOG2
+PID2=$!
+
+# 1. Both servers are connected up front; the first one answers.
+${top_builddir}/tests/tls-sessions -f radiusclient-temp$PID.conf -t 1 -n 3 >$TMPFILE 2>&1
+RET=$?
+sed 's/^/         | /' $TMPFILE
+REQS1=$(grep -c "received Access-Request" $LOG1)
+REQS2=$(grep -c "received Access-Request" $LOG2)
+CONNS2=$(grep -c "accepted connection" $LOG2)
+if test $RET != 0 || test "$REQS1" != 3 || test "$REQS2" != 0 || test "$CONNS2" != 1; then
+	echo "[ FAIL ] expected 3 requests to the first server and a warm session to the second"
+	exit 1
+fi
+echo "[  OK  ] the first server answered; the second had a warm session"
+
+# 2. The first server goes away while the client runs; its requests move
+# to the session to the second server that was connected up front.
+: >$LOG1
+: >$LOG2
+${top_builddir}/tests/tls-idle-restart -f radiusclient-temp$PID.conf -S "$STATEDIR" \
+	User-Name=test Password=test >$TMPFILE 2>&1 &
+TESTPID=$!
+wait_for_state ready_to_kill || { echo "[ FAIL ] client did not connect"; exit 1; }
+kill ${PID1}
+wait ${PID1} 2>/dev/null
+PID1=""
+touch "$STATEDIR/server_killed"
+wait_for_state restart_server || { echo "[ FAIL ] client did not fail over"; exit 1; }
+touch "$STATEDIR/server_up"
+wait ${TESTPID}
+RET=$?
+TESTPID=""
+sed 's/^/         | /' $TMPFILE
+REQS2=$(grep -c "received Access-Request" $LOG2)
+CONNS2=$(grep -c "accepted connection" $LOG2)
+if test $RET != 0 || test "$REQS2" != 3 || test "$CONNS2" != 1; then
+	echo "[ FAIL ] expected 3 requests over the warm session to the second server, got $REQS2 over $CONNS2 connections"
+	exit 1
+fi
+echo "[  OK  ] requests failed over to the warm session"
+
+echo ""
+exit 0
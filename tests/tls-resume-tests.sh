@@ -0,0 +1,132 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== TLS session resumption tests ====="
+echo " 1. A restarted session resumes the previous one"
+echo " 2. A server that lost the session gets a full handshake"
+echo "========================================"
+
+if ! python3 -c 'import ssl' 2>/dev/null; then
+	echo "This test requires python3 with the ssl module"
+	exit 77
+fi
+
+. ${srcdir}/common.sh
+
+PID=$$
+TMPFILE=tmp$$.out
+LOG=radius-server-$PID.log
+STATEDIR=$(mktemp -d /tmp/tls-resume-XXXXXX)
+RADIUSPID=""
+TESTPID=""
+
+eval "$GETPORT"
+
+function finish {
+	test -n "${RADIUSPID}" && kill ${RADIUSPID} >/dev/null 2>&1
+	test -n "${TESTPID}" && kill ${TESTPID} >/dev/null 2>&1
+	rm -f $TMPFILE $LOG
+	rm -f radiusclient-temp$PID.conf
+	rm -f servers-temp$PID
+	rm -rf "$STATEDIR"
+}
+trap finish EXIT
+
+wait_for_server() {
+	local i
+	for i in 1 2 3 4 5 6 7 8; do
+		check_if_port_in_use ${PORT} && return 0
+		sleep 0.5
+	done
+	return 1
+}
+
+wait_for_state() {
+	local i
+	for i in $(seq 1 30); do
+		test -f "$STATEDIR/$1" && return 0
+		sleep 1
+	done
+	return 1
+}
+
+start_server() {
+	: >$LOG
+	python3 ${srcdir}/radius-server.py \
+		--transport tls --port ${PORT} --secret radsec \
+		--tls-cert ${srcdir}/raddb/cert-rsa.pem --tls-key ${srcdir}/raddb/key-rsa.pem \
+		>>$LOG 2>&1 &
+	RADIUSPID=$!
+	wait_for_server || { echo "[ FAIL ] server did not start"; exit 1; }
+}
+
+stop_server() {
+	kill ${RADIUSPID}
+	wait ${RADIUSPID} 2>/dev/null
+	RADIUSPID=""
+}
+
+cat >radiusclient-temp$PID.conf <<EOF2
+serv-type tls
+tls-ca-file ${srcdir}/dtls/ca.pem
+tls-verify-hostname false
+nas-identifier my-nas-id
+authserver  127.0.0.1:${PORT}
+acctserver  127.0.0.1:${PORT}
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  5
+radius_retries  1
+bindaddr    *
+EOF2
+
+echo "127.0.0.1	testing123" >servers-temp$PID
+
+# 1. tls-restart breaks the session after one request; the reconnect
+# must resume it rather than perform a full handshake.
+start_server
+${top_builddir}/tests/tls-restart -f radiusclient-temp$PID.conf \
+	User-Name=test Password=test >$TMPFILE 2>&1
+RET=$?
+sed 's/^/         | /' $TMPFILE
+CONNS=$(grep -c "accepted connection" $LOG)
+RESUMED=$(grep -c "resumed TLS session" $LOG)
+if test $RET != 0 || test "$CONNS" != 2 || test "$RESUMED" != 1; then
+	echo "[ FAIL ] expected 2 connections, the second resumed; got $CONNS connections, $RESUMED resumed"
+	exit 1
+fi
+echo "[  OK  ] the reconnect resumed the session"
+stop_server
+
+# 2. A restarted server no longer knows the session; the client must
+# fall back to a full handshake and still get its request through.
+start_server
+${top_builddir}/tests/tls-idle-restart -f radiusclient-temp$PID.conf -S "$STATEDIR" \
+	User-Name=test Password=test >$TMPFILE 2>&1 &
+TESTPID=$!
+wait_for_state ready_to_kill || { echo "[ FAIL ] client did not connect"; exit 1; }
+stop_server
+touch "$STATEDIR/server_killed"
+wait_for_state restart_server || { echo "[ FAIL ] client did not reconnect"; exit 1; }
+start_server
+touch "$STATEDIR/server_up"
+wait ${TESTPID}
+RET=$?
+TESTPID=""
+sed 's/^/         | /' $TMPFILE
+CONNS=$(grep -c "accepted connection" $LOG)
+RESUMED=$(grep -c "resumed TLS session" $LOG)
+if test $RET != 0 || test "$CONNS" != 1 || test "$RESUMED" != 0; then
+	echo "[ FAIL ] expected a full handshake; got $CONNS connections, $RESUMED resumed"
+	exit 1
+fi
+echo "[  OK  ] a server that lost the session got a full handshake"
+
+echo ""
+exit 0
@@ -0,0 +1,155 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== Concurrent TLS session tests ====="
+echo " 1. Threads sharing a handle use a single session by default"
+echo " 2. tls-sessions lets concurrent requests use several sessions"
+echo " 3. Sessions are only opened when requests overlap"
+echo " 4. Concurrent requests are pipelined on a single session"
+echo " 5. tls-warm-sessions connects sessions before the first request"
+echo " 6. Requests move to a warm session when theirs breaks"
+echo "========================================"
+
+if ! python3 -c 'import ssl' 2>/dev/null; then
+	echo "This test requires python3 with the ssl module"
+	exit 77
+fi
+
+. ${srcdir}/common.sh
+
+PID=$$
+TMPFILE=tmp$$.out
+LOG=radius-server-$PID.log
+RADIUSPID=""
+
+eval "$GETPORT"
+
+function finish {
+	test -n "${RADIUSPID}" && kill ${RADIUSPID} >/dev/null 2>&1
+	rm -f $TMPFILE $LOG
+	rm -f radiusclient-temp$PID.conf
+	rm -f servers-temp$PID
+}
+trap finish EXIT
+
+wait_for_server() {
+	local i
+	for i in 1 2 3 4 5 6 7 8; do
+		check_if_port_in_use ${PORT} && return 0
+		sleep 0.5
+	done
+	return 1
+}
+
+# write_config [extra option line]
+write_config() {
+	cat >radiusclient-temp$PID.conf <<EOF2
+serv-type tls
+tls-ca-file ${srcdir}/dtls/ca.pem
+tls-verify-hostname false
+nas-identifier my-nas-id
+authserver  127.0.0.1:${PORT}
+acctserver  127.0.0.1:${PORT}
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  5
+radius_retries  1
+bindaddr    *
+$1
+EOF2
+}
+
+# run_sessions <args...>
+run_sessions() {
+	: >$LOG
+	${top_builddir}/tests/tls-sessions -f radiusclient-temp$PID.conf "$@" >$TMPFILE 2>&1
+	RET=$?
+	sed 's/^/         | /' $TMPFILE
+	CONNS=$(grep -c "accepted connection" $LOG)
+}
+
+echo "127.0.0.1	testing123" >servers-temp$PID
+
+# Each reply is held back, so that requests from different threads overlap.
+python3 ${srcdir}/radius-server.py \
+	--transport tls --port ${PORT} --secret radsec --reply-delay 0.1 \
+	--tls-cert ${srcdir}/raddb/cert-rsa.pem --tls-key ${srcdir}/raddb/key-rsa.pem \
+	>>$LOG 2>&1 &
+RADIUSPID=$!
+wait_for_server || { echo "[ FAIL ] server did not start"; exit 1; }
+
+# 1. Default: one session, shared by all threads in turn
+write_config
+run_sessions -t 4 -n 5
+if test $RET != 0 || test "$CONNS" != 1; then
+	echo "[ FAIL ] expected 20 requests over 1 connection, got $CONNS connections"
+	exit 1
+fi
+echo "[  OK  ] 4 threads shared the single default session"
+
+# 2. Up to tls-sessions sessions are used concurrently
+write_config "tls-sessions 4"
+run_sessions -t 8 -n 5
+if test $RET != 0 || test "$CONNS" != 4; then
+	echo "[ FAIL ] expected 40 requests over 4 connections, got $CONNS connections"
+	exit 1
+fi
+echo "[  OK  ] 8 threads spread their requests over 4 sessions"
+
+# 3. A single thread never has overlapping requests
+run_sessions -t 1 -n 10
+if test $RET != 0 || test "$CONNS" != 1; then
+	echo "[ FAIL ] expected 10 requests over 1 connection, got $CONNS connections"
+	exit 1
+fi
+echo "[  OK  ] sequential requests reused one session"
+
+# 4. Requests from all threads are in flight on the one session together:
+# 40 requests answered 0.1s after arrival take well below the 4s it would
+# take to send them one after the other.
+write_config
+START=$(date +%s%N)
+run_sessions -t 8 -n 5
+ELAPSED=$(( ($(date +%s%N) - START) / 1000000 ))
+if test $RET != 0 || test "$CONNS" != 1; then
+	echo "[ FAIL ] expected 40 requests over 1 connection, got $CONNS connections"
+	exit 1
+fi
+if test $ELAPSED -ge 2000; then
+	echo "[ FAIL ] 40 pipelined requests took ${ELAPSED}ms"
+	exit 1
+fi
+echo "[  OK  ] 8 threads pipelined their requests on one session (${ELAPSED}ms)"
+
+# 5. Warm sessions are connected when the configuration is loaded
+write_config "$(printf 'tls-sessions 2\ntls-warm-sessions 2')"
+run_sessions -t 1 -n 1
+if test $RET != 0 || test "$CONNS" != 2 || test "$(head -n 2 $LOG | grep -c 'accepted connection')" != 2; then
+	echo "[ FAIL ] expected 2 connections before the first request, got $CONNS connections"
+	sed 's/^/         | /' $LOG
+	exit 1
+fi
+echo "[  OK  ] both warm sessions were connected up front"
+
+# 6. tls-restart breaks the first session; the requests after it go to the
+# other warm session instead of reconnecting.
+: >$LOG
+${top_builddir}/tests/tls-restart -f radiusclient-temp$PID.conf \
+	User-Name=test Password=test >$TMPFILE 2>&1
+RET=$?
+sed 's/^/         | /' $TMPFILE
+CONNS=$(grep -c "accepted connection" $LOG)
+if test $RET != 0 || test "$CONNS" != 2; then
+	echo "[ FAIL ] expected the warm session to take over, got $CONNS connections"
+	exit 1
+fi
+echo "[  OK  ] a warm session took over without a new handshake"
+
+echo ""
+exit 0
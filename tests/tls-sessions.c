@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2026 Nikos Mavrogiannopoulos
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Driver for concurrent requests over a TLS/DTLS handle.
+ *
+ * Starts -t threads that share one handle and each send -n
+ * Access-Requests with rc_auth(), and checks that all of them succeed.
+ *
+ * Exit code: 0 when every request succeeded.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <pthread.h>
+
+#include <radcli/radcli.h>
+
+struct state {
+	rc_handle *rh;
+	unsigned count;
+	unsigned failed;
+};
+
+static void *worker(void *arg)
+{
+	struct state *st = arg;
+	VALUE_PAIR *send = NULL, *received;
+	char msg[PW_MAX_MSG_SIZE];
+	unsigned i;
+
+	if (rc_avpair_add(st->rh, &send, PW_USER_NAME, "test", -1, 0) == NULL ||
+	    rc_avpair_add(st->rh, &send, PW_USER_PASSWORD, "test", -1, 0) == NULL) {
+		st->failed = st->count;
+		return NULL;
+	}
+
+	for (i = 0; i < st->count; i++) {
+		received = NULL;
+		if (rc_auth(st->rh, 0, send, &received, msg) != OK_RC) {
+			fprintf(stderr, "tls-sessions: request %u failed\n", i);
+			st->failed++;
+		}
+		rc_avpair_free(received);
+	}
+
+	rc_avpair_free(send);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct state *st;
+	pthread_t *tids;
+	rc_handle *rh;
+	char *rc_conf = NULL;
+	unsigned i, threads = 1, count = 1, failed = 0;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "f:t:n:")) != -1) {
+		switch (ch) {
+		case 'f':
+			rc_conf = optarg;
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	if (rc_conf == NULL || threads == 0)
+		exit(1);
+
+	openlog("tls-sessions", LOG_PERROR, LOG_USER);
+
+	if ((rh = rc_read_config(rc_conf)) == NULL) {
+		fprintf(stderr, "tls-sessions: error reading config\n");
+		exit(1);
+	}
+
+	if (rc_read_dictionary(rh, rc_conf_str(rh, "dictionary")) != 0) {
+		fprintf(stderr, "tls-sessions: error reading dictionary\n");
+		exit(1);
+	}
+
+	st = calloc(threads, sizeof(*st));
+	tids = calloc(threads, sizeof(*tids));
+	if (st == NULL || tids == NULL)
+		exit(1);
+
+	for (i = 0; i < threads; i++) {
+		st[i].rh = rh;
+		st[i].count = count;
+		if (pthread_create(&tids[i], NULL, worker, &st[i]) != 0) {
+			fprintf(stderr, "tls-sessions: cannot start thread\n");
+			exit(1);
+		}
+	}
+
+	for (i = 0; i < threads; i++) {
+		pthread_join(tids[i], NULL);
+		failed += st[i].failed;
+	}
+
+	printf("completed=%u failed=%u\n", threads * count, failed);
+
+	free(st);
+	free(tids);
+	rc_destroy(rh);
+
+	return failed != 0;
+}
@@ -0,0 +1,104 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== Connected UDP socket tests ====="
+echo " 1. Without udp-connect, a stopped server is failed over after the timeouts"
+echo " 2. With udp-connect, the port unreachable error fails it over at once"
+echo "======================================"
+
+if ! python3 -c '' 2>/dev/null; then
+	echo "This test requires python3"
+	exit 77
+fi
+
+. ${srcdir}/common.sh
+
+PID=$$
+TMPFILE=tmp$$.out
+LOG1=radius-server1-$PID.log
+SRVPID1=""
+
+# nothing listens on PORT1
+eval "$GETPORT"; PORT1=$PORT
+eval "$GETPORT"; PORT2=$PORT
+
+function finish {
+	test -n "${SRVPID1}" && kill ${SRVPID1} >/dev/null 2>&1
+	rm -f $TMPFILE $LOG1
+	rm -f radiusclient-temp$PID.conf
+	rm -f servers-temp$PID
+}
+trap finish EXIT
+
+wait_for_server() {
+	local port="$1"
+	local i
+	for i in 1 2 3 4 5 6 7 8; do
+		check_if_port_in_use ${port} && return 0
+		sleep 0.5
+	done
+	return 1
+}
+
+count_requests() {
+	grep -c "received Access-Request" $1
+}
+
+python3 ${srcdir}/radius-server.py --port ${PORT2} --secret testing123 >$LOG1 2>&1 &
+SRVPID1=$!
+wait_for_server ${PORT2} || { echo "[ FAIL ] server did not start"; exit 1; }
+
+echo "127.0.0.1	testing123" >servers-temp$PID
+
+REQ='AUTH\nUser-Name=test\nPassword=test\n\n'
+
+# run_client <extra options>: sends three requests, sets ELAPSED (ms)
+run_client() {
+	cat >radiusclient-temp$PID.conf <<EOF2
+nas-identifier my-nas-id
+authserver  127.0.0.1:${PORT1},127.0.0.1:${PORT2}
+acctserver  127.0.0.1:${PORT2}
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  1
+radius_timeout_ms  250
+radius_retries  2
+$1
+bindaddr    *
+EOF2
+
+	: >$LOG1
+	START=$(date +%s%N)
+	printf "$REQ$REQ$REQ" | \
+		${top_builddir}/src/radiusclient -f radiusclient-temp$PID.conf -s >$TMPFILE 2>&1
+	ELAPSED=$(( ($(date +%s%N) - START) / 1000000 ))
+	if test "$(grep -c '^0$' $TMPFILE)" != 3 || test "$(count_requests $LOG1)" != 3; then
+		sed 's/^/         | /' $TMPFILE
+		echo "[ FAIL ] the requests were not answered by the second server"
+		exit 1
+	fi
+}
+
+# 1. three transmissions of 250 ms per request to the stopped server
+run_client ""
+if test $ELAPSED -lt 2000; then
+	echo "[ FAIL ] failing over took ${ELAPSED} ms, expected about 2250"
+	exit 1
+fi
+echo "[  OK  ] failed over after the timeouts in ${ELAPSED} ms"
+
+# 2. one transmission each, refused at once
+run_client "udp-connect yes"
+if test $ELAPSED -ge 700; then
+	echo "[ FAIL ] failing over took ${ELAPSED} ms"
+	exit 1
+fi
+echo "[  OK  ] failed over on port unreachable in ${ELAPSED} ms"
+
+exit 0
@@ -0,0 +1,134 @@
+#!/bin/bash
+
+# Copyright (C) 2026 Nikos Mavrogiannopoulos
+#
+# License: BSD
+
+srcdir="${srcdir:-.}"
+
+echo "===== UDP socket reuse tests ====="
+echo " 1. Consecutive requests on one handle leave from the same local port"
+echo " 2. Requests to different servers share the pooled socket"
+echo " 3. A reply with the right ID that fails verification is ignored"
+echo "=================================="
+
+if ! python3 -c '' 2>/dev/null; then
+	echo "This test requires python3"
+	exit 77
+fi
+
+. ${srcdir}/common.sh
+
+PID=$$
+TMPFILE=tmp$$.out
+LOG1=radius-server1-$PID.log
+LOG2=radius-server2-$PID.log
+LOG3=radius-server3-$PID.log
+SRVPID1=""
+SRVPID2=""
+SRVPID3=""
+
+eval "$GETPORT"; PORT1=$PORT
+eval "$GETPORT"; PORT2=$PORT
+eval "$GETPORT"; PORT3=$PORT
+
+function finish {
+	test -n "${SRVPID1}" && kill ${SRVPID1} >/dev/null 2>&1
+	test -n "${SRVPID2}" && kill ${SRVPID2} >/dev/null 2>&1
+	test -n "${SRVPID3}" && kill ${SRVPID3} >/dev/null 2>&1
+	rm -f $TMPFILE $LOG1 $LOG2 $LOG3
+	rm -f radiusclient-temp$PID.conf
+	rm -f servers-temp$PID
+}
+trap finish EXIT
+
+wait_for_server() {
+	local port="$1"
+	local i
+	for i in 1 2 3 4 5 6 7 8; do
+		check_if_port_in_use ${port} && return 0
+		sleep 0.5
+	done
+	return 1
+}
+
+python3 ${srcdir}/radius-server.py --port ${PORT1} --secret testing123 >$LOG1 2>&1 &
+SRVPID1=$!
+python3 ${srcdir}/radius-server.py --port ${PORT2} --secret testing123 >$LOG2 2>&1 &
+SRVPID2=$!
+python3 ${srcdir}/radius-server.py --port ${PORT3} --secret testing123 --forged-first 2 >$LOG3 2>&1 &
+SRVPID3=$!
+wait_for_server ${PORT1} || { echo "[ FAIL ] server 1 did not start"; exit 1; }
+wait_for_server ${PORT2} || { echo "[ FAIL ] server 2 did not start"; exit 1; }
+wait_for_server ${PORT3} || { echo "[ FAIL ] server 3 did not start"; exit 1; }
+
+cat >radiusclient-temp$PID.conf <<EOF2
+nas-identifier my-nas-id
+authserver  127.0.0.1:${PORT1}
+acctserver  127.0.0.1:${PORT2}
+servers     ./servers-temp$PID
+dictionary  ${srcdir}/../etc/dictionary
+default_realm
+radius_timeout  5
+radius_retries  1
+bindaddr    127.0.0.1
+EOF2
+echo "127.0.0.1/127.0.0.1	testing123" >servers-temp$PID
+
+# radiusclient -s reads one request per blank-line-terminated block and sends
+# all of them through the same handle.
+printf 'AUTH\nUser-Name=test\nPassword=test\n\nAUTH\nUser-Name=test\nPassword=test\n\nACCT\nUser-Name=test\nAcct-Status-Type=Start\n\n' | \
+	${top_builddir}/src/radiusclient -f radiusclient-temp$PID.conf -s >$TMPFILE 2>&1
+RET=$?
+sed 's/^/         | /' $TMPFILE
+
+if test $RET != 0 || test "$(grep -c '^0$' $TMPFILE)" != 3; then
+	echo "[ FAIL ] not every request succeeded"
+	exit 1
+fi
+
+AUTH_PORTS=$(sed -n 's/.*received Access-Request id=[0-9]* from 127.0.0.1:\([0-9]*\)$/\1/p' $LOG1 | sort -u)
+ACCT_PORTS=$(sed -n 's/.*received Accounting-Request id=[0-9]* from 127.0.0.1:\([0-9]*\)$/\1/p' $LOG2 | sort -u)
+
+if test "$(echo "$AUTH_PORTS" | wc -w)" != 1; then
+	echo "[ FAIL ] access requests used more than one local port: $AUTH_PORTS"
+	cat $LOG1
+	exit 1
+fi
+
+echo "[  OK  ] consecutive requests reused local port $AUTH_PORTS"
+
+if test "$AUTH_PORTS" != "$ACCT_PORTS"; then
+	echo "[ FAIL ] accounting request used port $ACCT_PORTS instead of $AUTH_PORTS"
+	cat $LOG2
+	exit 1
+fi
+
+echo "[  OK  ] accounting request shared the pooled socket"
+
+# 3. Each reply is preceded by a copy with the same ID and a bad Response
+# Authenticator, as a late reply or a spoofed packet could be. The client
+# keeps waiting and takes the real reply, without retransmitting.
+sed -i "s/127.0.0.1:${PORT1}/127.0.0.1:${PORT3}/" radiusclient-temp$PID.conf
+START=$(date +%s)
+printf 'AUTH\nUser-Name=test\nPassword=test\n\nAUTH\nUser-Name=test\nPassword=test\n\n' | \
+	${top_builddir}/src/radiusclient -f radiusclient-temp$PID.conf -s >$TMPFILE 2>&1
+RET=$?
+ELAPSED=$(( $(date +%s) - START ))
+sed 's/^/         | /' $TMPFILE
+
+if test $RET != 0 || test "$(grep -c '^0$' $TMPFILE)" != 2; then
+	echo "[ FAIL ] a forged reply failed the request"
+	cat $LOG3
+	exit 1
+fi
+
+if test "$(grep -c 'received Access-Request' $LOG3)" != 2 || test $ELAPSED -ge 5; then
+	echo "[ FAIL ] requests were retransmitted after a forged reply"
+	cat $LOG3
+	exit 1
+fi
+
+echo "[  OK  ] forged replies were ignored"
+
+exit 0